@@ -0,0 +1,64 @@
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+// Throughput measurement for the host benchmarks. Each benchmark runs its
+// body in growing batches until a batch lasts long enough to time, then
+// prints operations per second. --quick (used by ctest) shortens the runs to
+// a smoke test; the numbers are only meaningful without it.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef void (*bench_fn_t)(void *ctx, uint32_t iterations);
+
+static double bench_min_seconds = 0.5;
+
+// Keeps results alive so the compiler cannot drop the measured work
+static volatile uint64_t bench_sink;
+
+static inline void bench_parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            bench_min_seconds = 0.02;
+        }
+    }
+}
+
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Time fn and print "<name>: <ops/s> ops/s (<ns> ns/op)"
+ * @return Operations per second
+ */
+static inline double bench_run(const char *name, bench_fn_t fn, void *ctx) {
+    uint32_t iterations = 1;
+    double elapsed = 0;
+    for (;;) {
+        double start = bench_now();
+        fn(ctx, iterations);
+        elapsed = bench_now() - start;
+        if (elapsed >= bench_min_seconds || iterations >= (1u << 30)) {
+            break;
+        }
+        // Aim a little past the target so the next batch is usually the last
+        double scale = (elapsed > 0) ? 1.2 * bench_min_seconds / elapsed : 16;
+        if (scale < 2) {
+            scale = 2;
+        } else if (scale > 16) {
+            scale = 16;
+        }
+        iterations = (uint32_t)(iterations * scale);
+    }
+    double ops = iterations / elapsed;
+    printf("%-40s %12.0f ops/s %10.1f ns/op\n", name, ops, 1e9 / ops);
+    return ops;
+}
+
+#endif // HOST_BENCH_H
@@ -0,0 +1,136 @@
+// gzip of the JSON responses: the RAM the compressor takes per response,
+// the bytes saved on the service list (GET /api/services) for several store
+// sizes, with zlib at its default level as a reference, and how many lists
+// per second it compresses.
+//
+//   bench_gzip [--quick]
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "nvs_host.h"
+#include "gzip_stream.h"
+#include "totp/totp_storage.h"
+
+#define LIST_MAX 65536
+
+typedef struct {
+    char data[LIST_MAX];
+    size_t len;
+} list_t;
+
+typedef struct {
+    const list_t *list;
+    size_t compressed;
+} gzip_ctx_t;
+
+static const char *names[] = { "GitHub", "Google", "Amazon Web Services", "Dropbox", "Microsoft", "Cloudflare" };
+
+static esp_err_t collect(const char *data, size_t len, void *ctx) {
+    list_t *list = ctx;
+    if (list->len + len > sizeof(list->data)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(list->data + list->len, data, len);
+    list->len += len;
+    return ESP_OK;
+}
+
+static esp_err_t count_output(const char *data, size_t len, void *ctx) {
+    *(size_t *)ctx += len;
+    return ESP_OK;
+}
+
+// Compress the list in 512-byte pieces, as the server's response buffer hands them over
+static size_t gzip_size(const list_t *list) {
+    static gzip_stream_t z;
+    size_t compressed = 0;
+    gzip_stream_init(&z, count_output, &compressed);
+    for (size_t pos = 0; pos < list->len; pos += 512) {
+        size_t n = (list->len - pos < 512) ? list->len - pos : 512;
+        gzip_stream_write(&z, list->data + pos, n);
+    }
+    gzip_stream_finish(&z);
+    return compressed;
+}
+
+static size_t zlib_size(const list_t *list) {
+    static unsigned char out[LIST_MAX + 1024];
+    z_stream zs = { 0 };
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+    zs.next_in = (Bytef *)list->data;
+    zs.avail_in = (uInt)list->len;
+    zs.next_out = out;
+    zs.avail_out = sizeof(out);
+    size_t size = (deflate(&zs, Z_FINISH) == Z_STREAM_END) ? zs.total_out : 0;
+    deflateEnd(&zs);
+    return size;
+}
+
+static void gzip_lists(void *ctx, uint32_t iterations) {
+    gzip_ctx_t *c = ctx;
+    for (uint32_t i = 0; i < iterations; i++) {
+        c->compressed = gzip_size(c->list);
+        bench_sink += c->compressed;
+    }
+}
+
+static bool add_services(int count) {
+    for (int i = totp_storage_count(); i < count; i++) {
+        totp_service_t service = {
+            .digits = 6,
+            .period = 30,
+        };
+        snprintf(service.service_name, sizeof(service.service_name), "%s", names[i % 6]);
+        snprintf(service.account, sizeof(service.account), "user%d@example.com", i);
+        snprintf(service.issuer, sizeof(service.issuer), "%s", names[i % 6]);
+        strcpy(service.secret, "JBSWY3DPEHPK3PXP");
+        uint32_t id;
+        if (totp_storage_add(&service, &id) != ESP_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bench_parse_args(argc, argv);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_host_set_path(NULL);
+    if (totp_storage_init() != ESP_OK) {
+        return 1;
+    }
+
+    // zlib's deflate state for windowBits 15 and memLevel 8 (zconf.h)
+    printf("RAM per compressed response: gzip_stream_t %zu bytes (zlib deflate: ~%u bytes)\n",
+           sizeof(gzip_stream_t), (1u << (15 + 2)) + (1u << (8 + 9)) + 6 * 1024);
+
+    static list_t list;
+    static const int counts[] = { 1, 10, 50, 150 };
+    printf("%8s %10s %10s %8s %10s %8s\n", "services", "json", "gzip", "saved", "zlib -6", "saved");
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        list.len = 0;
+        if (!add_services(counts[i]) || totp_storage_write_list_json(collect, &list) != ESP_OK) {
+            totp_storage_deinit();
+            return 1;
+        }
+        size_t gzip = gzip_size(&list);
+        size_t zlib = zlib_size(&list);
+        printf("%8d %10zu %10zu %7.1f%% %10zu %7.1f%%\n", counts[i], list.len, gzip,
+               100.0 * (1.0 - (double)gzip / list.len), zlib, 100.0 * (1.0 - (double)zlib / list.len));
+    }
+
+    // The list of the last (largest) store
+    gzip_ctx_t ctx = { .list = &list };
+    char name[48];
+    snprintf(name, sizeof(name), "gzip service list, %d services", counts[3]);
+    double ops = bench_run(name, gzip_lists, &ctx);
+    printf("input: %.1f MB/s\n", ops * list.len / 1e6);
+
+    totp_storage_deinit();
+    return 0;
+}
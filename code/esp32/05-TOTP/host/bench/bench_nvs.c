@@ -0,0 +1,87 @@
+// NVS writes per second through nvs_helper: one commit per save, as before
+// transactions, against saves grouped between nvs_helper_begin() and
+// nvs_helper_commit(). Commits cost what --commit-us says (2000 us by
+// default, the order of a flash page write on the ESP32).
+//
+//   bench_nvs [--quick] [--commit-us N]
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "nvs_host.h"
+#include "storage/nvs_helper.h"
+
+#define KEY_COUNT 32
+
+typedef struct {
+    uint32_t batch;             // Saves per commit, 1 for no transaction
+    uint8_t record[96];         // About the size of a stored service
+} nvs_ctx_t;
+
+static char keys[KEY_COUNT][16];
+
+static void save(nvs_ctx_t *c, uint32_t i) {
+    c->record[0] = (uint8_t)i;
+    bench_sink += nvs_helper_save(keys[i % KEY_COUNT], c->record, sizeof(c->record));
+}
+
+static void saves(void *ctx, uint32_t iterations) {
+    nvs_ctx_t *c = ctx;
+    uint32_t i = 0;
+    while (i < iterations) {
+        if (c->batch == 1) {
+            save(c, i++);
+            continue;
+        }
+        nvs_helper_begin();
+        for (uint32_t n = 0; n < c->batch && i < iterations; n++) {
+            save(c, i++);
+        }
+        nvs_helper_commit();
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_parse_args(argc, argv);
+    uint32_t commit_us = 2000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--commit-us") == 0 && i + 1 < argc) {
+            commit_us = (uint32_t)atoi(argv[++i]);
+        }
+    }
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_host_set_path(NULL);
+    nvs_host_set_commit_delay(commit_us);
+    if (nvs_helper_init() != ESP_OK) {
+        return 1;
+    }
+    for (int i = 0; i < KEY_COUNT; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "svc_%d", i);
+    }
+    printf("commit delay: %u us\n", commit_us);
+
+    static const uint32_t batches[] = { 1, 10, 50 };
+    nvs_ctx_t ctx;
+    memset(&ctx, 0x5A, sizeof(ctx));
+    double unbatched = 0;
+    for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+        char name[48];
+        ctx.batch = batches[i];
+        if (ctx.batch == 1) {
+            snprintf(name, sizeof(name), "save, commit each");
+        } else {
+            snprintf(name, sizeof(name), "save, %u per transaction", ctx.batch);
+        }
+        double ops = bench_run(name, saves, &ctx);
+        if (ctx.batch == 1) {
+            unbatched = ops;
+        } else {
+            printf("speedup: %.2fx\n", ops / unbatched);
+        }
+    }
+
+    nvs_helper_deinit();
+    return 0;
+}
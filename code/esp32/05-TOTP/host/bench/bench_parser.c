@@ -0,0 +1,47 @@
+// otpauth URIs parsed per second: the strstr() parser (one scan of the query
+// per parameter, decoding through temporaries) against the single-pass one,
+// on a short URI and on a long one with every parameter and a logo URL.
+
+#include <stdint.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "totp_parser_strstr.h"
+#include "totp/totp_parser.h"
+
+static void strstr_parser(void *ctx, uint32_t iterations) {
+    totp_service_t service;
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench_sink += totp_parse_uri_strstr(ctx, &service);
+        bench_sink += service.digits;
+    }
+}
+
+static void single_pass_parser(void *ctx, uint32_t iterations) {
+    totp_service_t service;
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench_sink += totp_parse_uri(ctx, &service);
+        bench_sink += service.digits;
+    }
+}
+
+static void compare(const char *label, const char *uri) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s, strstr per parameter", label);
+    double before = bench_run(name, strstr_parser, (void *)uri);
+    snprintf(name, sizeof(name), "%s, single pass", label);
+    double after = bench_run(name, single_pass_parser, (void *)uri);
+    printf("speedup: %.2fx\n", after / before);
+}
+
+int main(int argc, char **argv) {
+    bench_parse_args(argc, argv);
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    compare("short URI", "otpauth://totp/GitHub:user@email.com?secret=JBSWY3DPEHPK3PXP&issuer=GitHub");
+    compare("long URI",
+            "otpauth://totp/Example%20Corporation%3Ajohn.doe%40example.com"
+            "?image=https%3A%2F%2Fstatic.example.com%2Fbrand%2Flogos%2Fexample-corporation-256x256.png"
+            "&issuer=Example%20Corporation&algorithm=SHA256&digits=8&period=30"
+            "&secret=GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA");
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Codes per second over the RFC 6238 vectors: deriving the key for
+// every code (what totp_generate_code() still does, and what every request
+// did before totp_key_t) against a key built once. Then the latency of one
+// totp_get_code() call with logging at info level, the device default, where
+// the code path used to print the secret and the code on every call. Last,
+// a precomputed SHA-256 and SHA-512 key.
+//
+// On the host the mbedtls SHA API is a stand-in over OpenSSL (shim/mbedtls),
+// so the hash cost is OpenSSL's; only the ratios carry over to the ESP32.
+
+#include <stdint.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "mbedtls/sha1.h"
+#include "totp/totp_engine.h"
+
+static const uint64_t times[] = { 59, 1111111109, 1111111111, 1234567890, 2000000000, 20000000000ULL };
+#define TIME_COUNT (sizeof(times) / sizeof(times[0]))
+
+static const char secret_b32[] = "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ";
+
+static const char sha256_secret_b32[] = "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA";
+static const char sha512_secret_b32[] =
+    "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNA";
+
+static uint64_t fixed_time = 0;
+
+static uint64_t fixed_time_source(void) {
+    return fixed_time;
+}
+
+static void per_call_key(void *ctx, uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t code = 0;
+        fixed_time = times[i % TIME_COUNT];
+        totp_generate_code(secret_b32, 30, 8, &code);
+        bench_sink += code;
+    }
+}
+
+static void precomputed_key(void *ctx, uint32_t iterations) {
+    const totp_key_t *key = ctx;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t code = 0;
+        totp_key_generate(key, times[i % TIME_COUNT] / 30, &code);
+        bench_sink += code;
+    }
+}
+
+static void get_code(void *ctx, uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t code = 0;
+        fixed_time = times[i % TIME_COUNT];
+        totp_get_code(secret_b32, 6, &code);
+        bench_sink += code;
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_parse_args(argc, argv);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    totp_set_time_source(fixed_time_source);
+
+    totp_key_t key;
+    if (totp_key_init(&key, secret_b32, TOTP_ALGO_SHA1, 8, 30) != ESP_OK) {
+        return 1;
+    }
+
+    printf("hashes: %s (mbedtls API stand-in)\n", HOST_MBEDTLS_BACKEND);
+    double before = bench_run("SHA1 (OpenSSL), key derived per code", per_call_key, NULL);
+    double after = bench_run("SHA1 (OpenSSL), precomputed key", precomputed_key, &key);
+    printf("speedup: %.2fx\n", after / before);
+
+    esp_log_level_set("*", ESP_LOG_INFO);
+    bench_run("totp_get_code, log level info", get_code, NULL);
+
+    static const struct {
+        totp_algorithm_t algorithm;
+        const char *secret_b32;
+    } algorithms[] = {
+        { TOTP_ALGO_SHA256, sha256_secret_b32 },
+        { TOTP_ALGO_SHA512, sha512_secret_b32 },
+    };
+    esp_log_level_set("*", ESP_LOG_NONE);
+    for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+        totp_key_t algo_key;
+        if (totp_key_init(&algo_key, algorithms[i].secret_b32, algorithms[i].algorithm, 8, 30) != ESP_OK) {
+            return 1;
+        }
+        char name[48];
+        snprintf(name, sizeof(name), "%s (OpenSSL), precomputed key", totp_algorithm_name(algorithms[i].algorithm));
+        bench_run(name, precomputed_key, &algo_key);
+        totp_key_free(&algo_key);
+    }
+
+    totp_key_free(&key);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Verifications per second with +/- 1 and +/- 3 steps of skew: totp_verify()
+// and its ring of precomputed codes against computing the 2 * window + 1
+// codes on every call. The clock advances one second every 64 calls, so the
+// ring slides like it would under steady traffic.
+//
+// HMACs go through the OpenSSL stand-in for the mbedtls SHA API (shim/mbedtls).
+
+#include <stdint.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "mbedtls/sha1.h"
+#include "nvs_host.h"
+#include "totp/totp_storage.h"
+#include "totp/totp_verify.h"
+
+#define BASE_TIME 1700000000ULL
+
+static const char secret_b32[] = "JBSWY3DPEHPK3PXP";
+
+typedef struct {
+    uint32_t id;
+    totp_key_t key;
+    uint8_t window;
+} verify_ctx_t;
+
+static uint64_t fixed_time = BASE_TIME;
+
+static uint64_t fixed_time_source(void) {
+    return fixed_time;
+}
+
+// Mostly wrong codes: the case an attacker controls
+static uint32_t guess(uint32_t i) {
+    return (i * 2654435761U) % 1000000;
+}
+
+static void brute_force(void *ctx, uint32_t iterations) {
+    verify_ctx_t *c = ctx;
+    for (uint32_t i = 0; i < iterations; i++) {
+        fixed_time = BASE_TIME + i / 64;
+        uint64_t counter = totp_get_timestamp() / 30;
+        uint32_t code = guess(i);
+        uint32_t match = 0;
+        for (uint64_t n = counter - c->window; n <= counter + c->window; n++) {
+            uint32_t value = 0;
+            totp_key_generate(&c->key, n, &value);
+            match |= (value == code);
+        }
+        bench_sink += match;
+    }
+}
+
+static void ring(void *ctx, uint32_t iterations) {
+    verify_ctx_t *c = ctx;
+    for (uint32_t i = 0; i < iterations; i++) {
+        fixed_time = BASE_TIME + i / 64;
+        bool valid = false;
+        totp_verify(c->id, guess(i), c->window, &valid);
+        bench_sink += valid;
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_parse_args(argc, argv);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_host_set_path(NULL);
+    totp_set_time_source(fixed_time_source);
+    if (totp_storage_init() != ESP_OK) {
+        return 1;
+    }
+
+    verify_ctx_t ctx = { 0 };
+    totp_service_t service = { .digits = 6, .period = 30 };
+    snprintf(service.service_name, sizeof(service.service_name), "Bench");
+    snprintf(service.secret, sizeof(service.secret), "%s", secret_b32);
+    if (totp_storage_add(&service, &ctx.id) != ESP_OK ||
+        totp_key_init(&ctx.key, secret_b32, TOTP_ALGO_SHA1, 6, 30) != ESP_OK) {
+        return 1;
+    }
+
+    printf("hashes: %s (mbedtls API stand-in)\n", HOST_MBEDTLS_BACKEND);
+    static const uint8_t windows[] = { 1, TOTP_VERIFY_MAX_WINDOW };
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        char name[48];
+        ctx.window = windows[i];
+        snprintf(name, sizeof(name), "window %u, %u OpenSSL HMACs per call", ctx.window, 2 * ctx.window + 1);
+        double before = bench_run(name, brute_force, &ctx);
+        snprintf(name, sizeof(name), "window %u, totp_verify()", ctx.window);
+        double after = bench_run(name, ring, &ctx);
+        printf("speedup: %.2fx\n", after / before);
+    }
+
+    totp_key_free(&ctx.key);
+    totp_storage_deinit();
+    return 0;
+}
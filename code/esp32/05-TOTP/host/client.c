@@ -0,0 +1,183 @@
+// Blocking HTTP/1.1 client connection shared by the host tools.
+
+#include "client.h"
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool conn_open(conn_t *c, const struct sockaddr_in *addr) {
+    c->len = c->pos = 0;
+    c->received = 0;
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0) {
+        return false;
+    }
+    int one = 1;
+    struct timeval timeout = { .tv_sec = 10 };
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(c->fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        close(c->fd);
+        c->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void conn_close(conn_t *c) {
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+bool conn_send(conn_t *c, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool conn_fill(conn_t *c) {
+    if (c->pos == c->len) {
+        c->pos = c->len = 0;
+    }
+    if (c->len == sizeof(c->buf)) {
+        memmove(c->buf, c->buf + c->pos, c->len - c->pos);
+        c->len -= c->pos;
+        c->pos = 0;
+    }
+    ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+    if (n <= 0) {
+        return false;
+    }
+    c->len += n;
+    c->received += n;
+    return true;
+}
+
+void conn_set_timeout(conn_t *c, uint32_t ms) {
+    struct timeval timeout = { .tv_sec = ms / 1000, .tv_usec = (ms % 1000) * 1000 };
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// One CRLF-terminated line, without the CRLF
+bool conn_line(conn_t *c, char *line, size_t size) {
+    for (;;) {
+        char *end = memchr(c->buf + c->pos, '\n', c->len - c->pos);
+        if (end != NULL) {
+            size_t n = end - (c->buf + c->pos);
+            if (n > 0 && end[-1] == '\r') {
+                n--;
+            }
+            if (n >= size) {
+                n = size - 1;
+            }
+            memcpy(line, c->buf + c->pos, n);
+            line[n] = '\0';
+            c->pos = end - c->buf + 1;
+            return true;
+        }
+        if (c->len - c->pos == sizeof(c->buf) || !conn_fill(c)) {
+            return false;
+        }
+    }
+}
+
+bool conn_read(conn_t *c, void *out, size_t len) {
+    uint8_t *dst = out;
+    while (len > 0) {
+        if (c->pos == c->len && !conn_fill(c)) {
+            return false;
+        }
+        size_t n = c->len - c->pos;
+        if (n > len) {
+            n = len;
+        }
+        if (dst != NULL) {
+            memcpy(dst, c->buf + c->pos, n);
+            dst += n;
+        }
+        c->pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Read len body bytes, keeping the first ones in resp->body
+static bool conn_body(conn_t *c, size_t len, response_t *resp, size_t *kept) {
+    while (len > 0) {
+        if (c->pos == c->len && !conn_fill(c)) {
+            return false;
+        }
+        size_t n = c->len - c->pos;
+        if (n > len) {
+            n = len;
+        }
+        if (*kept < CLIENT_BODY_KEEP) {
+            size_t copy = (n < CLIENT_BODY_KEEP - *kept) ? n : CLIENT_BODY_KEEP - *kept;
+            memcpy(resp->body + *kept, c->buf + c->pos, copy);
+            *kept += copy;
+            resp->body[*kept] = '\0';
+        }
+        c->pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool read_response(conn_t *c, response_t *resp) {
+    char line[512];
+    size_t content_length = 0;
+    bool chunked = false;
+    size_t kept = 0;
+
+    resp->body[0] = '\0';
+    resp->close = false;
+    if (!conn_line(c, line, sizeof(line)) || sscanf(line, "HTTP/1.%*d %d", &resp->status) != 1) {
+        return false;
+    }
+    while (conn_line(c, line, sizeof(line))) {
+        if (line[0] == '\0') {
+            if (!chunked) {
+                return conn_body(c, content_length, resp, &kept);
+            }
+            for (;;) {
+                size_t size;
+                if (!conn_line(c, line, sizeof(line)) || sscanf(line, "%zx", &size) != 1) {
+                    return false;
+                }
+                if (size == 0) {
+                    return conn_line(c, line, sizeof(line));
+                }
+                if (!conn_body(c, size, resp, &kept) || !conn_line(c, line, sizeof(line))) {
+                    return false;
+                }
+            }
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtoul(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            chunked = strstr(line + 18, "chunked") != NULL;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            resp->close = strstr(line + 11, "close") != NULL;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,72 @@
+#ifndef HOST_CLIENT_H
+#define HOST_CLIENT_H
+
+// Blocking HTTP/1.1 client connection shared by the host tools (load
+// generator and viewer measurement): keep-alive requests, responses with
+// Content-Length or chunked bodies, and raw reads for WebSocket frames.
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CLIENT_BUF_SIZE 16384
+#define CLIENT_BODY_KEEP 256        // Response bytes kept (enough for the id of a new service)
+
+typedef struct {
+    int fd;                         // -1 when closed
+    size_t len;
+    size_t pos;
+    uint64_t received;              // Bytes received since conn_open()
+    char buf[CLIENT_BUF_SIZE];
+} conn_t;
+
+typedef struct {
+    int status;
+    bool close;                     // Server sent Connection: close
+    char body[CLIENT_BODY_KEEP + 1];
+} response_t;
+
+/**
+ * @brief Monotonic time in microseconds
+ */
+int64_t now_us(void);
+
+/**
+ * @brief Connect (TCP_NODELAY, 10 s receive timeout)
+ * @return false if the connection failed (c->fd is then -1)
+ */
+bool conn_open(conn_t *c, const struct sockaddr_in *addr);
+
+void conn_close(conn_t *c);
+
+/**
+ * @brief Change the receive timeout of an open connection
+ */
+void conn_set_timeout(conn_t *c, uint32_t ms);
+
+bool conn_send(conn_t *c, const char *data, size_t len);
+
+/**
+ * @brief Receive more data into the buffer
+ * @return false on close, error or timeout
+ */
+bool conn_fill(conn_t *c);
+
+/**
+ * @brief Read one line, without the CRLF (truncated to size - 1)
+ */
+bool conn_line(conn_t *c, char *line, size_t size);
+
+/**
+ * @brief Read exactly len bytes
+ * @param out Destination, or NULL to discard them
+ */
+bool conn_read(conn_t *c, void *out, size_t len);
+
+/**
+ * @brief Read a whole response, keeping the start of the body
+ */
+bool read_response(conn_t *c, response_t *resp);
+
+#endif // HOST_CLIENT_H
@@ -0,0 +1,498 @@
+// HTTP load generator for the TOTP API: keep-alive connections send a mix of
+// GET/POST/DELETE requests for a fixed time, then req/s and latency
+// percentiles are printed per request kind.
+//
+//   totp_loadgen [--local | --host ADDR --port N] [--connections N]
+//                [--duration S] [--services N] [--mix code=60,codes=20,...]
+//                [--gzip] [--commit-us US] [--seed N]
+//
+// --local starts the firmware's server in this process (RAM-only NVS, an
+// ephemeral port), which is what the ctest smoke test uses.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "client.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "nvs_host.h"
+#include "network/server.h"
+#include "totp/totp_storage.h"
+#include "totp/totp_lookahead.h"
+
+#define MAX_CONNECTIONS 64
+#define POOL_LIMIT 150              // Below CONFIG_GMAKER_TOTP_MAX_SERVICES: adds never hit a full store
+
+typedef enum {
+    OP_CODE,                        // GET /api/code/{id}
+    OP_CODES,                       // GET /api/codes
+    OP_LIST,                        // GET /api/services
+    OP_ADD,                         // POST /api/services
+    OP_DELETE,                      // DELETE /api/services/{id}
+    OP_COUNT,
+} op_t;
+
+static const char *op_names[OP_COUNT] = { "code", "codes", "list", "add", "delete" };
+static const int op_expected[OP_COUNT] = { 200, 200, 200, 201, 200 };
+
+typedef struct {
+    struct sockaddr_in addr;
+    int connections;
+    double duration;
+    int services;
+    int mix[OP_COUNT];
+    bool gzip;
+    unsigned seed;
+} options_t;
+
+typedef struct {
+    uint32_t *samples;              // Latencies (us)
+    size_t count;
+    size_t capacity;
+    uint32_t rejected;              // 429 / 503: the server shedding load, not a failure
+    uint32_t stale;                 // 404 for a service deleted by another connection
+    uint32_t unexpected;            // Any other status
+} op_stats_t;
+
+typedef struct {
+    int index;
+    const options_t *opts;
+    op_stats_t ops[OP_COUNT];
+    uint32_t transport_errors;
+    uint32_t statuses[600];
+} worker_t;
+
+// Ids of the services that exist, shared by all connections
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t pool[POOL_LIMIT + MAX_CONNECTIONS];
+static size_t pool_count = 0;
+
+static void pool_put(uint32_t id) {
+    pthread_mutex_lock(&pool_lock);
+    if (pool_count < sizeof(pool) / sizeof(pool[0])) {
+        pool[pool_count++] = id;
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Copy (or, with take, remove) a random id; false if there is none
+static bool pool_pick(unsigned *seed, bool take, uint32_t *id) {
+    pthread_mutex_lock(&pool_lock);
+    bool found = pool_count > 0;
+    if (found) {
+        size_t i = (size_t)rand_r(seed) % pool_count;
+        *id = pool[i];
+        if (take) {
+            pool[i] = pool[--pool_count];
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return found;
+}
+
+static size_t pool_size(void) {
+    pthread_mutex_lock(&pool_lock);
+    size_t count = pool_count;
+    pthread_mutex_unlock(&pool_lock);
+    return count;
+}
+
+// Requests
+
+static int format_request(char *buf, size_t size, const options_t *opts, op_t op, uint32_t id, unsigned *seed) {
+    const char *encoding = opts->gzip ? "Accept-Encoding: gzip\r\n" : "";
+    switch (op) {
+    case OP_CODE:
+        return snprintf(buf, size, "GET /api/code/%u HTTP/1.1\r\nHost: totp\r\n%s\r\n", id, encoding);
+    case OP_CODES:
+        return snprintf(buf, size, "GET /api/codes HTTP/1.1\r\nHost: totp\r\n%s\r\n", encoding);
+    case OP_LIST:
+        return snprintf(buf, size, "GET /api/services HTTP/1.1\r\nHost: totp\r\n%s\r\n", encoding);
+    case OP_DELETE:
+        return snprintf(buf, size, "DELETE /api/services/%u HTTP/1.1\r\nHost: totp\r\n\r\n", id);
+    case OP_ADD:
+    default: {
+        // Quotes and a backslash in the names, so list responses need escaping
+        char body[192];
+        int len = snprintf(body, sizeof(body),
+                           "{\"uri\":\"otpauth://totp/Load%%20%%22Co%%22:user%u%%5C?secret=JBSWY3DPEHPK3PXP"
+                           "&issuer=Load%%20%%22Co%%22\"}",
+                           (unsigned)rand_r(seed) % 100000);
+        return snprintf(buf, size,
+                        "POST /api/services HTTP/1.1\r\nHost: totp\r\nContent-Type: application/json\r\n"
+                        "Content-Length: %d\r\n\r\n%s", len, body);
+    }
+    }
+}
+
+static bool parse_id(const char *body, uint32_t *id) {
+    const char *p = strstr(body, "\"id\":");
+    return p != NULL && sscanf(p + 5, "%u", id) == 1;
+}
+
+static op_t pick_op(const options_t *opts, unsigned *seed) {
+    int total = 0;
+    for (int i = 0; i < OP_COUNT; i++) {
+        total += opts->mix[i];
+    }
+    int r = rand_r(seed) % total;
+    for (int i = 0; i < OP_COUNT; i++) {
+        if (r < opts->mix[i]) {
+            return (op_t)i;
+        }
+        r -= opts->mix[i];
+    }
+    return OP_CODE;
+}
+
+static void record(op_stats_t *stats, uint32_t us) {
+    if (stats->count == stats->capacity) {
+        size_t capacity = stats->capacity ? stats->capacity * 2 : 4096;
+        uint32_t *samples = realloc(stats->samples, capacity * sizeof(*samples));
+        if (samples == NULL) {
+            return;
+        }
+        stats->samples = samples;
+        stats->capacity = capacity;
+    }
+    stats->samples[stats->count++] = us;
+}
+
+// Send one request and read its response on c (reconnecting if needed)
+static bool run_request(conn_t *c, const options_t *opts, op_t op, uint32_t id, unsigned *seed,
+                        response_t *resp, uint32_t *us) {
+    char request[512];
+    int len = format_request(request, sizeof(request), opts, op, id, seed);
+    bool reused = c->fd >= 0;
+    if (!reused && !conn_open(c, &opts->addr)) {
+        return false;
+    }
+    int64_t start = now_us();
+    bool ok = conn_send(c, request, len) && read_response(c, resp);
+    // The server closes a connection after an error response (as the IDF
+    // does when a handler fails) without saying so: retry once on a new one
+    if (!ok && reused && c->len == 0) {
+        conn_close(c);
+        start = now_us();
+        ok = conn_open(c, &opts->addr) && conn_send(c, request, len) && read_response(c, resp);
+    }
+    if (!ok) {
+        conn_close(c);
+        return false;
+    }
+    *us = (uint32_t)(now_us() - start);
+    if (resp->close) {
+        conn_close(c);
+    }
+    return true;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    const options_t *opts = w->opts;
+    unsigned seed = opts->seed * 7919u + (unsigned)w->index;
+    conn_t *c = malloc(sizeof(*c));
+    if (c == NULL) {
+        w->transport_errors++;
+        return NULL;
+    }
+    c->fd = -1;
+
+    int64_t deadline = now_us() + (int64_t)(opts->duration * 1e6);
+    while (now_us() < deadline) {
+        op_t op = pick_op(opts, &seed);
+        uint32_t id = 0;
+        // Keep the store between empty and POOL_LIMIT services
+        if ((op == OP_CODE || op == OP_DELETE) && !pool_pick(&seed, op == OP_DELETE, &id)) {
+            op = OP_ADD;
+        } else if (op == OP_ADD && pool_size() >= POOL_LIMIT && pool_pick(&seed, true, &id)) {
+            op = OP_DELETE;
+        }
+
+        response_t resp;
+        uint32_t us;
+        if (!run_request(c, opts, op, id, &seed, &resp, &us)) {
+            w->transport_errors++;
+            if (op == OP_DELETE) {
+                pool_put(id);
+            }
+            if (!conn_open(c, &opts->addr)) {
+                break;
+            }
+            continue;
+        }
+
+        op_stats_t *stats = &w->ops[op];
+        record(stats, us);
+        if (resp.status >= 0 && resp.status < 600) {
+            w->statuses[resp.status]++;
+        }
+        uint32_t new_id;
+        if (resp.status == op_expected[op]) {
+            if (op == OP_ADD && parse_id(resp.body, &new_id)) {
+                pool_put(new_id);
+            }
+        } else if (resp.status == 429 || resp.status == 503) {
+            stats->rejected++;
+            if (op == OP_DELETE) {
+                pool_put(id);
+            }
+        } else if (resp.status == 404 && op == OP_CODE) {
+            stats->stale++;
+        } else {
+            stats->unexpected++;
+        }
+    }
+
+    conn_close(c);
+    free(c);
+    return NULL;
+}
+
+// Setup and report
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(const uint32_t *sorted, size_t count, double p) {
+    if (count == 0) {
+        return 0;
+    }
+    size_t i = (size_t)(p * (count - 1) + 0.5);
+    return sorted[i] / 1000.0;
+}
+
+static void print_row(const char *name, op_stats_t *stats, double seconds) {
+    qsort(stats->samples, stats->count, sizeof(uint32_t), compare_u32);
+    printf("%-8s %9zu %10.1f %8.3f %8.3f %8.3f %8u %6u\n", name, stats->count, stats->count / seconds,
+           percentile_ms(stats->samples, stats->count, 0.50),
+           percentile_ms(stats->samples, stats->count, 0.99),
+           percentile_ms(stats->samples, stats->count, 1.0),
+           stats->rejected, stats->unexpected);
+}
+
+// Create the services the GET and DELETE requests work on
+static bool seed_services(const options_t *opts) {
+    conn_t *c = malloc(sizeof(*c));
+    if (c == NULL) {
+        return false;
+    }
+    c->fd = -1;
+    unsigned seed = opts->seed;
+    bool ok = true;
+    for (int i = 0; i < opts->services && ok; i++) {
+        response_t resp;
+        uint32_t us;
+        uint32_t id;
+        ok = run_request(c, opts, OP_ADD, 0, &seed, &resp, &us) &&
+             resp.status == 201 && parse_id(resp.body, &id);
+        if (ok) {
+            pool_put(id);
+        }
+    }
+    conn_close(c);
+    free(c);
+    return ok;
+}
+
+static bool parse_mix(const char *text, int mix[OP_COUNT]) {
+    memset(mix, 0, sizeof(int) * OP_COUNT);
+    char copy[128];
+    snprintf(copy, sizeof(copy), "%s", text);
+    int total = 0;
+    for (char *save, *item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        if (eq == NULL) {
+            return false;
+        }
+        *eq = '\0';
+        int i = 0;
+        while (i < OP_COUNT && strcmp(op_names[i], item) != 0) {
+            i++;
+        }
+        int weight = atoi(eq + 1);
+        if (i == OP_COUNT || weight < 0) {
+            return false;
+        }
+        mix[i] = weight;
+        total += weight;
+    }
+    return total > 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--local | --host ADDR --port N] [options]\n"
+            "  --local           run the server in this process (RAM NVS, any port)\n"
+            "  --host ADDR       server address (default 127.0.0.1)\n"
+            "  --port N          server port (default 8080)\n"
+            "  --connections N   keep-alive connections (default 4, max %d)\n"
+            "  --duration S      seconds to run (default 10)\n"
+            "  --services N      services created before the run (default 20)\n"
+            "  --mix SPEC        weights, default code=60,codes=20,list=10,add=5,delete=5\n"
+            "  --gzip            send Accept-Encoding: gzip on GET requests\n"
+            "  --commit-us US    with --local, emulated flash time per NVS commit\n"
+            "  --seed N          random seed (default 1)\n", prog, MAX_CONNECTIONS);
+}
+
+int main(int argc, char **argv) {
+    options_t opts = {
+        .addr = { .sin_family = AF_INET, .sin_port = htons(8080), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) },
+        .connections = 4,
+        .duration = 10,
+        .services = 20,
+        .mix = { 60, 20, 10, 5, 5 },
+        .seed = 1,
+    };
+    bool local = false;
+    uint32_t commit_us = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = true;
+        if (strcmp(arg, "--local") == 0) {
+            local = true;
+            continue;
+        } else if (strcmp(arg, "--gzip") == 0) {
+            opts.gzip = true;
+            continue;
+        } else if (value == NULL) {
+            ok = false;
+        } else if (strcmp(arg, "--host") == 0) {
+            ok = inet_pton(AF_INET, value, &opts.addr.sin_addr) == 1;
+        } else if (strcmp(arg, "--port") == 0) {
+            opts.addr.sin_port = htons((uint16_t)atoi(value));
+        } else if (strcmp(arg, "--connections") == 0) {
+            opts.connections = atoi(value);
+            ok = opts.connections > 0 && opts.connections <= MAX_CONNECTIONS;
+        } else if (strcmp(arg, "--duration") == 0) {
+            opts.duration = atof(value);
+            ok = opts.duration > 0;
+        } else if (strcmp(arg, "--services") == 0) {
+            opts.services = atoi(value);
+            ok = opts.services >= 0 && opts.services <= POOL_LIMIT;
+        } else if (strcmp(arg, "--mix") == 0) {
+            ok = parse_mix(value, opts.mix);
+        } else if (strcmp(arg, "--commit-us") == 0) {
+            commit_us = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opts.seed = (unsigned)strtoul(value, NULL, 10);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    if (local) {
+        esp_log_level_set("*", ESP_LOG_ERROR);
+        nvs_host_set_path(NULL);
+        nvs_host_set_commit_delay(commit_us);
+        httpd_host_set_port(0);
+        if (totp_storage_init() != ESP_OK || server_init() != ESP_OK) {
+            fprintf(stderr, "Failed to start the local server\n");
+            return 1;
+        }
+        totp_lookahead_start();
+        opts.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        opts.addr.sin_port = htons(httpd_host_get_port());
+    }
+
+    int ret = 1;
+    worker_t *workers = calloc(opts.connections, sizeof(*workers));
+    pthread_t *threads = calloc(opts.connections, sizeof(*threads));
+    if (workers == NULL || threads == NULL) {
+        goto done;
+    }
+    if (!seed_services(&opts)) {
+        fprintf(stderr, "Failed to create the initial services\n");
+        goto done;
+    }
+
+    int64_t start = now_us();
+    int started = 0;
+    for (; started < opts.connections; started++) {
+        workers[started].index = started;
+        workers[started].opts = &opts;
+        if (pthread_create(&threads[started], NULL, worker_main, &workers[started]) != 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (now_us() - start) / 1e6;
+
+    // Merge the per-connection results
+    op_stats_t merged[OP_COUNT] = { 0 };
+    op_stats_t all = { 0 };
+    uint32_t statuses[600] = { 0 };
+    uint32_t transport_errors = 0;
+    uint32_t unexpected = 0;
+    for (int i = 0; i < started; i++) {
+        transport_errors += workers[i].transport_errors;
+        for (int s = 0; s < 600; s++) {
+            statuses[s] += workers[i].statuses[s];
+        }
+        for (int op = 0; op < OP_COUNT; op++) {
+            op_stats_t *from = &workers[i].ops[op];
+            for (size_t k = 0; k < from->count; k++) {
+                record(&merged[op], from->samples[k]);
+                record(&all, from->samples[k]);
+            }
+            merged[op].rejected += from->rejected;
+            merged[op].stale += from->stale;
+            merged[op].unexpected += from->unexpected;
+            all.rejected += from->rejected;
+            all.unexpected += from->unexpected;
+            unexpected += from->unexpected;
+            free(from->samples);
+        }
+    }
+
+    printf("%d connections, %.1f s%s\n", started, seconds, opts.gzip ? ", gzip" : "");
+    printf("%-8s %9s %10s %8s %8s %8s %8s %6s\n", "kind", "requests", "req/s", "p50 ms", "p99 ms", "max ms",
+           "rejected", "bad");
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (opts.mix[op] > 0 || merged[op].count > 0) {
+            print_row(op_names[op], &merged[op], seconds);
+        }
+    }
+    print_row("total", &all, seconds);
+    printf("status:");
+    for (int s = 0; s < 600; s++) {
+        if (statuses[s] > 0) {
+            printf(" %d=%u", s, statuses[s]);
+        }
+    }
+    printf("\ntransport errors: %u\n", transport_errors);
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        free(merged[op].samples);
+    }
+    free(all.samples);
+    ret = (transport_errors == 0 && unexpected == 0 && started == opts.connections && all.count > 0) ? 0 : 1;
+
+done:
+    free(workers);
+    free(threads);
+    if (local) {
+        server_deinit();
+        totp_lookahead_stop();
+        totp_storage_deinit();
+    }
+    return ret;
+}
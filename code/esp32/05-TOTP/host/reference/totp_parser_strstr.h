@@ -0,0 +1,216 @@
+#ifndef HOST_REFERENCE_TOTP_PARSER_STRSTR_H
+#define HOST_REFERENCE_TOTP_PARSER_STRSTR_H
+
+// totp_parse_uri() before the single-pass parser: one strstr() over the query
+// per parameter, URL-decoding through 256-byte temporaries. Kept as the
+// baseline for the parser benchmark.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_log.h"
+#include "totp/totp_storage.h"
+
+// Kept as it was: %lu for uint32_t (a long on the ESP32) and truncating strncpy()
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wstringop-truncation"
+
+static const char *TAG_STRSTR = "totp_parser";
+
+// URL decode helper function
+static void strstr_url_decode(char *dst, const char *src) {
+    char a, b;
+    while (*src) {
+        if ((*src == '%') &&
+            ((a = src[1]) && (b = src[2])) &&
+            (isxdigit(a) && isxdigit(b))) {
+            if (a >= 'a') a -= 'a'-'A';
+            if (a >= 'A') a -= ('A' - 10);
+            else a -= '0';
+            if (b >= 'a') b -= 'a'-'A';
+            if (b >= 'A') b -= ('A' - 10);
+            else b -= '0';
+            *dst++ = 16*a+b;
+            src+=3;
+        } else if (*src == '+') {
+            *dst++ = ' ';
+            src++;
+        } else {
+            *dst++ = *src++;
+        }
+    }
+    *dst++ = '\0';
+}
+
+// Extract query parameter value
+static bool strstr_get_query_param(const char *query, const char *param, char *value, size_t value_size) {
+    char search[64];
+    snprintf(search, sizeof(search), "%s=", param);
+    
+    const char *start = strstr(query, search);
+    if (start == NULL) {
+        return false;
+    }
+    
+    start += strlen(search);
+    const char *end = strchr(start, '&');
+    
+    size_t len;
+    if (end != NULL) {
+        len = end - start;
+    } else {
+        len = strlen(start);
+    }
+    
+    if (len >= value_size) {
+        len = value_size - 1;
+    }
+    
+    strncpy(value, start, len);
+    value[len] = '\0';
+    
+    // URL decode the value
+    char decoded[256];
+    strstr_url_decode(decoded, value);
+    strncpy(value, decoded, value_size - 1);
+    value[value_size - 1] = '\0';
+    
+    return true;
+}
+
+static inline esp_err_t totp_parse_uri_strstr(const char *uri, totp_service_t *service) {
+    if (uri == NULL || service == NULL) {
+        ESP_LOGE(TAG_STRSTR, "Invalid parameters");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Clear service structure
+    memset(service, 0, sizeof(totp_service_t));
+    
+    // Set defaults
+    service->digits = 6;
+    service->period = 30;
+
+    // Check if URI starts with "otpauth://totp/" or "otpauth://hotp/"
+    const char *prefix = "otpauth://totp/";
+    if (strncmp(uri, "otpauth://hotp/", strlen(prefix)) == 0) {
+        service->type = TOTP_TYPE_HOTP;
+    } else if (strncmp(uri, prefix, strlen(prefix)) != 0) {
+        ESP_LOGE(TAG_STRSTR, "Invalid URI prefix, must start with 'otpauth://totp/' or 'otpauth://hotp/'");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Skip prefix
+    const char *path = uri + strlen(prefix);
+    
+    // Find the query string (starts with '?')
+    const char *query = strchr(path, '?');
+    if (query == NULL) {
+        ESP_LOGE(TAG_STRSTR, "No query string found in URI");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Extract label (path before '?')
+    size_t label_len = query - path;
+    char label[MAX_SERVICE_NAME_LEN + MAX_ACCOUNT_NAME_LEN];
+    if (label_len >= sizeof(label)) {
+        label_len = sizeof(label) - 1;
+    }
+    strncpy(label, path, label_len);
+    label[label_len] = '\0';
+    
+    // URL decode label
+    char decoded_label[MAX_SERVICE_NAME_LEN + MAX_ACCOUNT_NAME_LEN];
+    strstr_url_decode(decoded_label, label);
+
+    // Parse label: can be "Issuer:account" or just "account"
+    char *colon = strchr(decoded_label, ':');
+    if (colon != NULL) {
+        // Format: "Issuer:account"
+        *colon = '\0';
+        strncpy(service->service_name, decoded_label, MAX_SERVICE_NAME_LEN - 1);
+        strncpy(service->account, colon + 1, MAX_ACCOUNT_NAME_LEN - 1);
+    } else {
+        // Format: just "account"
+        strncpy(service->account, decoded_label, MAX_ACCOUNT_NAME_LEN - 1);
+        strncpy(service->service_name, decoded_label, MAX_SERVICE_NAME_LEN - 1);
+    }
+
+    // Skip '?' in query
+    query++;
+
+    // Extract secret (required)
+    if (!strstr_get_query_param(query, "secret", service->secret, MAX_SECRET_LEN)) {
+        ESP_LOGE(TAG_STRSTR, "Secret parameter is required");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Extract issuer (optional, overrides label issuer)
+    char issuer[MAX_ISSUER_LEN];
+    if (strstr_get_query_param(query, "issuer", issuer, sizeof(issuer))) {
+        strncpy(service->issuer, issuer, MAX_ISSUER_LEN - 1);
+    } else {
+        // Use service_name as issuer if not provided
+        strncpy(service->issuer, service->service_name, MAX_ISSUER_LEN - 1);
+    }
+
+    // Extract digits (optional)
+    char digits_str[4];
+    if (strstr_get_query_param(query, "digits", digits_str, sizeof(digits_str))) {
+        int digits = atoi(digits_str);
+        if (digits >= 6 && digits <= 8) {
+            service->digits = digits;
+        } else {
+            ESP_LOGW(TAG_STRSTR, "Invalid digits value %d, using default 6", digits);
+        }
+    }
+
+    // Extract period (optional)
+    char period_str[8];
+    if (strstr_get_query_param(query, "period", period_str, sizeof(period_str))) {
+        int period = atoi(period_str);
+        if (period > 0 && period <= 120) {
+            service->period = period;
+        } else {
+            ESP_LOGW(TAG_STRSTR, "Invalid period value %d, using default 30", period);
+        }
+    }
+
+    // Extract algorithm (optional, defaults to SHA1)
+    char algorithm_str[8];
+    if (strstr_get_query_param(query, "algorithm", algorithm_str, sizeof(algorithm_str))) {
+        if (strcasecmp(algorithm_str, "SHA1") == 0) {
+            service->algorithm = TOTP_ALGO_SHA1;
+        } else if (strcasecmp(algorithm_str, "SHA256") == 0) {
+            service->algorithm = TOTP_ALGO_SHA256;
+        } else if (strcasecmp(algorithm_str, "SHA512") == 0) {
+            service->algorithm = TOTP_ALGO_SHA512;
+        } else {
+            ESP_LOGE(TAG_STRSTR, "Unsupported algorithm '%s'", algorithm_str);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+
+    // Extract counter (required for HOTP)
+    if (service->type == TOTP_TYPE_HOTP) {
+        char counter_str[24];
+        if (!strstr_get_query_param(query, "counter", counter_str, sizeof(counter_str))) {
+            ESP_LOGE(TAG_STRSTR, "Counter parameter is required for HOTP");
+            return ESP_ERR_INVALID_ARG;
+        }
+        service->counter = strtoull(counter_str, NULL, 10);
+    }
+
+    ESP_LOGI(TAG_STRSTR, "Parsed URI - Issuer: %s, Account: %s, Digits: %d, Period: %lu, Algorithm: %s",
+             service->issuer, service->account, service->digits, service->period,
+             totp_algorithm_name(service->algorithm));
+
+    return ESP_OK;
+}
+
+#pragma GCC diagnostic pop
+
+#endif // HOST_REFERENCE_TOTP_PARSER_STRSTR_H
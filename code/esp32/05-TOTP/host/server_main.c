@@ -0,0 +1,93 @@
+// Runs the firmware's web server on the host, like app_main() does on the
+// device once Wi-Fi is up (no hardware or NTP: the host clock is already set).
+//
+//   totp_server [--port N] [--nvs FILE | --ram] [-v]
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "nvs_host.h"
+#include "network/server.h"
+#include "totp/totp_storage.h"
+#include "totp/totp_lookahead.h"
+
+static const char *TAG = "MAIN";
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--port N] [--nvs FILE | --ram] [-v]\n"
+            "  --port N    TCP port on 127.0.0.1 (default 8080, 0 for any)\n"
+            "  --nvs FILE  NVS partition file (default totp_nvs.bin)\n"
+            "  --ram       keep NVS in memory only\n"
+            "  -v          log at info level (-vv: debug)\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int port = 8080;
+    const char *nvs_path = "totp_nvs.bin";
+    esp_log_level_t level = ESP_LOG_WARN;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--nvs") == 0 && i + 1 < argc) {
+            nvs_path = argv[++i];
+        } else if (strcmp(argv[i], "--ram") == 0) {
+            nvs_path = NULL;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            level = ESP_LOG_INFO;
+        } else if (strcmp(argv[i], "-vv") == 0) {
+            level = ESP_LOG_DEBUG;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (port < 0 || port > 65535) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Blocked before any thread starts, so only the sigwait() below gets them
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    esp_log_level_set("*", level);
+    nvs_host_set_path(nvs_path);
+    httpd_host_set_port((uint16_t)port);
+
+    esp_err_t ret = totp_storage_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Storage init failed: %s", esp_err_to_name(ret));
+        return 1;
+    }
+    if (totp_lookahead_start() != ESP_OK) {
+        ESP_LOGW(TAG, "Look-ahead task not started, codes are computed on demand");
+    }
+    ret = server_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start web server: %s", esp_err_to_name(ret));
+        totp_lookahead_stop();
+        totp_storage_deinit();
+        return 1;
+    }
+
+    printf("Server running on http://127.0.0.1:%u/ (%u services)\n",
+           httpd_host_get_port(), totp_storage_count());
+    fflush(stdout);
+
+    int sig;
+    sigwait(&stop_signals, &sig);
+
+    server_deinit();
+    totp_lookahead_stop();
+    totp_storage_deinit();
+    return 0;
+}
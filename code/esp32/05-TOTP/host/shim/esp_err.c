@@ -0,0 +1,62 @@
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ERR_NAME(code) { code, #code }
+
+static const struct {
+    esp_err_t code;
+    const char *name;
+} err_names[] = {
+    ERR_NAME(ESP_OK),
+    ERR_NAME(ESP_FAIL),
+    ERR_NAME(ESP_ERR_NO_MEM),
+    ERR_NAME(ESP_ERR_INVALID_ARG),
+    ERR_NAME(ESP_ERR_INVALID_STATE),
+    ERR_NAME(ESP_ERR_INVALID_SIZE),
+    ERR_NAME(ESP_ERR_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NOT_SUPPORTED),
+    ERR_NAME(ESP_ERR_TIMEOUT),
+    ERR_NAME(ESP_ERR_INVALID_RESPONSE),
+    ERR_NAME(ESP_ERR_INVALID_CRC),
+    ERR_NAME(ESP_ERR_INVALID_VERSION),
+    ERR_NAME(ESP_ERR_INVALID_MAC),
+    ERR_NAME(ESP_ERR_NOT_FINISHED),
+    ERR_NAME(ESP_ERR_NVS_NOT_INITIALIZED),
+    ERR_NAME(ESP_ERR_NVS_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NVS_TYPE_MISMATCH),
+    ERR_NAME(ESP_ERR_NVS_READ_ONLY),
+    ERR_NAME(ESP_ERR_NVS_NOT_ENOUGH_SPACE),
+    ERR_NAME(ESP_ERR_NVS_INVALID_NAME),
+    ERR_NAME(ESP_ERR_NVS_INVALID_HANDLE),
+    ERR_NAME(ESP_ERR_NVS_KEY_TOO_LONG),
+    ERR_NAME(ESP_ERR_NVS_INVALID_LENGTH),
+    ERR_NAME(ESP_ERR_NVS_NO_FREE_PAGES),
+    ERR_NAME(ESP_ERR_NVS_VALUE_TOO_LONG),
+    ERR_NAME(ESP_ERR_NVS_NEW_VERSION_FOUND),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLERS_FULL),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLER_EXISTS),
+    ERR_NAME(ESP_ERR_HTTPD_INVALID_REQ),
+    ERR_NAME(ESP_ERR_HTTPD_RESULT_TRUNC),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_HDR),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_SEND),
+    ERR_NAME(ESP_ERR_HTTPD_ALLOC_MEM),
+    ERR_NAME(ESP_ERR_HTTPD_TASK),
+};
+
+const char *esp_err_to_name(esp_err_t code) {
+    for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); i++) {
+        if (err_names[i].code == code) {
+            return err_names[i].name;
+        }
+    }
+    return "UNKNOWN ERROR";
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function, const char *expression) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nfunc: %s\nexpression: %s\n",
+            rc, esp_err_to_name(rc), file, line, function, expression);
+    abort();
+}
@@ -0,0 +1,1206 @@
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#define OPENSSL_API_COMPAT 0x10100000L
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+static const char *TAG = "httpd_host";
+
+#define MAX_RESP_HEADERS 16
+#define RESP_HEAD_SIZE 1024
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+typedef struct work {
+    httpd_work_fn_t fn;
+    void *arg;
+    struct work *next;
+} work_t;
+
+typedef struct {
+    int fd;                         // -1 if free
+    uint64_t lru;                   // Server clock of the last request
+    bool busy;                      // Request handed to an async handler
+    bool close_pending;             // Close once not busy
+    bool ws;                        // WebSocket handshake done
+    const httpd_uri_t *ws_route;
+    httpd_send_func_t send_fn;
+    size_t len;                     // Received bytes not consumed yet
+    char buf[HTTPD_MAX_REQ_HDR_LEN + 1];
+    // WebSocket frame being handled
+    uint8_t ws_opcode;
+    bool ws_final;
+    uint64_t ws_left;               // Payload bytes not read yet
+    uint64_t ws_offset;
+    uint8_t ws_mask[4];
+} session_t;
+
+typedef struct {
+    httpd_config_t config;
+    int listen_fd;
+    int wake_fds[2];                // Self-pipe waking the server thread
+    pthread_t thread;
+    pthread_mutex_t lock;           // running, work queue, busy / close_pending
+    bool running;
+    work_t *work_head;
+    work_t *work_tail;
+    httpd_uri_t *routes;
+    size_t route_count;
+    session_t *sessions;
+    uint64_t lru_clock;
+} server_t;
+
+typedef struct {
+    server_t *server;
+    session_t *sess;
+    char hdr[HTTPD_MAX_REQ_HDR_LEN + 1];    // Request line and headers
+    size_t body_left;                       // Body bytes not received yet
+    bool keep_alive;
+    bool async;                             // Handed to an async copy
+    const char *status;
+    const char *type;
+    const char *resp_fields[MAX_RESP_HEADERS];
+    const char *resp_values[MAX_RESP_HEADERS];
+    size_t resp_count;
+    bool chunked;                           // Chunked response started
+} req_aux_t;
+
+static bool port_set = false;
+static uint16_t port_override = 0;
+static uint16_t last_port = 0;
+
+void httpd_host_set_port(uint16_t port) {
+    port_override = port;
+    port_set = true;
+}
+
+uint16_t httpd_host_get_port(void) {
+    return last_port;
+}
+
+static void wake(server_t *srv) {
+    char byte = 0;
+    ssize_t ret = write(srv->wake_fds[1], &byte, 1);
+    (void)ret;  // A full pipe already wakes the thread
+}
+
+// Sessions are owned by the server thread; fd, ws, busy and close_pending are
+// also read or written by other threads, under srv->lock
+static session_t *find_session(server_t *srv, int fd) {
+    for (size_t i = 0; i < srv->config.max_open_sockets; i++) {
+        if (srv->sessions[i].fd == fd && fd >= 0) {
+            return &srv->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void close_session(server_t *srv, session_t *s) {
+    pthread_mutex_lock(&srv->lock);
+    int fd = s->fd;
+    s->fd = -1;
+    s->busy = false;
+    s->close_pending = false;
+    s->ws = false;
+    pthread_mutex_unlock(&srv->lock);
+    s->ws_route = NULL;
+    s->len = 0;
+
+    if (srv->config.close_fn != NULL) {
+        srv->config.close_fn(srv, fd);
+    } else {
+        close(fd);
+    }
+}
+
+// True if the server thread may read the session (not closed, closing or async)
+static bool sess_idle(server_t *srv, session_t *s) {
+    pthread_mutex_lock(&srv->lock);
+    bool idle = s->fd >= 0 && !s->busy && !s->close_pending;
+    pthread_mutex_unlock(&srv->lock);
+    return idle;
+}
+
+int httpd_default_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    ssize_t ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)ret;
+}
+
+static esp_err_t send_fd(server_t *srv, int fd, httpd_send_func_t send_fn, const char *buf, size_t len) {
+    while (len > 0) {
+        int ret = send_fn(srv, fd, buf, len, 0);
+        if (ret <= 0) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t send_all(server_t *srv, session_t *s, const char *buf, size_t len) {
+    return send_fd(srv, s->fd, s->send_fn, buf, len);
+}
+
+// Read from the bytes already buffered first, then from the socket
+static int sess_recv(session_t *s, char *buf, size_t len) {
+    if (s->len > 0) {
+        size_t n = (len < s->len) ? len : s->len;
+        memcpy(buf, s->buf, n);
+        memmove(s->buf, s->buf + n, s->len - n);
+        s->len -= n;
+        return (int)n;
+    }
+
+    ssize_t ret = recv(s->fd, buf, len, 0);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)ret;
+}
+
+static bool sess_recv_exact(session_t *s, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        int ret = sess_recv(s, p, len);
+        if (ret <= 0) {
+            return false;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+// Receive and drop the rest of a request body
+static bool discard_body(req_aux_t *aux) {
+    char scratch[256];
+    while (aux->body_left > 0) {
+        int ret = sess_recv(aux->sess, scratch, (aux->body_left < sizeof(scratch)) ? aux->body_left : sizeof(scratch));
+        if (ret <= 0) {
+            return false;
+        }
+        aux->body_left -= ret;
+    }
+    return true;
+}
+
+static void free_req(httpd_req_t *req) {
+    free(req->aux);
+    free(req);
+}
+
+// Request line and headers
+
+static const char *find_header(const char *hdr, const char *field, size_t *value_len) {
+    size_t field_len = strlen(field);
+    const char *line = strstr(hdr, "\r\n");
+    while (line != NULL && line[2] != '\0' && line[2] != '\r') {
+        line += 2;
+        const char *end = strstr(line, "\r\n");
+        if (end == NULL) {
+            end = line + strlen(line);
+        }
+        if (strncasecmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            const char *value = line + field_len + 1;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            *value_len = end - value;
+            return value;
+        }
+        line = end;
+    }
+    return NULL;
+}
+
+static bool header_has_token(const char *hdr, const char *field, const char *token) {
+    size_t len;
+    const char *value = find_header(hdr, field, &len);
+    size_t token_len = strlen(token);
+    for (size_t i = 0; value != NULL && i + token_len <= len; i++) {
+        if (strncasecmp(value + i, token, token_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    size_t len;
+    req_aux_t *aux = r->aux;
+    return (find_header(aux->hdr, field, &len) != NULL) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    if (r == NULL || field == NULL || val == NULL || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t len;
+    req_aux_t *aux = r->aux;
+    const char *value = find_header(aux->hdr, field, &len);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t n = (len < val_size - 1) ? len : val_size - 1;
+    memcpy(val, value, n);
+    val[n] = '\0';
+    return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    const char *query = strchr(r->uri, '?');
+    return (query != NULL) ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    if (r == NULL || buf == NULL || buf_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *query = strchr(r->uri, '?');
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    query++;
+    size_t len = strlen(query);
+    size_t n = (len < buf_len - 1) ? len : buf_len - 1;
+    memcpy(buf, query, n);
+    buf[n] = '\0';
+    return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+// Values are returned as sent (not URL-decoded), as the IDF does
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    if (qry == NULL || key == NULL || val == NULL || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t key_len = strlen(key);
+    const char *pair = qry;
+    while (pair != NULL && *pair != '\0') {
+        const char *end = strchr(pair, '&');
+        size_t pair_len = (end != NULL) ? (size_t)(end - pair) : strlen(pair);
+        if (pair_len > key_len && strncmp(pair, key, key_len) == 0 && pair[key_len] == '=') {
+            const char *value = pair + key_len + 1;
+            size_t len = pair_len - key_len - 1;
+            size_t n = (len < val_size - 1) ? len : val_size - 1;
+            memcpy(val, value, n);
+            val[n] = '\0';
+            return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        pair = (end != NULL) ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// Same rules as the IDF: a trailing '*' matches anything after the prefix, a
+// trailing '?' makes the character before it optional ("/path/?*")
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+    size_t tpl_len = strlen(uri_template);
+    char last = (tpl_len > 0) ? uri_template[tpl_len - 1] : '\0';
+    char prev = (tpl_len > 1) ? uri_template[tpl_len - 2] : '\0';
+    bool asterisk = last == '*' || (prev == '*' && last == '?');
+    bool quest = last == '?' || (prev == '?' && last == '*');
+
+    size_t special = asterisk + quest * 2;
+    if (tpl_len < special) {
+        return false;
+    }
+    size_t exact = tpl_len - special;
+    if (match_upto < exact) {
+        return false;
+    }
+
+    if (!quest) {
+        if (!asterisk && match_upto != exact) {
+            return false;
+        }
+        return strncmp(uri_template, uri_to_match, exact) == 0;
+    }
+
+    if (match_upto > exact && uri_template[exact] != uri_to_match[exact]) {
+        return false;
+    }
+    if (strncmp(uri_template, uri_to_match, exact) != 0) {
+        return false;
+    }
+    return asterisk || match_upto <= exact + 1;
+}
+
+// Responses
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    if (r == NULL || r->aux == NULL) {
+        return -1;
+    }
+    return ((req_aux_t *)r->aux)->sess->fd;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    ((req_aux_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    ((req_aux_t *)r->aux)->type = type;
+    return ESP_OK;
+}
+
+// Like the IDF, only the pointers are kept: values must outlive the response
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    req_aux_t *aux = r->aux;
+    if (aux->resp_count >= aux->server->config.max_resp_headers || aux->resp_count >= MAX_RESP_HEADERS) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    aux->resp_fields[aux->resp_count] = field;
+    aux->resp_values[aux->resp_count] = value;
+    aux->resp_count++;
+    return ESP_OK;
+}
+
+static esp_err_t send_head(req_aux_t *aux, const char *length_line) {
+    char head[RESP_HEAD_SIZE];
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s",
+                       aux->status, aux->type, length_line);
+    for (size_t i = 0; i < aux->resp_count && len < (int)sizeof(head); i++) {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", aux->resp_fields[i], aux->resp_values[i]);
+    }
+    if (len < (int)sizeof(head)) {
+        len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    }
+    if (len >= (int)sizeof(head)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    return send_all(aux->server, aux->sess, head, len);
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    if (r == NULL || r->aux == NULL) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+    req_aux_t *aux = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = (buf != NULL) ? (ssize_t)strlen(buf) : 0;
+    }
+
+    char length_line[40];
+    snprintf(length_line, sizeof(length_line), "Content-Length: %zd\r\n", buf_len);
+    esp_err_t err = send_head(aux, length_line);
+    if (err == ESP_OK && buf_len > 0) {
+        err = send_all(aux->server, aux->sess, buf, buf_len);
+    }
+    return err;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    if (r == NULL || r->aux == NULL) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+    req_aux_t *aux = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = (buf != NULL) ? (ssize_t)strlen(buf) : 0;
+    }
+
+    if (!aux->chunked) {
+        esp_err_t err = send_head(aux, "Transfer-Encoding: chunked\r\n");
+        if (err != ESP_OK) {
+            return err;
+        }
+        aux->chunked = true;
+    }
+
+    if (buf == NULL || buf_len == 0) {
+        return send_all(aux->server, aux->sess, "0\r\n\r\n", 5);
+    }
+    char size_line[16];
+    int len = snprintf(size_line, sizeof(size_line), "%zx\r\n", buf_len);
+    esp_err_t err = send_all(aux->server, aux->sess, size_line, len);
+    if (err == ESP_OK) {
+        err = send_all(aux->server, aux->sess, buf, buf_len);
+    }
+    if (err == ESP_OK) {
+        err = send_all(aux->server, aux->sess, "\r\n", 2);
+    }
+    return err;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    static const struct {
+        const char *status;
+        const char *message;
+    } errors[] = {
+        [HTTPD_400_BAD_REQUEST] = { "400 Bad Request", "Bad request syntax" },
+        [HTTPD_404_NOT_FOUND] = { "404 Not Found", "Nothing matches the given URI" },
+        [HTTPD_405_METHOD_NOT_ALLOWED] = { "405 Method Not Allowed", "Request method for this URI is not handled by server" },
+        [HTTPD_408_REQ_TIMEOUT] = { "408 Request Timeout", "Server closed this connection" },
+        [HTTPD_414_URI_TOO_LONG] = { "414 URI Too Long", "URI is too long" },
+        [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = { "431 Request Header Fields Too Large", "Header fields are too long" },
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+        [HTTPD_501_METHOD_NOT_IMPLEMENTED] = { "501 Method Not Implemented", "Server does not support this operation" },
+    };
+    httpd_resp_set_status(req, errors[error].status);
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_send(req, (msg != NULL) ? msg : errors[error].message, HTTPD_RESP_USE_STRLEN);
+}
+
+// Request body and async requests
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    if (r == NULL || r->aux == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    req_aux_t *aux = r->aux;
+    if (buf_len > aux->body_left) {
+        buf_len = aux->body_left;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+    int ret = sess_recv(aux->sess, buf, buf_len);
+    if (ret > 0) {
+        aux->body_left -= ret;
+    }
+    return ret;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+    if (r == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_req_t *copy = malloc(sizeof(*copy));
+    req_aux_t *aux = malloc(sizeof(*aux));
+    if (copy == NULL || aux == NULL) {
+        free(copy);
+        free(aux);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, r, sizeof(*copy));
+    memcpy(aux, r->aux, sizeof(*aux));
+    copy->aux = aux;
+
+    // The session is not read again until the copy completes
+    req_aux_t *orig = r->aux;
+    orig->async = true;
+    pthread_mutex_lock(&orig->server->lock);
+    orig->sess->busy = true;
+    pthread_mutex_unlock(&orig->server->lock);
+
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+    if (r == NULL || r->aux == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = r->aux;
+    bool reusable = discard_body(aux) && aux->keep_alive;
+
+    server_t *srv = aux->server;
+    pthread_mutex_lock(&srv->lock);
+    aux->sess->busy = false;
+    aux->sess->close_pending |= !reusable;
+    pthread_mutex_unlock(&srv->lock);
+    wake(srv);
+
+    free_req(r);
+    return ESP_OK;
+}
+
+// WebSocket
+
+static esp_err_t ws_send(server_t *srv, int fd, httpd_send_func_t send_fn, uint8_t first,
+                         const uint8_t *payload, size_t len) {
+    uint8_t head[10];
+    size_t head_len = 2;
+    head[0] = first;
+    if (len < 126) {
+        head[1] = (uint8_t)len;
+    } else if (len <= 0xFFFF) {
+        head[1] = 126;
+        head[2] = (uint8_t)(len >> 8);
+        head[3] = (uint8_t)len;
+        head_len = 4;
+    } else {
+        head[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            head[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+        }
+        head_len = 10;
+    }
+    esp_err_t err = send_fd(srv, fd, send_fn, (const char *)head, head_len);
+    if (err == ESP_OK && len > 0) {
+        err = send_fd(srv, fd, send_fn, (const char *)payload, len);
+    }
+    return err;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+    server_t *srv = hd;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = find_session(srv, fd);
+    bool ws = s != NULL && s->ws;
+    httpd_send_func_t send_fn = ws ? s->send_fn : NULL;
+    pthread_mutex_unlock(&srv->lock);
+    if (!ws || frame == NULL) {
+        return ESP_FAIL;
+    }
+    uint8_t first = ((!frame->fragmented || frame->final) ? 0x80 : 0) | (frame->type & 0x0F);
+    return ws_send(srv, fd, send_fn, first, frame->payload, frame->len) == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    server_t *srv = hd;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = find_session(srv, fd);
+    httpd_ws_client_info_t info = HTTPD_WS_CLIENT_INVALID;
+    if (s != NULL) {
+        info = s->ws ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    return info;
+}
+
+// With max_len 0 only the header is reported (pkt->len), as in the IDF
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+    if (req == NULL || req->aux == NULL || pkt == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    session_t *s = ((req_aux_t *)req->aux)->sess;
+    pkt->type = s->ws_opcode;
+    pkt->final = s->ws_final;
+    pkt->fragmented = !s->ws_final || s->ws_opcode == HTTPD_WS_TYPE_CONTINUE;
+    pkt->len = s->ws_left;
+    if (max_len == 0) {
+        return ESP_OK;
+    }
+    if (pkt->len > max_len || pkt->payload == NULL) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!sess_recv_exact(s, pkt->payload, pkt->len)) {
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < pkt->len; i++) {
+        pkt->payload[i] ^= s->ws_mask[(s->ws_offset + i) % 4];
+    }
+    s->ws_offset += pkt->len;
+    s->ws_left = 0;
+    return ESP_OK;
+}
+
+static bool ws_handshake(server_t *srv, session_t *s, req_aux_t *aux) {
+    size_t key_len;
+    const char *key = find_header(aux->hdr, "Sec-WebSocket-Key", &key_len);
+    if (key == NULL || key_len > 64 || !header_has_token(aux->hdr, "Upgrade", "websocket")) {
+        return false;
+    }
+
+    char input[64 + sizeof(WS_GUID)];
+    memcpy(input, key, key_len);
+    memcpy(input + key_len, WS_GUID, sizeof(WS_GUID) - 1);
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1((const unsigned char *)input, key_len + sizeof(WS_GUID) - 1, digest);
+    char accept[32];
+    EVP_EncodeBlock((unsigned char *)accept, digest, sizeof(digest));
+
+    char response[192];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                       "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+    return send_all(srv, s, response, len) == ESP_OK;
+}
+
+static req_aux_t *new_request(server_t *srv, session_t *s, httpd_req_t **out) {
+    httpd_req_t *req = calloc(1, sizeof(*req));
+    req_aux_t *aux = calloc(1, sizeof(*aux));
+    if (req == NULL || aux == NULL) {
+        free(req);
+        free(aux);
+        return NULL;
+    }
+    aux->server = srv;
+    aux->sess = s;
+    aux->keep_alive = true;
+    aux->status = "200 OK";
+    aux->type = "text/html";
+    req->handle = srv;
+    req->aux = aux;
+    *out = req;
+    return aux;
+}
+
+// A frame arrived on a WebSocket session
+static void handle_ws_frame(server_t *srv, session_t *s) {
+    uint8_t head[2];
+    if (!sess_recv_exact(s, head, sizeof(head))) {
+        close_session(srv, s);
+        return;
+    }
+    uint64_t len = head[1] & 0x7F;
+    uint8_t ext[8];
+    if (len == 126 || len == 127) {
+        size_t ext_len = (len == 126) ? 2 : 8;
+        if (!sess_recv_exact(s, ext, ext_len)) {
+            close_session(srv, s);
+            return;
+        }
+        len = 0;
+        for (size_t i = 0; i < ext_len; i++) {
+            len = (len << 8) | ext[i];
+        }
+    }
+    memset(s->ws_mask, 0, sizeof(s->ws_mask));
+    if ((head[1] & 0x80) && !sess_recv_exact(s, s->ws_mask, sizeof(s->ws_mask))) {
+        close_session(srv, s);
+        return;
+    }
+    s->ws_opcode = head[0] & 0x0F;
+    s->ws_final = (head[0] & 0x80) != 0;
+    s->ws_left = len;
+    s->ws_offset = 0;
+    s->lru = ++srv->lru_clock;
+
+    // Control frames are answered here unless the route asked for them
+    if (!s->ws_route->handle_ws_control_frames && (s->ws_opcode & 0x08)) {
+        uint8_t payload[125];
+        httpd_req_t fake = { 0 };
+        req_aux_t fake_aux = { .sess = s };
+        httpd_ws_frame_t frame = { .payload = payload };
+        fake.aux = &fake_aux;
+        if (len > sizeof(payload) || httpd_ws_recv_frame(&fake, &frame, sizeof(payload)) != ESP_OK) {
+            close_session(srv, s);
+        } else if (s->ws_opcode == HTTPD_WS_TYPE_PING) {
+            ws_send(srv, s->fd, s->send_fn, 0x80 | HTTPD_WS_TYPE_PONG, payload, frame.len);
+        } else if (s->ws_opcode == HTTPD_WS_TYPE_CLOSE) {
+            ws_send(srv, s->fd, s->send_fn, 0x80 | HTTPD_WS_TYPE_CLOSE, NULL, 0);
+            close_session(srv, s);
+        }
+        return;
+    }
+
+    httpd_req_t *req;
+    req_aux_t *aux = new_request(srv, s, &req);
+    if (aux == NULL) {
+        close_session(srv, s);
+        return;
+    }
+    req->method = 0;
+    strncpy((char *)req->uri, s->ws_route->uri, HTTPD_MAX_URI_LEN);
+    req->user_ctx = s->ws_route->user_ctx;
+
+    esp_err_t ret = s->ws_route->handler(req);
+    free_req(req);
+
+    // Drop whatever the handler did not read
+    uint8_t scratch[128];
+    while (ret == ESP_OK && s->ws_left > 0) {
+        size_t n = (s->ws_left < sizeof(scratch)) ? s->ws_left : sizeof(scratch);
+        if (!sess_recv_exact(s, scratch, n)) {
+            ret = ESP_FAIL;
+        }
+        s->ws_left -= n;
+    }
+    if (ret != ESP_OK) {
+        close_session(srv, s);
+    }
+}
+
+// HTTP requests
+
+static size_t header_end(const char *buf, size_t len) {
+    for (size_t i = 0; i + 3 < len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n') {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+static const char *const method_names[] = {
+    [HTTP_DELETE] = "DELETE", [HTTP_GET] = "GET", [HTTP_HEAD] = "HEAD",
+    [HTTP_POST] = "POST", [HTTP_PUT] = "PUT", [HTTP_OPTIONS] = "OPTIONS",
+};
+
+const char *http_method_str(enum http_method m) {
+    if ((size_t)m < sizeof(method_names) / sizeof(method_names[0]) && method_names[m] != NULL) {
+        return method_names[m];
+    }
+    return "<unknown>";
+}
+
+static int parse_method(const char *text, size_t len) {
+    for (size_t i = 0; i < sizeof(method_names) / sizeof(method_names[0]); i++) {
+        if (method_names[i] != NULL && strlen(method_names[i]) == len && strncmp(method_names[i], text, len) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static const httpd_uri_t *find_route(server_t *srv, const char *uri, int method, bool *method_mismatch) {
+    size_t path_len = strcspn(uri, "?");
+    *method_mismatch = false;
+    for (size_t i = 0; i < srv->route_count; i++) {
+        const httpd_uri_t *route = &srv->routes[i];
+        bool match = (srv->config.uri_match_fn != NULL)
+                     ? srv->config.uri_match_fn(route->uri, uri, path_len)
+                     : (strlen(route->uri) == path_len && strncmp(route->uri, uri, path_len) == 0);
+        if (match && (int)route->method == method) {
+            return route;
+        }
+        *method_mismatch |= match;
+    }
+    return NULL;
+}
+
+// Handle the request whose headers are the first hdr_len buffered bytes;
+// false if the session was closed or handed to an async handler
+static bool handle_request(server_t *srv, session_t *s, size_t hdr_len) {
+    httpd_req_t *req;
+    req_aux_t *aux = new_request(srv, s, &req);
+    if (aux == NULL) {
+        close_session(srv, s);
+        return false;
+    }
+    memcpy(aux->hdr, s->buf, hdr_len);
+    aux->hdr[hdr_len] = '\0';
+    memmove(s->buf, s->buf + hdr_len, s->len - hdr_len);
+    s->len -= hdr_len;
+    s->lru = ++srv->lru_clock;
+
+    // Request line: METHOD SP URI SP HTTP/1.x
+    const char *method_end = strchr(aux->hdr, ' ');
+    const char *uri = (method_end != NULL) ? method_end + 1 : NULL;
+    const char *uri_end = (uri != NULL) ? strchr(uri, ' ') : NULL;
+    const char *line_end = strstr(aux->hdr, "\r\n");
+    httpd_err_code_t error = HTTPD_400_BAD_REQUEST;
+    bool valid = uri_end != NULL && uri_end < line_end && strncmp(uri_end + 1, "HTTP/1.", 7) == 0;
+    if (valid) {
+        req->method = parse_method(aux->hdr, method_end - aux->hdr);
+        if (uri_end - uri > HTTPD_MAX_URI_LEN) {
+            error = HTTPD_414_URI_TOO_LONG;
+            valid = false;
+        } else if (req->method < 0) {
+            error = HTTPD_501_METHOD_NOT_IMPLEMENTED;
+            valid = false;
+        } else {
+            memcpy((char *)req->uri, uri, uri_end - uri);
+            aux->keep_alive = (uri_end[8] == '1') ? !header_has_token(aux->hdr, "Connection", "close")
+                                                 : header_has_token(aux->hdr, "Connection", "keep-alive");
+        }
+    }
+
+    size_t value_len;
+    const char *length = find_header(aux->hdr, "Content-Length", &value_len);
+    if (length != NULL) {
+        req->content_len = strtoul(length, NULL, 10);
+        aux->body_left = req->content_len;
+    }
+
+    const httpd_uri_t *route = NULL;
+    if (valid) {
+        bool method_mismatch;
+        route = find_route(srv, req->uri, req->method, &method_mismatch);
+        if (route == NULL) {
+            error = method_mismatch ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND;
+        }
+    }
+    if (route == NULL) {
+        httpd_resp_send_err(req, error, NULL);
+        free_req(req);
+        close_session(srv, s);
+        return false;
+    }
+
+    req->user_ctx = route->user_ctx;
+    esp_err_t ret;
+    if (route->is_websocket) {
+        if (req->method != HTTP_GET || !ws_handshake(srv, s, aux)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+            ret = ESP_FAIL;
+        } else {
+            pthread_mutex_lock(&srv->lock);
+            s->ws = true;
+            pthread_mutex_unlock(&srv->lock);
+            s->ws_route = route;
+            ret = route->handler(req);
+        }
+    } else {
+        ret = route->handler(req);
+    }
+
+    // The session now belongs to the async copy until it completes
+    if (aux->async) {
+        free_req(req);
+        return false;
+    }
+    bool reusable = ret == ESP_OK && !s->ws && discard_body(aux) && aux->keep_alive;
+    bool keep = reusable || (ret == ESP_OK && s->ws);
+    free_req(req);
+    if (!keep) {
+        close_session(srv, s);
+        return false;
+    }
+    return true;
+}
+
+// Handle every complete request buffered on the session
+static void handle_buffered(server_t *srv, session_t *s) {
+    while (sess_idle(srv, s) && !s->ws && s->len > 0) {
+        size_t hdr_len = header_end(s->buf, s->len);
+        if (hdr_len == 0) {
+            if (s->len == HTTPD_MAX_REQ_HDR_LEN) {
+                const char *reply = "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                                    "Content-Type: text/html\r\nContent-Length: 0\r\n\r\n";
+                send_all(srv, s, reply, strlen(reply));
+                close_session(srv, s);
+            }
+            return;
+        }
+        if (!handle_request(srv, s, hdr_len)) {
+            return;
+        }
+    }
+}
+
+static void handle_readable(server_t *srv, session_t *s) {
+    if (s->ws) {
+        handle_ws_frame(srv, s);
+        return;
+    }
+
+    ssize_t ret = recv(s->fd, s->buf + s->len, HTTPD_MAX_REQ_HDR_LEN - s->len, 0);
+    if (ret <= 0) {
+        close_session(srv, s);
+        return;
+    }
+    s->len += ret;
+    handle_buffered(srv, s);
+}
+
+static void accept_session(server_t *srv) {
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    session_t *s = NULL;
+    for (size_t i = 0; i < srv->config.max_open_sockets; i++) {
+        if (srv->sessions[i].fd < 0) {
+            s = &srv->sessions[i];
+            break;
+        }
+    }
+    if (s == NULL && srv->config.lru_purge_enable) {
+        for (size_t i = 0; i < srv->config.max_open_sockets; i++) {
+            session_t *c = &srv->sessions[i];
+            if (sess_idle(srv, c) && (s == NULL || c->lru < s->lru)) {
+                s = c;
+            }
+        }
+        if (s != NULL) {
+            ESP_LOGD(TAG, "Closing least recently used session %d", s->fd);
+            close_session(srv, s);
+        }
+    }
+    if (s == NULL) {
+        ESP_LOGW(TAG, "No free session, refusing connection");
+        close(fd);
+        return;
+    }
+
+    struct timeval recv_timeout = { .tv_sec = srv->config.recv_wait_timeout };
+    struct timeval send_timeout = { .tv_sec = srv->config.send_wait_timeout };
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    // Headers and body go out in separate sends: do not let Nagle delay the body
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    pthread_mutex_lock(&srv->lock);
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->send_fn = httpd_default_send;
+    pthread_mutex_unlock(&srv->lock);
+    s->lru = ++srv->lru_clock;
+    if (srv->config.open_fn != NULL && srv->config.open_fn(srv, fd) != ESP_OK) {
+        close_session(srv, s);
+    }
+}
+
+static void run_work(server_t *srv) {
+    char drain[64];
+    while (read(srv->wake_fds[0], drain, sizeof(drain)) > 0) {
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    work_t *work = srv->work_head;
+    srv->work_head = srv->work_tail = NULL;
+    pthread_mutex_unlock(&srv->lock);
+
+    while (work != NULL) {
+        work_t *next = work->next;
+        work->fn(work->arg);
+        free(work);
+        work = next;
+    }
+}
+
+static void *server_thread(void *arg) {
+    server_t *srv = arg;
+    size_t max = srv->config.max_open_sockets;
+    struct pollfd *fds = calloc(max + 2, sizeof(*fds));
+    session_t **polled = calloc(max, sizeof(*polled));
+
+    while (fds != NULL && polled != NULL) {
+        pthread_mutex_lock(&srv->lock);
+        bool running = srv->running;
+        pthread_mutex_unlock(&srv->lock);
+        if (!running) {
+            break;
+        }
+
+        size_t count = 0;
+        for (size_t i = 0; i < max; i++) {
+            session_t *s = &srv->sessions[i];
+            pthread_mutex_lock(&srv->lock);
+            bool closing = s->fd >= 0 && s->close_pending && !s->busy;
+            pthread_mutex_unlock(&srv->lock);
+            if (closing) {
+                close_session(srv, s);
+            }
+            // Requests left in the buffer while an async handler had the session
+            handle_buffered(srv, s);
+            if (sess_idle(srv, s)) {
+                polled[count] = s;
+                fds[2 + count].fd = s->fd;
+                fds[2 + count].events = POLLIN;
+                count++;
+            }
+        }
+
+        fds[0].fd = srv->wake_fds[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = srv->listen_fd;
+        fds[1].events = POLLIN;
+        if (poll(fds, count + 2, -1) < 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            run_work(srv);
+        }
+        for (size_t i = 0; i < count; i++) {
+            session_t *s = polled[i];
+            if ((fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR)) && s->fd == fds[2 + i].fd &&
+                sess_idle(srv, s)) {
+                handle_readable(srv, s);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            accept_session(srv);
+        }
+    }
+
+    free(fds);
+    free(polled);
+    return NULL;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    server_t *srv = handle;
+    if (srv == NULL || work == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    work_t *item = malloc(sizeof(*item));
+    if (item == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    item->fn = work;
+    item->arg = arg;
+    item->next = NULL;
+
+    pthread_mutex_lock(&srv->lock);
+    if (!srv->running) {
+        pthread_mutex_unlock(&srv->lock);
+        free(item);
+        return ESP_FAIL;
+    }
+    if (srv->work_tail != NULL) {
+        srv->work_tail->next = item;
+    } else {
+        srv->work_head = item;
+    }
+    srv->work_tail = item;
+    pthread_mutex_unlock(&srv->lock);
+    wake(srv);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    server_t *srv = handle;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = find_session(srv, sockfd);
+    if (s != NULL) {
+        s->close_pending = true;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    if (s == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    wake(srv);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func) {
+    server_t *srv = hd;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = find_session(srv, sockfd);
+    if (s != NULL) {
+        s->send_fn = send_func;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    return (s != NULL) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    server_t *srv = handle;
+    if (srv == NULL || uri_handler == NULL || uri_handler->uri == NULL || uri_handler->handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < srv->route_count; i++) {
+        if (srv->routes[i].method == uri_handler->method && strcmp(srv->routes[i].uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (srv->route_count >= srv->config.max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+
+    httpd_uri_t *route = &srv->routes[srv->route_count];
+    *route = *uri_handler;
+    route->uri = strdup(uri_handler->uri);
+    if (route->uri == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    srv->route_count++;
+    return ESP_OK;
+}
+
+static void free_server(server_t *srv) {
+    for (size_t i = 0; i < srv->route_count; i++) {
+        free((char *)srv->routes[i].uri);
+    }
+    while (srv->work_head != NULL) {
+        work_t *next = srv->work_head->next;
+        free(srv->work_head);
+        srv->work_head = next;
+    }
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+    }
+    if (srv->wake_fds[0] >= 0) {
+        close(srv->wake_fds[0]);
+        close(srv->wake_fds[1]);
+    }
+    pthread_mutex_destroy(&srv->lock);
+    free(srv->routes);
+    free(srv->sessions);
+    free(srv);
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if (handle == NULL || config == NULL || config->max_open_sockets == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    server_t *srv = calloc(1, sizeof(*srv));
+    if (srv == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    srv->config = *config;
+    srv->listen_fd = -1;
+    srv->wake_fds[0] = srv->wake_fds[1] = -1;
+    pthread_mutex_init(&srv->lock, NULL);
+    srv->routes = calloc(config->max_uri_handlers, sizeof(*srv->routes));
+    srv->sessions = calloc(config->max_open_sockets, sizeof(*srv->sessions));
+    if (srv->routes == NULL || srv->sessions == NULL) {
+        free_server(srv);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    for (size_t i = 0; i < config->max_open_sockets; i++) {
+        srv->sessions[i].fd = -1;
+    }
+
+    // A client closing early must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    // Loopback only: this is a test server, not meant to be reachable on the network
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port_set ? port_override : config->server_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    int one = 1;
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->listen_fd < 0 ||
+        setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(srv->listen_fd, config->backlog_conn) != 0 ||
+        getsockname(srv->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0 ||
+        pipe(srv->wake_fds) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %u: %s", ntohs(addr.sin_port), strerror(errno));
+        free_server(srv);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    fcntl(srv->wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(srv->wake_fds[1], F_SETFL, O_NONBLOCK);
+    last_port = ntohs(addr.sin_port);
+
+    srv->running = true;
+    if (pthread_create(&srv->thread, NULL, server_thread, srv) != 0) {
+        free_server(srv);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    *handle = srv;
+    return ESP_OK;
+}
+
+// Pending work is dropped, like the IDF does
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    server_t *srv = handle;
+    if (srv == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&srv->lock);
+    srv->running = false;
+    pthread_mutex_unlock(&srv->lock);
+    wake(srv);
+    pthread_join(srv->thread, NULL);
+
+    for (size_t i = 0; i < srv->config.max_open_sockets; i++) {
+        if (srv->sessions[i].fd >= 0) {
+            close_session(srv, &srv->sessions[i]);
+        }
+    }
+    if (srv->config.global_user_ctx_free_fn != NULL) {
+        srv->config.global_user_ctx_free_fn(srv->config.global_user_ctx);
+    }
+    free_server(srv);
+    return ESP_OK;
+}
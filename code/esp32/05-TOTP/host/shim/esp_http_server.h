@@ -0,0 +1,204 @@
+#ifndef HOST_ESP_HTTP_SERVER_H
+#define HOST_ESP_HTTP_SERVER_H
+
+// Host stand-in for ESP-IDF esp_http_server.h, over POSIX sockets.
+//
+// Keeps the behaviour the firmware depends on: one server thread runs the
+// handlers and queued work, at most max_open_sockets sessions (the least
+// recently used one is closed for a new client with lru_purge_enable),
+// keep-alive, chunked responses, async requests, send overrides, open/close
+// hooks and WebSocket frames. It does not try to be a complete HTTP server.
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define ESP_ERR_HTTPD_BASE              0xb000
+#define ESP_ERR_HTTPD_HANDLERS_FULL     (ESP_ERR_HTTPD_BASE + 1)
+#define ESP_ERR_HTTPD_HANDLER_EXISTS    (ESP_ERR_HTTPD_BASE + 2)
+#define ESP_ERR_HTTPD_INVALID_REQ       (ESP_ERR_HTTPD_BASE + 3)
+#define ESP_ERR_HTTPD_RESULT_TRUNC      (ESP_ERR_HTTPD_BASE + 4)
+#define ESP_ERR_HTTPD_RESP_HDR          (ESP_ERR_HTTPD_BASE + 5)
+#define ESP_ERR_HTTPD_RESP_SEND         (ESP_ERR_HTTPD_BASE + 6)
+#define ESP_ERR_HTTPD_ALLOC_MEM         (ESP_ERR_HTTPD_BASE + 7)
+#define ESP_ERR_HTTPD_TASK              (ESP_ERR_HTTPD_BASE + 8)
+
+#define HTTPD_MAX_REQ_HDR_LEN   CONFIG_HTTPD_MAX_REQ_HDR_LEN
+#define HTTPD_MAX_URI_LEN       CONFIG_HTTPD_MAX_URI_LEN
+#define HTTPD_RESP_USE_STRLEN   -1
+
+#define HTTPD_SOCK_ERR_FAIL     -1
+#define HTTPD_SOCK_ERR_INVALID  -2
+#define HTTPD_SOCK_ERR_TIMEOUT  -3
+
+typedef void *httpd_handle_t;
+
+// Same values as http_parser, which the IDF uses
+typedef enum http_method {
+    HTTP_DELETE = 0,
+    HTTP_GET = 1,
+    HTTP_HEAD = 2,
+    HTTP_POST = 3,
+    HTTP_PUT = 4,
+    HTTP_OPTIONS = 6,
+} httpd_method_t;
+
+/**
+ * @brief Method name ("GET"...), from http_parser.h in the IDF
+ */
+const char *http_method_str(enum http_method m);
+
+typedef void (*httpd_free_ctx_fn_t)(void *ctx);
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;                             // HTTP_GET... (0 for WebSocket frames)
+    const char uri[HTTPD_MAX_URI_LEN + 1];
+    size_t content_len;
+    void *aux;                              // Private to the server
+    void *user_ctx;                         // From the matched httpd_uri_t
+    void *sess_ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    bool ignore_sess_ctx_changes;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    bool is_websocket;
+    bool handle_ws_control_frames;
+    const char *supported_subprotocol;
+} httpd_uri_t;
+
+typedef esp_err_t (*httpd_open_func_t)(httpd_handle_t hd, int sockfd);
+typedef void (*httpd_close_func_t)(httpd_handle_t hd, int sockfd);
+typedef bool (*httpd_uri_match_func_t)(const char *reference_uri, const char *uri_to_match, size_t match_upto);
+typedef int (*httpd_send_func_t)(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags);
+typedef void (*httpd_work_fn_t)(void *arg);
+
+typedef struct httpd_config {
+    unsigned task_priority;
+    size_t stack_size;
+    BaseType_t core_id;
+    uint16_t server_port;
+    uint16_t ctrl_port;
+    uint16_t max_open_sockets;
+    uint16_t max_uri_handlers;
+    uint16_t max_resp_headers;
+    uint16_t backlog_conn;
+    bool lru_purge_enable;
+    uint16_t recv_wait_timeout;             // Seconds
+    uint16_t send_wait_timeout;             // Seconds
+    void *global_user_ctx;
+    httpd_free_ctx_fn_t global_user_ctx_free_fn;
+    httpd_open_func_t open_fn;
+    httpd_close_func_t close_fn;            // Must close the socket when set
+    httpd_uri_match_func_t uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {                        \
+        .task_priority      = tskIDLE_PRIORITY + 5,     \
+        .stack_size         = 4096,                     \
+        .core_id            = tskNO_AFFINITY,           \
+        .server_port        = 80,                       \
+        .ctrl_port          = 32768,                    \
+        .max_open_sockets   = 7,                        \
+        .max_uri_handlers   = 8,                        \
+        .max_resp_headers   = 8,                        \
+        .backlog_conn       = 5,                        \
+        .lru_purge_enable   = false,                    \
+        .recv_wait_timeout  = 5,                        \
+        .send_wait_timeout  = 5,                        \
+        .global_user_ctx    = NULL,                     \
+        .global_user_ctx_free_fn = NULL,                \
+        .open_fn            = NULL,                     \
+        .close_fn           = NULL,                     \
+        .uri_match_fn       = NULL,                     \
+    }
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_stop(httpd_handle_t handle);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func);
+int httpd_default_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags);
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto);
+
+int httpd_req_to_sockfd(httpd_req_t *r);
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out);
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+
+typedef enum {
+    HTTPD_400_BAD_REQUEST,
+    HTTPD_404_NOT_FOUND,
+    HTTPD_405_METHOD_NOT_ALLOWED,
+    HTTPD_408_REQ_TIMEOUT,
+    HTTPD_414_URI_TOO_LONG,
+    HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE,
+    HTTPD_500_INTERNAL_SERVER_ERROR,
+    HTTPD_501_METHOD_NOT_IMPLEMENTED,
+} httpd_err_code_t;
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+
+typedef enum {
+    HTTPD_WS_TYPE_CONTINUE = 0x0,
+    HTTPD_WS_TYPE_TEXT = 0x1,
+    HTTPD_WS_TYPE_BINARY = 0x2,
+    HTTPD_WS_TYPE_CLOSE = 0x8,
+    HTTPD_WS_TYPE_PING = 0x9,
+    HTTPD_WS_TYPE_PONG = 0xA,
+} httpd_ws_type_t;
+
+typedef enum {
+    HTTPD_WS_CLIENT_INVALID = 0x0,
+    HTTPD_WS_CLIENT_HTTP = 0x1,
+    HTTPD_WS_CLIENT_WEBSOCKET = 0x2,
+} httpd_ws_client_info_t;
+
+typedef struct httpd_ws_frame {
+    bool final;
+    bool fragmented;
+    httpd_ws_type_t type;
+    uint8_t *payload;
+    size_t len;
+} httpd_ws_frame_t;
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame);
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd);
+
+// Host only: the firmware always asks for port 80
+
+/**
+ * @brief Port the next httpd_start() listens on, instead of config->server_port
+ * @param port TCP port, 0 for any free one
+ */
+void httpd_host_set_port(uint16_t port);
+
+/**
+ * @brief Port the last server started listens on (the firmware keeps its handle private)
+ */
+uint16_t httpd_host_get_port(void);
+
+#endif // HOST_ESP_HTTP_SERVER_H
@@ -0,0 +1,47 @@
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+
+static int stderr_vprintf(const char *format, va_list args) {
+    return vfprintf(stderr, format, args);
+}
+
+static vprintf_like_t log_vprintf = stderr_vprintf;
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    vprintf_like_t previous = log_vprintf;
+    log_vprintf = func;
+    return previous;
+}
+
+static void log_output(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_vprintf(format, args);
+    va_end(args);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0) {
+        log_level = level;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    if (level > log_level) {
+        return;
+    }
+
+    // One output call per line so lines from different tasks do not interleave
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    log_output("%c (%lld) %s: %s\n", letters[level], (long long)(esp_timer_get_time() / 1000), tag, line);
+}
@@ -0,0 +1,45 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+// Host stand-in for ESP-IDF esp_log.h: lines go to stderr as "I (ms) tag: message"
+
+#include <stdarg.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+/**
+ * @brief Set the log level (only "*", all tags, is supported on the host)
+ * @param tag Tag, "*" for all
+ * @param level Most verbose level printed; ESP_LOG_WARN by default
+ */
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+typedef int (*vprintf_like_t)(const char *format, va_list args);
+
+/**
+ * @brief Route log output through func instead of stderr
+ * @param func Output function, called once per line
+ * @return The previous output function
+ */
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+
+/**
+ * @brief Print a log line if level is enabled
+ */
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, format, ...) esp_log_write(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) esp_log_write(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) esp_log_write(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) esp_log_write(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) esp_log_write(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif // HOST_ESP_LOG_H
@@ -0,0 +1,6 @@
+#include "esp_rom_crc.h"
+#include <zlib.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+    return crc32(crc, buf, len);
+}
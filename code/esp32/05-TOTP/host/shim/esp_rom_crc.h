@@ -0,0 +1,13 @@
+#ifndef HOST_ESP_ROM_CRC_H
+#define HOST_ESP_ROM_CRC_H
+
+// Host stand-in for the ROM CRC functions, backed by zlib
+
+#include <stdint.h>
+
+/**
+ * @brief CRC-32 (IEEE 802.3, as used by gzip), continuing from crc (0 to start)
+ */
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#endif // HOST_ESP_ROM_CRC_H
@@ -0,0 +1,34 @@
+#ifndef HOST_ESP_SNTP_H
+#define HOST_ESP_SNTP_H
+
+// Host stand-in for ESP-IDF esp_sntp.h: the host clock is already kept in
+// sync by the OS, so synchronization completes immediately
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+typedef enum {
+    SNTP_SYNC_MODE_IMMED,
+    SNTP_SYNC_MODE_SMOOTH,
+} sntp_sync_mode_t;
+
+typedef enum {
+    SNTP_SYNC_STATUS_RESET,
+    SNTP_SYNC_STATUS_COMPLETED,
+    SNTP_SYNC_STATUS_IN_PROGRESS,
+} sntp_sync_status_t;
+
+#define SNTP_OPMODE_POLL 0
+#define SNTP_OPMODE_LISTENONLY 1
+
+static inline void sntp_set_sync_mode(sntp_sync_mode_t mode) { (void)mode; }
+static inline void esp_sntp_setoperatingmode(uint8_t mode) { (void)mode; }
+static inline void esp_sntp_setservername(uint8_t idx, const char *server) { (void)idx; (void)server; }
+static inline void esp_sntp_init(void) {}
+static inline void esp_sntp_stop(void) {}
+static inline sntp_sync_status_t sntp_get_sync_status(void) { return SNTP_SYNC_STATUS_COMPLETED; }
+
+#endif // HOST_ESP_SNTP_H
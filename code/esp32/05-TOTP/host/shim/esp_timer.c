@@ -0,0 +1,18 @@
+#include "esp_timer.h"
+#include <time.h>
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t boot_us = 0;
+
+__attribute__((constructor)) static void timer_boot(void) {
+    boot_us = now_us();
+}
+
+int64_t esp_timer_get_time(void) {
+    return now_us() - boot_us;
+}
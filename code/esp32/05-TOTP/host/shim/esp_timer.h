@@ -0,0 +1,13 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+// Host stand-in for ESP-IDF esp_timer.h
+
+#include <stdint.h>
+
+/**
+ * @brief Microseconds since the process started (monotonic clock)
+ */
+int64_t esp_timer_get_time(void);
+
+#endif // HOST_ESP_TIMER_H
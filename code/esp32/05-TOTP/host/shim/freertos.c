@@ -0,0 +1,303 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    bool created;               // Started by xTaskCreate() (not an adopted thread)
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;            // Notification value (a counting semaphore)
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+    uint8_t items[];
+};
+
+struct host_mutex {
+    pthread_mutex_t lock;
+};
+
+static __thread struct host_task *current_task = NULL;
+
+// Absolute CLOCK_REALTIME deadline ticks (ms) from now
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+static struct host_task *task_new(void) {
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    return task;
+}
+
+static void task_free(struct host_task *task) {
+    pthread_mutex_destroy(&task->lock);
+    pthread_cond_destroy(&task->cond);
+    free(task);
+}
+
+// Tasks are only cancelled where FreeRTOS could delete them without harm:
+// while blocked (see enable_delete()), never while holding a lock
+static void *task_entry(void *arg) {
+    struct host_task *task = arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    current_task = task;
+    task->fn(task->arg);
+    // Returning from a task function is not allowed in FreeRTOS either
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static void enable_delete(void) {
+    if (current_task != NULL && current_task->created) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        pthread_testcancel();
+    }
+}
+
+static void disable_delete(void) {
+    if (current_task != NULL && current_task->created) {
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    struct host_task *task = task_new();
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->created = true;
+
+    // Set before the thread runs: the task may use its own handle right away
+    if (handle != NULL) {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        if (handle != NULL) {
+            *handle = NULL;
+        }
+        task_free(task);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        task = current_task;
+        if (task != NULL && task->created) {
+            pthread_detach(task->thread);
+            current_task = NULL;
+            task_free(task);
+            pthread_exit(NULL);
+        }
+        return;
+    }
+
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    task_free(task);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = { .tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000L };
+    enable_delete();
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+    disable_delete();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == NULL) {
+        current_task = task_new();
+        if (current_task != NULL) {
+            current_task->thread = pthread_self();
+        }
+    }
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+static void unlock_cleanup(void *lock) {
+    pthread_mutex_unlock(lock);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = deadline_after(ticks);
+
+    pthread_mutex_lock(&task->lock);
+    pthread_cleanup_push(unlock_cleanup, &task->lock);
+    enable_delete();
+    while (task->notify == 0 && ticks != 0) {
+        int ret = (ticks == portMAX_DELAY)
+                  ? pthread_cond_wait(&task->cond, &task->lock)
+                  : pthread_cond_timedwait(&task->cond, &task->lock, &deadline);
+        if (ret == ETIMEDOUT) {
+            break;
+        }
+    }
+    disable_delete();
+    pthread_cleanup_pop(0);
+
+    uint32_t value = task->notify;
+    if (value > 0) {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct host_queue *queue = calloc(1, sizeof(*queue) + (size_t)length * item_size);
+    if (queue == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue);
+}
+
+// Wait on cond until ready() or the timeout (queue lock held)
+static bool queue_wait(struct host_queue *queue, pthread_cond_t *cond, bool (*ready)(struct host_queue *),
+                       TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+    while (!ready(queue)) {
+        if (ticks == 0) {
+            return false;
+        }
+        int ret = (ticks == portMAX_DELAY)
+                  ? pthread_cond_wait(cond, &queue->lock)
+                  : pthread_cond_timedwait(cond, &queue->lock, &deadline);
+        if (ret == ETIMEDOUT && !ready(queue)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool has_space(struct host_queue *queue) {
+    return queue->count < queue->length;
+}
+
+static bool has_items(struct host_queue *queue) {
+    return queue->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    if (!queue_wait(queue, &queue->not_full, has_space, ticks)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFAIL;
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    if (!queue_wait(queue, &queue->not_empty, has_items, ticks)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFAIL;
+    }
+    memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct host_mutex *sem = malloc(sizeof(*sem));
+    if (sem != NULL) {
+        pthread_mutex_init(&sem->lock, NULL);
+    }
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return pthread_mutex_lock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+    }
+    if (ticks == 0) {
+        return pthread_mutex_trylock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+    }
+    struct timespec deadline = deadline_after(ticks);
+    return pthread_mutex_timedlock(&sem->lock, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pthread_mutex_unlock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+}
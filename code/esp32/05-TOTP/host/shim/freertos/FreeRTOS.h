@@ -0,0 +1,34 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Host stand-in for the FreeRTOS API used by the firmware, on POSIX threads.
+// One tick is one millisecond; priorities, stack sizes and cores are ignored.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+
+#define tskIDLE_PRIORITY        0
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+// Critical sections: a mutex instead of the ESP32 spinlock (not nestable)
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)  pthread_mutex_unlock(mux)
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,14 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+typedef struct host_mutex *SemaphoreHandle_t;
+
+// Mutexes only (not recursive), which is all the firmware uses
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#endif // HOST_FREERTOS_SEMPHR_H
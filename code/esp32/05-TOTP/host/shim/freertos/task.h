@@ -0,0 +1,34 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/**
+ * @brief Start a task on its own thread
+ *
+ * A task can be deleted by another one only while it is blocked in
+ * vTaskDelay() or ulTaskNotifyTake(), which is where the firmware's tasks
+ * spend their time.
+ */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle);
+
+/**
+ * @brief Delete a task, or the calling one with NULL (does not return then)
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+/**
+ * @brief Handle of the calling task (threads not started by xTaskCreate() get one too)
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,50 @@
+#ifndef HOST_MBEDTLS_SHA1_H
+#define HOST_MBEDTLS_SHA1_H
+
+// Host stand-in for mbedtls/sha1.h over OpenSSL's SHA1 API (plain structs,
+// so contexts can be copied like the mbedtls ones)
+
+#ifndef OPENSSL_API_COMPAT
+#define OPENSSL_API_COMPAT 0x10100000L    // SHA*_Init() and friends
+#endif
+#include <openssl/opensslv.h>
+#include <openssl/sha.h>
+#include <stddef.h>
+#include <string.h>
+
+// What the host benchmarks actually time (the ESP32 runs mbedtls)
+#ifndef HOST_MBEDTLS_BACKEND
+#define HOST_MBEDTLS_BACKEND OPENSSL_VERSION_TEXT
+#endif
+
+typedef SHA_CTX mbedtls_sha1_context;
+
+static inline void mbedtls_sha1_init(mbedtls_sha1_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha1_free(mbedtls_sha1_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha1_clone(mbedtls_sha1_context *dst, const mbedtls_sha1_context *src) {
+    *dst = *src;
+}
+
+static inline int mbedtls_sha1_starts(mbedtls_sha1_context *ctx) {
+    return SHA1_Init(ctx) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha1_update(mbedtls_sha1_context *ctx, const unsigned char *input, size_t len) {
+    return SHA1_Update(ctx, input, len) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha1_finish(mbedtls_sha1_context *ctx, unsigned char output[20]) {
+    return SHA1_Final(output, ctx) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha1(const unsigned char *input, size_t len, unsigned char output[20]) {
+    return SHA1(input, len, output) != NULL ? 0 : -1;
+}
+
+#endif // HOST_MBEDTLS_SHA1_H
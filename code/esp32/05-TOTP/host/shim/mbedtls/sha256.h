@@ -0,0 +1,52 @@
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+// Host stand-in for mbedtls/sha256.h over OpenSSL's SHA256 API (plain structs,
+// so contexts can be copied like the mbedtls ones)
+
+#ifndef OPENSSL_API_COMPAT
+#define OPENSSL_API_COMPAT 0x10100000L    // SHA*_Init() and friends
+#endif
+#include <openssl/opensslv.h>
+#include <openssl/sha.h>
+#include <stddef.h>
+#include <string.h>
+
+// What the host benchmarks actually time (the ESP32 runs mbedtls)
+#ifndef HOST_MBEDTLS_BACKEND
+#define HOST_MBEDTLS_BACKEND OPENSSL_VERSION_TEXT
+#endif
+
+typedef SHA256_CTX mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src) {
+    *dst = *src;
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) {
+    int ok = is224 ? SHA224_Init(ctx) : SHA256_Init(ctx);
+    return ok == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t len) {
+    return SHA256_Update(ctx, input, len) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32]) {
+    return SHA256_Final(output, ctx) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256(const unsigned char *input, size_t len, unsigned char output[32], int is224) {
+    unsigned char *ok = is224 ? SHA224(input, len, output) : SHA256(input, len, output);
+    return ok != NULL ? 0 : -1;
+}
+
+#endif // HOST_MBEDTLS_SHA256_H
@@ -0,0 +1,52 @@
+#ifndef HOST_MBEDTLS_SHA512_H
+#define HOST_MBEDTLS_SHA512_H
+
+// Host stand-in for mbedtls/sha512.h over OpenSSL's SHA512 API (plain structs,
+// so contexts can be copied like the mbedtls ones)
+
+#ifndef OPENSSL_API_COMPAT
+#define OPENSSL_API_COMPAT 0x10100000L    // SHA*_Init() and friends
+#endif
+#include <openssl/opensslv.h>
+#include <openssl/sha.h>
+#include <stddef.h>
+#include <string.h>
+
+// What the host benchmarks actually time (the ESP32 runs mbedtls)
+#ifndef HOST_MBEDTLS_BACKEND
+#define HOST_MBEDTLS_BACKEND OPENSSL_VERSION_TEXT
+#endif
+
+typedef SHA512_CTX mbedtls_sha512_context;
+
+static inline void mbedtls_sha512_init(mbedtls_sha512_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha512_free(mbedtls_sha512_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha512_clone(mbedtls_sha512_context *dst, const mbedtls_sha512_context *src) {
+    *dst = *src;
+}
+
+static inline int mbedtls_sha512_starts(mbedtls_sha512_context *ctx, int is384) {
+    int ok = is384 ? SHA384_Init(ctx) : SHA512_Init(ctx);
+    return ok == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha512_update(mbedtls_sha512_context *ctx, const unsigned char *input, size_t len) {
+    return SHA512_Update(ctx, input, len) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha512_finish(mbedtls_sha512_context *ctx, unsigned char output[64]) {
+    return SHA512_Final(output, ctx) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha512(const unsigned char *input, size_t len, unsigned char output[64], int is384) {
+    unsigned char *ok = is384 ? SHA384(input, len, output) : SHA512(input, len, output);
+    return ok != NULL ? 0 : -1;
+}
+
+#endif // HOST_MBEDTLS_SHA512_H
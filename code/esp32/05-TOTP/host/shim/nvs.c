@@ -0,0 +1,389 @@
+#include "nvs_flash.h"
+#include "nvs_host.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_HANDLES 8
+#define FILE_MAGIC "NVSH"
+
+typedef struct {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t *data;
+    size_t len;
+} entry_t;
+
+typedef struct {
+    bool used;
+    bool writable;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+} handle_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool initialized = false;
+static entry_t *entries = NULL;
+static size_t entry_count = 0;
+static handle_t handles[MAX_HANDLES];
+static char *file_path = NULL;
+static uint32_t commit_delay_us = 0;
+static uint32_t failing_commits = 0;
+static nvs_host_stats_t stats;
+
+static void clear_entries(void) {
+    for (size_t i = 0; i < entry_count; i++) {
+        free(entries[i].data);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+}
+
+static entry_t *find_entry(const char *ns, const char *key) {
+    for (size_t i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].ns, ns) == 0 && strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t put_entry(const char *ns, const char *key, const void *data, size_t len) {
+    uint8_t *copy = malloc(len > 0 ? len : 1);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, data, len);
+
+    entry_t *entry = find_entry(ns, key);
+    if (entry == NULL) {
+        entry_t *grown = realloc(entries, (entry_count + 1) * sizeof(*entries));
+        if (grown == NULL) {
+            free(copy);
+            return ESP_ERR_NO_MEM;
+        }
+        entries = grown;
+        entry = &entries[entry_count++];
+        memset(entry, 0, sizeof(*entry));
+        strcpy(entry->ns, ns);
+        strcpy(entry->key, key);
+    }
+    free(entry->data);
+    entry->data = copy;
+    entry->len = len;
+    return ESP_OK;
+}
+
+static void remove_entry(entry_t *entry) {
+    free(entry->data);
+    *entry = entries[--entry_count];
+}
+
+// File: magic, then per entry the NUL-padded namespace and key, a 32-bit
+// length and the value (host byte order: the file is not meant to be portable)
+static esp_err_t load_file(void) {
+    FILE *f = fopen(file_path, "rb");
+    if (f == NULL) {
+        return ESP_OK;  // Erased partition
+    }
+
+    esp_err_t err = ESP_OK;
+    char magic[4];
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, FILE_MAGIC, 4) != 0) {
+        err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+    }
+
+    entry_t header;
+    uint32_t len;
+    while (err == ESP_OK &&
+           fread(header.ns, 1, sizeof(header.ns), f) == sizeof(header.ns) &&
+           fread(header.key, 1, sizeof(header.key), f) == sizeof(header.key) &&
+           fread(&len, 1, sizeof(len), f) == sizeof(len)) {
+        uint8_t *data = malloc(len > 0 ? len : 1);
+        if (data == NULL || fread(data, 1, len, f) != len) {
+            err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+        } else {
+            header.ns[sizeof(header.ns) - 1] = '\0';
+            header.key[sizeof(header.key) - 1] = '\0';
+            err = put_entry(header.ns, header.key, data, len);
+        }
+        free(data);
+    }
+
+    fclose(f);
+    return err;
+}
+
+// Written to a temporary file and renamed, so a crash never leaves half a partition
+static esp_err_t save_file(void) {
+    size_t tmp_len = strlen(file_path) + 5;
+    char *tmp = malloc(tmp_len);
+    if (tmp == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(tmp, tmp_len, "%s.tmp", file_path);
+
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f != NULL && fwrite(FILE_MAGIC, 1, 4, f) == 4;
+    for (size_t i = 0; ok && i < entry_count; i++) {
+        char ns[NVS_KEY_NAME_MAX_SIZE] = { 0 };
+        char key[NVS_KEY_NAME_MAX_SIZE] = { 0 };
+        uint32_t len = entries[i].len;
+        strcpy(ns, entries[i].ns);
+        strcpy(key, entries[i].key);
+        ok = fwrite(ns, 1, sizeof(ns), f) == sizeof(ns) &&
+             fwrite(key, 1, sizeof(key), f) == sizeof(key) &&
+             fwrite(&len, 1, sizeof(len), f) == sizeof(len) &&
+             fwrite(entries[i].data, 1, len, f) == len;
+    }
+    if (f != NULL && fclose(f) != 0) {
+        ok = false;
+    }
+    if (ok && rename(tmp, file_path) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        remove(tmp);
+    }
+    free(tmp);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+static handle_t *get_handle(nvs_handle_t handle) {
+    if (!initialized || handle == 0 || handle > MAX_HANDLES || !handles[handle - 1].used) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static bool valid_name(const char *name) {
+    return name != NULL && name[0] != '\0' && strlen(name) < NVS_KEY_NAME_MAX_SIZE;
+}
+
+void nvs_host_set_path(const char *path) {
+    pthread_mutex_lock(&nvs_lock);
+    free(file_path);
+    file_path = (path != NULL) ? strdup(path) : NULL;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void nvs_host_set_commit_delay(uint32_t us) {
+    commit_delay_us = us;
+}
+
+void nvs_host_fail_commits(uint32_t count) {
+    pthread_mutex_lock(&nvs_lock);
+    failing_commits = count;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void nvs_host_get_stats(nvs_host_stats_t *out) {
+    pthread_mutex_lock(&nvs_lock);
+    *out = stats;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void nvs_host_reset_stats(void) {
+    pthread_mutex_lock(&nvs_lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_flash_init(void) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    if (!initialized) {
+        clear_entries();
+        err = (file_path != NULL) ? load_file() : ESP_OK;
+        if (err != ESP_OK) {
+            clear_entries();
+        }
+        initialized = (err == ESP_OK);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    if (!initialized) {
+        err = ESP_ERR_NVS_NOT_INITIALIZED;
+    } else {
+        // Without a backing file, RAM is the partition: keep it for the next init
+        if (file_path != NULL) {
+            clear_entries();
+        }
+        memset(handles, 0, sizeof(handles));
+        initialized = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    if (initialized) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        clear_entries();
+        if (file_path != NULL) {
+            remove(file_path);
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (!valid_name(namespace_name) || out_handle == NULL) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_ERR_NVS_NOT_INITIALIZED;
+    if (initialized) {
+        err = ESP_ERR_NO_MEM;
+        for (size_t i = 0; i < MAX_HANDLES; i++) {
+            if (!handles[i].used) {
+                handles[i].used = true;
+                handles[i].writable = (open_mode == NVS_READWRITE);
+                strcpy(handles[i].ns, namespace_name);
+                *out_handle = i + 1;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    if (h != NULL) {
+        h->used = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (key == NULL || key[0] == '\0') {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    esp_err_t err;
+    if (h == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        err = put_entry(h->ns, key, value, length);
+        if (err == ESP_OK) {
+            stats.writes++;
+            stats.bytes_written += length;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    if (key == NULL || length == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    entry_t *entry = (h != NULL) ? find_entry(h->ns, key) : NULL;
+    esp_err_t err = ESP_OK;
+    if (h == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (entry == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = entry->len;
+    } else if (*length < entry->len) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->data, entry->len);
+        *length = entry->len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    entry_t *entry = (h != NULL && key != NULL) ? find_entry(h->ns, key) : NULL;
+    esp_err_t err = ESP_OK;
+    if (h == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if (entry == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        remove_entry(entry);
+        stats.erases++;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    esp_err_t err = ESP_OK;
+    if (h == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        for (size_t i = 0; i < entry_count; ) {
+            if (strcmp(entries[i].ns, h->ns) == 0) {
+                remove_entry(&entries[i]);
+                stats.erases++;
+            } else {
+                i++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    if (get_handle(handle) == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (failing_commits > 0) {
+        failing_commits--;
+        err = ESP_FAIL;
+    } else {
+        stats.commits++;
+        if (file_path != NULL) {
+            err = save_file();
+        }
+    }
+    uint32_t delay = commit_delay_us;
+    pthread_mutex_unlock(&nvs_lock);
+
+    // Outside the lock: like a flash write, it only blocks the committing task
+    if (delay > 0) {
+        usleep(delay);
+    }
+    return err;
+}
@@ -0,0 +1,12 @@
+#ifndef HOST_NVS_FLASH_H
+#define HOST_NVS_FLASH_H
+
+// Host stand-in for ESP-IDF nvs_flash.h, see nvs_host.h
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_deinit(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif // HOST_NVS_FLASH_H
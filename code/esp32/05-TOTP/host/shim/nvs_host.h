@@ -0,0 +1,47 @@
+#ifndef HOST_NVS_HOST_H
+#define HOST_NVS_HOST_H
+
+// Host-only controls of the NVS emulator.
+//
+// Entries live in RAM; nvs_flash_init() loads them from the backing file and
+// every nvs_commit() rewrites it, so data survives a restart of the process
+// (as it survives a reboot on the device). Every set and erase is counted as a
+// flash write, so tests can check how much a storage operation costs.
+
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef struct {
+    uint32_t writes;            // nvs_set_blob() calls that stored a value
+    uint32_t erases;            // Keys removed by nvs_erase_key() / nvs_erase_all()
+    uint32_t commits;           // nvs_commit() calls
+    uint32_t bytes_written;     // Value bytes stored
+} nvs_host_stats_t;
+
+/**
+ * @brief Back the partition with a file (call before nvs_flash_init())
+ * @param path File path, or NULL to keep the data in RAM only (default)
+ */
+void nvs_host_set_path(const char *path);
+
+/**
+ * @brief Delay every commit, to emulate the flash write time of the device
+ * @param us Microseconds per nvs_commit() (0 by default)
+ */
+void nvs_host_set_commit_delay(uint32_t us);
+
+/**
+ * @brief Make the next commits fail with ESP_FAIL (without persisting anything)
+ * @param count Number of commits to fail
+ */
+void nvs_host_fail_commits(uint32_t count);
+
+/**
+ * @brief Counters since start or the last nvs_host_reset_stats()
+ * @param stats Output
+ */
+void nvs_host_get_stats(nvs_host_stats_t *stats);
+
+void nvs_host_reset_stats(void);
+
+#endif // HOST_NVS_HOST_H
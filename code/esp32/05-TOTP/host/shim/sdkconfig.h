@@ -0,0 +1,23 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Kconfig values for the host build: the defaults of main/Kconfig, except the
+// rate limits. A load generator is one client (one address) doing the work of
+// many phones, so its budgets are raised far past the Kconfig ranges: the
+// limiter still runs on every request but does not throttle the measurement
+
+#define CONFIG_GMAKER_TOTP_MAX_SERVICES 200
+#define CONFIG_GMAKER_TOTP_KEY_POOL_SIZE 8
+#define CONFIG_GMAKER_HOTP_COUNTER_RESERVE 64
+#define CONFIG_GMAKER_CODE_PUSH 1
+#define CONFIG_GMAKER_GZIP_JSON 1
+#define CONFIG_GMAKER_RATE_READ_PER_S 1000000
+#define CONFIG_GMAKER_RATE_READ_BURST 1000000
+#define CONFIG_GMAKER_RATE_WRITE_PER_MIN 60000000
+#define CONFIG_GMAKER_RATE_WRITE_BURST 1000000
+
+#define CONFIG_HTTPD_WS_SUPPORT 1
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+
+#endif // HOST_SDKCONFIG_H
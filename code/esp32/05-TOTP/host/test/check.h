@@ -0,0 +1,38 @@
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+// Minimal assertions for the host tests: a failed check is reported and the
+// test keeps going; check_result() is the process exit code.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond) do {                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                   \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do {                                         \
+        long long check_a = (long long)(actual);                                \
+        long long check_e = (long long)(expected);                              \
+        if (check_a != check_e) {                                               \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n",               \
+                    __FILE__, __LINE__, #actual, check_a, check_e);             \
+            check_failures++;                                                   \
+        }                                                                       \
+    } while (0)
+
+static inline int check_result(const char *name) {
+    if (check_failures > 0) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, check_failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+#endif // HOST_CHECK_H
@@ -0,0 +1,210 @@
+// gzip compressor: zlib inflates the output (in gzip mode, so the header,
+// CRC-32 and length are checked too) back to the exact input, for empty,
+// random, repetitive and JSON inputs written in chunks of any size;
+// compressible input shrinks, random input grows by a bounded amount, and an
+// output error is latched.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "check.h"
+#include "gzip_stream.h"
+
+#define INPUT_MAX 131072
+#define FUZZ_ROUNDS 300
+
+typedef struct {
+    uint8_t data[2 * INPUT_MAX];
+    size_t len;
+    int calls;
+    int fail_after;         // Output error after this many calls, -1 for never
+} sink_t;
+
+static esp_err_t sink_output(const char *data, size_t len, void *ctx) {
+    sink_t *s = ctx;
+    if (s->fail_after >= 0 && s->calls >= s->fail_after) {
+        return ESP_ERR_NO_MEM;
+    }
+    s->calls++;
+    if (len > GZIP_STREAM_OUT_SIZE) {
+        check_failures++;
+        fprintf(stderr, "output call of %zu bytes\n", len);
+    }
+    if (s->len + len <= sizeof(s->data)) {
+        memcpy(s->data + s->len, data, len);
+    }
+    s->len += len;
+    return ESP_OK;
+}
+
+static unsigned next_rand(unsigned *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 16) & 0x7FFF;
+}
+
+// Compress in pieces of chunk bytes (0: random sizes up to 700)
+static void compress_input(const uint8_t *input, size_t len, size_t chunk, unsigned *seed, sink_t *sink) {
+    static gzip_stream_t z;
+    sink->len = 0;
+    sink->calls = 0;
+    sink->fail_after = -1;
+    gzip_stream_init(&z, sink_output, sink);
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = chunk ? chunk : 1 + next_rand(seed) % 700;
+        if (n > len - pos) {
+            n = len - pos;
+        }
+        CHECK_EQ(gzip_stream_write(&z, (const char *)input + pos, n), ESP_OK);
+        pos += n;
+    }
+    CHECK_EQ(gzip_stream_finish(&z), ESP_OK);
+}
+
+// Inflate a whole gzip member; false if zlib rejects it or bytes are left over
+static bool inflate_gzip(const uint8_t *data, size_t len, uint8_t *out, size_t out_size, size_t *out_len) {
+    z_stream zs = { 0 };
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = out;
+    zs.avail_out = (uInt)out_size;
+    int ret = inflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    bool ok = ret == Z_STREAM_END && zs.avail_in == 0;
+    inflateEnd(&zs);
+    return ok;
+}
+
+// Compress with several chunkings and check each output inflates to the input;
+// returns the compressed size of the last one
+static size_t check_round_trip(const char *name, const uint8_t *input, size_t len, unsigned *seed) {
+    static sink_t sink;
+    static uint8_t inflated[INPUT_MAX + 1];
+    static const size_t chunks[] = { INPUT_MAX, 1, 3, GZIP_STREAM_WINDOW, 0 };
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        compress_input(input, len, chunks[i], seed, &sink);
+        CHECK(sink.len >= 18 && sink.len <= sizeof(sink.data));
+        CHECK(sink.data[0] == 0x1f && sink.data[1] == 0x8b && sink.data[2] == 8);
+
+        size_t out_len = 0;
+        bool ok = inflate_gzip(sink.data, sink.len, inflated, sizeof(inflated), &out_len);
+        if (!ok || out_len != len || memcmp(inflated, input, len) != 0) {
+            fprintf(stderr, "%s: chunk %zu, %zu bytes: inflate %s, %zu bytes out\n",
+                    name, chunks[i], len, ok ? "ok" : "failed", out_len);
+            check_failures++;
+        }
+    }
+    return sink.len;
+}
+
+static void check_fixed_inputs(unsigned *seed) {
+    static uint8_t input[INPUT_MAX];
+
+    check_round_trip("empty", input, 0, seed);
+    check_round_trip("one byte", (const uint8_t *)"a", 1, seed);
+
+    // Incompressible: fixed Huffman codes spend at most 9 bits per literal
+    for (size_t i = 0; i < 20000; i++) {
+        input[i] = (uint8_t)next_rand(seed);
+    }
+    size_t size = check_round_trip("random", input, 20000, seed);
+    CHECK(size <= 20000 + 20000 / 8 + 64);
+
+    // One byte repeated: back-to-back maximum-length matches
+    memset(input, 'x', INPUT_MAX);
+    size = check_round_trip("run", input, INPUT_MAX, seed);
+    CHECK(size < INPUT_MAX / 100);
+
+    // Repeats around the window size: matches at the largest distances, and
+    // none past the window
+    static const size_t periods[] = { 2, 3, 7, 258, 259, GZIP_STREAM_WINDOW - 1, GZIP_STREAM_WINDOW,
+                                      GZIP_STREAM_WINDOW + 1, 2 * GZIP_STREAM_WINDOW + 5 };
+    uint8_t pattern[2 * GZIP_STREAM_WINDOW + 5];
+    for (size_t i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t)next_rand(seed);
+    }
+    for (size_t p = 0; p < sizeof(periods) / sizeof(periods[0]); p++) {
+        char name[32];
+        snprintf(name, sizeof(name), "period %zu", periods[p]);
+        for (size_t i = 0; i < 30000; i++) {
+            input[i] = pattern[i % periods[p]];
+        }
+        size = check_round_trip(name, input, 30000, seed);
+        if (periods[p] <= GZIP_STREAM_WINDOW) {
+            CHECK(size < 30000 / 4);
+        }
+    }
+
+    // A service list as /api/services sends it
+    size_t len = 0;
+    len += snprintf((char *)input + len, INPUT_MAX - len, "[");
+    for (int i = 0; i < 150; i++) {
+        len += snprintf((char *)input + len, INPUT_MAX - len,
+                        "%s{\"id\":%d,\"service_name\":\"Service %d\",\"account\":\"user%d@example.com\","
+                        "\"issuer\":\"Issuer %d\",\"digits\":6,\"period\":30,\"algorithm\":\"SHA1\","
+                        "\"type\":\"totp\"}", i ? "," : "", i + 1, i, i * 7, i % 5);
+    }
+    len += snprintf((char *)input + len, INPUT_MAX - len, "]");
+    size = check_round_trip("service list", input, len, seed);
+    CHECK(size < len / 3);
+}
+
+// Random lengths, from a small alphabet so literals and matches mix
+static void check_fuzz(unsigned *seed) {
+    static uint8_t input[INPUT_MAX];
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        size_t len = next_rand(seed) * 4 % 40000;
+        unsigned alphabet = 2 + next_rand(seed) % 60;
+        for (size_t i = 0; i < len; i++) {
+            // Copies from earlier in the input, near or far, between literals
+            if (i > 16 && next_rand(seed) % 4 == 0) {
+                size_t dist = 1 + next_rand(seed) % (i < 5000 ? i : 5000);
+                size_t copy = 3 + next_rand(seed) % 300;
+                for (size_t k = 0; k < copy && i < len; k++, i++) {
+                    input[i] = input[i - dist];
+                }
+                i--;
+            } else {
+                input[i] = (uint8_t)('!' + next_rand(seed) % alphabet);
+            }
+        }
+        check_round_trip("fuzz", input, len, seed);
+    }
+}
+
+// The first output error stops the stream and is returned from then on
+static void check_output_error(void) {
+    static uint8_t input[20000];
+    static sink_t sink;
+    static gzip_stream_t z;
+    unsigned seed = 99;
+    for (size_t i = 0; i < sizeof(input); i++) {
+        input[i] = (uint8_t)next_rand(&seed);
+    }
+
+    sink.len = 0;
+    sink.calls = 0;
+    sink.fail_after = 2;
+    gzip_stream_init(&z, sink_output, &sink);
+    esp_err_t err = ESP_OK;
+    for (size_t pos = 0; pos < sizeof(input) && err == ESP_OK; pos += 1000) {
+        err = gzip_stream_write(&z, (const char *)input + pos, 1000);
+    }
+    CHECK_EQ(err, ESP_ERR_NO_MEM);
+    CHECK_EQ(gzip_stream_write(&z, "more", 4), ESP_ERR_NO_MEM);
+    CHECK_EQ(gzip_stream_finish(&z), ESP_ERR_NO_MEM);
+    CHECK_EQ(sink.calls, 2);
+}
+
+int main(void) {
+    unsigned seed = 4127;
+    check_fixed_inputs(&seed);
+    check_fuzz(&seed);
+    check_output_error();
+    return check_result("test_gzip_stream");
+}
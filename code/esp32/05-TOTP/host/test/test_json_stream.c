@@ -0,0 +1,404 @@
+// JSON reader and writer: exact escaping, identical output whatever the
+// buffer size, reader tokens and errors, json_find_string(), random
+// documents written then read back, and a mutation fuzz of the reader.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "json_stream.h"
+
+#define ROUND_TRIPS 5000
+#define FUZZ_ROUNDS 100000
+
+// Output collected through a flush callback
+
+typedef struct {
+    char data[65536];
+    size_t len;
+    int flushes;
+    int fail_after;         // Flush error after this many flushes, -1 for never
+} sink_t;
+
+static esp_err_t sink_flush(const char *data, size_t len, void *ctx) {
+    sink_t *s = ctx;
+    if (s->fail_after >= 0 && s->flushes >= s->fail_after) {
+        return ESP_FAIL;
+    }
+    s->flushes++;
+    if (s->len + len <= sizeof(s->data)) {
+        memcpy(s->data + s->len, data, len);
+    }
+    s->len += len;
+    return ESP_OK;
+}
+
+static void write_sample(json_writer_t *w) {
+    json_writer_begin_object(w);
+    json_writer_key(w, "na\"me");
+    json_writer_string_n(w, "a\\b\n\x01\x1f/\xc3\xa9\0z", 11);
+    json_writer_key(w, "n");
+    json_writer_uint(w, UINT64_MAX);
+    json_writer_key(w, "ok");
+    json_writer_bool(w, true);
+    json_writer_key(w, "list");
+    json_writer_begin_array(w);
+    json_writer_uint(w, 0);
+    json_writer_begin_object(w);
+    json_writer_end_object(w);
+    json_writer_begin_array(w);
+    json_writer_end_array(w);
+    json_writer_raw(w, ",null", 5);
+    json_writer_string(w, "\t\r\b\f");
+    json_writer_end_array(w);
+    json_writer_end_object(w);
+}
+
+static const char sample_json[] =
+    "{\"na\\\"me\":\"a\\\\b\\n\\u0001\\u001f/\xc3\xa9\\u0000z\",\"n\":18446744073709551615,\"ok\":true,"
+    "\"list\":[0,{},[],null,\"\\t\\r\\b\\f\"]}";
+
+static void check_writer(void) {
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    write_sample(&w);
+    CHECK_EQ(json_writer_finish(&w), ESP_OK);
+    CHECK(strcmp(buf, sample_json) == 0);
+    CHECK_EQ(json_writer_length(&w), strlen(sample_json));
+
+    // Counting only
+    json_writer_init(&w, NULL, 0, NULL, NULL);
+    write_sample(&w);
+    CHECK_EQ(json_writer_finish(&w), ESP_OK);
+    CHECK_EQ(json_writer_length(&w), strlen(sample_json));
+
+    // Every buffer size gives the same bytes through the flush callback
+    for (size_t size = 1; size <= 40; size++) {
+        sink_t sink = { .fail_after = -1 };
+        char small[40];
+        json_writer_init(&w, small, size, sink_flush, &sink);
+        write_sample(&w);
+        CHECK_EQ(json_writer_finish(&w), ESP_OK);
+        CHECK_EQ(sink.len, strlen(sample_json));
+        CHECK(memcmp(sink.data, sample_json, sink.len) == 0);
+    }
+
+    // A fixed buffer one byte short overflows, but still counts the whole output
+    json_writer_init(&w, buf, strlen(sample_json), NULL, NULL);
+    write_sample(&w);
+    CHECK_EQ(json_writer_finish(&w), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(json_writer_length(&w), strlen(sample_json));
+
+    // A flush error is latched and returned
+    sink_t failing = { .fail_after = 2 };
+    char small[8];
+    json_writer_init(&w, small, sizeof(small), sink_flush, &failing);
+    write_sample(&w);
+    CHECK_EQ(json_writer_error(&w), ESP_FAIL);
+    CHECK_EQ(json_writer_finish(&w), ESP_FAIL);
+    CHECK_EQ(failing.len, 2 * sizeof(small));
+
+    // Unbalanced or too deep nesting is an error
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    json_writer_end_array(&w);
+    CHECK_EQ(json_writer_finish(&w), ESP_ERR_INVALID_STATE);
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    for (int i = 0; i <= JSON_MAX_DEPTH; i++) {
+        json_writer_begin_array(&w);
+    }
+    CHECK_EQ(json_writer_error(&w), ESP_ERR_INVALID_STATE);
+}
+
+static void check_reader_tokens(void) {
+    static const char doc[] = " {\"a\" : [1, -2.5e+3, \"x\\\"y\", true, false, null, {}],\n\t\"b\":{\"c\":[]} } ";
+    static const json_token_type_t expected[] = {
+        JSON_TOK_OBJECT_START, JSON_TOK_KEY, JSON_TOK_ARRAY_START, JSON_TOK_NUMBER, JSON_TOK_NUMBER,
+        JSON_TOK_STRING, JSON_TOK_TRUE, JSON_TOK_FALSE, JSON_TOK_NULL, JSON_TOK_OBJECT_START,
+        JSON_TOK_OBJECT_END, JSON_TOK_ARRAY_END, JSON_TOK_KEY, JSON_TOK_OBJECT_START, JSON_TOK_KEY,
+        JSON_TOK_ARRAY_START, JSON_TOK_ARRAY_END, JSON_TOK_OBJECT_END, JSON_TOK_OBJECT_END, JSON_TOK_END,
+    };
+    json_reader_t r;
+    json_token_t tok;
+    json_reader_init(&r, doc, strlen(doc));
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        CHECK_EQ(json_reader_next(&r, &tok), expected[i]);
+        if (i == 4) {
+            CHECK(tok.len == 7 && memcmp(tok.start, "-2.5e+3", 7) == 0);
+        }
+        if (i == 5) {
+            char out[8];
+            CHECK_EQ(json_token_string(&tok, out, sizeof(out)), 3);
+            CHECK(strcmp(out, "x\"y") == 0);
+            CHECK_EQ(json_token_string(&tok, out, 3), -1);
+        }
+    }
+
+    // Skip a whole container, then carry on
+    json_reader_init(&r, doc, strlen(doc));
+    json_reader_next(&r, &tok);
+    json_reader_next(&r, &tok);
+    CHECK_EQ(json_reader_next(&r, &tok), JSON_TOK_ARRAY_START);
+    CHECK_EQ(json_reader_skip(&r, &tok), ESP_OK);
+    CHECK_EQ(json_reader_next(&r, &tok), JSON_TOK_KEY);
+    CHECK(json_token_equals(&tok, "b"));
+
+    // \u escapes, surrogate pairs included, become UTF-8
+    static const char unicode[] = "\"\\u00e9\\u20ac\\ud83d\\ude00\\/\"";
+    json_reader_init(&r, unicode, strlen(unicode));
+    CHECK_EQ(json_reader_next(&r, &tok), JSON_TOK_STRING);
+    char out[32];
+    CHECK_EQ(json_token_string(&tok, out, sizeof(out)), 10);
+    CHECK(strcmp(out, "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80/") == 0);
+}
+
+// Reads doc to the end: true if it reached JSON_TOK_END
+static bool read_all(const char *doc, size_t len) {
+    json_reader_t r;
+    json_token_t tok;
+    json_reader_init(&r, doc, len);
+    for (size_t i = 0; i <= len + 1; i++) {
+        json_token_type_t type = json_reader_next(&r, &tok);
+        if (type == JSON_TOK_END) {
+            return true;
+        }
+        if (type == JSON_TOK_ERROR) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static void check_reader_errors(void) {
+    static const char *bad[] = {
+        "", " ", "{", "}", "[1,]", "[1 2]", "{\"a\"}", "{\"a\":1,}", "{1:2}", "{\"a\":1]", "[1}",
+        "\"abc", "\"\\x\"", "\"\\u12g4\"", "\"\\u12\"", "\"a\nb\"", "tru", "nul", "1 2", "]", "{} {}",
+        "[\"a\":1]", ",", "{\"a\" 1}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (read_all(bad[i], strlen(bad[i]))) {
+            fprintf(stderr, "accepted: %s\n", bad[i]);
+            CHECK(false);
+        }
+    }
+
+    static const char *good[] = { "0", "\"\"", "[]", "{}", " [ [ ] , { } ] ", "{\"\":null}", "-0" };
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        CHECK(read_all(good[i], strlen(good[i])));
+    }
+
+    // JSON_MAX_DEPTH levels are fine, one more is not
+    char deep[2 * JSON_MAX_DEPTH + 3];
+    memset(deep, '[', JSON_MAX_DEPTH);
+    memset(deep + JSON_MAX_DEPTH, ']', JSON_MAX_DEPTH);
+    CHECK(read_all(deep, 2 * JSON_MAX_DEPTH));
+    memset(deep, '[', JSON_MAX_DEPTH + 1);
+    memset(deep + JSON_MAX_DEPTH + 1, ']', JSON_MAX_DEPTH + 1);
+    CHECK(!read_all(deep, 2 * JSON_MAX_DEPTH + 2));
+
+    // The length bounds the input, a NUL does not end it
+    CHECK(!read_all("[1]", 2));
+    CHECK(!read_all("[1]\0", 4));
+}
+
+static void check_find_string(void) {
+    static const char doc[] = "{\"x\":{\"uri\":\"nested\"},\"n\":1,\"uri\":\"otpauth://totp/A%20B?s=\\u0041\"}";
+    char out[64];
+    CHECK_EQ(json_find_string(doc, strlen(doc), "uri", out, sizeof(out)), ESP_OK);
+    CHECK(strcmp(out, "otpauth://totp/A%20B?s=A") == 0);
+    CHECK_EQ(json_find_string(doc, strlen(doc), "uri", out, 10), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(json_find_string(doc, strlen(doc), "n", out, sizeof(out)), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(json_find_string(doc, strlen(doc), "missing", out, sizeof(out)), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(json_find_string("[\"uri\"]", 7, "uri", out, sizeof(out)), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(json_find_string("{\"a\":[1,}", 9, "uri", out, sizeof(out)), ESP_ERR_INVALID_ARG);
+
+    // Unescaping in place, as the server does with its receive buffer
+    char body[] = "{\"uri\":\"a\\\"b\\\\c\"}";
+    CHECK_EQ(json_find_string(body, strlen(body), "uri", body, sizeof(body)), ESP_OK);
+    CHECK(strcmp(body, "a\"b\\c") == 0);
+}
+
+// Random documents: the writer output, read back, gives the same values
+
+typedef struct {
+    json_token_type_t type;
+    char text[40];              // Unescaped string or number digits
+    size_t len;
+} expected_token_t;
+
+typedef struct {
+    expected_token_t tokens[512];
+    size_t count;
+} expected_t;
+
+static expected_token_t *expect(expected_t *e, json_token_type_t type) {
+    expected_token_t *t = &e->tokens[e->count++];
+    t->type = type;
+    t->len = 0;
+    return t;
+}
+
+static void random_bytes(unsigned *seed, char *dst, size_t *len, bool with_nul) {
+    *len = (size_t)rand_r(seed) % 32;
+    for (size_t i = 0; i < *len; i++) {
+        int r = rand_r(seed) % 10;
+        dst[i] = (r < 6) ? (char)(' ' + rand_r(seed) % 95)
+               : (r < 8) ? "\"\\/\n\t\x01\x7f"[rand_r(seed) % 7]
+               : (char)(with_nul ? rand_r(seed) % 256 : 1 + rand_r(seed) % 255);
+    }
+    dst[*len] = '\0';
+}
+
+static void random_value(json_writer_t *w, expected_t *e, unsigned *seed, int depth) {
+    int kind = rand_r(seed) % ((depth < 6 && e->count < 400) ? 6 : 4);
+    switch (kind) {
+        case 0: {
+            expected_token_t *t = expect(e, JSON_TOK_STRING);
+            random_bytes(seed, t->text, &t->len, true);
+            json_writer_string_n(w, t->text, t->len);
+            break;
+        }
+        case 1: {
+            uint64_t v = ((uint64_t)rand_r(seed) << 33) ^ (uint64_t)rand_r(seed);
+            expected_token_t *t = expect(e, JSON_TOK_NUMBER);
+            t->len = (size_t)snprintf(t->text, sizeof(t->text), "%llu", (unsigned long long)v);
+            json_writer_uint(w, v);
+            break;
+        }
+        case 2:
+        case 3: {
+            bool v = kind == 2;
+            expect(e, v ? JSON_TOK_TRUE : JSON_TOK_FALSE);
+            json_writer_bool(w, v);
+            break;
+        }
+        case 4: {
+            expect(e, JSON_TOK_ARRAY_START);
+            json_writer_begin_array(w);
+            int n = rand_r(seed) % 5;
+            for (int i = 0; i < n; i++) {
+                random_value(w, e, seed, depth + 1);
+            }
+            expect(e, JSON_TOK_ARRAY_END);
+            json_writer_end_array(w);
+            break;
+        }
+        default: {
+            expect(e, JSON_TOK_OBJECT_START);
+            json_writer_begin_object(w);
+            int n = rand_r(seed) % 5;
+            for (int i = 0; i < n; i++) {
+                expected_token_t *t = expect(e, JSON_TOK_KEY);
+                random_bytes(seed, t->text, &t->len, false);     // Keys are C strings
+                json_writer_key(w, t->text);
+                random_value(w, e, seed, depth + 1);
+            }
+            expect(e, JSON_TOK_OBJECT_END);
+            json_writer_end_object(w);
+            break;
+        }
+    }
+}
+
+static void check_round_trips(unsigned *seed, char docs[][4096], size_t *doc_lens, size_t doc_count) {
+    static expected_t e;
+    for (int round = 0; round < ROUND_TRIPS && check_failures == 0; round++) {
+        char doc[16384];
+        json_writer_t w;
+        e.count = 0;
+        json_writer_init(&w, doc, sizeof(doc), NULL, NULL);
+        random_value(&w, &e, seed, 0);
+        CHECK_EQ(json_writer_finish(&w), ESP_OK);
+        size_t len = json_writer_length(&w);
+
+        json_reader_t r;
+        json_token_t tok;
+        json_reader_init(&r, doc, len);
+        for (size_t i = 0; i < e.count && check_failures == 0; i++) {
+            const expected_token_t *t = &e.tokens[i];
+            CHECK_EQ(json_reader_next(&r, &tok), t->type);
+            if (t->type == JSON_TOK_STRING || t->type == JSON_TOK_KEY) {
+                char out[64];
+                CHECK_EQ(json_token_string(&tok, out, sizeof(out)), t->len);
+                CHECK(memcmp(out, t->text, t->len) == 0);
+            } else if (t->type == JSON_TOK_NUMBER) {
+                CHECK(tok.len == t->len && memcmp(tok.start, t->text, t->len) == 0);
+            }
+        }
+        CHECK_EQ(json_reader_next(&r, &tok), JSON_TOK_END);
+        if (check_failures > 0) {
+            fprintf(stderr, "document: %.*s\n", (int)len, doc);
+        }
+
+        // Keep a few as fuzz seeds
+        if (round < (int)doc_count) {
+            doc_lens[round] = (len < 4096) ? len : 4095;
+            memcpy(docs[round], doc, doc_lens[round]);
+        }
+    }
+}
+
+// Mutated documents: the reader must stay inside the input, keep its
+// brackets balanced, and finish in at most one token per byte
+static void check_fuzz(unsigned *seed, char docs[][4096], const size_t *doc_lens, size_t doc_count) {
+    static const char specials[] = "{}[]\",:\\u0eE.-+ntf ";
+    for (int round = 0; round < FUZZ_ROUNDS && check_failures == 0; round++) {
+        size_t index = (size_t)rand_r(seed) % doc_count;
+        size_t len = doc_lens[index];
+        // Exactly len bytes on the heap, so reading past the end is caught by ASan
+        char *doc = malloc(len + 1);
+        memcpy(doc, docs[index], len);
+        int mutations = 1 + rand_r(seed) % 4;
+        for (int m = 0; m < mutations && len > 0; m++) {
+            size_t pos = (size_t)rand_r(seed) % len;
+            if (rand_r(seed) % 6 == 0) {
+                len = pos;
+            } else {
+                doc[pos] = (rand_r(seed) % 2) ? specials[rand_r(seed) % (sizeof(specials) - 1)]
+                                              : (char)rand_r(seed);
+            }
+        }
+
+        json_reader_t r;
+        json_token_t tok;
+        json_reader_init(&r, doc, len);
+        int depth = 0;
+        size_t tokens = 0;
+        json_token_type_t type;
+        do {
+            type = json_reader_next(&r, &tok);
+            CHECK(tok.start >= doc && tok.start + tok.len <= doc + len);
+            if (type == JSON_TOK_OBJECT_START || type == JSON_TOK_ARRAY_START) {
+                depth++;
+            } else if (type == JSON_TOK_OBJECT_END || type == JSON_TOK_ARRAY_END) {
+                depth--;
+            }
+            CHECK(depth >= 0 && depth <= JSON_MAX_DEPTH);
+            if (type == JSON_TOK_STRING || type == JSON_TOK_KEY) {
+                char out[4096];
+                CHECK(json_token_string(&tok, out, sizeof(out)) >= 0);
+            }
+        } while (type != JSON_TOK_END && type != JSON_TOK_ERROR && ++tokens <= len + 1);
+        CHECK(tokens <= len + 1);
+        if (type == JSON_TOK_END) {
+            CHECK_EQ(depth, 0);
+        }
+
+        char value[64];
+        json_find_string(doc, len, "uri", value, sizeof(value));
+        free(doc);
+    }
+}
+
+int main(void) {
+    static char docs[64][4096];
+    static size_t doc_lens[64];
+    unsigned seed = 8259;
+    check_writer();
+    check_reader_tokens();
+    check_reader_errors();
+    check_find_string();
+    check_round_trips(&seed, docs, doc_lens, 64);
+    check_fuzz(&seed, docs, doc_lens, 64);
+    return check_result("test_json_stream");
+}
@@ -0,0 +1,142 @@
+// Flash cost of the storage operations, counted by the NVS emulator: each
+// add, delete and clear commits once and rewrites only the records it touches,
+// however many services are stored.
+
+#include <stdio.h>
+#include <string.h>
+#include "check.h"
+#include "esp_log.h"
+#include "nvs_host.h"
+#include "totp/totp_storage.h"
+
+static totp_service_t make_service(int n) {
+    totp_service_t service = { 0 };
+    snprintf(service.service_name, sizeof(service.service_name), "Service%d", n);
+    snprintf(service.account, sizeof(service.account), "user%d@example.com", n);
+    snprintf(service.issuer, sizeof(service.issuer), "Service%d", n);
+    strcpy(service.secret, "JBSWY3DPEHPK3PXP");
+    service.digits = 6;
+    service.period = 30;
+    return service;
+}
+
+static void measure_start(void) {
+    nvs_host_reset_stats();
+}
+
+static nvs_host_stats_t measure_end(void) {
+    nvs_host_stats_t stats;
+    nvs_host_get_stats(&stats);
+    return stats;
+}
+
+// Fill the store to 'stored' services, then measure one add, delete and clear
+static void check_costs(int stored) {
+    CHECK_EQ(totp_storage_clear(), ESP_OK);
+    uint32_t ids[64];
+    for (int i = 0; i < stored; i++) {
+        totp_service_t service = make_service(i);
+        CHECK_EQ(totp_storage_add(&service, &ids[i]), ESP_OK);
+    }
+
+    // Add: the new record, the next ID and the count
+    totp_service_t service = make_service(stored);
+    uint32_t id;
+    measure_start();
+    CHECK_EQ(totp_storage_add(&service, &id), ESP_OK);
+    nvs_host_stats_t stats = measure_end();
+    CHECK_EQ(stats.commits, 1);
+    CHECK_EQ(stats.writes, 3);
+    CHECK_EQ(stats.erases, 0);
+    printf("%3d stored, add:    %u writes, %u erases, %u commits, %u bytes\n",
+           stored, stats.writes, stats.erases, stats.commits, stats.bytes_written);
+
+    // Delete the last service: nothing moves
+    measure_start();
+    CHECK_EQ(totp_storage_delete(id), ESP_OK);
+    stats = measure_end();
+    CHECK_EQ(stats.commits, 1);
+    CHECK_EQ(stats.writes, 1);
+    CHECK_EQ(stats.erases, 1);
+
+    // Delete from the middle: the last record moves into the hole, the count
+    // shrinks and the old last key is erased
+    measure_start();
+    CHECK_EQ(totp_storage_delete(ids[stored / 2]), ESP_OK);
+    stats = measure_end();
+    CHECK_EQ(stats.commits, 1);
+    CHECK_EQ(stats.writes, 2);
+    CHECK_EQ(stats.erases, 1);
+    printf("%3d stored, delete: %u writes, %u erases, %u commits, %u bytes\n",
+           stored, stats.writes, stats.erases, stats.commits, stats.bytes_written);
+
+    // Clear: the count, then one erase per record, in one commit
+    uint16_t remaining = totp_storage_count();
+    measure_start();
+    CHECK_EQ(totp_storage_clear(), ESP_OK);
+    stats = measure_end();
+    CHECK_EQ(stats.commits, 1);
+    CHECK_EQ(stats.writes, 1);
+    CHECK_EQ(stats.erases, remaining);
+    printf("%3d stored, clear:  %u writes, %u erases, %u commits\n",
+           remaining, stats.writes, stats.erases, stats.commits);
+}
+
+// An import batch is one commit for all its records
+static void check_batch(void) {
+    CHECK_EQ(totp_storage_clear(), ESP_OK);
+    totp_storage_batch_t batch;
+    totp_storage_batch_init(&batch);
+    for (int i = 0; i < 10; i++) {
+        totp_service_t service = make_service(i);
+        CHECK_EQ(totp_storage_batch_add(&batch, &service), ESP_OK);
+    }
+
+    uint16_t added = 0;
+    measure_start();
+    CHECK_EQ(totp_storage_batch_commit(&batch, &added), ESP_OK);
+    nvs_host_stats_t stats = measure_end();
+    totp_storage_batch_free(&batch);
+    CHECK_EQ(added, 10);
+    CHECK_EQ(stats.commits, 1);
+    CHECK_EQ(stats.writes, 10 + 2);
+}
+
+// The records written incrementally read back after a restart
+static void check_reload(void) {
+    CHECK_EQ(totp_storage_clear(), ESP_OK);
+    uint32_t ids[5];
+    for (int i = 0; i < 5; i++) {
+        totp_service_t service = make_service(i);
+        CHECK_EQ(totp_storage_add(&service, &ids[i]), ESP_OK);
+    }
+    CHECK_EQ(totp_storage_delete(ids[1]), ESP_OK);
+
+    CHECK_EQ(totp_storage_deinit(), ESP_OK);
+    CHECK_EQ(totp_storage_init(), ESP_OK);
+    CHECK_EQ(totp_storage_count(), 4);
+
+    totp_service_t service;
+    CHECK_EQ(totp_storage_get(ids[1], &service), ESP_ERR_NOT_FOUND);
+    for (int i = 0; i < 5; i++) {
+        if (i != 1) {
+            CHECK_EQ(totp_storage_get(ids[i], &service), ESP_OK);
+            CHECK_EQ(strcmp(service.account, make_service(i).account), 0);
+        }
+    }
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_host_set_path(NULL);
+    CHECK_EQ(totp_storage_init(), ESP_OK);
+
+    check_costs(3);
+    check_costs(20);
+    check_costs(60);
+    check_batch();
+    check_reload();
+
+    totp_storage_deinit();
+    return check_result("test_storage_nvs");
+}
@@ -0,0 +1,172 @@
+// RFC 6238 appendix B test vectors (SHA-1, SHA-256, SHA-512) through the precomputed key API and the
+// one-shot totp_generate_code(), the latter at the vector timestamps through
+// an injected time source.
+
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+#include "esp_log.h"
+#include "totp/totp_engine.h"
+
+typedef struct {
+    uint64_t time;
+    uint32_t sha1;
+    uint32_t sha256;
+    uint32_t sha512;
+} rfc6238_vector_t;
+
+// 8-digit codes, 30 s step
+static const rfc6238_vector_t vectors[] = {
+    { 59, 94287082, 46119246, 90693936 },
+    { 1111111109, 7081804, 68084774, 25091201 },
+    { 1111111111, 14050471, 67062674, 99943326 },
+    { 1234567890, 89005924, 91819424, 93441116 },
+    { 2000000000, 69279037, 90698825, 38618901 },
+    { 20000000000ULL, 65353130, 77737706, 47863826 },
+};
+#define VECTOR_COUNT (sizeof(vectors) / sizeof(vectors[0]))
+
+static const char sha1_secret[] = "12345678901234567890";
+static const char sha1_secret_b32[] = "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ";
+
+// The RFC repeats the ASCII digits up to the digest size for SHA-256 and SHA-512
+static const char sha256_secret[] = "12345678901234567890123456789012";
+static const char sha512_secret[] = "1234567890123456789012345678901234567890123456789012345678901234";
+
+static void check_key_vectors(void) {
+    totp_key_t raw;
+    totp_key_t b32;
+    CHECK_EQ(totp_key_init_raw(&raw, (const uint8_t *)sha1_secret, strlen(sha1_secret),
+                               TOTP_ALGO_SHA1, 8, 30), ESP_OK);
+    CHECK_EQ(totp_key_init(&b32, sha1_secret_b32, TOTP_ALGO_SHA1, 8, 30), ESP_OK);
+
+    for (size_t i = 0; i < VECTOR_COUNT; i++) {
+        uint32_t code = 0;
+        CHECK_EQ(totp_key_generate(&raw, vectors[i].time / 30, &code), ESP_OK);
+        CHECK_EQ(code, vectors[i].sha1);
+        CHECK_EQ(totp_key_generate(&b32, vectors[i].time / 30, &code), ESP_OK);
+        CHECK_EQ(code, vectors[i].sha1);
+    }
+
+    // Generating does not consume the precomputed state
+    uint32_t first = 0;
+    uint32_t again = 0;
+    CHECK_EQ(totp_key_generate(&raw, 1, &first), ESP_OK);
+    CHECK_EQ(totp_key_generate(&raw, 1, &again), ESP_OK);
+    CHECK_EQ(first, again);
+
+    // 6 digits is the 8-digit code truncated
+    totp_key_t six;
+    CHECK_EQ(totp_key_init(&six, sha1_secret_b32, TOTP_ALGO_SHA1, 6, 30), ESP_OK);
+    uint32_t code = 0;
+    CHECK_EQ(totp_key_generate(&six, vectors[0].time / 30, &code), ESP_OK);
+    CHECK_EQ(code, vectors[0].sha1 % 1000000);
+
+    totp_key_free(&raw);
+    totp_key_free(&b32);
+    totp_key_free(&six);
+}
+
+static void check_sha2_vectors(void) {
+    totp_key_t sha256;
+    totp_key_t sha512;
+    CHECK_EQ(totp_key_init_raw(&sha256, (const uint8_t *)sha256_secret, strlen(sha256_secret),
+                               TOTP_ALGO_SHA256, 8, 30), ESP_OK);
+    CHECK_EQ(totp_key_init_raw(&sha512, (const uint8_t *)sha512_secret, strlen(sha512_secret),
+                               TOTP_ALGO_SHA512, 8, 30), ESP_OK);
+
+    for (size_t i = 0; i < VECTOR_COUNT; i++) {
+        uint32_t code = 0;
+        CHECK_EQ(totp_key_generate(&sha256, vectors[i].time / 30, &code), ESP_OK);
+        CHECK_EQ(code, vectors[i].sha256);
+        CHECK_EQ(totp_key_generate(&sha512, vectors[i].time / 30, &code), ESP_OK);
+        CHECK_EQ(code, vectors[i].sha512);
+    }
+
+    // The batch call mixes algorithms and gives each key its own codes
+    totp_key_t keys[3];
+    CHECK_EQ(totp_key_init_raw(&keys[0], (const uint8_t *)sha256_secret, strlen(sha256_secret),
+                               TOTP_ALGO_SHA256, 8, 30), ESP_OK);
+    CHECK_EQ(totp_key_init(&keys[1], sha1_secret_b32, TOTP_ALGO_SHA1, 8, 30), ESP_OK);
+    CHECK_EQ(totp_key_init_raw(&keys[2], (const uint8_t *)sha512_secret, strlen(sha512_secret),
+                               TOTP_ALGO_SHA512, 8, 30), ESP_OK);
+    totp_code_result_t results[3];
+    CHECK_EQ(totp_generate_codes_batch(keys, 3, vectors[3].time, results), ESP_OK);
+    CHECK(results[0].valid && results[1].valid && results[2].valid);
+    CHECK_EQ(results[0].code, vectors[3].sha256);
+    CHECK_EQ(results[1].code, vectors[3].sha1);
+    CHECK_EQ(results[2].code, vectors[3].sha512);
+    uint32_t next = 0;
+    CHECK_EQ(totp_key_generate(&sha512, vectors[3].time / 30 + 1, &next), ESP_OK);
+    CHECK_EQ(results[2].next_code, next);
+
+    CHECK(strcmp(totp_algorithm_name(TOTP_ALGO_SHA256), "SHA256") == 0);
+    CHECK(strcmp(totp_algorithm_name(TOTP_ALGO_SHA512), "SHA512") == 0);
+
+    for (size_t i = 0; i < 3; i++) {
+        totp_key_free(&keys[i]);
+    }
+    totp_key_free(&sha256);
+    totp_key_free(&sha512);
+}
+
+static uint64_t fixed_time = 0;
+
+static uint64_t fixed_time_source(void) {
+    return fixed_time;
+}
+
+static int log_lines = 0;
+
+static int count_log_lines(const char *format, va_list args) {
+    log_lines++;
+    return 0;
+}
+
+static void check_time_source(void) {
+    totp_set_time_source(fixed_time_source);
+
+    // The code path must not log, even at the most verbose level
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+    vprintf_like_t previous = esp_log_set_vprintf(count_log_lines);
+
+    for (size_t i = 0; i < VECTOR_COUNT; i++) {
+        fixed_time = vectors[i].time;
+        CHECK_EQ(totp_get_timestamp(), vectors[i].time);
+
+        uint32_t code = 0;
+        CHECK_EQ(totp_generate_code(sha1_secret_b32, 30, 8, &code), ESP_OK);
+        CHECK_EQ(code, vectors[i].sha1);
+        CHECK_EQ(totp_get_code(sha1_secret_b32, 6, &code), ESP_OK);
+        CHECK_EQ(code, vectors[i].sha1 % 1000000);
+    }
+    CHECK_EQ(log_lines, 0);
+
+    esp_log_set_vprintf(previous);
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    fixed_time = 59;
+    CHECK_EQ(totp_get_remaining_seconds(30), 1);
+    fixed_time = 45;
+    CHECK_EQ(totp_get_remaining_seconds(30), 15);
+
+    // NULL goes back to the system clock
+    totp_set_time_source(NULL);
+    CHECK(totp_get_timestamp() > 1700000000ULL);
+}
+
+static void check_invalid_keys(void) {
+    totp_key_t key;
+    CHECK(totp_key_init(&key, "", TOTP_ALGO_SHA1, 6, 30) != ESP_OK);
+    CHECK(totp_key_init(&key, "NOT BASE32!", TOTP_ALGO_SHA1, 6, 30) != ESP_OK);
+    CHECK(totp_key_init_raw(&key, NULL, 0, TOTP_ALGO_SHA1, 6, 30) != ESP_OK);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    check_key_vectors();
+    check_sha2_vectors();
+    check_time_source();
+    check_invalid_keys();
+    return check_result("test_totp_engine");
+}
@@ -0,0 +1,396 @@
+// otpauth-migration decoder: a payload built by another encoder, random
+// payloads encoded here and fed in random chunks, skipped accounts, malformed
+// input, and a mutation fuzz that checks chunking never changes the outcome.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "esp_log.h"
+#include "base32.h"
+#include "totp/totp_migration.h"
+
+#define ROUND_TRIPS 3000
+#define FUZZ_ROUNDS 30000
+#define MAX_ENTRIES 12
+
+typedef struct {
+    totp_service_t services[MAX_ENTRIES];
+    int count;
+    int fail_at;            // Callback error on this entry, -1 for none
+} collected_t;
+
+static esp_err_t collect(const totp_service_t *service, void *ctx) {
+    collected_t *c = ctx;
+    if (c->count == c->fail_at) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (c->count < MAX_ENTRIES) {
+        c->services[c->count] = *service;
+    }
+    c->count++;
+    return ESP_OK;
+}
+
+// Feed uri in chunks of 1 to max_chunk bytes (0: all at once)
+static esp_err_t decode(const char *uri, size_t len, unsigned *seed, size_t max_chunk,
+                        collected_t *out, uint16_t *skipped) {
+    totp_migration_t m;
+    memset(out, 0, sizeof(*out));
+    out->fail_at = -1;
+    totp_migration_init(&m, collect, out);
+
+    esp_err_t err = ESP_OK;
+    size_t pos = 0;
+    while (pos < len && err == ESP_OK) {
+        size_t chunk = (max_chunk == 0) ? len : 1 + (size_t)rand_r(seed) % max_chunk;
+        chunk = (chunk > len - pos) ? len - pos : chunk;
+        err = totp_migration_feed(&m, uri + pos, chunk);
+        pos += chunk;
+    }
+    if (err == ESP_OK) {
+        err = totp_migration_finish(&m);
+    }
+    if (skipped != NULL) {
+        *skipped = m.skipped;
+    }
+    return err;
+}
+
+// Two accounts, encoded with Python's base64 and a hand-written protobuf writer
+static void check_known_payload(void) {
+    static const char uri[] =
+        "otpauth-migration://offline?data="
+        "CjUKCkhlbGxvId6tvu8SGEFDTUUgQ286am9obkBleGFtcGxlLmNvbRoHQUNNRSBDbyABKAEwAgo4ChQBAgMEBQYHCAkKCwwNDg8Q"
+        "ERITFBIRYWxpY2VAZXhhbXBsZS5jb20aBEJhbmsgAigCMAE4rAIQARgBIAAolZrvOg%3D%3D";
+    collected_t got;
+    uint16_t skipped = 0;
+    unsigned seed = 1;
+    CHECK_EQ(decode(uri, strlen(uri), &seed, 0, &got, &skipped), ESP_OK);
+    CHECK_EQ(got.count, 2);
+    CHECK_EQ(skipped, 0);
+
+    const totp_service_t *a = &got.services[0];
+    CHECK(strcmp(a->service_name, "ACME Co") == 0);
+    CHECK(strcmp(a->account, "john@example.com") == 0);
+    CHECK(strcmp(a->issuer, "ACME Co") == 0);
+    CHECK(strcmp(a->secret, "JBSWY3DPEHPK3PXP") == 0);
+    CHECK_EQ(a->algorithm, TOTP_ALGO_SHA1);
+    CHECK_EQ(a->digits, 6);
+    CHECK_EQ(a->period, 30);
+    CHECK_EQ(a->type, TOTP_TYPE_TOTP);
+
+    const totp_service_t *b = &got.services[1];
+    CHECK(strcmp(b->service_name, "Bank") == 0);
+    CHECK(strcmp(b->account, "alice@example.com") == 0);
+    CHECK(strcmp(b->issuer, "Bank") == 0);
+    CHECK(strcmp(b->secret, "AEBAGBAFAYDQQCIKBMGA2DQPCAIREEYU") == 0);
+    CHECK_EQ(b->algorithm, TOTP_ALGO_SHA256);
+    CHECK_EQ(b->digits, 8);
+    CHECK_EQ(b->type, TOTP_TYPE_HOTP);
+    CHECK_EQ(b->counter, 300);
+}
+
+// Protobuf and URI writer for the generated payloads
+
+typedef struct {
+    uint8_t data[4096];
+    size_t len;
+} buf_t;
+
+static void put_varint(buf_t *b, uint64_t v) {
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        b->data[b->len++] = byte | (v ? 0x80 : 0);
+    } while (v);
+}
+
+static void put_varint_field(buf_t *b, uint32_t field, uint64_t v) {
+    put_varint(b, (uint64_t)field << 3);
+    put_varint(b, v);
+}
+
+static void put_bytes_field(buf_t *b, uint32_t field, const void *data, size_t len) {
+    put_varint(b, ((uint64_t)field << 3) | 2);
+    put_varint(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+// Standard Base64 with padding, then '+', '/' and '=' percent-encoded at random
+static size_t to_uri(const buf_t *payload, char *uri, unsigned *seed) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t len = (size_t)sprintf(uri, "otpauth-migration://offline?data=");
+    char b64[6000];
+    size_t n = 0;
+    for (size_t i = 0; i < payload->len; i += 3) {
+        uint32_t v = (uint32_t)payload->data[i] << 16;
+        size_t left = payload->len - i;
+        if (left > 1) v |= (uint32_t)payload->data[i + 1] << 8;
+        if (left > 2) v |= payload->data[i + 2];
+        b64[n++] = alphabet[(v >> 18) & 63];
+        b64[n++] = alphabet[(v >> 12) & 63];
+        b64[n++] = (left > 1) ? alphabet[(v >> 6) & 63] : '=';
+        b64[n++] = (left > 2) ? alphabet[v & 63] : '=';
+    }
+    for (size_t i = 0; i < n; i++) {
+        char c = b64[i];
+        if ((c == '+' || c == '/' || c == '=') && rand_r(seed) % 2) {
+            len += (size_t)sprintf(uri + len, "%%%02X", (unsigned char)c);
+        } else if ((c == '+' || c == '/') && rand_r(seed) % 4 == 0) {
+            uri[len++] = (c == '+') ? '-' : '_';       // URL-safe alphabet
+        } else {
+            uri[len++] = c;
+        }
+    }
+    uri[len] = '\0';
+    return len;
+}
+
+static void random_text(unsigned *seed, char *dst, size_t max_len, bool allow_colon) {
+    size_t len = (size_t)rand_r(seed) % (max_len + 1);
+    for (size_t i = 0; i < len; i++) {
+        char c;
+        do {
+            c = (char)(' ' + rand_r(seed) % 95);
+        } while (c == ':' && !allow_colon);
+        dst[i] = c;
+    }
+    dst[len] = '\0';
+}
+
+static void check_round_trips(unsigned *seed) {
+    for (int round = 0; round < ROUND_TRIPS && check_failures == 0; round++) {
+        buf_t payload = { .len = 0 };
+        totp_service_t expected[MAX_ENTRIES];
+        int count = rand_r(seed) % (MAX_ENTRIES + 1);
+
+        for (int e = 0; e < count; e++) {
+            totp_service_t *s = &expected[e];
+            memset(s, 0, sizeof(*s));
+            uint8_t secret[TOTP_MIGRATION_MAX_SECRET];
+            size_t secret_len = 1 + (size_t)rand_r(seed) % sizeof(secret);
+            for (size_t i = 0; i < secret_len; i++) {
+                secret[i] = (uint8_t)rand_r(seed);
+            }
+            base32_encode(secret, secret_len, s->secret, sizeof(s->secret));
+
+            // "Issuer:account" or "account", with or without the issuer field
+            char name[MAX_SERVICE_NAME_LEN + MAX_ACCOUNT_NAME_LEN];
+            char issuer[MAX_ISSUER_LEN];
+            bool prefixed = rand_r(seed) % 2;
+            random_text(seed, s->account, 30, prefixed);       // Only the first ':' splits
+            random_text(seed, issuer, 30, true);
+            if (prefixed) {
+                random_text(seed, s->service_name, 30, false);
+                snprintf(name, sizeof(name), "%s:%s", s->service_name, s->account);
+            } else {
+                snprintf(name, sizeof(name), "%s", s->account);
+                strcpy(s->service_name, issuer[0] != '\0' ? issuer : s->account);
+            }
+            strcpy(s->issuer, issuer[0] != '\0' ? issuer : s->service_name);
+
+            uint32_t algorithm = rand_r(seed) % 4;      // Unspecified, SHA1, SHA256, SHA512
+            uint32_t digits = rand_r(seed) % 3;         // Unspecified, six, eight
+            uint32_t type = rand_r(seed) % 3;           // Unspecified, HOTP, TOTP
+            s->algorithm = (algorithm == 2) ? TOTP_ALGO_SHA256 : (algorithm == 3) ? TOTP_ALGO_SHA512 : TOTP_ALGO_SHA1;
+            s->digits = (digits == 2) ? 8 : 6;
+            s->period = 30;
+            s->type = (type == 1) ? TOTP_TYPE_HOTP : TOTP_TYPE_TOTP;
+            s->counter = (type == 1) ? ((uint64_t)rand_r(seed) << 20) : 0;
+
+            // Fields in protobuf order, plus an unknown one now and then
+            buf_t entry = { .len = 0 };
+            put_bytes_field(&entry, 1, secret, secret_len);
+            put_bytes_field(&entry, 2, name, strlen(name));
+            if (issuer[0] != '\0') {
+                put_bytes_field(&entry, 3, issuer, strlen(issuer));
+            }
+            if (algorithm) put_varint_field(&entry, 4, algorithm);
+            if (digits) put_varint_field(&entry, 5, digits);
+            if (type) put_varint_field(&entry, 6, type);
+            if (type == 1) put_varint_field(&entry, 7, s->counter);
+            if (rand_r(seed) % 4 == 0) {
+                put_bytes_field(&entry, 15, "future", 6);
+            }
+            put_bytes_field(&payload, 1, entry.data, entry.len);
+        }
+        put_varint_field(&payload, 2, 1);               // version
+        put_varint_field(&payload, 3, 1);               // batch_size
+        put_varint_field(&payload, 4, 0);               // batch_index
+        put_varint_field(&payload, 5, (uint32_t)rand_r(seed));
+
+        char uri[8192];
+        size_t len = to_uri(&payload, uri, seed);
+        collected_t got;
+        CHECK_EQ(decode(uri, len, seed, 1 + rand_r(seed) % 64, &got, NULL), ESP_OK);
+        CHECK_EQ(got.count, count);
+        for (int e = 0; e < count && e < got.count; e++) {
+            const totp_service_t *a = &got.services[e];
+            const totp_service_t *b = &expected[e];
+            CHECK(strcmp(a->service_name, b->service_name) == 0);
+            CHECK(strcmp(a->account, b->account) == 0);
+            CHECK(strcmp(a->issuer, b->issuer) == 0);
+            CHECK(strcmp(a->secret, b->secret) == 0);
+            CHECK_EQ(a->algorithm, b->algorithm);
+            CHECK_EQ(a->digits, b->digits);
+            CHECK_EQ(a->period, b->period);
+            CHECK_EQ(a->type, b->type);
+            CHECK(a->counter == b->counter);
+        }
+    }
+}
+
+// MD5 and keys too long to store are skipped, the rest still imported
+static void check_skipped(unsigned *seed) {
+    buf_t payload = { .len = 0 };
+    uint8_t secret[TOTP_MIGRATION_MAX_SECRET + 1];
+    memset(secret, 0x5A, sizeof(secret));
+
+    buf_t entry = { .len = 0 };
+    put_bytes_field(&entry, 1, secret, 10);
+    put_bytes_field(&entry, 2, "md5", 3);
+    put_varint_field(&entry, 4, 4);
+    put_bytes_field(&payload, 1, entry.data, entry.len);
+
+    entry.len = 0;
+    put_bytes_field(&entry, 1, secret, sizeof(secret));
+    put_bytes_field(&entry, 2, "long", 4);
+    put_bytes_field(&payload, 1, entry.data, entry.len);
+
+    entry.len = 0;
+    put_bytes_field(&entry, 1, secret, TOTP_MIGRATION_MAX_SECRET);
+    put_bytes_field(&entry, 2, "longest", 7);
+    put_bytes_field(&payload, 1, entry.data, entry.len);
+
+    char uri[2048];
+    size_t len = to_uri(&payload, uri, seed);
+    collected_t got;
+    uint16_t skipped = 0;
+    CHECK_EQ(decode(uri, len, seed, 7, &got, &skipped), ESP_OK);
+    CHECK_EQ(got.count, 1);
+    CHECK_EQ(skipped, 2);
+    CHECK(strcmp(got.services[0].account, "longest") == 0);
+    CHECK_EQ(strlen(got.services[0].secret), (TOTP_MIGRATION_MAX_SECRET * 8 + 4) / 5);
+
+    // A callback error stops decoding and is returned
+    totp_migration_t m;
+    collected_t out = { .fail_at = 0 };
+    totp_migration_init(&m, collect, &out);
+    CHECK_EQ(totp_migration_feed(&m, uri, len), ESP_ERR_NO_MEM);
+    CHECK_EQ(totp_migration_finish(&m), ESP_ERR_NO_MEM);
+}
+
+static void check_malformed(void) {
+    static const char *bad[] = {
+        "otpauth://totp/x?secret=JBSWY3DPEHPK3PXP",         // Not a migration URI
+        "otpauth-migration://offline?data",                 // No data parameter
+        "otpauth-migration://offline?data=CjUK*",           // Not Base64
+        "otpauth-migration://offline?data=CjUKCkhl",        // Entry cut short
+        "otpauth-migration://offline?data=CgIKBUFBQUFB",    // Field overruns the entry
+        "otpauth-migration://offline?data=%ZZ",             // Bad escape
+        "otpauth-migration://offline?data=Cg%3",            // Escape cut short
+        "otpauth-migration://offline?data=Bw",              // Field 0
+        "otpauth-migration://offline?data=Cw",              // Wire type 3
+        "otpauth-migration://offline?data=EP__________________w",  // Varint too long
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        collected_t got;
+        unsigned seed = (unsigned)i;
+        esp_err_t err = decode(bad[i], strlen(bad[i]), &seed, 3, &got, NULL);
+        if (err != ESP_ERR_INVALID_ARG) {
+            fprintf(stderr, "accepted: %s\n", bad[i]);
+        }
+        CHECK_EQ(err, ESP_ERR_INVALID_ARG);
+        CHECK_EQ(got.count, 0);
+    }
+
+    // Nothing but the prefix is an empty, valid payload; anything after '&' is ignored
+    collected_t got;
+    unsigned seed = 0;
+    const char *empty = "otpauth-migration://offline?data=";
+    CHECK_EQ(decode(empty, strlen(empty), &seed, 0, &got, NULL), ESP_OK);
+    const char *extra = "otpauth-migration://offline?data=&x=*";
+    CHECK_EQ(decode(extra, strlen(extra), &seed, 0, &got, NULL), ESP_OK);
+}
+
+static bool terminated(const char *field, size_t size) {
+    return memchr(field, '\0', size) != NULL;
+}
+
+// Mutated payloads: any outcome is allowed, but it must not depend on how the
+// input is split, and every reported account must be usable
+static void check_fuzz(unsigned *seed) {
+    buf_t payload = { .len = 0 };
+    for (int e = 0; e < 4; e++) {
+        buf_t entry = { .len = 0 };
+        put_bytes_field(&entry, 1, "0123456789abcdefghij", 10 + e * 3);
+        put_bytes_field(&entry, 2, "Issuer:account", 14);
+        put_bytes_field(&entry, 3, "Issuer", 6);
+        put_varint_field(&entry, 4, e);
+        put_varint_field(&entry, 5, 1 + e % 2);
+        put_varint_field(&entry, 6, 1 + e % 2);
+        put_varint_field(&entry, 7, 99);
+        put_bytes_field(&payload, 1, entry.data, entry.len);
+    }
+    put_varint_field(&payload, 2, 1);
+    char base[2048];
+    size_t base_len = to_uri(&payload, base, seed);
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/%=&";
+    const size_t prefix = strlen("otpauth-migration://offline?data=");
+
+    for (int round = 0; round < FUZZ_ROUNDS && check_failures == 0; round++) {
+        char uri[2048];
+        memcpy(uri, base, base_len + 1);
+        size_t len = base_len;
+        int mutations = 1 + rand_r(seed) % 4;
+        for (int i = 0; i < mutations; i++) {
+            size_t pos = prefix + (size_t)rand_r(seed) % (len - prefix);
+            if (rand_r(seed) % 8 == 0) {
+                len = pos;                                  // Truncate
+            } else {
+                uri[pos] = b64[rand_r(seed) % (sizeof(b64) - 1)];
+            }
+            if (len <= prefix) {
+                break;
+            }
+        }
+        uri[len] = '\0';
+
+        collected_t whole;
+        collected_t chunked;
+        esp_err_t err = decode(uri, len, seed, 0, &whole, NULL);
+        CHECK_EQ(decode(uri, len, seed, 1 + rand_r(seed) % 16, &chunked, NULL), err);
+        CHECK_EQ(chunked.count, whole.count);
+        if (whole.count <= MAX_ENTRIES && chunked.count == whole.count) {
+            CHECK(memcmp(whole.services, chunked.services, whole.count * sizeof(totp_service_t)) == 0);
+        }
+
+        for (int e = 0; e < whole.count && e < MAX_ENTRIES; e++) {
+            const totp_service_t *s = &whole.services[e];
+            CHECK(terminated(s->service_name, sizeof(s->service_name)));
+            CHECK(terminated(s->account, sizeof(s->account)));
+            CHECK(terminated(s->issuer, sizeof(s->issuer)));
+            CHECK(terminated(s->secret, sizeof(s->secret)));
+            uint8_t key[TOTP_MIGRATION_MAX_SECRET];
+            CHECK(base32_decode(s->secret, key, sizeof(key)) > 0);
+            CHECK(s->digits == 6 || s->digits == 8);
+            CHECK(s->algorithm <= TOTP_ALGO_SHA512);
+        }
+        if (check_failures > 0) {
+            fprintf(stderr, "uri: %s\n", uri);
+        }
+    }
+}
+
+int main(void) {
+    unsigned seed = 4226;
+    esp_log_level_set("*", ESP_LOG_NONE);
+    check_known_payload();
+    check_round_trips(&seed);
+    check_skipped(&seed);
+    check_malformed();
+    check_fuzz(&seed);
+    return check_result("test_totp_migration");
+}
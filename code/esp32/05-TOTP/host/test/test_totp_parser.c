@@ -0,0 +1,275 @@
+// otpauth URI parser: known URIs, key names inside other values, errors,
+// round trips of random services through an encoded URI, and a mutation fuzz
+// that checks every result stays within its fields and limits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "esp_log.h"
+#include "base32.h"
+#include "totp/totp_parser.h"
+
+#define ROUND_TRIPS 20000
+#define FUZZ_ROUNDS 200000
+
+static void check_examples(void) {
+    totp_service_t s;
+    CHECK_EQ(totp_parse_uri("otpauth://totp/GitHub:user@email.com?secret=JBSWY3DPEHPK3PXP&issuer=GitHub", &s), ESP_OK);
+    CHECK(strcmp(s.service_name, "GitHub") == 0);
+    CHECK(strcmp(s.account, "user@email.com") == 0);
+    CHECK(strcmp(s.issuer, "GitHub") == 0);
+    CHECK(strcmp(s.secret, "JBSWY3DPEHPK3PXP") == 0);
+    CHECK_EQ(s.digits, 6);
+    CHECK_EQ(s.period, 30);
+    CHECK_EQ(s.algorithm, TOTP_ALGO_SHA1);
+    CHECK_EQ(s.type, TOTP_TYPE_TOTP);
+
+    // Label only: used for name, account and issuer
+    CHECK_EQ(totp_parse_uri("otpauth://totp/user%40example.com?secret=JBSWY3DPEHPK3PXP", &s), ESP_OK);
+    CHECK(strcmp(s.service_name, "user@example.com") == 0);
+    CHECK(strcmp(s.account, "user@example.com") == 0);
+    CHECK(strcmp(s.issuer, "user@example.com") == 0);
+
+    // Encoded ':' and spaces, every key, lower-case algorithm
+    CHECK_EQ(totp_parse_uri("otpauth://totp/ACME%20Co%3Ajohn+doe?secret=GEZDGNBVGY3TQOJQ&issuer=ACME%20Co"
+                            "&algorithm=sha512&digits=8&period=60&image=https%3A%2F%2Fexample.com%2Flogo.png", &s), ESP_OK);
+    CHECK(strcmp(s.service_name, "ACME Co") == 0);
+    CHECK(strcmp(s.account, "john doe") == 0);
+    CHECK(strcmp(s.issuer, "ACME Co") == 0);
+    CHECK_EQ(s.algorithm, TOTP_ALGO_SHA512);
+    CHECK_EQ(s.digits, 8);
+    CHECK_EQ(s.period, 60);
+
+    CHECK_EQ(totp_parse_uri("otpauth://hotp/Bank:me?secret=JBSWY3DPEHPK3PXP&counter=18446744073709551615", &s), ESP_OK);
+    CHECK_EQ(s.type, TOTP_TYPE_HOTP);
+    CHECK(s.counter == UINT64_MAX);
+
+    // Out of range numbers fall back to the defaults
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?secret=JBSWY3DPEHPK3PXP&digits=9&period=0", &s), ESP_OK);
+    CHECK_EQ(s.digits, 6);
+    CHECK_EQ(s.period, 30);
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?secret=JBSWY3DPEHPK3PXP&digits=6x&period=121", &s), ESP_OK);
+    CHECK_EQ(s.digits, 6);
+    CHECK_EQ(s.period, 30);
+}
+
+// A key name inside another parameter's value is not that key
+static void check_embedded_keys(void) {
+    totp_service_t s;
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?issuer=notsecret=EVILEVIL&secret=JBSWY3DPEHPK3PXP", &s), ESP_OK);
+    CHECK(strcmp(s.secret, "JBSWY3DPEHPK3PXP") == 0);
+    CHECK(strcmp(s.issuer, "notsecret=EVILEVIL") == 0);
+
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?image=https://example.com/?secret=EVILEVIL&digits=8"
+                            "&secret=JBSWY3DPEHPK3PXP", &s), ESP_OK);
+    CHECK(strcmp(s.secret, "JBSWY3DPEHPK3PXP") == 0);
+    CHECK_EQ(s.digits, 8);
+
+    // Encoded separators stay in the value
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?issuer=A%26digits%3D8&secret=JBSWY3DPEHPK3PXP", &s), ESP_OK);
+    CHECK(strcmp(s.issuer, "A&digits=8") == 0);
+    CHECK_EQ(s.digits, 6);
+
+    // "secret=" only inside another value does not provide a secret
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?issuer=secret=JBSWY3DPEHPK3PXP", &s), ESP_ERR_INVALID_ARG);
+}
+
+static void check_errors(void) {
+    totp_service_t s;
+    char uri[300];
+    CHECK_EQ(totp_parse_uri(NULL, &s), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?secret=A", NULL), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_parse_uri("otpauth://xotp/x?secret=JBSWY3DPEHPK3PXP", &s), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x", &s), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?issuer=A", &s), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?secret=", &s), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_parse_uri("otpauth://totp/x?secret=JBSWY3DPEHPK3PXP&algorithm=MD5", &s), ESP_ERR_NOT_SUPPORTED);
+    CHECK_EQ(totp_parse_uri("otpauth://hotp/x?secret=JBSWY3DPEHPK3PXP", &s), ESP_ERR_INVALID_ARG);
+
+    // MAX_SECRET_LEN - 1 characters fit, one more does not
+    int n = snprintf(uri, sizeof(uri), "otpauth://totp/x?secret=");
+    memset(uri + n, 'A', MAX_SECRET_LEN - 1);
+    uri[n + MAX_SECRET_LEN - 1] = '\0';
+    CHECK_EQ(totp_parse_uri(uri, &s), ESP_OK);
+    CHECK_EQ(strlen(s.secret), MAX_SECRET_LEN - 1);
+    strcat(uri, "A");
+    CHECK_EQ(totp_parse_uri(uri, &s), ESP_ERR_INVALID_SIZE);
+}
+
+// Percent-encode everything but unreserved characters
+static size_t url_encode(char *dst, const char *src) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t len = 0;
+    for (; *src != '\0'; src++) {
+        unsigned char c = (unsigned char)*src;
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '.' || c == '_' || c == '~') {
+            dst[len++] = (char)c;
+        } else {
+            dst[len++] = '%';
+            dst[len++] = hex[c >> 4];
+            dst[len++] = hex[c & 0xF];
+        }
+    }
+    dst[len] = '\0';
+    return len;
+}
+
+// Printable text, including the characters URIs give meaning to
+static void random_text(unsigned *seed, char *dst, size_t max_len, bool allow_colon) {
+    size_t len = 1 + (size_t)rand_r(seed) % max_len;
+    for (size_t i = 0; i < len; i++) {
+        char c;
+        do {
+            c = (char)(' ' + rand_r(seed) % 95);
+        } while (c == ':' && !allow_colon);
+        dst[i] = c;
+    }
+    dst[len] = '\0';
+}
+
+static void check_round_trips(unsigned *seed) {
+    static const char *algorithms[] = { "SHA1", "SHA256", "SHA512" };
+    for (int round = 0; round < ROUND_TRIPS && check_failures == 0; round++) {
+        totp_service_t in = { 0 };
+        random_text(seed, in.service_name, MAX_SERVICE_NAME_LEN - 1, false);
+        random_text(seed, in.account, MAX_ACCOUNT_NAME_LEN - 1, true);
+        random_text(seed, in.issuer, MAX_ISSUER_LEN - 1, true);
+        uint8_t key[64];
+        size_t key_len = 10 + (size_t)rand_r(seed) % 55;
+        for (size_t i = 0; i < key_len; i++) {
+            key[i] = (uint8_t)rand_r(seed);
+        }
+        base32_encode(key, key_len, in.secret, sizeof(in.secret));
+        in.digits = 6 + rand_r(seed) % 3;
+        in.period = 1 + rand_r(seed) % 120;
+        in.algorithm = rand_r(seed) % 3;
+        in.type = rand_r(seed) % 2;
+        in.counter = (in.type == TOTP_TYPE_HOTP) ? ((uint64_t)rand_r(seed) << 32 | rand_r(seed)) : 0;
+
+        char label[2][3 * MAX_ACCOUNT_NAME_LEN];
+        char issuer[3 * MAX_ISSUER_LEN];
+        url_encode(label[0], in.service_name);
+        url_encode(label[1], in.account);
+        url_encode(issuer, in.issuer);
+
+        // Parameters in a random order
+        char params[6][256];
+        int count = 0;
+        snprintf(params[count++], sizeof(params[0]), "secret=%s", in.secret);
+        snprintf(params[count++], sizeof(params[0]), "issuer=%s", issuer);
+        snprintf(params[count++], sizeof(params[0]), "digits=%u", in.digits);
+        snprintf(params[count++], sizeof(params[0]), "period=%u", (unsigned)in.period);
+        snprintf(params[count++], sizeof(params[0]), "algorithm=%s", algorithms[in.algorithm]);
+        if (in.type == TOTP_TYPE_HOTP) {
+            snprintf(params[count++], sizeof(params[0]), "counter=%llu", (unsigned long long)in.counter);
+        }
+        for (int i = count - 1; i > 0; i--) {
+            int j = rand_r(seed) % (i + 1);
+            char tmp[256];
+            memcpy(tmp, params[i], sizeof(tmp));
+            memcpy(params[i], params[j], sizeof(tmp));
+            memcpy(params[j], tmp, sizeof(tmp));
+        }
+
+        char uri[1500];
+        int len = snprintf(uri, sizeof(uri), "otpauth://%s/%s:%s?", in.type == TOTP_TYPE_HOTP ? "hotp" : "totp",
+                           label[0], label[1]);
+        for (int i = 0; i < count; i++) {
+            len += snprintf(uri + len, sizeof(uri) - len, "%s%s", i > 0 ? "&" : "", params[i]);
+        }
+
+        totp_service_t out;
+        CHECK_EQ(totp_parse_uri(uri, &out), ESP_OK);
+        CHECK(strcmp(out.service_name, in.service_name) == 0);
+        CHECK(strcmp(out.account, in.account) == 0);
+        CHECK(strcmp(out.issuer, in.issuer) == 0);
+        CHECK(strcmp(out.secret, in.secret) == 0);
+        CHECK_EQ(out.digits, in.digits);
+        CHECK_EQ(out.period, in.period);
+        CHECK_EQ(out.algorithm, in.algorithm);
+        CHECK_EQ(out.type, in.type);
+        CHECK(out.counter == in.counter);
+        if (check_failures > 0) {
+            fprintf(stderr, "uri: %s\n", uri);
+        }
+    }
+}
+
+static bool terminated(const char *field, size_t size) {
+    return memchr(field, '\0', size) != NULL;
+}
+
+// Mutations of a valid URI: the parser may reject them, but anything it
+// accepts must be a usable service
+static void check_fuzz(unsigned *seed) {
+    static const char *seeds[] = {
+        "otpauth://totp/ACME%20Co:john@example.com?secret=JBSWY3DPEHPK3PXP&issuer=ACME&algorithm=SHA256&digits=8&period=60",
+        "otpauth://hotp/Bank?secret=GEZDGNBVGY3TQOJQ&counter=42&image=https%3A%2F%2Fexample.com%2Fa.png",
+    };
+    static const char specials[] = "%&=?:+#/";
+
+    for (int round = 0; round < FUZZ_ROUNDS && check_failures == 0; round++) {
+        char uri[400];
+        strcpy(uri, seeds[rand_r(seed) % 2]);
+        int mutations = 1 + rand_r(seed) % 8;
+        for (int m = 0; m < mutations; m++) {
+            size_t len = strlen(uri);
+            size_t pos = (size_t)rand_r(seed) % (len + 1);
+            switch (rand_r(seed) % 4) {
+                case 0:     // Replace with a special or any byte
+                    if (pos < len) {
+                        uri[pos] = (rand_r(seed) % 2) ? specials[rand_r(seed) % 8] : (char)(1 + rand_r(seed) % 255);
+                    }
+                    break;
+                case 1:     // Insert
+                    if (len + 1 < sizeof(uri)) {
+                        memmove(uri + pos + 1, uri + pos, len - pos + 1);
+                        uri[pos] = specials[rand_r(seed) % 8];
+                    }
+                    break;
+                case 2:     // Delete a run
+                    if (pos < len) {
+                        size_t run = 1 + (size_t)rand_r(seed) % 8;
+                        run = (run > len - pos) ? len - pos : run;
+                        memmove(uri + pos, uri + pos + run, len - pos - run + 1);
+                    }
+                    break;
+                default:    // Truncate
+                    uri[pos] = '\0';
+                    break;
+            }
+        }
+
+        totp_service_t s;
+        memset(&s, 0xA5, sizeof(s));
+        esp_err_t err = totp_parse_uri(uri, &s);
+        if (err != ESP_OK) {
+            continue;
+        }
+        CHECK(terminated(s.service_name, sizeof(s.service_name)));
+        CHECK(terminated(s.account, sizeof(s.account)));
+        CHECK(terminated(s.issuer, sizeof(s.issuer)));
+        CHECK(terminated(s.secret, sizeof(s.secret)));
+        CHECK(s.secret[0] != '\0');
+        CHECK(s.digits >= 6 && s.digits <= 8);
+        CHECK(s.period >= 1 && s.period <= 120);
+        CHECK(s.algorithm <= TOTP_ALGO_SHA512);
+        CHECK(s.type <= TOTP_TYPE_HOTP);
+        if (check_failures > 0) {
+            fprintf(stderr, "uri: %s\n", uri);
+        }
+    }
+}
+
+int main(void) {
+    unsigned seed = 6238;
+    esp_log_level_set("*", ESP_LOG_NONE);
+    check_examples();
+    check_embedded_keys();
+    check_errors();
+    check_round_trips(&seed);
+    check_fuzz(&seed);
+    return check_result("test_totp_parser");
+}
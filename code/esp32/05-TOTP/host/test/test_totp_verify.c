@@ -0,0 +1,171 @@
+// totp_verify(): codes inside +/- window steps are accepted and codes outside
+// are not, the ring follows the clock forwards, backwards and across jumps,
+// and it never answers for a different service after a delete moves records.
+// Each verification is compared against computing all 2 * window + 1 codes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "esp_log.h"
+#include "nvs_host.h"
+#include "totp/totp_storage.h"
+#include "totp/totp_verify.h"
+
+#define FUZZ_ROUNDS 20000
+
+static uint64_t fixed_time = 0;
+
+static uint64_t fixed_time_source(void) {
+    return fixed_time;
+}
+
+static uint32_t add_service(const char *name, const char *secret, uint8_t algorithm) {
+    totp_service_t service = { 0 };
+    snprintf(service.service_name, sizeof(service.service_name), "%s", name);
+    snprintf(service.account, sizeof(service.account), "%s@example.com", name);
+    snprintf(service.secret, sizeof(service.secret), "%s", secret);
+    service.digits = 6;
+    service.period = 30;
+    service.algorithm = algorithm;
+    uint32_t id = 0;
+    CHECK_EQ(totp_storage_add(&service, &id), ESP_OK);
+    return id;
+}
+
+static uint32_t code_at(const totp_key_t *key, int64_t counter) {
+    uint32_t code = 0;
+    CHECK_EQ(totp_key_generate(key, (uint64_t)counter, &code), ESP_OK);
+    return code;
+}
+
+static bool verified(uint32_t id, uint32_t code, uint8_t window) {
+    bool valid = false;
+    CHECK_EQ(totp_verify(id, code, window, &valid), ESP_OK);
+    return valid;
+}
+
+static void check_window(void) {
+    uint32_t id = add_service("Window", "JBSWY3DPEHPK3PXP", TOTP_ALGO_SHA1);
+    totp_key_t key;
+    CHECK_EQ(totp_key_init(&key, "JBSWY3DPEHPK3PXP", TOTP_ALGO_SHA1, 6, 30), ESP_OK);
+
+    fixed_time = 1700000000;
+    int64_t counter = fixed_time / 30;
+    for (uint8_t window = 0; window <= TOTP_VERIFY_MAX_WINDOW; window++) {
+        for (int offset = -(TOTP_VERIFY_MAX_WINDOW + 1); offset <= TOTP_VERIFY_MAX_WINDOW + 1; offset++) {
+            uint32_t code = code_at(&key, counter + offset);
+            bool inside = abs(offset) <= window;
+            // A code outside the window may still equal one inside it by chance
+            bool collides = false;
+            for (int w = -window; w <= window; w++) {
+                collides |= code_at(&key, counter + w) == code;
+            }
+            CHECK_EQ(verified(id, code, window), inside || collides);
+        }
+    }
+
+    bool valid = true;
+    CHECK_EQ(totp_verify(id, 0, TOTP_VERIFY_MAX_WINDOW + 1, &valid), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(totp_verify(id + 1000, 0, 1, &valid), ESP_ERR_NOT_FOUND);
+
+    // The API checks code lengths against this
+    uint8_t digits = 0;
+    CHECK_EQ(totp_storage_get_digits(id, &digits), ESP_OK);
+    CHECK_EQ(digits, 6);
+    CHECK_EQ(totp_storage_get_digits(id + 1000, &digits), ESP_ERR_NOT_FOUND);
+
+    // Near the epoch the window is cut at counter 0
+    fixed_time = 15;
+    CHECK(verified(id, code_at(&key, 0), 2));
+    CHECK(verified(id, code_at(&key, 2), 2));
+
+    totp_key_free(&key);
+}
+
+// Random clock moves and codes, against the brute force answer
+static void check_fuzz(void) {
+    uint32_t id = add_service("Fuzz", "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA", TOTP_ALGO_SHA256);
+    totp_key_t key;
+    CHECK_EQ(totp_key_init(&key, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA", TOTP_ALGO_SHA256, 6, 30), ESP_OK);
+
+    unsigned seed = 6238;
+    fixed_time = 1700000000;
+    for (int round = 0; round < FUZZ_ROUNDS && check_failures == 0; round++) {
+        int r = rand_r(&seed) % 100;
+        if (r < 60) {
+            fixed_time += rand_r(&seed) % 40;                   // Next request, maybe next step
+        } else if (r < 80) {
+            fixed_time -= rand_r(&seed) % 120;                  // Clock stepped back by NTP
+        } else {
+            fixed_time += (uint64_t)(rand_r(&seed) % 100000);   // Jump far ahead
+        }
+
+        uint8_t window = rand_r(&seed) % (TOTP_VERIFY_MAX_WINDOW + 1);
+        int64_t counter = fixed_time / 30;
+        uint32_t code;
+        if (rand_r(&seed) % 4 == 0) {
+            code = rand_r(&seed) % 1000000;
+        } else {
+            code = code_at(&key, counter + rand_r(&seed) % 9 - 4);
+        }
+
+        bool expected = false;
+        for (int w = -window; w <= window; w++) {
+            expected |= code_at(&key, counter + w) == code;
+        }
+        CHECK_EQ(verified(id, code, window), expected);
+    }
+
+    totp_key_free(&key);
+}
+
+// A delete moves the last record into the hole: its ring must not follow the old slot
+static void check_delete_moves(void) {
+    CHECK_EQ(totp_storage_clear(), ESP_OK);
+    uint32_t first = add_service("First", "JBSWY3DPEHPK3PXP", TOTP_ALGO_SHA1);
+    uint32_t second = add_service("Second", "GEZDGNBVGY3TQOJQ", TOTP_ALGO_SHA1);
+    totp_key_t first_key;
+    totp_key_t second_key;
+    CHECK_EQ(totp_key_init(&first_key, "JBSWY3DPEHPK3PXP", TOTP_ALGO_SHA1, 6, 30), ESP_OK);
+    CHECK_EQ(totp_key_init(&second_key, "GEZDGNBVGY3TQOJQ", TOTP_ALGO_SHA1, 6, 30), ESP_OK);
+
+    fixed_time = 1800000000;
+    int64_t counter = fixed_time / 30;
+    CHECK(verified(first, code_at(&first_key, counter), 1));
+    CHECK(verified(second, code_at(&second_key, counter), 1));
+
+    CHECK_EQ(totp_storage_delete(first), ESP_OK);
+    CHECK(verified(second, code_at(&second_key, counter), 1));
+    CHECK(verified(second, code_at(&second_key, counter + 1), 1));
+    if (code_at(&first_key, counter) != code_at(&second_key, counter)) {
+        CHECK(!verified(second, code_at(&first_key, counter), 1));
+    }
+
+    // A new service in a reused slot starts with an empty ring
+    uint32_t third = add_service("Third", "MFRGGZDFMZTWQ2LK", TOTP_ALGO_SHA1);
+    totp_key_t third_key;
+    CHECK_EQ(totp_key_init(&third_key, "MFRGGZDFMZTWQ2LK", TOTP_ALGO_SHA1, 6, 30), ESP_OK);
+    CHECK(verified(third, code_at(&third_key, counter - 1), 1));
+    if (code_at(&second_key, counter) != code_at(&third_key, counter)) {
+        CHECK(!verified(third, code_at(&second_key, counter), 1));
+    }
+
+    totp_key_free(&first_key);
+    totp_key_free(&second_key);
+    totp_key_free(&third_key);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_host_set_path(NULL);
+    totp_set_time_source(fixed_time_source);
+    CHECK_EQ(totp_storage_init(), ESP_OK);
+
+    check_window();
+    check_fuzz();
+    check_delete_moves();
+
+    totp_storage_deinit();
+    return check_result("test_totp_verify");
+}
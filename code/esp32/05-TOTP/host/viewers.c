@@ -0,0 +1,414 @@
+// Viewer capacity of the code page: N browsers showing a code at once,
+// either polling GET /api/code/{id} every second or subscribed to the
+// /ws/codes pushes. Like the page, a push viewer that is refused (subscriber
+// limit) or loses its socket falls back to polling. For each viewer count
+// it prints how many code updates arrived on time and the server's load.
+//
+//   totp_viewers [--viewers 1,3,5,7,10,15] [--duration S] [--period S]
+//                [--services N]
+//
+// The firmware's server runs in this process (RAM-only NVS, an ephemeral
+// port), so the socket and subscriber limits are the device's.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "client.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "nvs_host.h"
+#include "network/server.h"
+#include "totp/totp_storage.h"
+#include "totp/totp_lookahead.h"
+
+#define MAX_VIEWERS 64
+#define MAX_RUNS 16
+#define POLL_INTERVAL_US 1000000    // The page polls once per second
+#define ON_TIME_US 1000000          // An update later than this shows a stale countdown
+
+typedef enum {
+    MODE_POLL,
+    MODE_PUSH,
+} viewer_mode_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int viewers[MAX_RUNS];
+    int runs;
+    double duration;
+    uint32_t period;
+    int services;
+    uint32_t first_id;
+} options_t;
+
+typedef struct {
+    const options_t *opts;
+    viewer_mode_t mode;
+    int64_t start;                  // now_us() of the first request
+    int64_t end;
+    uint32_t id;                    // Service shown
+    bool subscribed;                // Got pushes until the end
+    bool polled;                    // Polled at some point
+    uint32_t expected;              // Updates due: one per poll, or one per push
+    uint32_t on_time;
+    uint32_t requests;              // HTTP requests, WebSocket handshakes included
+    uint32_t messages;              // Push messages received
+    uint32_t connections;
+    uint64_t bytes;
+} viewer_t;
+
+static const char WS_REQUEST[] =
+    "GET /ws/codes HTTP/1.1\r\nHost: totp\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+
+static int64_t wall_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void sleep_until(int64_t when) {
+    int64_t wait = when - now_us();
+    if (wait > 0) {
+        usleep((useconds_t)wait);
+    }
+}
+
+static bool viewer_connect(viewer_t *v, conn_t *c) {
+    if (!conn_open(c, &v->opts->addr)) {
+        return false;
+    }
+    v->connections++;
+    return true;
+}
+
+static void viewer_disconnect(viewer_t *v, conn_t *c) {
+    v->bytes += c->received;
+    conn_close(c);
+}
+
+// What the page does without pushes: GET /api/code/{id} every second on a
+// keep-alive connection, reconnecting when the server closes it
+static void poll_codes(viewer_t *v, conn_t *c) {
+    char request[96];
+    int len = snprintf(request, sizeof(request), "GET /api/code/%u HTTP/1.1\r\nHost: totp\r\n\r\n", v->id);
+    int64_t next = now_us();
+
+    v->polled = true;
+    while (next < v->end) {
+        sleep_until(next);
+        next += POLL_INTERVAL_US;
+        v->expected++;
+        if (c->fd < 0) {
+            if (!viewer_connect(v, c)) {
+                continue;
+            }
+            conn_set_timeout(c, ON_TIME_US / 1000);
+        }
+
+        int64_t sent = now_us();
+        response_t resp;
+        v->requests++;
+        bool ok = conn_send(c, request, len) && read_response(c, &resp);
+        if (ok && resp.status == 200 && now_us() - sent <= ON_TIME_US) {
+            v->on_time++;
+        }
+        if (!ok || resp.close) {
+            viewer_disconnect(v, c);
+        }
+    }
+}
+
+// Handshake for /ws/codes; true once the server switched protocols
+static bool ws_subscribe(viewer_t *v, conn_t *c) {
+    char line[256];
+    int status = 0;
+    v->requests++;
+    if (!conn_send(c, WS_REQUEST, sizeof(WS_REQUEST) - 1) || !conn_line(c, line, sizeof(line)) ||
+        sscanf(line, "HTTP/1.%*d %d", &status) != 1) {
+        return false;
+    }
+    while (conn_line(c, line, sizeof(line))) {
+        if (line[0] == '\0') {
+            return status == 101;
+        }
+    }
+    return false;
+}
+
+typedef enum {
+    WS_MESSAGE,
+    WS_TIMEOUT,
+    WS_CLOSED,
+} ws_result_t;
+
+// Read one whole message (the server fragments it); server frames are not masked
+static ws_result_t ws_read_message(conn_t *c) {
+    for (;;) {
+        uint8_t head[2];
+        uint8_t ext[8];
+        errno = 0;
+        if (!conn_read(c, head, sizeof(head))) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? WS_TIMEOUT : WS_CLOSED;
+        }
+        uint64_t len = head[1] & 0x7F;
+        if (len == 126 || len == 127) {
+            size_t ext_len = (len == 126) ? 2 : 8;
+            if (!conn_read(c, ext, ext_len)) {
+                return WS_CLOSED;
+            }
+            len = 0;
+            for (size_t i = 0; i < ext_len; i++) {
+                len = (len << 8) | ext[i];
+            }
+        }
+        uint8_t opcode = head[0] & 0x0F;
+        if (!conn_read(c, NULL, len) || opcode == HTTPD_WS_TYPE_CLOSE) {
+            return WS_CLOSED;
+        }
+        if ((head[0] & 0x80) && (opcode == HTTPD_WS_TYPE_TEXT || opcode == HTTPD_WS_TYPE_CONTINUE)) {
+            return WS_MESSAGE;
+        }
+    }
+}
+
+// What the page does with pushes: subscribe, expect the codes right away and
+// after every rollover, and poll instead once the socket is refused or closed
+static void push_codes(viewer_t *v, conn_t *c) {
+    if (!viewer_connect(v, c) || !ws_subscribe(v, c)) {
+        viewer_disconnect(v, c);
+        poll_codes(v, c);
+        return;
+    }
+
+    // The codes come on connect (a refused subscriber is closed instead),
+    // then after every rollover; pushes due after the end are not counted
+    int64_t due = now_us() + ON_TIME_US;
+    v->expected++;
+    while (now_us() < v->end) {
+        int64_t wait = ((due < v->end) ? due : v->end) - now_us();
+        conn_set_timeout(c, wait > 1000 ? (uint32_t)(wait / 1000) : 1);
+        ws_result_t result = ws_read_message(c);
+        if (result == WS_CLOSED) {
+            viewer_disconnect(v, c);
+            poll_codes(v, c);
+            return;
+        }
+        if (result == WS_MESSAGE) {
+            v->messages++;
+        }
+        if (due == INT64_MAX || (result == WS_TIMEOUT && now_us() < due)) {
+            continue;
+        }
+        if (result == WS_MESSAGE) {
+            v->on_time++;
+        }
+
+        // Received or missed: the next one is due just after the next rollover
+        uint64_t period_us = (uint64_t)v->opts->period * 1000000;
+        int64_t wall = wall_us();
+        int64_t rollover = (int64_t)(((uint64_t)wall / period_us + 1) * period_us);
+        due = now_us() + (rollover - wall) + ON_TIME_US;
+        if (due <= v->end) {
+            v->expected++;
+        } else {
+            due = INT64_MAX;
+        }
+    }
+    v->subscribed = v->messages > 0;
+    viewer_disconnect(v, c);
+}
+
+static void *viewer_main(void *arg) {
+    viewer_t *v = arg;
+    conn_t *c = malloc(sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    c->fd = -1;
+    sleep_until(v->start);
+    if (v->mode == MODE_PUSH) {
+        push_codes(v, c);
+    } else {
+        poll_codes(v, c);
+    }
+    viewer_disconnect(v, c);
+    free(c);
+    return NULL;
+}
+
+// All viewers of one run; false if a thread could not be started
+static bool run_viewers(const options_t *opts, viewer_mode_t mode, int count) {
+    viewer_t viewers[MAX_VIEWERS] = { 0 };
+    pthread_t threads[MAX_VIEWERS];
+    int64_t start = now_us() + 100000;
+    int64_t end = start + (int64_t)(opts->duration * 1e6);
+
+    int started = 0;
+    for (; started < count; started++) {
+        viewer_t *v = &viewers[started];
+        v->opts = opts;
+        v->mode = mode;
+        v->start = start + (int64_t)started * POLL_INTERVAL_US / count;
+        v->end = end;
+        v->id = opts->first_id + (uint32_t)started % (uint32_t)opts->services;
+        if (pthread_create(&threads[started], NULL, viewer_main, v) != 0) {
+            break;
+        }
+    }
+
+    viewer_t total = { 0 };
+    int subscribed = 0;
+    int polling = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        subscribed += viewers[i].subscribed;
+        polling += viewers[i].polled;
+        total.expected += viewers[i].expected;
+        total.on_time += viewers[i].on_time;
+        total.requests += viewers[i].requests;
+        total.messages += viewers[i].messages;
+        total.connections += viewers[i].connections;
+        total.bytes += viewers[i].bytes;
+    }
+    double seconds = (now_us() - start) / 1e6;
+
+    printf("%-5s %7d %7d %7d %8.1f%% %8.1f %8.1f %8.2f %6u\n", mode == MODE_PUSH ? "push" : "poll",
+           count, subscribed, polling, total.expected ? 100.0 * total.on_time / total.expected : 0.0,
+           total.requests / seconds, total.messages / seconds, total.bytes / seconds / 1024,
+           total.connections);
+    fflush(stdout);
+
+    // Let the server close the sessions before the next run
+    usleep(300000);
+    return started == count && total.on_time > 0;
+}
+
+static bool parse_viewers(const char *spec, options_t *opts) {
+    opts->runs = 0;
+    while (*spec != '\0') {
+        char *end;
+        long count = strtol(spec, &end, 10);
+        if (end == spec || count < 1 || count > MAX_VIEWERS || opts->runs == MAX_RUNS) {
+            return false;
+        }
+        opts->viewers[opts->runs++] = (int)count;
+        spec = end;
+        if (*spec == ',') {
+            spec++;
+        } else if (*spec != '\0') {
+            return false;
+        }
+    }
+    return opts->runs > 0;
+}
+
+static bool seed_services(options_t *opts) {
+    for (int i = 0; i < opts->services; i++) {
+        totp_service_t service = {
+            .digits = 6,
+            .period = opts->period,
+            .algorithm = TOTP_ALGO_SHA1,
+            .type = TOTP_TYPE_TOTP,
+        };
+        snprintf(service.service_name, sizeof(service.service_name), "Viewer%d", i);
+        snprintf(service.account, sizeof(service.account), "user%d", i);
+        strcpy(service.secret, "JBSWY3DPEHPK3PXP");
+        uint32_t id;
+        if (totp_storage_add(&service, &id) != ESP_OK) {
+            return false;
+        }
+        if (i == 0) {
+            opts->first_id = id;
+        }
+    }
+    return true;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --viewers LIST    viewer counts to measure (default 1,3,5,7,10,15, max %d)\n"
+            "  --duration S      seconds per run (default 6)\n"
+            "  --period S        TOTP period of the services (default 2)\n"
+            "  --services N      services in the store (default 5)\n", prog, MAX_VIEWERS);
+}
+
+int main(int argc, char **argv) {
+    options_t opts = {
+        .addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) },
+        .viewers = { 1, 3, 5, 7, 10, 15 },
+        .runs = 6,
+        .duration = 6,
+        .period = 2,
+        .services = 5,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = true;
+        if (value == NULL) {
+            ok = false;
+        } else if (strcmp(arg, "--viewers") == 0) {
+            ok = parse_viewers(value, &opts);
+        } else if (strcmp(arg, "--duration") == 0) {
+            opts.duration = atof(value);
+            ok = opts.duration > 0;
+        } else if (strcmp(arg, "--period") == 0) {
+            opts.period = (uint32_t)strtoul(value, NULL, 10);
+            ok = opts.period > 0;
+        } else if (strcmp(arg, "--services") == 0) {
+            opts.services = atoi(value);
+            ok = opts.services > 0 && opts.services <= CONFIG_GMAKER_TOTP_MAX_SERVICES;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    nvs_host_set_path(NULL);
+    httpd_host_set_port(0);
+    if (totp_storage_init() != ESP_OK || server_init() != ESP_OK) {
+        fprintf(stderr, "Failed to start the local server\n");
+        return 1;
+    }
+    totp_lookahead_start();
+    opts.addr.sin_port = htons(httpd_host_get_port());
+
+    int ret = 1;
+    if (!seed_services(&opts)) {
+        fprintf(stderr, "Failed to create the services\n");
+        goto done;
+    }
+
+    printf("%d services, %us period, %.1f s per run\n", opts.services, opts.period, opts.duration);
+    printf("%-5s %7s %7s %7s %9s %8s %8s %8s %6s\n", "mode", "viewers", "pushed", "polling", "on time",
+           "req/s", "msg/s", "KB/s", "conns");
+    ret = 0;
+    for (int run = 0; run < opts.runs; run++) {
+        if (!run_viewers(&opts, MODE_POLL, opts.viewers[run]) ||
+            !run_viewers(&opts, MODE_PUSH, opts.viewers[run])) {
+            ret = 1;
+        }
+    }
+
+done:
+    server_deinit();
+    totp_lookahead_stop();
+    totp_storage_deinit();
+    return ret;
+}
@@ -0,0 +1,15 @@
+// The firmware embeds index.html.gz with the IDF EMBED_FILES symbols; the host
+// build links the same bytes under the same names (ELF targets only)
+#ifndef INDEX_HTML_GZ_PATH
+#error "INDEX_HTML_GZ_PATH must name the gzipped index.html"
+#endif
+
+__asm__(
+    "    .section .rodata\n"
+    "    .global _binary_index_html_gz_start\n"
+    "    .global _binary_index_html_gz_end\n"
+    "_binary_index_html_gz_start:\n"
+    "    .incbin \"" INDEX_HTML_GZ_PATH "\"\n"
+    "_binary_index_html_gz_end:\n"
+    "    .previous\n"
+);
@@ -7,6 +7,7 @@
 #include "hardware/hardware.h"
 #include "network/server.h"
 #include "totp/totp_storage.h"
+#include "totp/totp_lookahead.h"
 #include "utils/ntp.h"
 
 
@@ -23,6 +24,11 @@ void app_main(void) {
     if (hardware_is_ready()) {
         ntp_sync();
         ESP_LOGI(TAG, "Hardware initialized successfully");
+
+        // Precompute next-window codes in the background
+        if (totp_lookahead_start() != ESP_OK) {
+            ESP_LOGW(TAG, "Look-ahead task not started, codes are computed on demand");
+        }
         
         // Iniciar servidor web
         esp_err_t ret = server_init();
@@ -41,6 +47,7 @@ void app_main(void) {
         }
         
         server_deinit();
+        totp_lookahead_stop();
         ESP_ERROR_CHECK(hardware_deinit());
         totp_storage_deinit();
     } else {
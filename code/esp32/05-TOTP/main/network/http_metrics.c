@@ -0,0 +1,324 @@
+#include "http_metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "totp/totp_cache.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+static const char *TAG = "http_metrics";
+
+// Text response buffer (stack); the output goes out in chunks of this size
+#define METRICS_BUFFER_SIZE 512
+#define METRICS_LINE_SIZE 192
+
+// Latency histogram upper bounds, in microseconds and as Prometheus "le" labels
+static const int64_t bucket_bounds_us[] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+static const char *const bucket_labels[] = {
+    "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5"
+};
+#define LATENCY_BUCKETS (sizeof(bucket_bounds_us) / sizeof(bucket_bounds_us[0]))
+
+struct http_metrics_route {
+    const httpd_uri_t *uri;         // Route as declared (handler, labels, user_ctx)
+    uint32_t requests;
+    uint32_t errors;                // Handler returned something other than ESP_OK
+    uint64_t bytes_sent;
+    uint64_t latency_sum_us;
+    uint32_t buckets[LATENCY_BUCKETS + 1];  // Per bucket (not cumulative), last is +Inf
+};
+typedef struct http_metrics_route route_metrics_t;
+
+// Route last handled on each open session, so bytes sent later on the socket
+// (by a deferred handler or a WebSocket push) are attributed to it
+typedef struct {
+    int fd;                         // -1 if free
+    route_metrics_t *route;
+} session_route_t;
+
+// The route table and session hooks run on the httpd task; counters are also
+// updated by deferred handlers on other tasks, and the send hook reads the
+// session table from whichever task sends (storage worker, code push), so
+// both are changed under metrics_lock
+static route_metrics_t routes[HTTP_METRICS_MAX_ROUTES];
+static size_t route_count = 0;
+static session_route_t sessions[HTTP_METRICS_MAX_SESSIONS];
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t sessions_open = 0;
+static uint32_t sessions_opened = 0;
+static uint32_t lru_purges = 0;
+static uint16_t session_capacity = UINT16_MAX;
+static bool closed_while_full = false;
+
+// Handler running on the httpd task, and whether it deferred its accounting
+static route_metrics_t *current_route = NULL;
+static int64_t current_start = 0;
+static bool current_deferred = false;
+
+void http_metrics_init(uint16_t max_open_sockets) {
+    memset(routes, 0, sizeof(routes));
+    route_count = 0;
+    for (size_t i = 0; i < HTTP_METRICS_MAX_SESSIONS; i++) {
+        sessions[i].fd = -1;
+        sessions[i].route = NULL;
+    }
+    sessions_open = 0;
+    sessions_opened = 0;
+    lru_purges = 0;
+    closed_while_full = false;
+    session_capacity = max_open_sockets;
+    current_route = NULL;
+}
+
+static session_route_t *find_session(int fd) {
+    for (size_t i = 0; i < HTTP_METRICS_MAX_SESSIONS; i++) {
+        if (sessions[i].fd == fd) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void record_request(route_metrics_t *m, int64_t elapsed, esp_err_t ret) {
+    size_t bucket = 0;
+    while (bucket < LATENCY_BUCKETS && elapsed > bucket_bounds_us[bucket]) {
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&metrics_lock);
+    m->buckets[bucket]++;
+    m->latency_sum_us += elapsed;
+    m->requests++;
+    if (ret != ESP_OK) {
+        m->errors++;
+    }
+    portEXIT_CRITICAL(&metrics_lock);
+}
+
+static esp_err_t metered_handler(httpd_req_t *req) {
+    route_metrics_t *m = req->user_ctx;
+    req->user_ctx = m->uri->user_ctx;
+
+    portENTER_CRITICAL(&metrics_lock);
+    session_route_t *session = find_session(httpd_req_to_sockfd(req));
+    if (session != NULL) {
+        session->route = m;
+    }
+    portEXIT_CRITICAL(&metrics_lock);
+
+    current_route = m;
+    current_deferred = false;
+    current_start = esp_timer_get_time();
+    esp_err_t ret = m->uri->handler(req);
+    int64_t elapsed = esp_timer_get_time() - current_start;
+    current_route = NULL;
+
+    if (!current_deferred) {
+        record_request(m, elapsed, ret);
+    }
+    return ret;
+}
+
+http_metrics_pending_t http_metrics_defer(void) {
+    http_metrics_pending_t pending = { .route = current_route, .start_us = current_start };
+    current_deferred = true;
+    return pending;
+}
+
+void http_metrics_complete(const http_metrics_pending_t *pending, esp_err_t ret) {
+    if (pending->route != NULL) {
+        record_request(pending->route, esp_timer_get_time() - pending->start_us, ret);
+    }
+}
+
+esp_err_t http_metrics_register(httpd_handle_t server, const httpd_uri_t *uri) {
+    if (route_count >= HTTP_METRICS_MAX_ROUTES) {
+        ESP_LOGE(TAG, "Route table full, %s not registered", uri->uri);
+        return ESP_ERR_NO_MEM;
+    }
+
+    route_metrics_t *m = &routes[route_count];
+    memset(m, 0, sizeof(*m));
+    m->uri = uri;
+
+    // httpd keeps its own copy of the descriptor
+    httpd_uri_t wrapped = *uri;
+    wrapped.handler = metered_handler;
+    wrapped.user_ctx = m;
+    esp_err_t err = httpd_register_uri_handler(server, &wrapped);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", uri->uri, esp_err_to_name(err));
+        return err;
+    }
+
+    route_count++;
+    return ESP_OK;
+}
+
+// Send hook: attributes response bytes to the route last handled on the socket
+static int metered_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    int ret = httpd_default_send(hd, sockfd, buf, buf_len, flags);
+    if (ret > 0) {
+        portENTER_CRITICAL(&metrics_lock);
+        session_route_t *session = find_session(sockfd);
+        if (session != NULL && session->route != NULL) {
+            session->route->bytes_sent += ret;
+        }
+        portEXIT_CRITICAL(&metrics_lock);
+    }
+    return ret;
+}
+
+esp_err_t http_metrics_session_open(httpd_handle_t hd, int sockfd) {
+    // With LRU purging, httpd closes the oldest session right before opening
+    // a new one when all are in use; a close at capacity followed directly by
+    // an open is counted as a purge
+    if (closed_while_full) {
+        lru_purges++;
+        closed_while_full = false;
+    }
+    sessions_open++;
+    sessions_opened++;
+
+    portENTER_CRITICAL(&metrics_lock);
+    session_route_t *session = find_session(-1);
+    if (session != NULL) {
+        session->route = NULL;
+        session->fd = sockfd;
+    }
+    portEXIT_CRITICAL(&metrics_lock);
+    httpd_sess_set_send_override(hd, sockfd, metered_send);
+    return ESP_OK;
+}
+
+void http_metrics_session_close(httpd_handle_t hd, int sockfd) {
+    closed_while_full = (sessions_open >= session_capacity);
+    if (sessions_open > 0) {
+        sessions_open--;
+    }
+
+    portENTER_CRITICAL(&metrics_lock);
+    session_route_t *session = find_session(sockfd);
+    if (session != NULL) {
+        session->fd = -1;
+        session->route = NULL;
+    }
+    portEXIT_CRITICAL(&metrics_lock);
+    close(sockfd);
+}
+
+// Chunked text response on a stack buffer
+typedef struct {
+    httpd_req_t *req;
+    size_t len;
+    esp_err_t err;
+    char buf[METRICS_BUFFER_SIZE];
+} metrics_out_t;
+
+static void out_flush(metrics_out_t *out) {
+    if (out->err == ESP_OK && out->len > 0) {
+        out->err = httpd_resp_send_chunk(out->req, out->buf, out->len);
+    }
+    out->len = 0;
+}
+
+static void out_printf(metrics_out_t *out, const char *fmt, ...) {
+    char line[METRICS_LINE_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n >= sizeof(line)) {
+        n = sizeof(line) - 1;
+    }
+
+    if (out->len + n > sizeof(out->buf)) {
+        out_flush(out);
+    }
+    memcpy(out->buf + out->len, line, n);
+    out->len += n;
+}
+
+typedef uint64_t (*route_field_t)(const route_metrics_t *m);
+
+static uint64_t route_requests(const route_metrics_t *m) { return m->requests; }
+static uint64_t route_errors(const route_metrics_t *m) { return m->errors; }
+static uint64_t route_bytes_sent(const route_metrics_t *m) { return m->bytes_sent; }
+
+// Write one counter family with a sample per route
+static void write_route_counter(metrics_out_t *out, const char *name, const char *help, route_field_t field) {
+    out_printf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (size_t i = 0; i < route_count; i++) {
+        portENTER_CRITICAL(&metrics_lock);
+        uint64_t value = field(&routes[i]);
+        portEXIT_CRITICAL(&metrics_lock);
+        const route_metrics_t *m = &routes[i];
+        out_printf(out, "%s{route=\"%s\",method=\"%s\"} %llu\n", name, m->uri->uri,
+                   http_method_str((enum http_method)m->uri->method), (unsigned long long)value);
+    }
+}
+
+esp_err_t http_metrics_get_handler(httpd_req_t *req) {
+    metrics_out_t out = { .req = req, .len = 0, .err = ESP_OK };
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    write_route_counter(&out, "http_requests_total", "Requests handled per route", route_requests);
+    write_route_counter(&out, "http_request_errors_total", "Handler failures per route", route_errors);
+    write_route_counter(&out, "http_response_bytes_total", "Response bytes sent per route", route_bytes_sent);
+
+    out_printf(&out, "# HELP http_request_duration_seconds Handler latency per route\n"
+                     "# TYPE http_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < route_count; i++) {
+        route_metrics_t snapshot;
+        portENTER_CRITICAL(&metrics_lock);
+        snapshot = routes[i];
+        portEXIT_CRITICAL(&metrics_lock);
+        const route_metrics_t *m = &snapshot;
+        const char *method = http_method_str((enum http_method)m->uri->method);
+        uint32_t cumulative = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+            cumulative += m->buckets[b];
+            out_printf(&out, "http_request_duration_seconds_bucket{route=\"%s\",method=\"%s\",le=\"%s\"} %lu\n",
+                       m->uri->uri, method, bucket_labels[b], (unsigned long)cumulative);
+        }
+        out_printf(&out, "http_request_duration_seconds_bucket{route=\"%s\",method=\"%s\",le=\"+Inf\"} %lu\n",
+                   m->uri->uri, method, (unsigned long)m->requests);
+        out_printf(&out, "http_request_duration_seconds_sum{route=\"%s\",method=\"%s\"} %llu.%06llu\n",
+                   m->uri->uri, method, (unsigned long long)(m->latency_sum_us / 1000000),
+                   (unsigned long long)(m->latency_sum_us % 1000000));
+        out_printf(&out, "http_request_duration_seconds_count{route=\"%s\",method=\"%s\"} %lu\n",
+                   m->uri->uri, method, (unsigned long)m->requests);
+    }
+
+    out_printf(&out, "# HELP http_sessions_open Open client sessions\n"
+                     "# TYPE http_sessions_open gauge\nhttp_sessions_open %lu\n",
+               (unsigned long)sessions_open);
+    out_printf(&out, "# HELP http_sessions_opened_total Client sessions accepted\n"
+                     "# TYPE http_sessions_opened_total counter\nhttp_sessions_opened_total %lu\n",
+               (unsigned long)sessions_opened);
+    out_printf(&out, "# HELP http_lru_purges_total Sessions closed to make room for a new one (estimated)\n"
+                     "# TYPE http_lru_purges_total counter\nhttp_lru_purges_total %lu\n",
+               (unsigned long)lru_purges);
+
+    totp_cache_stats_t stats;
+    totp_cache_get_stats(&stats);
+    out_printf(&out, "# HELP totp_cache_hits_total Codes served from the code cache\n"
+                     "# TYPE totp_cache_hits_total counter\ntotp_cache_hits_total %lu\n",
+               (unsigned long)stats.hits);
+    out_printf(&out, "# HELP totp_cache_misses_total Codes computed on demand\n"
+                     "# TYPE totp_cache_misses_total counter\ntotp_cache_misses_total %lu\n",
+               (unsigned long)stats.misses);
+
+    out_flush(&out);
+    if (out.err == ESP_OK) {
+        out.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return out.err;
+}
@@ -0,0 +1,77 @@
+#ifndef NETWORK_HTTP_METRICS_H
+#define NETWORK_HTTP_METRICS_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdint.h>
+
+#define HTTP_METRICS_MAX_ROUTES 16  // Routes that can be registered through http_metrics_register()
+#define HTTP_METRICS_MAX_SESSIONS 16 // Sessions tracked for byte counts (at least max_open_sockets)
+
+/**
+ * @brief Accounting of a request finished outside the httpd task
+ */
+typedef struct {
+    struct http_metrics_route *route;
+    int64_t start_us;
+} http_metrics_pending_t;
+
+/**
+ * @brief Reset all counters; call before httpd_start()
+ * @param max_open_sockets Session limit of the server (for purge detection)
+ */
+void http_metrics_init(uint16_t max_open_sockets);
+
+/**
+ * @brief Register a URI handler wrapped with per-route metrics
+ *
+ * Counts requests, handler errors, response bytes and latency (histogram)
+ * for the route; the original handler still sees its own user_ctx.
+ *
+ * @param server Server handle
+ * @param uri Route to register (must stay valid while the server runs)
+ * @return ESP_OK, ESP_ERR_NO_MEM if the route table is full, or the httpd error
+ */
+esp_err_t http_metrics_register(httpd_handle_t server, const httpd_uri_t *uri);
+
+/**
+ * @brief Take over the accounting of the request being handled
+ *
+ * For handlers that hand the request to another task: the wrapper then
+ * records nothing and http_metrics_complete() must be called once the
+ * request is done. Latency is measured from the original start.
+ *
+ * @return Pending accounting to pass to http_metrics_complete()
+ */
+http_metrics_pending_t http_metrics_defer(void);
+
+/**
+ * @brief Record a request deferred with http_metrics_defer()
+ * @param pending Pending accounting
+ * @param ret Handler result
+ */
+void http_metrics_complete(const http_metrics_pending_t *pending, esp_err_t ret);
+
+/**
+ * @brief Session open hook (httpd_config_t.open_fn): counts response bytes
+ * @param hd Server handle
+ * @param sockfd Session socket
+ * @return ESP_OK
+ */
+esp_err_t http_metrics_session_open(httpd_handle_t hd, int sockfd);
+
+/**
+ * @brief Session close hook (httpd_config_t.close_fn): closes the socket
+ * @param hd Server handle
+ * @param sockfd Session socket
+ */
+void http_metrics_session_close(httpd_handle_t hd, int sockfd);
+
+/**
+ * @brief Handler for GET /api/metrics (Prometheus text format)
+ * @param req Request
+ * @return ESP_OK on success
+ */
+esp_err_t http_metrics_get_handler(httpd_req_t *req);
+
+#endif // NETWORK_HTTP_METRICS_H
@@ -0,0 +1,122 @@
+#include "rate_limit.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+static const char *TAG = "rate_limit";
+
+// Bucket levels are kept in units of 1/60,000,000 token, so refilling at N
+// tokens per minute adds exactly N units per microsecond
+#define UNITS_PER_TOKEN 60000000ULL
+
+typedef struct {
+    uint32_t per_minute;            // Refill rate
+    uint32_t burst;                 // Bucket size
+} rate_budget_t;
+
+static const rate_budget_t budgets[RATE_LIMIT_CLASSES] = {
+    [RATE_LIMIT_READ]  = { CONFIG_GMAKER_RATE_READ_PER_S * 60, CONFIG_GMAKER_RATE_READ_BURST },
+    [RATE_LIMIT_WRITE] = { CONFIG_GMAKER_RATE_WRITE_PER_MIN, CONFIG_GMAKER_RATE_WRITE_BURST },
+};
+
+typedef struct {
+    uint8_t addr[16];               // IPv6, or IPv4-mapped (::ffff:a.b.c.d)
+    bool used;
+    int64_t last_seen;              // For LRU eviction
+    int64_t refilled[RATE_LIMIT_CLASSES];
+    uint64_t level[RATE_LIMIT_CLASSES];
+} rate_client_t;
+
+static rate_client_t clients[RATE_LIMIT_CLIENTS];
+
+void rate_limit_reset(void) {
+    memset(clients, 0, sizeof(clients));
+}
+
+static bool peer_address(int sockfd, uint8_t addr[16]) {
+    struct sockaddr_storage peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(sockfd, (struct sockaddr *)&peer, &len) != 0) {
+        return false;
+    }
+
+    memset(addr, 0, 16);
+    if (peer.ss_family == AF_INET) {
+        const struct sockaddr_in *v4 = (const struct sockaddr_in *)&peer;
+        addr[10] = 0xFF;
+        addr[11] = 0xFF;
+        memcpy(&addr[12], &v4->sin_addr.s_addr, 4);
+        return true;
+    }
+#if defined(AF_INET6)
+    if (peer.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *v6 = (const struct sockaddr_in6 *)&peer;
+        memcpy(addr, &v6->sin6_addr, 16);
+        return true;
+    }
+#endif
+    return false;
+}
+
+// Find the client's entry, taking a free one or the least recently seen
+static rate_client_t *find_client(const uint8_t addr[16], int64_t now) {
+    rate_client_t *victim = &clients[0];
+    for (size_t i = 0; i < RATE_LIMIT_CLIENTS; i++) {
+        rate_client_t *c = &clients[i];
+        if (c->used && memcmp(c->addr, addr, 16) == 0) {
+            return c;
+        }
+        if (victim->used && (!c->used || c->last_seen < victim->last_seen)) {
+            victim = c;
+        }
+    }
+
+    // New clients start with full buckets
+    memcpy(victim->addr, addr, 16);
+    victim->used = true;
+    for (size_t cls = 0; cls < RATE_LIMIT_CLASSES; cls++) {
+        victim->level[cls] = budgets[cls].burst * UNITS_PER_TOKEN;
+        victim->refilled[cls] = now;
+    }
+    return victim;
+}
+
+uint32_t rate_limit_take(int sockfd, rate_limit_class_t cls) {
+    uint8_t addr[16];
+    if (cls >= RATE_LIMIT_CLASSES || !peer_address(sockfd, addr)) {
+        return 0;
+    }
+
+    int64_t now = esp_timer_get_time();
+    rate_client_t *c = find_client(addr, now);
+    c->last_seen = now;
+
+    const rate_budget_t *budget = &budgets[cls];
+    uint64_t capacity = budget->burst * UNITS_PER_TOKEN;
+    uint64_t elapsed = (uint64_t)(now - c->refilled[cls]);
+    c->refilled[cls] = now;
+    if (elapsed >= capacity / budget->per_minute) {
+        c->level[cls] = capacity;
+    } else {
+        c->level[cls] += elapsed * budget->per_minute;
+        if (c->level[cls] > capacity) {
+            c->level[cls] = capacity;
+        }
+    }
+
+    if (c->level[cls] >= UNITS_PER_TOKEN) {
+        c->level[cls] -= UNITS_PER_TOKEN;
+        return 0;
+    }
+
+    // Whole seconds until the bucket holds a token again
+    uint64_t wait_us = (UNITS_PER_TOKEN - c->level[cls] + budget->per_minute - 1) / budget->per_minute;
+    uint32_t retry_s = (uint32_t)((wait_us + 999999) / 1000000);
+    ESP_LOGD(TAG, "Client over its %s budget, retry in %lu s",
+             (cls == RATE_LIMIT_WRITE) ? "write" : "read", (unsigned long)retry_s);
+    return retry_s;
+}
@@ -0,0 +1,35 @@
+#ifndef NETWORK_RATE_LIMIT_H
+#define NETWORK_RATE_LIMIT_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+#define RATE_LIMIT_CLIENTS 16       // Clients tracked at once; the least recently seen is evicted
+
+/**
+ * @brief Request budgets, each a token bucket per client
+ */
+typedef enum {
+    RATE_LIMIT_READ = 0,            // API reads (served from RAM)
+    RATE_LIMIT_WRITE,               // Requests that may write to flash
+    RATE_LIMIT_CLASSES
+} rate_limit_class_t;
+
+/**
+ * @brief Forget every client (all buckets start full again)
+ */
+void rate_limit_reset(void);
+
+/**
+ * @brief Take one token from the client's bucket
+ *
+ * Clients are keyed by the peer IP address of the socket. Not thread-safe:
+ * call from the httpd task only.
+ *
+ * @param sockfd Client socket
+ * @param cls Budget to charge
+ * @return 0 if the request may proceed, otherwise the seconds until a token is available
+ */
+uint32_t rate_limit_take(int sockfd, rate_limit_class_t cls);
+
+#endif // NETWORK_RATE_LIMIT_H
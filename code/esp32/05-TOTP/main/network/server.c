@@ -1,220 +1,787 @@
 #include "server.h"
+#include "http_metrics.h"
+#include "rate_limit.h"
+#include "sdkconfig.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "totp/totp_storage.h"
 #include "totp/totp_parser.h"
 #include "totp/totp_engine.h"
+#include "totp/totp_cache.h"
+#include "totp/totp_verify.h"
+#include "totp/totp_migration.h"
+#include "utils/json_stream.h"
+#include "utils/gzip_stream.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <sys/time.h>
-#include <cJSON.h>
 
 static const char *TAG = "server";
+
+// Services per totp_storage_generate_codes() call in /api/codes (bounds stack use)
+#define CODES_BLOCK_SIZE 16
+// JSON response buffer (stack); longer responses are sent in chunks of this size
+#define RESP_BUFFER_SIZE 512
+// Largest accepted POST /api/services body
+#define POST_BODY_SIZE 512
+// A request body must arrive within this time, and the client may not stall
+// for more than this many receive timeouts (recv_wait_timeout, 5 s) in a row
+#define BODY_TIMEOUT_MS 20000
+#define BODY_MAX_STALLS 2
+#define MAX_OPEN_SOCKETS 7
+// Code push subscribers; the remaining sockets stay free for API requests
+#define WS_MAX_SUBSCRIBERS (MAX_OPEN_SOCKETS - 2)
+#define PUSH_TASK_STACK 2048
+#define PUSH_TASK_PRIO (tskIDLE_PRIORITY + 1)
+#define PUSH_GUARD_MS 200       // Broadcast this long after a boundary
+#define PUSH_IDLE_S 30          // Broadcast interval when there are no TOTP codes
+// Storage worker: mutating requests wait here instead of blocking the httpd task
+#define STORAGE_QUEUE_LEN 4
+#define STORAGE_TASK_STACK 6144
+#define STORAGE_TASK_PRIO (tskIDLE_PRIORITY + 4)    // Below httpd, so reads go first
 static httpd_handle_t server = NULL;
 static bool server_running = false;
 
-// Embedded HTML file
-extern const uint8_t index_html_start[] asm("_binary_index_html_start");
-extern const uint8_t index_html_end[] asm("_binary_index_html_end");
+// Embedded HTML file, gzipped at build time (see main/CMakeLists.txt)
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+// Content hash of index.html, changes only when the page does
+#define INDEX_HTML_ETAG "\"" INDEX_HTML_HASH "\""
+
+// Parse the service ID in the last path segment (e.g., /api/code/12 or /api/verify/12?code=...)
+static bool parse_service_id(const char *uri, uint32_t *id) {
+    const char *id_str = strrchr(uri, '/');
+    if (id_str == NULL || id_str[1] < '0' || id_str[1] > '9') {
+        return false;
+    }
+
+    char *end;
+    unsigned long value = strtoul(id_str + 1, &end, 10);
+    if ((*end != '\0' && *end != '?') || value == 0 || value == ULONG_MAX) {
+        return false;
+    }
+    *id = (uint32_t)value;
+    return true;
+}
+
+// True if the If-None-Match header lists etag (or is "*")
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    char header[128];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    return strcmp(header, "*") == 0 || strstr(header, etag) != NULL;
+}
 
 // HTTP GET handler for root path
 static esp_err_t root_get_handler(httpd_req_t *req) {
+    // Browsers revalidate on every load; an unchanged page costs a bodyless 304
+    httpd_resp_set_hdr(req, "ETag", INDEX_HTML_ETAG);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (etag_matches(req, INDEX_HTML_ETAG)) {
+        ESP_LOGD(TAG, "Root page not modified");
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
     ESP_LOGI(TAG, "Serving root page");
-    
-    const size_t index_html_size = (index_html_end - index_html_start);
+
+    // Only the gzipped copy is embedded; every browser accepts gzip
+    const size_t index_html_size = (index_html_gz_end - index_html_gz_start);
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, (const char *)index_html_start, index_html_size);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_send(req, (const char *)index_html_gz_start, index_html_size);
     
     return ESP_OK;
 }
 
-// Mock API: Get services list (JSON)
-static esp_err_t api_services_get_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "API: Get services");
-    
-    // Use real storage
-    char *json = totp_storage_list_json();
-    if (json == NULL) {
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        httpd_resp_send(req, "{\"error\":\"Failed to generate JSON\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+// JSON response on a stack buffer: a response that fits is sent at once with
+// Content-Length, a larger one goes out in chunks as the buffer fills (gzipped
+// if the client accepts it)
+typedef struct {
+    httpd_req_t *req;
+    bool chunked;           // At least one chunk is out
+    bool finishing;         // Flushing the last buffer
+    gzip_stream_t *gzip;    // Compressor of a chunked response, or NULL
+    json_writer_t json;
+    char buf[RESP_BUFFER_SIZE];
+} json_response_t;
+
+#ifdef CONFIG_GMAKER_GZIP_JSON
+static esp_err_t gzip_output(const char *data, size_t len, void *ctx) {
+    return httpd_resp_send_chunk(ctx, data, len);
+}
+
+// True if the parameters of an Accept-Encoding entry (after its coding) give
+// it q=0, written as 0, 0.0, 0.00 or 0.000
+static bool coding_refused(const char *p, const char *end) {
+    while (p < end) {
+        if (*p++ != ';') {
+            continue;
+        }
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (end - p < 2 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=') {
+            continue;
+        }
+        p += 2;
+        if (p == end || *p++ != '0') {
+            return false;
+        }
+        if (p < end && *p == '.') {
+            const char *decimals = ++p;
+            while (p < end && *p == '0' && p - decimals < 3) {
+                p++;
+            }
+        }
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        return p == end || *p == ';';
+    }
+    return false;
+}
+
+// True if Accept-Encoding accepts gzip: listed with a non-zero q, or not
+// listed and covered by "*"
+static bool accepts_gzip(httpd_req_t *req) {
+    char header[96];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", header, sizeof(header));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+
+    int gzip = -1;              // -1 not listed, 0 refused, 1 accepted
+    int any = -1;
+    const char *item = header;
+    while (*item != '\0') {
+        const char *end = strchr(item, ',');
+        if (end == NULL) {
+            end = item + strlen(item);
+        }
+        while (item < end && (*item == ' ' || *item == '\t')) {
+            item++;
+        }
+        const char *coding = item;
+        while (item < end && *item != ';' && *item != ' ' && *item != '\t') {
+            item++;
+        }
+        size_t len = item - coding;
+        int verdict = coding_refused(item, end) ? 0 : 1;
+        if (len == 4 && strncasecmp(coding, "gzip", 4) == 0) {
+            gzip = verdict;
+        } else if (len == 1 && coding[0] == '*') {
+            any = verdict;
+        }
+        item = (*end == ',') ? end + 1 : end;
+    }
+    return (gzip >= 0) ? gzip == 1 : any == 1;
+}
+
+#endif // CONFIG_GMAKER_GZIP_JSON
+
+// The body outgrew the buffer: compress the rest of the response if possible
+static void resp_start_gzip(json_response_t *resp) {
+#ifdef CONFIG_GMAKER_GZIP_JSON
+    httpd_resp_set_hdr(resp->req, "Vary", "Accept-Encoding");
+    if (!accepts_gzip(resp->req)) {
+        return;
+    }
+
+    // Only held while the response is being sent
+    resp->gzip = malloc(sizeof(gzip_stream_t));
+    if (resp->gzip == NULL) {
+        ESP_LOGW(TAG, "No memory for gzip, sending uncompressed");
+        return;
+    }
+    gzip_stream_init(resp->gzip, gzip_output, resp->req);
+    httpd_resp_set_hdr(resp->req, "Content-Encoding", "gzip");
+#endif
+}
+
+static esp_err_t resp_flush(const char *data, size_t len, void *ctx) {
+    json_response_t *resp = ctx;
+    if (resp->finishing && !resp->chunked) {
+        return httpd_resp_send(resp->req, data, len);
+    }
+    if (!resp->chunked) {
+        resp->chunked = true;
+        resp_start_gzip(resp);
+    }
+    if (resp->gzip != NULL) {
+        return gzip_stream_write(resp->gzip, data, len);
+    }
+    return httpd_resp_send_chunk(resp->req, data, len);
+}
+
+static json_writer_t *resp_begin(json_response_t *resp, httpd_req_t *req, const char *status) {
+    resp->req = req;
+    resp->chunked = false;
+    resp->finishing = false;
+    resp->gzip = NULL;
+    if (status != NULL) {
+        httpd_resp_set_status(req, status);
     }
-    
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
-    
-    free(json);
-    return ESP_OK;
+    json_writer_init(&resp->json, resp->buf, sizeof(resp->buf), resp_flush, resp);
+    return &resp->json;
 }
 
-// API: Add service (POST)
-static esp_err_t api_services_post_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "API: Add service");
-    
-    // Allocate buffer dynamically to avoid stack overflow
-    char *buf = malloc(512);
-    if (buf == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory");
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        httpd_resp_send(req, "{\"error\":\"Out of memory\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+static esp_err_t resp_end(json_response_t *resp) {
+    resp->finishing = true;
+    esp_err_t err = json_writer_finish(&resp->json);
+    if (resp->gzip != NULL) {
+        esp_err_t gzip_err = gzip_stream_finish(resp->gzip);
+        if (err == ESP_OK) {
+            err = gzip_err;
+        }
+        free(resp->gzip);
+        resp->gzip = NULL;
     }
-    
-    int ret = httpd_req_recv(req, buf, 512 - 1);
-    if (ret <= 0) {
+    if (resp->chunked) {
+        httpd_resp_send_chunk(resp->req, NULL, 0);
+    }
+    return err;
+}
+
+// Send {"error":"<message>"} or {"error":"<message>: <cause>"}
+static esp_err_t send_error(httpd_req_t *req, const char *status, const char *message, esp_err_t cause) {
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, status);
+    json_writer_begin_object(w);
+    json_writer_key(w, "error");
+    if (cause != ESP_OK) {
+        char text[96];
+        snprintf(text, sizeof(text), "%s: %s", message, esp_err_to_name(cause));
+        json_writer_string(w, text);
+    } else {
+        json_writer_string(w, message);
+    }
+    json_writer_end_object(w);
+    resp_end(&resp);
+    return ESP_FAIL;
+}
+
+// Charge the client's budget; false once it is exhausted (429 already sent)
+static bool rate_limit_allow(httpd_req_t *req, rate_limit_class_t cls) {
+    uint32_t retry_s = rate_limit_take(httpd_req_to_sockfd(req), cls);
+    if (retry_s == 0) {
+        return true;
+    }
+
+    char retry_after[12];
+    snprintf(retry_after, sizeof(retry_after), "%lu", (unsigned long)retry_s);
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    send_error(req, "429 Too Many Requests", "Rate limit exceeded", ESP_OK);
+    return false;
+}
+
+// Receive part of the request body; HTTPD_SOCK_ERR_TIMEOUT once the client has
+// stalled for BODY_MAX_STALLS receive timeouts or the deadline has passed
+static int recv_bounded(httpd_req_t *req, char *buf, size_t len, int64_t deadline_us) {
+    for (int stalls = 0; stalls < BODY_MAX_STALLS && esp_timer_get_time() < deadline_us; stalls++) {
+        int ret = httpd_req_recv(req, buf, len);
+        if (ret != HTTPD_SOCK_ERR_TIMEOUT) {
+            return ret;
+        }
+    }
+    return HTTPD_SOCK_ERR_TIMEOUT;
+}
+
+// Receive the whole request body into buf (NUL-terminated)
+// Returns ESP_ERR_INVALID_SIZE if it does not fit, ESP_ERR_TIMEOUT if the client
+// is too slow, ESP_FAIL if the connection failed
+static esp_err_t recv_body(httpd_req_t *req, char *buf, size_t size, size_t *len) {
+    if (req->content_len >= size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int64_t deadline = esp_timer_get_time() + BODY_TIMEOUT_MS * 1000LL;
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = recv_bounded(req, buf + received, req->content_len - received, deadline);
         if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_408(req);
+            return ESP_ERR_TIMEOUT;
         }
-        free(buf);
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    buf[received] = '\0';
+    *len = received;
+    return ESP_OK;
+}
+
+static esp_err_t list_piece(const char *data, size_t len, void *ctx) {
+    json_writer_t *w = ctx;
+    json_writer_raw(w, data, len);
+    return json_writer_error(w);
+}
+
+// API: Get services list (JSON), streamed from the cached entries
+static esp_err_t api_services_get_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "API: Get services");
+    if (!rate_limit_allow(req, RATE_LIMIT_READ)) {
         return ESP_FAIL;
     }
-    buf[ret] = '\0';
-    
-    ESP_LOGI(TAG, "Received: %s", buf);
-    
-    // Parse JSON to extract URI
-    cJSON *root = cJSON_Parse(buf);
-    free(buf); // Free buffer after parsing JSON
-    
-    if (root == NULL) {
-        ESP_LOGE(TAG, "Failed to parse JSON");
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "{\"error\":\"Invalid JSON\"}", HTTPD_RESP_USE_STRLEN);
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    esp_err_t err = totp_storage_write_list_json(list_piece, w);
+    if (err != ESP_OK && !resp.chunked) {
+        // Nothing is out yet: replace the partial list with an error
+        ESP_LOGE(TAG, "Failed to generate service list: %s", esp_err_to_name(err));
+        return send_error(req, "500 Internal Server Error", "Failed to generate JSON", ESP_OK);
+    }
+
+    esp_err_t send_err = resp_end(&resp);
+    if (err != ESP_OK || send_err != ESP_OK) {
+        // Headers are out: the client sees a truncated list
+        ESP_LOGE(TAG, "Failed to send service list: %s",
+                 esp_err_to_name((err != ESP_OK) ? err : send_err));
         return ESP_FAIL;
     }
-    
-    cJSON *uri_json = cJSON_GetObjectItem(root, "uri");
-    if (uri_json == NULL || !cJSON_IsString(uri_json)) {
+    return ESP_OK;
+}
+
+// API: Add service (POST)
+static esp_err_t api_services_post_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "API: Add service");
+
+    // Body and decoded URI share one stack buffer: the URI is unescaped in place
+    char body[POST_BODY_SIZE];
+    size_t len;
+    esp_err_t err = recv_body(req, body, sizeof(body), &len);
+    if (err == ESP_ERR_TIMEOUT) {
+        return send_error(req, "408 Request Timeout", "Body not received in time", ESP_OK);
+    } else if (err != ESP_OK) {
+        return send_error(req, "400 Bad Request", "Body missing or too large", ESP_OK);
+    }
+
+    char *uri = body;
+    err = json_find_string(body, len, "uri", uri, sizeof(body));
+    if (err == ESP_ERR_NOT_FOUND) {
         ESP_LOGE(TAG, "URI field not found or invalid");
-        cJSON_Delete(root);
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "{\"error\":\"URI field required\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+        return send_error(req, "400 Bad Request", "URI field required", ESP_OK);
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to parse JSON");
+        return send_error(req, "400 Bad Request", "Invalid JSON", ESP_OK);
     }
-    
-    const char *uri = uri_json->valuestring;
-    ESP_LOGI(TAG, "Parsing URI: %s", uri);
-    
+
+    // The URI carries the secret: never log it
+    ESP_LOGD(TAG, "Parsing URI (%d bytes)", (int)strlen(uri));
+
     // Parse TOTP URI
     totp_service_t service;
-    esp_err_t err = totp_parse_uri(uri, &service);
-    
-    // Clean up JSON before checking error
-    cJSON_Delete(root);
-    
+    err = totp_parse_uri(uri, &service);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to parse URI: %s", esp_err_to_name(err));
-        httpd_resp_set_status(req, "400 Bad Request");
-        char response[128];
-        snprintf(response, sizeof(response), "{\"error\":\"Invalid URI: %s\"}", esp_err_to_name(err));
-        httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+        return send_error(req, "400 Bad Request", "Invalid URI", err);
     }
-    
+
     // Add service to storage
-    err = totp_storage_add(&service);
+    uint32_t id = 0;
+    err = totp_storage_add(&service, &id);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to add service: %s", esp_err_to_name(err));
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        char response[128];
-        snprintf(response, sizeof(response), "{\"error\":\"Failed to save: %s\"}", esp_err_to_name(err));
-        httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+        return send_error(req, "500 Internal Server Error", "Failed to save", err);
     }
-    
+
     // Success response
-    httpd_resp_set_status(req, "201 Created");
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
-    
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, "201 Created");
+    json_writer_begin_object(w);
+    json_writer_key(w, "success");
+    json_writer_bool(w, true);
+    json_writer_key(w, "id");
+    json_writer_uint(w, id);
+    json_writer_end_object(w);
+    resp_end(&resp);
+
     ESP_LOGI(TAG, "Service added successfully: %s (%s)", service.issuer, service.account);
     return ESP_OK;
 }
 
+typedef struct {
+    totp_storage_batch_t batch;
+    uint16_t failed;
+} import_ctx_t;
+
+// Stage each decoded migration account in the import batch
+static esp_err_t import_entry(const totp_service_t *service, void *ctx) {
+    import_ctx_t *import = ctx;
+    esp_err_t err = totp_storage_batch_add(&import->batch, service);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Import: skipping %s (%s): %s",
+                 service->issuer, service->account, esp_err_to_name(err));
+        import->failed++;
+    }
+    return ESP_OK;
+}
+
+// API: Import Google Authenticator export (POST, body: otpauth-migration://offline?data=...)
+static esp_err_t api_import_post_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "API: Import migration payload (%d bytes)", (int)req->content_len);
+
+    // Body is decoded as it arrives into a staging batch, without any storage
+    // lock: memory is bounded by MAX_SERVICES packed records whatever the payload
+    import_ctx_t import = { .failed = 0 };
+    totp_storage_batch_init(&import.batch);
+    totp_migration_t migration;
+    totp_migration_init(&migration, import_entry, &import);
+
+    int64_t deadline = esp_timer_get_time() + BODY_TIMEOUT_MS * 1000LL;
+    esp_err_t err = ESP_OK;
+    char buf[128];
+    size_t remaining = req->content_len;
+    while (remaining > 0 && err == ESP_OK) {
+        int ret = recv_bounded(req, buf, (remaining < sizeof(buf)) ? remaining : sizeof(buf), deadline);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            totp_storage_batch_free(&import.batch);
+            return send_error(req, "408 Request Timeout", "Body not received in time", ESP_OK);
+        }
+        if (ret <= 0) {
+            totp_storage_batch_free(&import.batch);
+            return ESP_FAIL;
+        }
+        remaining -= ret;
+        err = totp_migration_feed(&migration, buf, ret);
+    }
+
+    if (err == ESP_OK) {
+        err = totp_migration_finish(&migration);
+    }
+
+    if (err != ESP_OK) {
+        totp_storage_batch_free(&import.batch);
+        return send_error(req, "400 Bad Request", "Invalid migration payload", ESP_OK);
+    }
+
+    // The write lock is only taken now, for a single NVS commit of all accounts
+    uint16_t staged = import.batch.count;
+    uint16_t imported = 0;
+    err = totp_storage_batch_commit(&import.batch, &imported);
+    if (err != ESP_OK) {
+        return send_error(req, "500 Internal Server Error", "Failed to save", err);
+    }
+
+    // Accounts the store had no room for count as skipped
+    uint16_t skipped = migration.skipped + import.failed + (staged - imported);
+
+    ESP_LOGI(TAG, "Imported %d services (%d skipped)", imported, skipped);
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "imported");
+    json_writer_uint(w, imported);
+    json_writer_key(w, "skipped");
+    json_writer_uint(w, skipped);
+    json_writer_end_object(w);
+    return resp_end(&resp);
+}
+
 // API: Get TOTP code
 static esp_err_t api_code_get_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "API: Get code");
+    // Hot path (polled every second): keep logging at debug level
+    ESP_LOGD(TAG, "API: Get code");
+    if (!rate_limit_allow(req, RATE_LIMIT_READ)) {
+        return ESP_FAIL;
+    }
 
-    
-    // Extract index from URI (e.g., /api/code/0)
-    const char *uri = req->uri;
-    const char *index_str = strrchr(uri, '/');
-    if (index_str == NULL) {
+    // Extract service ID from URI (e.g., /api/code/1)
+    uint32_t id;
+    if (!parse_service_id(req->uri, &id)) {
         ESP_LOGE(TAG, "Invalid URI format");
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "{\"error\":\"Invalid URI\"}", HTTPD_RESP_USE_STRLEN);
+        return send_error(req, "400 Bad Request", "Invalid URI", ESP_OK);
+    }
+
+    ESP_LOGD(TAG, "Getting code for service %lu", (unsigned long)id);
+
+    // One locked lookup: codes (from the per-window cache when possible), period and issuer
+    totp_code_result_t result;
+    char issuer[MAX_ISSUER_LEN];
+    esp_err_t err = totp_storage_get_code(id, totp_get_timestamp(), &result, issuer, sizeof(issuer));
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGD(TAG, "Service %lu not found", (unsigned long)id);
+        return send_error(req, "404 Not Found", "Service not found", ESP_OK);
+    } else if (err == ESP_ERR_NOT_SUPPORTED) {
+        // HOTP codes advance a counter, so they are only produced on POST
+        return send_error(req, "409 Conflict", "HOTP service, use POST to generate a code", ESP_OK);
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to generate TOTP code: %s", esp_err_to_name(err));
+        return send_error(req, "500 Internal Server Error", "Failed to generate code", ESP_OK);
+    }
+
+    ESP_LOGD(TAG, "Sending TOTP code for %s (remaining: %lu)", issuer, (unsigned long)result.remaining);
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "code");
+    json_writer_uint(w, result.code);
+    json_writer_key(w, "next");
+    json_writer_uint(w, result.next_code);
+    json_writer_key(w, "remaining");
+    json_writer_uint(w, result.remaining);
+    json_writer_key(w, "period");
+    json_writer_uint(w, result.period);
+    json_writer_key(w, "digits");
+    json_writer_uint(w, result.digits);
+    json_writer_key(w, "service");
+    json_writer_string(w, issuer);
+    json_writer_end_object(w);
+    return resp_end(&resp);
+}
+
+// API: Generate next HOTP code (POST /api/code/1)
+static esp_err_t api_code_post_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "API: Generate HOTP code");
+
+    uint32_t id;
+    if (!parse_service_id(req->uri, &id)) {
+        return send_error(req, "400 Bad Request", "Invalid URI", ESP_OK);
+    }
+
+    // Only the digits are needed: no copy of the service (and its secret) on the stack
+    uint8_t digits;
+    esp_err_t err = totp_storage_get_digits(id, &digits);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return send_error(req, "404 Not Found", "Service not found", ESP_OK);
+    } else if (err != ESP_OK) {
+        return send_error(req, "500 Internal Server Error", "HOTP failed", err);
+    }
+
+    uint32_t code;
+    uint64_t counter;
+    err = totp_storage_next_hotp(id, &code, &counter);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return send_error(req, "404 Not Found", "Service not found", ESP_OK);
+    } else if (err != ESP_OK) {
+        return send_error(req, (err == ESP_ERR_NOT_SUPPORTED) ? "409 Conflict" : "500 Internal Server Error",
+                          "HOTP failed", err);
+    }
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "code");
+    json_writer_uint(w, code);
+    json_writer_key(w, "counter");
+    json_writer_uint(w, counter);
+    json_writer_key(w, "digits");
+    json_writer_uint(w, digits);
+    json_writer_end_object(w);
+    return resp_end(&resp);
+}
+
+// Write {"timestamp":...,"codes":[...]} for every service at one timestamp, with
+// codes fetched in fixed-size blocks; nothing is written if generation fails.
+// soonest receives the seconds until the first code changes (UINT32_MAX if none)
+static esp_err_t write_codes(json_writer_t *w, uint64_t timestamp, uint32_t *soonest) {
+    totp_code_result_t results[CODES_BLOCK_SIZE];
+    uint32_t ids[CODES_BLOCK_SIZE];
+    uint16_t count = 0;
+    esp_err_t err = totp_storage_generate_codes(timestamp, 0, results, ids, CODES_BLOCK_SIZE, &count);
+    if (err != ESP_OK && err != ESP_FAIL) {
+        ESP_LOGE(TAG, "Failed to generate codes: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    *soonest = UINT32_MAX;
+    json_writer_begin_object(w);
+    json_writer_key(w, "timestamp");
+    json_writer_uint(w, timestamp);
+    json_writer_key(w, "codes");
+    json_writer_begin_array(w);
+
+    uint16_t first = 0;
+    while (count > 0) {
+        for (uint16_t i = 0; i < count; i++) {
+            json_writer_begin_object(w);
+            json_writer_key(w, "id");
+            json_writer_uint(w, ids[i]);
+            if (results[i].valid) {
+                json_writer_key(w, "code");
+                json_writer_uint(w, results[i].code);
+                json_writer_key(w, "next");
+                json_writer_uint(w, results[i].next_code);
+                json_writer_key(w, "remaining");
+                json_writer_uint(w, results[i].remaining);
+                json_writer_key(w, "digits");
+                json_writer_uint(w, results[i].digits);
+                if (results[i].remaining < *soonest) {
+                    *soonest = results[i].remaining;
+                }
+            } else {
+                json_writer_key(w, "error");
+                json_writer_string(w, "Failed to generate code");
+            }
+            json_writer_end_object(w);
+        }
+
+        first += count;
+        if (count < CODES_BLOCK_SIZE ||
+            totp_storage_generate_codes(timestamp, first, results, ids, CODES_BLOCK_SIZE, &count) == ESP_ERR_INVALID_STATE) {
+            break;
+        }
+    }
+
+    json_writer_end_array(w);
+    json_writer_end_object(w);
+    return ESP_OK;
+}
+
+// API: Get TOTP codes of every service in one response
+static esp_err_t api_codes_get_handler(httpd_req_t *req) {
+    ESP_LOGD(TAG, "API: Get all codes");
+    if (!rate_limit_allow(req, RATE_LIMIT_READ)) {
         return ESP_FAIL;
     }
-    
-    int index = atoi(index_str + 1);
-    ESP_LOGI(TAG, "Getting code for service index %d", index);
-    
-    // Get service from storage
-    totp_service_t service;
-    esp_err_t err = totp_storage_get(index, &service);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get service %d: %s", index, esp_err_to_name(err));
-        httpd_resp_set_status(req, "404 Not Found");
-        httpd_resp_send(req, "{\"error\":\"Service not found\"}", HTTPD_RESP_USE_STRLEN);
+
+    // Streamed through the response buffer, no heap needed
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    uint32_t soonest;
+    if (write_codes(w, totp_get_timestamp(), &soonest) != ESP_OK) {
+        if (resp.chunked) {
+            // Headers are out: end the stream, the client sees a truncated list
+            resp_end(&resp);
+            return ESP_FAIL;
+        }
+        return send_error(req, "500 Internal Server Error", "Failed to generate codes", ESP_OK);
+    }
+    return resp_end(&resp);
+}
+
+// API: Verify a code (e.g., /api/verify/1?code=123456&window=1)
+static esp_err_t api_verify_get_handler(httpd_req_t *req) {
+    ESP_LOGD(TAG, "API: Verify code");
+    if (!rate_limit_allow(req, RATE_LIMIT_READ)) {
         return ESP_FAIL;
     }
-    
-    // Generate real TOTP code
-    uint32_t totp_code;
-    ESP_LOGI(TAG, "Generating TOTP code for service: %s (%s)", service.issuer, service.account);
-    ESP_LOGI(TAG, "Using secret: %s", service.secret);
-    ESP_LOGI(TAG, "Using digits: %d, period: %lu", service.digits, service.period);
-    err = totp_get_code(service.secret, service.digits, &totp_code);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to generate TOTP code: %s", esp_err_to_name(err));
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        httpd_resp_send(req, "{\"error\":\"Failed to generate code\"}", HTTPD_RESP_USE_STRLEN);
+
+    // ID is the last path segment, before the query string
+    uint32_t id;
+    char query[64];
+    char value[16];
+    if (!parse_service_id(req->uri, &id) ||
+        httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "code", value, sizeof(value)) != ESP_OK) {
+        return send_error(req, "400 Bad Request", "code parameter required", ESP_OK);
+    }
+
+    // Digits only, and no longer than the service's codes (leading zeros count)
+    size_t code_len = strlen(value);
+    uint8_t digits;
+    esp_err_t err = totp_storage_get_digits(id, &digits);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return send_error(req, "404 Not Found", "Service not found", ESP_OK);
+    } else if (err != ESP_OK) {
+        return send_error(req, "500 Internal Server Error", "Verify failed", err);
+    }
+    if (code_len == 0 || code_len > digits || strspn(value, "0123456789") != code_len) {
+        return send_error(req, "400 Bad Request", "Invalid code", ESP_OK);
+    }
+    uint32_t code = strtoul(value, NULL, 10);
+
+    // Beyond TOTP_VERIFY_MAX_WINDOW the ring does not hold the codes
+    uint8_t window = 1;
+    if (httpd_query_key_value(query, "window", value, sizeof(value)) == ESP_OK) {
+        char *end;
+        unsigned long parsed = strtoul(value, &end, 10);
+        if (value[0] < '0' || value[0] > '9' || *end != '\0' || parsed > TOTP_VERIFY_MAX_WINDOW) {
+            return send_error(req, "400 Bad Request", "Invalid window", ESP_OK);
+        }
+        window = (uint8_t)parsed;
+    }
+
+    bool valid = false;
+    err = totp_verify(id, code, window, &valid);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return send_error(req, "404 Not Found", "Service not found", ESP_OK);
+    } else if (err != ESP_OK) {
+        // HOTP services have no time window to verify against
+        return send_error(req, (err == ESP_ERR_NOT_SUPPORTED) ? "409 Conflict" : "500 Internal Server Error",
+                          "Verify failed", err);
+    }
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "valid");
+    json_writer_bool(w, valid);
+    json_writer_end_object(w);
+    return resp_end(&resp);
+}
+
+// API: Get the device clock, for pages that generate codes themselves
+static esp_err_t api_time_get_handler(httpd_req_t *req) {
+    if (!rate_limit_allow(req, RATE_LIMIT_READ)) {
         return ESP_FAIL;
     }
-    
-    // Get remaining seconds
-    uint32_t remaining = totp_get_remaining_seconds(service.period);
-    
-    char response[256];
-    snprintf(response, sizeof(response), 
-        "{\"code\":%lu,\"remaining\":%lu,\"service\":\"%s\"}", 
-        totp_code, remaining, service.issuer);
-    
-    ESP_LOGI(TAG, "Sending TOTP code for %s: %0*lu (remaining: %lu)", 
-             service.issuer, service.digits, totp_code, remaining);
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-    
-    return ESP_OK;
+
+    // The clock the codes are generated from (honours totp_set_time_source())
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "time");
+    json_writer_uint(w, totp_get_timestamp());
+    json_writer_end_object(w);
+    return resp_end(&resp);
 }
 
-// Mock API: Delete service
+// API: Get code cache statistics
+static esp_err_t api_stats_get_handler(httpd_req_t *req) {
+    if (!rate_limit_allow(req, RATE_LIMIT_READ)) {
+        return ESP_FAIL;
+    }
+    totp_cache_stats_t stats;
+    totp_cache_get_stats(&stats);
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "cache_hits");
+    json_writer_uint(w, stats.hits);
+    json_writer_key(w, "cache_misses");
+    json_writer_uint(w, stats.misses);
+    json_writer_end_object(w);
+    return resp_end(&resp);
+}
+
+// API: Delete service
 static esp_err_t api_services_delete_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "API: Delete service");
-    
-    // Extract index from URI (e.g., /api/services/0)
-    const char *uri = req->uri;
-    const char *index_str = strrchr(uri, '/');
-    if (index_str == NULL) {
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "{\"error\":\"Invalid URI\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+
+    // Extract service ID from URI (e.g., /api/services/1)
+    uint32_t id;
+    if (!parse_service_id(req->uri, &id)) {
+        return send_error(req, "400 Bad Request", "Invalid URI", ESP_OK);
     }
-    
-    int index = atoi(index_str + 1);
-    esp_err_t err = totp_storage_delete(index);
-    
-    if (err == ESP_OK) {
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
-    } else {
-        httpd_resp_set_status(req, "400 Bad Request");
-        char response[64];
-        snprintf(response, sizeof(response), "{\"error\":\"Delete failed: %s\"}", esp_err_to_name(err));
-        httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+
+    esp_err_t err = totp_storage_delete(id);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return send_error(req, "404 Not Found", "Service not found", ESP_OK);
+    } else if (err != ESP_OK) {
+        return send_error(req, "500 Internal Server Error", "Delete failed", err);
     }
-    
-    return err;
+
+    json_response_t resp;
+    json_writer_t *w = resp_begin(&resp, req, NULL);
+    json_writer_begin_object(w);
+    json_writer_key(w, "success");
+    json_writer_bool(w, true);
+    json_writer_end_object(w);
+    return resp_end(&resp);
 }
 
 bool api_code_uri_match(httpd_req_t *req, const char *uri, size_t uri_len) {
@@ -233,6 +800,259 @@ bool api_code_uri_match(httpd_req_t *req, const char *uri, size_t uri_len) {
     return false;
 }
 
+// Storage worker: handlers that write to flash run here on an async copy of
+// the request, so the httpd task keeps serving reads (from RAM) meanwhile
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t (*handler)(httpd_req_t *req);
+    http_metrics_pending_t metrics;
+} storage_job_t;
+
+static QueueHandle_t storage_queue = NULL;
+static TaskHandle_t storage_task = NULL;
+static bool storage_stopping = false;       // Set on the httpd task by server_deinit()
+static TaskHandle_t storage_stopper = NULL; // Task waiting for the worker to exit
+
+static void storage_task_fn(void *arg) {
+    storage_job_t job;
+    while (true) {
+        if (xQueueReceive(storage_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (job.handler == NULL) {
+            // Stop request, queued behind every accepted job
+            break;
+        }
+        esp_err_t ret = job.handler(job.req);
+        http_metrics_complete(&job.metrics, ret);
+        httpd_req_async_handler_complete(job.req);
+    }
+
+    xTaskNotifyGive(storage_stopper);
+    vTaskDelete(NULL);
+}
+
+// Queued on the httpd task, which is the only one submitting jobs: nothing can
+// be queued behind the stop request
+static void storage_stop_work(void *arg) {
+    storage_stopping = true;
+    storage_job_t stop = { .handler = NULL };
+    xQueueSend(storage_queue, &stop, portMAX_DELAY);
+}
+
+// Hand a request to the storage worker; 503 while its queue is full
+static esp_err_t submit_storage_job(httpd_req_t *req, esp_err_t (*handler)(httpd_req_t *req)) {
+    if (!rate_limit_allow(req, RATE_LIMIT_WRITE)) {
+        return ESP_FAIL;
+    }
+    if (storage_stopping) {
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return send_error(req, "503 Service Unavailable", "Server stopping", ESP_OK);
+    }
+    if (storage_queue == NULL) {
+        return handler(req);
+    }
+
+    // Only the httpd task enqueues, so a free slot cannot be taken before the send below
+    if (uxQueueSpacesAvailable(storage_queue) == 0) {
+        ESP_LOGW(TAG, "Storage queue full, rejecting %s", req->uri);
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return send_error(req, "503 Service Unavailable", "Storage busy", ESP_OK);
+    }
+
+    storage_job_t job = { .handler = handler };
+    esp_err_t err = httpd_req_async_handler_begin(req, &job.req);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start async request: %s", esp_err_to_name(err));
+        return send_error(req, "500 Internal Server Error", "Failed to queue request", err);
+    }
+    job.metrics = http_metrics_defer();
+    xQueueSend(storage_queue, &job, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static esp_err_t api_services_post_async(httpd_req_t *req) {
+    return submit_storage_job(req, api_services_post_handler);
+}
+
+static esp_err_t api_import_post_async(httpd_req_t *req) {
+    return submit_storage_job(req, api_import_post_handler);
+}
+
+static esp_err_t api_code_post_async(httpd_req_t *req) {
+    return submit_storage_job(req, api_code_post_handler);
+}
+
+static esp_err_t api_services_delete_async(httpd_req_t *req) {
+    return submit_storage_job(req, api_services_delete_handler);
+}
+
+#ifdef CONFIG_GMAKER_CODE_PUSH
+// Code push over WebSocket (/ws/codes): subscribers get the codes once on
+// connect and again at every window rollover, and count down locally.
+// The subscriber list is only touched from the httpd task (handlers and
+// queued work); the push task just schedules broadcasts.
+
+static int ws_fds[WS_MAX_SUBSCRIBERS];
+static volatile size_t ws_count = 0;
+static volatile uint32_t ws_next_rollover = 0;  // Unix time of the next broadcast
+static TaskHandle_t push_task = NULL;
+
+static void ws_remove(int fd) {
+    for (size_t i = 0; i < ws_count; i++) {
+        if (ws_fds[i] == fd) {
+            ws_fds[i] = ws_fds[--ws_count];
+            return;
+        }
+    }
+}
+
+// Forget sockets that were closed (or reused by a plain HTTP client)
+static void ws_prune(void) {
+    for (size_t i = 0; i < ws_count; ) {
+        if (httpd_ws_get_fd_info(server, ws_fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            ws_fds[i] = ws_fds[--ws_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+// One codes message sent as WebSocket fragments, one per writer buffer
+typedef struct {
+    int fds[WS_MAX_SUBSCRIBERS];
+    size_t count;
+    bool started;           // First fragment is out
+    bool finished;          // Final fragment is out
+    bool finishing;         // Flushing the last buffer
+    json_writer_t json;
+    char buf[RESP_BUFFER_SIZE];
+} ws_message_t;
+
+static esp_err_t ws_flush(const char *data, size_t len, void *ctx) {
+    ws_message_t *msg = ctx;
+    httpd_ws_frame_t frame = {
+        .type = msg->started ? HTTPD_WS_TYPE_CONTINUE : HTTPD_WS_TYPE_TEXT,
+        .fragmented = msg->started || !msg->finishing,
+        .final = msg->finishing,
+        .payload = (uint8_t *)data,
+        .len = len,
+    };
+    msg->started = true;
+    msg->finished = msg->finishing;
+
+    // A subscriber that misses a fragment is closed, the others still get it
+    for (size_t i = 0; i < msg->count; ) {
+        if (httpd_ws_send_frame_async(server, msg->fds[i], &frame) != ESP_OK) {
+            ESP_LOGW(TAG, "Dropping push subscriber %d", msg->fds[i]);
+            ws_remove(msg->fds[i]);
+            httpd_sess_trigger_close(server, msg->fds[i]);
+            msg->fds[i] = msg->fds[--msg->count];
+        } else {
+            i++;
+        }
+    }
+    return msg->count > 0 ? ESP_OK : ESP_FAIL;
+}
+
+// Send the current codes to the given subscribers; with reschedule, also set
+// the next broadcast (a subscriber joining just after a rollover must not
+// move it past the broadcast the others are still waiting for)
+static void ws_send_codes(const int *fds, size_t count, bool reschedule) {
+    ws_message_t msg;
+    memcpy(msg.fds, fds, count * sizeof(int));
+    msg.count = count;
+    msg.started = false;
+    msg.finished = false;
+    msg.finishing = false;
+    json_writer_init(&msg.json, msg.buf, sizeof(msg.buf), ws_flush, &msg);
+
+    uint64_t timestamp = totp_get_timestamp();
+    uint32_t soonest;
+    if (write_codes(&msg.json, timestamp, &soonest) == ESP_OK) {
+        msg.finishing = true;
+        if (json_writer_finish(&msg.json) == ESP_OK && msg.started && !msg.finished) {
+            // The last buffer was flushed while full: close the message with an empty fragment
+            ws_flush("", 0, &msg);
+        }
+    } else {
+        soonest = UINT32_MAX;
+    }
+
+    // Always at least one second ahead so the push task never spins
+    if (reschedule) {
+        ws_next_rollover = (uint32_t)timestamp + (soonest == UINT32_MAX ? PUSH_IDLE_S : soonest);
+    }
+}
+
+static void ws_broadcast_work(void *arg) {
+    ws_prune();
+    if (ws_count > 0) {
+        int fds[WS_MAX_SUBSCRIBERS];
+        size_t count = ws_count;
+        memcpy(fds, ws_fds, count * sizeof(int));
+        ws_send_codes(fds, count, true);
+    }
+    xTaskNotifyGive(push_task);
+}
+
+// Sleeps until just after the soonest rollover and queues a broadcast on the
+// httpd task; idle while nobody is subscribed
+static void push_task_fn(void *arg) {
+    while (true) {
+        if (ws_count == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // Seconds from the code generator's clock (honours totp_set_time_source());
+        // the system clock only places the wake-up within the second, and
+        // nothing is sent until the generator's clock reaches the rollover
+        int64_t remaining = (int64_t)ws_next_rollover - (int64_t)totp_get_timestamp();
+        if (remaining > 0) {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            int64_t wait_ms = remaining * 1000 - tv.tv_usec / 1000 + PUSH_GUARD_MS;
+            // A new subscriber wakes the task early to reschedule
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+            continue;
+        }
+
+        if (httpd_queue_work(server, ws_broadcast_work, NULL) != ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+        // The broadcast publishes the next rollover and notifies back
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PUSH_IDLE_S * 1000));
+    }
+}
+
+// WebSocket: subscribe to code pushes
+static esp_err_t ws_codes_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        // Handshake done: register the subscriber and send it the current codes
+        int fd = httpd_req_to_sockfd(req);
+        ws_prune();
+        if (ws_count >= WS_MAX_SUBSCRIBERS) {
+            ESP_LOGW(TAG, "Push subscriber limit reached, client falls back to polling");
+            return ESP_FAIL;
+        }
+
+        ws_fds[ws_count++] = fd;
+        ESP_LOGI(TAG, "Push subscriber %d connected (%u active)", fd, (unsigned)ws_count);
+        ws_send_codes(&fd, 1, ws_count == 1);
+        xTaskNotifyGive(push_task);
+        return ESP_OK;
+    }
+
+    // Clients are not expected to send anything: short frames are ignored,
+    // anything larger closes the connection
+    uint8_t payload[32];
+    httpd_ws_frame_t frame = { .payload = payload };
+    return httpd_ws_recv_frame(req, &frame, sizeof(payload));
+}
+#endif // CONFIG_GMAKER_CODE_PUSH
+
 // URI handler structures
 static const httpd_uri_t root_uri = {
     .uri       = "/",
@@ -251,7 +1071,14 @@ static const httpd_uri_t api_services_get_uri = {
 static const httpd_uri_t api_services_post_uri = {
     .uri       = "/api/services",
     .method    = HTTP_POST,
-    .handler   = api_services_post_handler,
+    .handler   = api_services_post_async,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t api_import_uri = {
+    .uri       = "/api/import",
+    .method    = HTTP_POST,
+    .handler   = api_import_post_async,
     .user_ctx  = NULL
 };
 
@@ -262,13 +1089,65 @@ static const httpd_uri_t api_code_uri = {
     .user_ctx  = NULL
 };
 
+static const httpd_uri_t api_code_post_uri = {
+    .uri       = "/api/code/*",
+    .method    = HTTP_POST,
+    .handler   = api_code_post_async,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t api_codes_uri = {
+    .uri       = "/api/codes",
+    .method    = HTTP_GET,
+    .handler   = api_codes_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t api_verify_uri = {
+    .uri       = "/api/verify/*",
+    .method    = HTTP_GET,
+    .handler   = api_verify_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t api_time_uri = {
+    .uri       = "/api/time",
+    .method    = HTTP_GET,
+    .handler   = api_time_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t api_stats_uri = {
+    .uri       = "/api/stats",
+    .method    = HTTP_GET,
+    .handler   = api_stats_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t api_metrics_uri = {
+    .uri       = "/api/metrics",
+    .method    = HTTP_GET,
+    .handler   = http_metrics_get_handler,
+    .user_ctx  = NULL
+};
+
 static const httpd_uri_t api_services_delete_uri = {
     .uri       = "/api/services/*",
     .method    = HTTP_DELETE,
-    .handler   = api_services_delete_handler,
+    .handler   = api_services_delete_async,
     .user_ctx  = NULL
 };
 
+#ifdef CONFIG_GMAKER_CODE_PUSH
+static const httpd_uri_t ws_codes_uri = {
+    .uri       = "/ws/codes",
+    .method    = HTTP_GET,
+    .handler   = ws_codes_handler,
+    .user_ctx  = NULL,
+    .is_websocket = true
+};
+#endif
+
 esp_err_t server_init(void) {
     if (server_running) {
         ESP_LOGW(TAG, "Server already running");
@@ -280,11 +1159,16 @@ esp_err_t server_init(void) {
     // HTTP server configuration
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
-    config.max_open_sockets = 7;
+    config.max_open_sockets = MAX_OPEN_SOCKETS;
     config.lru_purge_enable = true;
-    config.max_uri_handlers = 10;
+    config.max_uri_handlers = 14;
     config.stack_size = 6144;  // Increase stack size to avoid overflow
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.open_fn = http_metrics_session_open;
+    config.close_fn = http_metrics_session_close;
+
+    http_metrics_init(config.max_open_sockets);
+    rate_limit_reset();
 
     // Start the HTTP server
     esp_err_t err = httpd_start(&server, &config);
@@ -293,12 +1177,41 @@ esp_err_t server_init(void) {
         return err;
     }
 
-    // Register URI handlers
-    httpd_register_uri_handler(server, &root_uri);
-    httpd_register_uri_handler(server, &api_services_get_uri);
-    httpd_register_uri_handler(server, &api_services_post_uri);
-    httpd_register_uri_handler(server, &api_code_uri);
-    httpd_register_uri_handler(server, &api_services_delete_uri);
+    // Without the worker, mutating requests are handled inline on the httpd task
+    storage_stopping = false;
+    storage_queue = xQueueCreate(STORAGE_QUEUE_LEN, sizeof(storage_job_t));
+    if (storage_queue == NULL ||
+        xTaskCreate(storage_task_fn, "storage_worker", STORAGE_TASK_STACK, NULL,
+                    STORAGE_TASK_PRIO, &storage_task) != pdPASS) {
+        ESP_LOGW(TAG, "Storage worker not started, flash writes run on the httpd task");
+        if (storage_queue != NULL) {
+            vQueueDelete(storage_queue);
+            storage_queue = NULL;
+        }
+        storage_task = NULL;
+    }
+
+    // Register URI handlers, each wrapped with per-route metrics
+    http_metrics_register(server, &root_uri);
+    http_metrics_register(server, &api_services_get_uri);
+    http_metrics_register(server, &api_services_post_uri);
+    http_metrics_register(server, &api_import_uri);
+    http_metrics_register(server, &api_code_uri);
+    http_metrics_register(server, &api_code_post_uri);
+    http_metrics_register(server, &api_codes_uri);
+    http_metrics_register(server, &api_verify_uri);
+    http_metrics_register(server, &api_time_uri);
+    http_metrics_register(server, &api_stats_uri);
+    http_metrics_register(server, &api_metrics_uri);
+    http_metrics_register(server, &api_services_delete_uri);
+#ifdef CONFIG_GMAKER_CODE_PUSH
+    if (xTaskCreate(push_task_fn, "code_push", PUSH_TASK_STACK, NULL, PUSH_TASK_PRIO, &push_task) == pdPASS) {
+        http_metrics_register(server, &ws_codes_uri);
+    } else {
+        ESP_LOGW(TAG, "Code push task not started, pages fall back to polling");
+        push_task = NULL;
+    }
+#endif
 
     server_running = true;
     ESP_LOGI(TAG, "HTTP server started on port 80");
@@ -313,12 +1226,36 @@ esp_err_t server_deinit(void) {
 
     ESP_LOGI(TAG, "Stopping HTTP server");
 
+    // Let the storage worker finish the accepted requests and exit on its own
+    // (never in the middle of a flash write), while their sessions still exist
+    if (storage_task != NULL) {
+        storage_stopper = xTaskGetCurrentTaskHandle();
+        if (httpd_queue_work(server, storage_stop_work, NULL) != ESP_OK) {
+            storage_stop_work(NULL);
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        storage_task = NULL;
+    }
+    if (storage_queue != NULL) {
+        vQueueDelete(storage_queue);
+        storage_queue = NULL;
+    }
+
     esp_err_t err = httpd_stop(server);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to stop HTTP server: %s", esp_err_to_name(err));
         return err;
     }
 
+#ifdef CONFIG_GMAKER_CODE_PUSH
+    // After httpd_stop() no queued broadcast can notify the task any more
+    if (push_task != NULL) {
+        vTaskDelete(push_task);
+        push_task = NULL;
+    }
+    ws_count = 0;
+#endif
+
     server = NULL;
     server_running = false;
     ESP_LOGI(TAG, "HTTP server stopped");
@@ -6,6 +6,45 @@
 static const char *TAG = "nvs_helper";
 static bool nvs_ready = false;
 
+// Namespace handle, opened on first use and kept until deinit
+static nvs_handle_t nvs_handle;
+static bool handle_open = false;
+
+// Nesting depth of nvs_helper_begin(); writes commit only at depth 0
+static int txn_depth = 0;
+
+static esp_err_t get_handle(nvs_handle_t *out) {
+    if (!nvs_ready) {
+        ESP_LOGE(TAG, "NVS helper not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!handle_open) {
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
+            return err;
+        }
+        handle_open = true;
+    }
+
+    *out = nvs_handle;
+    return ESP_OK;
+}
+
+// Commit a single write unless a transaction is open
+static esp_err_t commit_unless_batched(nvs_handle_t handle) {
+    if (txn_depth > 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = nvs_commit(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_commit failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
 esp_err_t nvs_helper_init(void) {
     if (nvs_ready) {
         ESP_LOGW(TAG, "NVS helper already initialized");
@@ -39,6 +78,16 @@ esp_err_t nvs_helper_deinit(void) {
     }
 
     ESP_LOGI(TAG, "Deinitializing NVS");
+    if (handle_open) {
+        if (txn_depth > 0) {
+            ESP_LOGW(TAG, "Closing NVS with an open transaction, committing it");
+            nvs_commit(nvs_handle);
+            txn_depth = 0;
+        }
+        nvs_close(nvs_handle);
+        handle_open = false;
+    }
+
     esp_err_t err = nvs_flash_deinit();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "nvs_flash_deinit failed: %s", esp_err_to_name(err));
@@ -54,51 +103,51 @@ bool nvs_helper_is_ready(void) {
     return nvs_ready;
 }
 
-esp_err_t nvs_helper_save(const char *key, const void *data, size_t size) {
-    if (!nvs_ready) {
-        ESP_LOGE(TAG, "NVS helper not initialized");
+esp_err_t nvs_helper_begin(void) {
+    nvs_handle_t handle;
+    esp_err_t err = get_handle(&handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    txn_depth++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_helper_commit(void) {
+    if (txn_depth == 0) {
+        ESP_LOGE(TAG, "nvs_helper_commit without nvs_helper_begin");
         return ESP_ERR_INVALID_STATE;
     }
 
+    txn_depth--;
+    return commit_unless_batched(nvs_handle);
+}
+
+esp_err_t nvs_helper_save(const char *key, const void *data, size_t size) {
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    esp_err_t err = get_handle(&handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
         return err;
     }
 
     err = nvs_set_blob(handle, key, data, size);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "nvs_set_blob failed for key '%s': %s", key, esp_err_to_name(err));
-        nvs_close(handle);
         return err;
     }
 
-    err = nvs_commit(handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "nvs_commit failed: %s", esp_err_to_name(err));
-    } else {
-        ESP_LOGI(TAG, "Saved key '%s' (%d bytes)", key, size);
+    err = commit_unless_batched(handle);
+    if (err == ESP_OK) {
+        ESP_LOGD(TAG, "Saved key '%s' (%u bytes)", key, (unsigned)size);
     }
-
-    nvs_close(handle);
     return err;
 }
 
 esp_err_t nvs_helper_load(const char *key, void *data, size_t *size) {
-    if (!nvs_ready) {
-        ESP_LOGE(TAG, "NVS helper not initialized");
-        return ESP_ERR_INVALID_STATE;
-    }
-
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        // Namespace doesn't exist yet (first run) - this is normal
-        ESP_LOGI(TAG, "Namespace '%s' not found (first run)", NVS_NAMESPACE);
-        return ESP_ERR_NVS_NOT_FOUND;
-    } else if (err != ESP_OK) {
-        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
+    esp_err_t err = get_handle(&handle);
+    if (err != ESP_OK) {
         return err;
     }
 
@@ -108,57 +157,41 @@ esp_err_t nvs_helper_load(const char *key, void *data, size_t *size) {
     } else if (err != ESP_OK) {
         ESP_LOGE(TAG, "nvs_get_blob failed for key '%s': %s", key, esp_err_to_name(err));
     } else {
-        ESP_LOGI(TAG, "Loaded key '%s' (%d bytes)", key, *size);
+        ESP_LOGD(TAG, "Loaded key '%s' (%u bytes)", key, (unsigned)*size);
     }
 
-    nvs_close(handle);
     return err;
 }
 
 esp_err_t nvs_helper_delete(const char *key) {
-    if (!nvs_ready) {
-        ESP_LOGE(TAG, "NVS helper not initialized");
-        return ESP_ERR_INVALID_STATE;
-    }
-
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    esp_err_t err = get_handle(&handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
         return err;
     }
 
     err = nvs_erase_key(handle, key);
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGW(TAG, "Key '%s' not found for deletion", key);
+        return err;
     } else if (err != ESP_OK) {
         ESP_LOGE(TAG, "nvs_erase_key failed for key '%s': %s", key, esp_err_to_name(err));
-    } else {
-        ESP_LOGI(TAG, "Deleted key '%s'", key);
+        return err;
     }
 
-    nvs_commit(handle);
-    nvs_close(handle);
+    err = commit_unless_batched(handle);
+    if (err == ESP_OK) {
+        ESP_LOGD(TAG, "Deleted key '%s'", key);
+    }
     return err;
 }
 
 bool nvs_helper_exists(const char *key) {
-    if (!nvs_ready) {
-        return false;
-    }
-
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        // Namespace doesn't exist yet
-        return false;
-    } else if (err != ESP_OK) {
+    if (!nvs_ready || get_handle(&handle) != ESP_OK) {
         return false;
     }
 
     size_t size;
-    err = nvs_get_blob(handle, key, NULL, &size);
-    nvs_close(handle);
-
-    return (err == ESP_OK);
+    return nvs_get_blob(handle, key, NULL, &size) == ESP_OK;
 }
@@ -26,7 +26,25 @@ esp_err_t nvs_helper_deinit(void);
 bool nvs_helper_is_ready(void);
 
 /**
- * @brief Save data to NVS
+ * @brief Start a transaction: writes are only committed by nvs_helper_commit()
+ * @return ESP_OK on success
+ *
+ * Transactions nest; only the outermost nvs_helper_commit() commits. The
+ * helper keeps one NVS handle open and is not thread-safe, callers serialize
+ * access (totp_storage holds its lock).
+ */
+esp_err_t nvs_helper_begin(void);
+
+/**
+ * @brief End the transaction started by nvs_helper_begin()
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE without a matching begin
+ *
+ * NVS has no rollback: writes that succeeded before a failure stay applied.
+ */
+esp_err_t nvs_helper_commit(void);
+
+/**
+ * @brief Save data to NVS (committed now, or by nvs_helper_commit() in a transaction)
  * @param key Key name
  * @param data Data to save
  * @param size Size of data
@@ -44,9 +62,9 @@ esp_err_t nvs_helper_save(const char *key, const void *data, size_t size);
 esp_err_t nvs_helper_load(const char *key, void *data, size_t *size);
 
 /**
- * @brief Delete data from NVS
+ * @brief Delete data from NVS (committed now, or by nvs_helper_commit() in a transaction)
  * @param key Key name
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if the key does not exist
  */
 esp_err_t nvs_helper_delete(const char *key);
 
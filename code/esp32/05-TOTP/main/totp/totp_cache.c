@@ -0,0 +1,109 @@
+#include "totp_cache.h"
+#include "totp_storage.h"
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct {
+    uint64_t counter;
+    uint32_t code;
+    bool valid;
+} cache_entry_t;
+
+#define CACHE_WAYS  2   // Current and look-ahead window
+
+// Entries per service slot (same indices as totp_storage), grown with its table
+static cache_entry_t (*cache)[CACHE_WAYS] = NULL;
+static uint16_t cache_capacity = 0;
+static totp_cache_stats_t stats = {0};
+
+esp_err_t totp_cache_reserve(uint16_t capacity) {
+    if (capacity <= cache_capacity) {
+        return ESP_OK;
+    }
+
+    cache_entry_t (*grown)[CACHE_WAYS] = realloc(cache, capacity * sizeof(cache[0]));
+    if (grown == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(grown[cache_capacity], 0, (capacity - cache_capacity) * sizeof(grown[0]));
+    cache = grown;
+    cache_capacity = capacity;
+    return ESP_OK;
+}
+
+bool totp_cache_lookup(uint16_t index, uint64_t counter, uint32_t *code) {
+    if (index >= cache_capacity || code == NULL) {
+        return false;
+    }
+
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        const cache_entry_t *entry = &cache[index][way];
+        if (entry->valid && entry->counter == counter) {
+            *code = entry->code;
+            stats.hits++;
+            return true;
+        }
+    }
+
+    stats.misses++;
+    return false;
+}
+
+bool totp_cache_contains(uint16_t index, uint64_t counter) {
+    if (index >= cache_capacity) {
+        return false;
+    }
+
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        const cache_entry_t *entry = &cache[index][way];
+        if (entry->valid && entry->counter == counter) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void totp_cache_store(uint16_t index, uint64_t counter, uint32_t code) {
+    if (index >= cache_capacity) {
+        return;
+    }
+
+    // Reuse the entry for the same counter, else an empty one, else the oldest
+    cache_entry_t *victim = &cache[index][0];
+    for (int way = 0; way < CACHE_WAYS; way++) {
+        cache_entry_t *entry = &cache[index][way];
+        if (entry->valid && entry->counter == counter) {
+            victim = entry;
+            break;
+        }
+        if (!entry->valid) {
+            victim = entry;
+        } else if (victim->valid && entry->counter < victim->counter) {
+            victim = entry;
+        }
+    }
+
+    victim->counter = counter;
+    victim->code = code;
+    victim->valid = true;
+}
+
+void totp_cache_invalidate(uint16_t index) {
+    if (index >= cache_capacity) {
+        return;
+    }
+
+    memset(cache[index], 0, sizeof(cache[index]));
+}
+
+void totp_cache_release(void) {
+    free(cache);
+    cache = NULL;
+    cache_capacity = 0;
+}
+
+void totp_cache_get_stats(totp_cache_stats_t *out) {
+    if (out != NULL) {
+        *out = stats;
+    }
+}
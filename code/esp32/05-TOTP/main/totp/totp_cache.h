@@ -0,0 +1,70 @@
+#ifndef TOTP_CACHE_H
+#define TOTP_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * @brief Code cache statistics
+ */
+typedef struct {
+    uint32_t hits;      // Lookups served from memory
+    uint32_t misses;    // Lookups that required an HMAC
+} totp_cache_stats_t;
+
+/**
+ * @brief Make room for service indices below capacity (grown with the service table)
+ * @param capacity Number of service slots
+ * @return ESP_OK, or ESP_ERR_NO_MEM (the cache keeps its previous size)
+ */
+esp_err_t totp_cache_reserve(uint16_t capacity);
+
+/**
+ * @brief Look up the cached code of a service for a time counter
+ * @param index Service index
+ * @param counter Time counter (timestamp / period)
+ * @param code Output code on hit
+ * @return true on hit, false if the code must be computed
+ *
+ * An entry stored for another counter (previous window) counts as a miss.
+ */
+bool totp_cache_lookup(uint16_t index, uint64_t counter, uint32_t *code);
+
+/**
+ * @brief Check whether a code is cached, without touching the statistics
+ * @param index Service index
+ * @param counter Time counter (timestamp / period)
+ * @return true if the code for that counter is cached
+ */
+bool totp_cache_contains(uint16_t index, uint64_t counter);
+
+/**
+ * @brief Store the code of a service for a time counter
+ * @param index Service index
+ * @param counter Time counter (timestamp / period)
+ * @param code Code to cache
+ *
+ * Each service keeps two windows (typically current and next); the entry
+ * with the older counter is replaced.
+ */
+void totp_cache_store(uint16_t index, uint64_t counter, uint32_t code);
+
+/**
+ * @brief Invalidate the cached code of one service
+ * @param index Service index
+ */
+void totp_cache_invalidate(uint16_t index);
+
+/**
+ * @brief Drop every cached code and free the cache (statistics are kept)
+ */
+void totp_cache_release(void);
+
+/**
+ * @brief Get hit/miss counters
+ * @param stats Output statistics
+ */
+void totp_cache_get_stats(totp_cache_stats_t *stats);
+
+#endif // TOTP_CACHE_H
@@ -1,53 +1,121 @@
 #include "totp_engine.h"
 #include "utils/base32.h"
 #include "esp_log.h"
-#include "mbedtls/md.h"
 #include <string.h>
 #include <sys/time.h>
 
 static const char *TAG = "totp_engine";
 
-// HMAC-SHA1 implementation using mbedtls
-static esp_err_t hmac_sha1(const uint8_t *key, size_t key_len, 
-                           const uint8_t *data, size_t data_len,
-                           uint8_t *output) {
-    const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
-    if (md_info == NULL) {
-        return ESP_FAIL;
-    }
+#define HMAC_MAX_BLOCK_SIZE     128
+#define HMAC_MAX_DIGEST_SIZE    64
 
-    int ret = mbedtls_md_hmac(md_info, key, key_len, data, data_len, output);
-    if (ret != 0) {
-        return ESP_FAIL;
-    }
+// mbedtls SHA-2 entry points take an extra "truncated variant" flag
+static inline int sha256_starts(mbedtls_sha256_context *ctx) {
+    return mbedtls_sha256_starts(ctx, 0);
+}
 
-    return ESP_OK;
+static inline int sha256_digest(const uint8_t *in, size_t len, uint8_t *out) {
+    return mbedtls_sha256(in, len, out, 0);
 }
 
-/**
-static inline uint64_t get_timestamp(void) {
-    return esp_timer_get_time() / 1000000ULL;
-}*/
+static inline int sha512_starts(mbedtls_sha512_context *ctx) {
+    return mbedtls_sha512_starts(ctx, 0);
+}
 
-// Get current Unix timestamp
-static uint64_t get_timestamp(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    ESP_LOGI(TAG, "Current time: %ld seconds since the Epoch", tv.tv_sec);
-    return (uint64_t)tv.tv_sec;
+static inline int sha512_digest(const uint8_t *in, size_t len, uint8_t *out) {
+    return mbedtls_sha512(in, len, out, 0);
 }
 
-esp_err_t totp_generate_code(const char *secret_b32, uint32_t time_step, uint8_t digits, uint32_t *code) {
-    if (secret_b32 == NULL || code == NULL) {
-        ESP_LOGE(TAG, "Invalid parameters");
-        return ESP_ERR_INVALID_ARG;
+/*
+ * HMAC kernels, one set per hash, expanded at compile time so the hot path
+ * calls the hash functions directly instead of going through mbedtls_md.
+ *
+ * NAME##_absorb_pad: absorb one padded key block and keep the state in dst.
+ * Going through a temporary context and clone() makes sure dst ends up as a
+ * plain software state, so it never holds the hardware SHA engine locked.
+ *
+ * NAME##_hmac: H(opad || H(ipad || msg)), resuming from the pad states.
+ */
+#define DEFINE_HMAC_KERNEL(NAME, CTX, BLOCK, DIGEST, INIT, FREE, CLONE, STARTS, UPDATE, FINISH)  \
+    static esp_err_t NAME##_absorb_pad(CTX *dst, const uint8_t *pad) {                        \
+        CTX ctx;                                                                              \
+        INIT(&ctx);                                                                           \
+        int ret = STARTS(&ctx);                                                               \
+        if (ret == 0) {                                                                       \
+            ret = UPDATE(&ctx, pad, BLOCK);                                                   \
+        }                                                                                     \
+        if (ret == 0) {                                                                       \
+            INIT(dst);                                                                        \
+            CLONE(dst, &ctx);                                                                 \
+        }                                                                                     \
+        FREE(&ctx);                                                                           \
+        return (ret == 0) ? ESP_OK : ESP_FAIL;                                                \
+    }                                                                                         \
+                                                                                              \
+    static esp_err_t NAME##_hmac(const CTX *inner, const CTX *outer,                          \
+                                 const uint8_t *msg, size_t msg_len, uint8_t *out) {          \
+        CTX ctx;                                                                              \
+        INIT(&ctx);                                                                           \
+        CLONE(&ctx, inner);                                                                   \
+        int ret = UPDATE(&ctx, msg, msg_len);                                                 \
+        if (ret == 0) {                                                                       \
+            ret = FINISH(&ctx, out);                                                          \
+        }                                                                                     \
+        FREE(&ctx);                                                                           \
+        if (ret == 0) {                                                                       \
+            INIT(&ctx);                                                                       \
+            CLONE(&ctx, outer);                                                               \
+            ret = UPDATE(&ctx, out, DIGEST);                                                  \
+            if (ret == 0) {                                                                   \
+                ret = FINISH(&ctx, out);                                                      \
+            }                                                                                 \
+            FREE(&ctx);                                                                       \
+        }                                                                                     \
+        return (ret == 0) ? ESP_OK : ESP_FAIL;                                                \
+    }
+
+DEFINE_HMAC_KERNEL(sha1, mbedtls_sha1_context, 64, 20,
+                   mbedtls_sha1_init, mbedtls_sha1_free, mbedtls_sha1_clone,
+                   mbedtls_sha1_starts, mbedtls_sha1_update, mbedtls_sha1_finish)
+
+DEFINE_HMAC_KERNEL(sha256, mbedtls_sha256_context, 64, 32,
+                   mbedtls_sha256_init, mbedtls_sha256_free, mbedtls_sha256_clone,
+                   sha256_starts, mbedtls_sha256_update, mbedtls_sha256_finish)
+
+DEFINE_HMAC_KERNEL(sha512, mbedtls_sha512_context, 128, 64,
+                   mbedtls_sha512_init, mbedtls_sha512_free, mbedtls_sha512_clone,
+                   sha512_starts, mbedtls_sha512_update, mbedtls_sha512_finish)
+
+// Block and digest sizes per algorithm
+static size_t block_size(totp_algorithm_t algorithm) {
+    return (algorithm == TOTP_ALGO_SHA512) ? 128 : 64;
+}
+
+static size_t digest_size(totp_algorithm_t algorithm) {
+    switch (algorithm) {
+        case TOTP_ALGO_SHA256: return 32;
+        case TOTP_ALGO_SHA512: return 64;
+        default:               return 20;
     }
+}
 
-    if (digits < 6 || digits > 8) {
-        ESP_LOGE(TAG, "Digits must be 6, 7, or 8");
+const char *totp_algorithm_name(totp_algorithm_t algorithm) {
+    switch (algorithm) {
+        case TOTP_ALGO_SHA1:   return "SHA1";
+        case TOTP_ALGO_SHA256: return "SHA256";
+        case TOTP_ALGO_SHA512: return "SHA512";
+        default:               return "UNKNOWN";
+    }
+}
+
+esp_err_t totp_key_init(totp_key_t *key, const char *secret_b32, totp_algorithm_t algorithm,
+                        uint8_t digits, uint32_t period) {
+    if (key == NULL || secret_b32 == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    memset(key, 0, sizeof(totp_key_t));
+
     // Decode Base32 secret
     uint8_t secret[128];
     int secret_len = base32_decode(secret_b32, secret, sizeof(secret));
@@ -56,14 +124,120 @@ esp_err_t totp_generate_code(const char *secret_b32, uint32_t time_step, uint8_t
         return ESP_ERR_INVALID_ARG;
     }
 
-    ESP_LOGI(TAG, "Decoded secret length: %d bytes", secret_len);
-    ESP_LOGI(TAG, "Decoded secret %.*s", secret_len, secret);
+    esp_err_t err = totp_key_init_raw(key, secret, secret_len, algorithm, digits, period);
+    memset(secret, 0, sizeof(secret));
+    return err;
+}
 
-    // Get current time counter
-    uint64_t timestamp = get_timestamp();
-    uint64_t counter = timestamp / time_step;
-    
-    ESP_LOGD(TAG, "Timestamp: %llu, Counter: %llu", timestamp, counter);
+esp_err_t totp_key_init_raw(totp_key_t *key, const uint8_t *secret, size_t secret_len,
+                            totp_algorithm_t algorithm, uint8_t digits, uint32_t period) {
+    if (key == NULL || secret == NULL || secret_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(key, 0, sizeof(totp_key_t));
+
+    if (digits < 6 || digits > 8 || period == 0) {
+        ESP_LOGE(TAG, "Invalid digits %d or period %lu", digits, (unsigned long)period);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (algorithm != TOTP_ALGO_SHA1 && algorithm != TOTP_ALGO_SHA256 &&
+        algorithm != TOTP_ALGO_SHA512) {
+        ESP_LOGE(TAG, "Unsupported algorithm %d", algorithm);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Keys longer than the block size are hashed first (RFC 2104)
+    size_t block_len = block_size(algorithm);
+    uint8_t block[HMAC_MAX_BLOCK_SIZE] = {0};
+    int ret = 0;
+    if (secret_len > block_len) {
+        switch (algorithm) {
+            case TOTP_ALGO_SHA256: ret = sha256_digest(secret, secret_len, block); break;
+            case TOTP_ALGO_SHA512: ret = sha512_digest(secret, secret_len, block); break;
+            default:               ret = mbedtls_sha1(secret, secret_len, block); break;
+        }
+    } else {
+        memcpy(block, secret, secret_len);
+    }
+
+    esp_err_t err = (ret == 0) ? ESP_OK : ESP_FAIL;
+    uint8_t ipad[HMAC_MAX_BLOCK_SIZE];
+    uint8_t opad[HMAC_MAX_BLOCK_SIZE];
+    for (size_t i = 0; i < block_len; i++) {
+        ipad[i] = block[i] ^ 0x36;
+        opad[i] = block[i] ^ 0x5C;
+    }
+
+    if (err == ESP_OK) {
+        switch (algorithm) {
+            case TOTP_ALGO_SHA256:
+                err = sha256_absorb_pad(&key->state.sha256.inner, ipad);
+                if (err == ESP_OK) {
+                    err = sha256_absorb_pad(&key->state.sha256.outer, opad);
+                }
+                break;
+            case TOTP_ALGO_SHA512:
+                err = sha512_absorb_pad(&key->state.sha512.inner, ipad);
+                if (err == ESP_OK) {
+                    err = sha512_absorb_pad(&key->state.sha512.outer, opad);
+                }
+                break;
+            default:
+                err = sha1_absorb_pad(&key->state.sha1.inner, ipad);
+                if (err == ESP_OK) {
+                    err = sha1_absorb_pad(&key->state.sha1.outer, opad);
+                }
+                break;
+        }
+    }
+
+    memset(block, 0, sizeof(block));
+    memset(ipad, 0, sizeof(ipad));
+    memset(opad, 0, sizeof(opad));
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to precompute HMAC key state");
+        memset(key, 0, sizeof(totp_key_t));
+        return err;
+    }
+
+    key->algorithm = algorithm;
+    key->digits = digits;
+    key->period = period;
+    key->ready = true;
+    return ESP_OK;
+}
+
+void totp_key_free(totp_key_t *key) {
+    if (key == NULL) {
+        return;
+    }
+
+    if (key->ready) {
+        switch (key->algorithm) {
+            case TOTP_ALGO_SHA256:
+                mbedtls_sha256_free(&key->state.sha256.inner);
+                mbedtls_sha256_free(&key->state.sha256.outer);
+                break;
+            case TOTP_ALGO_SHA512:
+                mbedtls_sha512_free(&key->state.sha512.inner);
+                mbedtls_sha512_free(&key->state.sha512.outer);
+                break;
+            default:
+                mbedtls_sha1_free(&key->state.sha1.inner);
+                mbedtls_sha1_free(&key->state.sha1.outer);
+                break;
+        }
+    }
+    memset(key, 0, sizeof(totp_key_t));
+}
+
+esp_err_t totp_key_generate(const totp_key_t *key, uint64_t counter, uint32_t *code) {
+    if (key == NULL || !key->ready || code == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
     // Convert counter to big-endian bytes
     uint8_t counter_bytes[8];
@@ -72,16 +246,30 @@ esp_err_t totp_generate_code(const char *secret_b32, uint32_t time_step, uint8_t
         counter >>= 8;
     }
 
-    // Compute HMAC-SHA1
-    uint8_t hmac[20];
-    esp_err_t err = hmac_sha1(secret, secret_len, counter_bytes, sizeof(counter_bytes), hmac);
+    uint8_t hmac[HMAC_MAX_DIGEST_SIZE];
+    esp_err_t err;
+    switch (key->algorithm) {
+        case TOTP_ALGO_SHA256:
+            err = sha256_hmac(&key->state.sha256.inner, &key->state.sha256.outer,
+                              counter_bytes, sizeof(counter_bytes), hmac);
+            break;
+        case TOTP_ALGO_SHA512:
+            err = sha512_hmac(&key->state.sha512.inner, &key->state.sha512.outer,
+                              counter_bytes, sizeof(counter_bytes), hmac);
+            break;
+        default:
+            err = sha1_hmac(&key->state.sha1.inner, &key->state.sha1.outer,
+                            counter_bytes, sizeof(counter_bytes), hmac);
+            break;
+    }
+
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "HMAC-SHA1 failed");
+        ESP_LOGE(TAG, "HMAC-%s failed", totp_algorithm_name(key->algorithm));
         return err;
     }
 
     // Dynamic truncation (RFC 4226)
-    int offset = hmac[19] & 0x0F;
+    int offset = hmac[digest_size(key->algorithm) - 1] & 0x0F;
     uint32_t binary = ((hmac[offset] & 0x7F) << 24) |
                       ((hmac[offset + 1] & 0xFF) << 16) |
                       ((hmac[offset + 2] & 0xFF) << 8) |
@@ -89,20 +277,95 @@ esp_err_t totp_generate_code(const char *secret_b32, uint32_t time_step, uint8_t
 
     // Generate code with specified number of digits
     uint32_t modulo = 1;
-    for (int i = 0; i < digits; i++) {
+    for (int i = 0; i < key->digits; i++) {
         modulo *= 10;
     }
     *code = binary % modulo;
 
-    ESP_LOGI(TAG, "Generated TOTP code: %0*lu", digits, *code);
-
     return ESP_OK;
 }
 
+esp_err_t totp_generate_codes_batch(const totp_key_t *keys, size_t count, uint64_t timestamp,
+                                    totp_code_result_t *results) {
+    if ((keys == NULL || results == NULL) && count > 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < count; i++) {
+        memset(&results[i], 0, sizeof(totp_code_result_t));
+
+        if (!keys[i].ready) {
+            ret = ESP_FAIL;
+            continue;
+        }
+
+        uint32_t period = keys[i].period;
+        uint64_t counter = timestamp / period;
+        if (totp_key_generate(&keys[i], counter, &results[i].code) != ESP_OK ||
+            totp_key_generate(&keys[i], counter + 1, &results[i].next_code) != ESP_OK) {
+            ret = ESP_FAIL;
+            continue;
+        }
+
+        results[i].digits = keys[i].digits;
+        results[i].period = period;
+
+        results[i].remaining = period - (timestamp % period);
+        results[i].valid = true;
+    }
+
+    return ret;
+}
+
+// Default time source: system clock (set by NTP)
+static uint64_t system_timestamp(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec;
+}
+
+static totp_time_source_t time_source = system_timestamp;
+
+// Get current Unix timestamp (no logging, this runs on every code request)
+static inline uint64_t get_timestamp(void) {
+    return time_source();
+}
+
+esp_err_t totp_generate_code(const char *secret_b32, uint32_t time_step, uint8_t digits, uint32_t *code) {
+    if (secret_b32 == NULL || code == NULL || time_step == 0) {
+        ESP_LOGE(TAG, "Invalid parameters");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    totp_key_t key;
+    esp_err_t err = totp_key_init(&key, secret_b32, TOTP_ALGO_SHA1, digits, time_step);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Get current time counter
+    uint64_t timestamp = get_timestamp();
+    uint64_t counter = timestamp / time_step;
+    
+    err = totp_key_generate(&key, counter, code);
+    totp_key_free(&key);
+
+    return err;
+}
+
 esp_err_t totp_get_code(const char *secret_b32, uint8_t digits, uint32_t *code) {
     return totp_generate_code(secret_b32, 30, digits, code);
 }
 
+void totp_set_time_source(totp_time_source_t source) {
+    time_source = (source != NULL) ? source : system_timestamp;
+}
+
+uint64_t totp_get_timestamp(void) {
+    return get_timestamp();
+}
+
 uint32_t totp_get_remaining_seconds(uint32_t period) {
     uint64_t timestamp = get_timestamp();
     return period - (timestamp % period);
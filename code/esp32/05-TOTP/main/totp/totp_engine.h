@@ -3,7 +3,122 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "esp_err.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/sha512.h"
+
+/**
+ * @brief HMAC hash algorithm (otpauth "algorithm" parameter)
+ */
+typedef enum {
+    TOTP_ALGO_SHA1 = 0,     // Default, value 0 keeps older records valid
+    TOTP_ALGO_SHA256 = 1,
+    TOTP_ALGO_SHA512 = 2,
+} totp_algorithm_t;
+
+/**
+ * @brief Time source returning the current Unix timestamp in seconds
+ */
+typedef uint64_t (*totp_time_source_t)(void);
+
+/**
+ * @brief Precomputed HMAC key state
+ *
+ * Holds the hash states after absorbing the inner and outer key pads,
+ * so generating a code only costs the two final compressions.
+ */
+typedef struct {
+    union {
+        struct {
+            mbedtls_sha1_context inner;     // State after (key ^ ipad)
+            mbedtls_sha1_context outer;     // State after (key ^ opad)
+        } sha1;
+        struct {
+            mbedtls_sha256_context inner;
+            mbedtls_sha256_context outer;
+        } sha256;
+        struct {
+            mbedtls_sha512_context inner;
+            mbedtls_sha512_context outer;
+        } sha512;
+    } state;
+    totp_algorithm_t algorithm;
+    uint32_t period;                // Time step in seconds
+    uint8_t digits;                 // Number of digits (6 to 8)
+    bool ready;
+} totp_key_t;
+
+/**
+ * @brief Code generated by a batch call
+ */
+typedef struct {
+    uint32_t code;          // TOTP code of the current window
+    uint32_t next_code;     // TOTP code of the next window
+    uint32_t remaining;     // Seconds until the code changes
+    uint32_t period;        // Time step in seconds
+    uint8_t digits;         // Number of digits of both codes
+    bool valid;             // false if the key could not produce a code
+} totp_code_result_t;
+
+/**
+ * @brief Build the precomputed key state from a Base32 secret
+ * @param key Key state to initialize
+ * @param secret_b32 Base32-encoded secret string
+ * @param algorithm HMAC hash algorithm
+ * @param digits Number of digits in code (6 to 8)
+ * @param period Time step in seconds (usually 30)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the secret is invalid
+ */
+esp_err_t totp_key_init(totp_key_t *key, const char *secret_b32, totp_algorithm_t algorithm,
+                        uint8_t digits, uint32_t period);
+
+/**
+ * @brief Build the precomputed key state from a binary secret
+ * @param key Key state to initialize
+ * @param secret Decoded secret bytes
+ * @param secret_len Length of secret
+ * @param algorithm HMAC hash algorithm
+ * @param digits Number of digits in code (6 to 8)
+ * @param period Time step in seconds (usually 30)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the secret is empty
+ */
+esp_err_t totp_key_init_raw(totp_key_t *key, const uint8_t *secret, size_t secret_len,
+                            totp_algorithm_t algorithm, uint8_t digits, uint32_t period);
+
+/**
+ * @brief Get the otpauth name of an algorithm
+ * @param algorithm Algorithm
+ * @return "SHA1", "SHA256", "SHA512" or "UNKNOWN"
+ */
+const char *totp_algorithm_name(totp_algorithm_t algorithm);
+
+/**
+ * @brief Release a key state and wipe the pad states
+ * @param key Key state to free
+ */
+void totp_key_free(totp_key_t *key);
+
+/**
+ * @brief Generate a code for a given counter using a precomputed key
+ * @param key Initialized key state
+ * @param counter Moving factor (time step for TOTP)
+ * @param code Output code
+ * @return ESP_OK on success
+ */
+esp_err_t totp_key_generate(const totp_key_t *key, uint64_t counter, uint32_t *code);
+
+/**
+ * @brief Generate codes for several keys at the same timestamp
+ * @param keys Array of key states
+ * @param count Number of keys (and results)
+ * @param timestamp Unix timestamp shared by all codes
+ * @param results Output array with one entry per key
+ * @return ESP_OK if every code was generated, ESP_FAIL if any entry is invalid
+ */
+esp_err_t totp_generate_codes_batch(const totp_key_t *keys, size_t count, uint64_t timestamp,
+                                    totp_code_result_t *results);
 
 /**
  * @brief Generate TOTP code from secret
@@ -24,6 +139,18 @@ esp_err_t totp_generate_code(const char *secret_b32, uint32_t time_step, uint8_t
  */
 esp_err_t totp_get_code(const char *secret_b32, uint8_t digits, uint32_t *code);
 
+/**
+ * @brief Replace the clock used by the engine
+ * @param source Time source, or NULL to restore the system clock (gettimeofday)
+ */
+void totp_set_time_source(totp_time_source_t source);
+
+/**
+ * @brief Get current Unix timestamp from the configured time source
+ * @return Seconds since the Epoch
+ */
+uint64_t totp_get_timestamp(void);
+
 /**
  * @brief Get remaining seconds until code changes
  * @param period Time period in seconds (usually 30)
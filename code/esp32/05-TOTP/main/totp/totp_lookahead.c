@@ -0,0 +1,69 @@
+#include "totp_lookahead.h"
+#include "totp_storage.h"
+#include "totp_engine.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "totp_lookahead";
+
+#define LOOKAHEAD_TASK_STACK    4096
+#define LOOKAHEAD_TASK_PRIO     (tskIDLE_PRIORITY + 1)
+#define LOOKAHEAD_LEAD_S        2       // Wake this many seconds before a boundary
+#define LOOKAHEAD_IDLE_S        30      // Poll interval when there are no services
+
+static TaskHandle_t lookahead_task = NULL;
+
+static void lookahead_task_fn(void *arg) {
+    ESP_LOGI(TAG, "Look-ahead task started");
+
+    while (true) {
+        uint32_t next_rollover = UINT32_MAX;
+        totp_storage_precompute(totp_get_timestamp(), &next_rollover);
+
+        // Sleep until shortly before the next boundary; if already inside the
+        // lead time, sleep past the boundary so the next round targets the one after
+        uint32_t sleep_s;
+        if (next_rollover == UINT32_MAX) {
+            sleep_s = LOOKAHEAD_IDLE_S;
+        } else if (next_rollover > LOOKAHEAD_LEAD_S) {
+            sleep_s = next_rollover - LOOKAHEAD_LEAD_S;
+        } else {
+            sleep_s = next_rollover + 1;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(sleep_s * 1000));
+    }
+}
+
+esp_err_t totp_lookahead_start(void) {
+    if (lookahead_task != NULL) {
+        ESP_LOGW(TAG, "Look-ahead task already running");
+        return ESP_OK;
+    }
+
+    BaseType_t ret = xTaskCreate(lookahead_task_fn, "totp_lookahead", LOOKAHEAD_TASK_STACK,
+                                 NULL, LOOKAHEAD_TASK_PRIO, &lookahead_task);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create look-ahead task");
+        lookahead_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t totp_lookahead_stop(void) {
+    if (lookahead_task == NULL) {
+        return ESP_OK;
+    }
+
+    vTaskDelete(lookahead_task);
+    lookahead_task = NULL;
+    ESP_LOGI(TAG, "Look-ahead task stopped");
+    return ESP_OK;
+}
+
+bool totp_lookahead_is_running(void) {
+    return lookahead_task != NULL;
+}
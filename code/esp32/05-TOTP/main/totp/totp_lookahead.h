@@ -0,0 +1,30 @@
+#ifndef TOTP_LOOKAHEAD_H
+#define TOTP_LOOKAHEAD_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+
+/**
+ * @brief Start the look-ahead task
+ *
+ * A low-priority task that wakes shortly before each window boundary and
+ * precomputes the next-window code of every stored service, so requests
+ * right after the rollover are served from the code cache.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t totp_lookahead_start(void);
+
+/**
+ * @brief Stop the look-ahead task
+ * @return ESP_OK on success
+ */
+esp_err_t totp_lookahead_stop(void);
+
+/**
+ * @brief Check if the look-ahead task is running
+ * @return true if running
+ */
+bool totp_lookahead_is_running(void);
+
+#endif // TOTP_LOOKAHEAD_H
@@ -0,0 +1,375 @@
+#include "totp_migration.h"
+#include "totp_engine.h"
+#include "utils/base32.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "totp_migration";
+
+static const char MIGRATION_PREFIX[] = "otpauth-migration://offline?data=";
+
+enum {
+    STAGE_PREFIX = 0,
+    STAGE_DATA,
+    STAGE_DONE,
+};
+
+enum {
+    PB_TAG = 0,
+    PB_VARINT,
+    PB_LEN,
+    PB_BYTES,
+    PB_SKIP,
+};
+
+// MigrationPayload.otp_parameters
+#define FIELD_OTP_PARAMETERS    1
+
+// OtpParameters fields
+#define FIELD_SECRET            1
+#define FIELD_NAME              2
+#define FIELD_ISSUER            3
+#define FIELD_ALGORITHM         4
+#define FIELD_DIGITS            5
+#define FIELD_TYPE              6
+#define FIELD_COUNTER           7
+
+// OtpParameters enum values
+#define MIG_ALGO_SHA256         2
+#define MIG_ALGO_SHA512         3
+#define MIG_ALGO_MD5            4
+#define MIG_DIGITS_EIGHT        2
+#define MIG_TYPE_HOTP           1
+
+static esp_err_t fail(totp_migration_t *m, const char *reason) {
+    if (m->error == ESP_OK) {
+        ESP_LOGE(TAG, "Malformed migration payload: %s", reason);
+        m->error = ESP_ERR_INVALID_ARG;
+    }
+    return m->error;
+}
+
+static void reset_entry(totp_migration_t *m) {
+    m->secret_len = 0;
+    m->secret_overflow = false;
+    m->name_len = 0;
+    m->issuer_len = 0;
+    m->algorithm = 0;
+    m->digits = 0;
+    m->type = 0;
+    m->counter = 0;
+}
+
+// Copy a decoded label piece into a fixed field, truncating if needed
+static void copy_field(char *dst, size_t dst_size, const char *src, size_t len) {
+    if (len >= dst_size) {
+        len = dst_size - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+// Convert the finished OtpParameters into a service and report it
+static void finish_entry(totp_migration_t *m) {
+    m->in_entry = false;
+
+    if (m->secret_len == 0 || m->secret_overflow || m->algorithm == MIG_ALGO_MD5) {
+        ESP_LOGW(TAG, "Skipping account '%.*s': unsupported secret or algorithm",
+                 (int)m->name_len, m->name);
+        m->skipped++;
+        return;
+    }
+
+    totp_service_t service;
+    memset(&service, 0, sizeof(service));
+    service.digits = (m->digits == MIG_DIGITS_EIGHT) ? 8 : 6;
+    service.period = 30;
+    service.type = (m->type == MIG_TYPE_HOTP) ? TOTP_TYPE_HOTP : TOTP_TYPE_TOTP;
+    service.counter = m->counter;
+    if (m->algorithm == MIG_ALGO_SHA256) {
+        service.algorithm = TOTP_ALGO_SHA256;
+    } else if (m->algorithm == MIG_ALGO_SHA512) {
+        service.algorithm = TOTP_ALGO_SHA512;
+    } else {
+        service.algorithm = TOTP_ALGO_SHA1;
+    }
+
+    base32_encode(m->secret, m->secret_len, service.secret, MAX_SECRET_LEN);
+
+    // Name is "Issuer:account" or just "account", like the otpauth label
+    const char *colon = memchr(m->name, ':', m->name_len);
+    if (colon != NULL) {
+        copy_field(service.service_name, MAX_SERVICE_NAME_LEN, m->name, colon - m->name);
+        copy_field(service.account, MAX_ACCOUNT_NAME_LEN, colon + 1, m->name + m->name_len - colon - 1);
+    } else {
+        copy_field(service.account, MAX_ACCOUNT_NAME_LEN, m->name, m->name_len);
+        if (m->issuer_len > 0) {
+            copy_field(service.service_name, MAX_SERVICE_NAME_LEN, m->issuer, m->issuer_len);
+        } else {
+            copy_field(service.service_name, MAX_SERVICE_NAME_LEN, m->name, m->name_len);
+        }
+    }
+
+    if (m->issuer_len > 0) {
+        copy_field(service.issuer, MAX_ISSUER_LEN, m->issuer, m->issuer_len);
+    } else {
+        copy_field(service.issuer, MAX_ISSUER_LEN, service.service_name, strlen(service.service_name));
+    }
+
+    esp_err_t err = m->on_entry(&service, m->ctx);
+    if (err != ESP_OK && m->error == ESP_OK) {
+        m->error = err;
+    }
+}
+
+// A field of the current message is complete
+static void field_done(totp_migration_t *m) {
+    m->pb_state = PB_TAG;
+    if (m->in_entry && m->entry_remaining == 0) {
+        finish_entry(m);
+    }
+}
+
+static void store_varint(totp_migration_t *m) {
+    if (!m->in_entry) {
+        return;     // version, batch_size, batch_index, batch_id
+    }
+
+    switch (m->field) {
+        case FIELD_ALGORITHM: m->algorithm = (uint32_t)m->varint; break;
+        case FIELD_DIGITS:    m->digits = (uint32_t)m->varint; break;
+        case FIELD_TYPE:      m->type = (uint32_t)m->varint; break;
+        case FIELD_COUNTER:   m->counter = m->varint; break;
+        default: break;
+    }
+}
+
+// Start a length-delimited field of m->varint bytes
+static void start_bytes(totp_migration_t *m) {
+    uint64_t len = m->varint;
+
+    if (!m->in_entry && m->field == FIELD_OTP_PARAMETERS) {
+        if (len > UINT32_MAX) {
+            fail(m, "entry too long");
+            return;
+        }
+        reset_entry(m);
+        m->in_entry = true;
+        m->entry_remaining = (uint32_t)len;
+        m->pb_state = PB_TAG;
+        if (len == 0) {
+            finish_entry(m);
+        }
+        return;
+    }
+
+    if (m->in_entry && len > m->entry_remaining) {
+        fail(m, "field overruns entry");
+        return;
+    }
+
+    m->bytes_dst = NULL;
+    if (m->in_entry) {
+        switch (m->field) {
+            case FIELD_SECRET:
+                m->bytes_dst = m->secret;
+                m->bytes_cap = sizeof(m->secret);
+                m->bytes_len = &m->secret_len;
+                m->secret_overflow = len > sizeof(m->secret);
+                break;
+            case FIELD_NAME:
+                m->bytes_dst = (uint8_t *)m->name;
+                m->bytes_cap = sizeof(m->name);
+                m->bytes_len = &m->name_len;
+                break;
+            case FIELD_ISSUER:
+                m->bytes_dst = (uint8_t *)m->issuer;
+                m->bytes_cap = sizeof(m->issuer);
+                m->bytes_len = &m->issuer_len;
+                break;
+            default:
+                break;
+        }
+        if (m->bytes_dst != NULL) {
+            *m->bytes_len = 0;
+        }
+    }
+
+    m->skip = (uint32_t)len;
+    m->pb_state = PB_BYTES;
+    if (len == 0) {
+        field_done(m);
+    }
+}
+
+// Feed one decoded payload byte to the protobuf reader
+static void pb_byte(totp_migration_t *m, uint8_t b) {
+    if (m->in_entry) {
+        m->entry_remaining--;
+    }
+
+    switch (m->pb_state) {
+        case PB_TAG:
+        case PB_VARINT:
+        case PB_LEN:
+            if (m->varint_shift >= 64) {
+                fail(m, "varint too long");
+                return;
+            }
+            m->varint |= (uint64_t)(b & 0x7F) << m->varint_shift;
+            m->varint_shift += 7;
+            if (b & 0x80) {
+                break;
+            }
+            m->varint_shift = 0;
+
+            if (m->pb_state == PB_TAG) {
+                m->field = (uint32_t)(m->varint >> 3);
+                m->wire_type = m->varint & 0x07;
+                m->varint = 0;
+                if (m->field == 0) {
+                    fail(m, "field 0");
+                    return;
+                }
+                switch (m->wire_type) {
+                    case 0: m->pb_state = PB_VARINT; break;
+                    case 1: m->pb_state = PB_SKIP; m->skip = 8; break;
+                    case 2: m->pb_state = PB_LEN; break;
+                    case 5: m->pb_state = PB_SKIP; m->skip = 4; break;
+                    default:
+                        fail(m, "unsupported wire type");
+                        return;
+                }
+            } else if (m->pb_state == PB_VARINT) {
+                store_varint(m);
+                m->varint = 0;
+                field_done(m);
+            } else {
+                start_bytes(m);
+                m->varint = 0;
+            }
+            break;
+
+        case PB_BYTES:
+            if (m->bytes_dst != NULL && *m->bytes_len < m->bytes_cap) {
+                m->bytes_dst[(*m->bytes_len)++] = b;
+            }
+            if (--m->skip == 0) {
+                field_done(m);
+            }
+            break;
+
+        case PB_SKIP:
+            if (--m->skip == 0) {
+                field_done(m);
+            }
+            break;
+    }
+
+    // Entry length must end on a field boundary (field_done finished it)
+    if (m->in_entry && m->entry_remaining == 0 && m->error == ESP_OK) {
+        fail(m, "truncated field");
+    }
+}
+
+// Base64 symbol value (standard and URL-safe alphabets), or -1
+static int b64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+' || c == '-') return 62;
+    if (c == '/' || c == '_') return 63;
+    return -1;
+}
+
+// Feed one URL-decoded character of the data parameter
+static void data_char(totp_migration_t *m, char c) {
+    if (c == '=') {
+        m->stage = STAGE_DONE;      // Base64 padding ends the payload
+        return;
+    }
+
+    int v = b64_value(c);
+    if (v < 0) {
+        fail(m, "invalid Base64");
+        return;
+    }
+
+    m->b64_bits = (m->b64_bits << 6) | (uint32_t)v;
+    m->b64_nbits += 6;
+    if (m->b64_nbits >= 8) {
+        m->b64_nbits -= 8;
+        pb_byte(m, (uint8_t)(m->b64_bits >> m->b64_nbits));
+        m->b64_bits &= (1u << m->b64_nbits) - 1;
+    }
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void totp_migration_init(totp_migration_t *m, totp_migration_entry_cb_t on_entry, void *ctx) {
+    memset(m, 0, sizeof(*m));
+    m->on_entry = on_entry;
+    m->ctx = ctx;
+    m->stage = STAGE_PREFIX;
+    m->pb_state = PB_TAG;
+}
+
+esp_err_t totp_migration_feed(totp_migration_t *m, const char *data, size_t len) {
+    for (size_t i = 0; i < len && m->error == ESP_OK; i++) {
+        char c = data[i];
+
+        if (m->stage == STAGE_PREFIX) {
+            if (c != MIGRATION_PREFIX[m->prefix_pos]) {
+                return fail(m, "expected otpauth-migration://offline?data=");
+            }
+            if (++m->prefix_pos == sizeof(MIGRATION_PREFIX) - 1) {
+                m->stage = STAGE_DATA;
+            }
+            continue;
+        }
+
+        if (m->stage == STAGE_DONE) {
+            // Padding, trailing whitespace or further parameters are ignored
+            continue;
+        }
+
+        if (m->pct_state > 0) {
+            int v = hex_value(c);
+            if (v < 0) {
+                return fail(m, "invalid percent escape");
+            }
+            m->pct_value = (m->pct_value << 4) | (uint8_t)v;
+            if (++m->pct_state == 3) {
+                m->pct_state = 0;
+                data_char(m, (char)m->pct_value);
+            }
+        } else if (c == '%') {
+            m->pct_state = 1;
+            m->pct_value = 0;
+        } else if (c == '&' || c == ' ' || c == '\r' || c == '\n') {
+            m->stage = STAGE_DONE;
+        } else {
+            data_char(m, c);
+        }
+    }
+
+    return m->error;
+}
+
+esp_err_t totp_migration_finish(totp_migration_t *m) {
+    if (m->error != ESP_OK) {
+        return m->error;
+    }
+    if (m->stage == STAGE_PREFIX) {
+        return fail(m, "missing data parameter");
+    }
+    if (m->pct_state != 0 || m->pb_state != PB_TAG || m->in_entry) {
+        return fail(m, "payload truncated");
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,94 @@
+#ifndef TOTP_MIGRATION_H
+#define TOTP_MIGRATION_H
+
+#include "totp_storage.h"
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Largest raw key that still fits MAX_SECRET_LEN once Base32 encoded
+#define TOTP_MIGRATION_MAX_SECRET   (((MAX_SECRET_LEN - 1) * 5) / 8)
+
+/**
+ * @brief Called for each account decoded from the payload
+ * @param service Decoded service (only valid during the call)
+ * @param ctx User context given to totp_migration_init()
+ * @return ESP_OK to continue, any other value aborts decoding with that error
+ */
+typedef esp_err_t (*totp_migration_entry_cb_t)(const totp_service_t *service, void *ctx);
+
+/**
+ * @brief Streaming decoder state, fixed size whatever the payload length
+ *
+ * Fields are private to totp_migration.c; use the functions below.
+ */
+typedef struct {
+    totp_migration_entry_cb_t on_entry;
+    void *ctx;
+    esp_err_t error;
+
+    // Input: URI prefix, then URL-decoded Base64 text
+    uint8_t stage;
+    uint8_t prefix_pos;
+    uint8_t pct_state;
+    uint8_t pct_value;
+    uint32_t b64_bits;
+    uint8_t b64_nbits;
+
+    // Protobuf reader
+    uint8_t pb_state;
+    uint8_t wire_type;
+    uint32_t field;
+    uint64_t varint;
+    uint8_t varint_shift;
+    uint32_t skip;
+    bool in_entry;
+    uint32_t entry_remaining;
+
+    // Account being decoded
+    uint8_t *bytes_dst;
+    size_t bytes_cap;
+    size_t *bytes_len;
+    uint8_t secret[TOTP_MIGRATION_MAX_SECRET];
+    size_t secret_len;
+    bool secret_overflow;
+    char name[MAX_SERVICE_NAME_LEN + MAX_ACCOUNT_NAME_LEN];
+    size_t name_len;
+    char issuer[MAX_ISSUER_LEN];
+    size_t issuer_len;
+    uint32_t algorithm;
+    uint32_t digits;
+    uint32_t type;
+    uint64_t counter;
+
+    uint16_t skipped;       // Accounts that could not be converted
+} totp_migration_t;
+
+/**
+ * @brief Prepare a decoder for an otpauth-migration://offline?data=... URI
+ * @param m Decoder state
+ * @param on_entry Callback for each decoded account
+ * @param ctx User context passed to the callback
+ */
+void totp_migration_init(totp_migration_t *m, totp_migration_entry_cb_t on_entry, void *ctx);
+
+/**
+ * @brief Feed the next chunk of the URI
+ * @param m Decoder state
+ * @param data Chunk (not NUL-terminated)
+ * @param len Chunk length
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a malformed payload, or the callback error
+ *
+ * Accounts are reported through the callback as soon as they are complete.
+ */
+esp_err_t totp_migration_feed(totp_migration_t *m, const char *data, size_t len);
+
+/**
+ * @brief Finish decoding after the last chunk
+ * @param m Decoder state
+ * @return ESP_OK if the payload ended cleanly
+ */
+esp_err_t totp_migration_finish(totp_migration_t *m);
+
+#endif // TOTP_MIGRATION_H
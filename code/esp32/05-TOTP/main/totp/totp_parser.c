@@ -2,71 +2,110 @@
 #include "esp_log.h"
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
+#include <strings.h>
 
 static const char *TAG = "totp_parser";
 
-// URL decode helper function
-static void url_decode(char *dst, const char *src) {
-    char a, b;
-    while (*src) {
-        if ((*src == '%') &&
-            ((a = src[1]) && (b = src[2])) &&
-            (isxdigit(a) && isxdigit(b))) {
-            if (a >= 'a') a -= 'a'-'A';
-            if (a >= 'A') a -= ('A' - 10);
-            else a -= '0';
-            if (b >= 'a') b -= 'a'-'A';
-            if (b >= 'A') b -= ('A' - 10);
-            else b -= '0';
-            *dst++ = 16*a+b;
-            src+=3;
-        } else if (*src == '+') {
-            *dst++ = ' ';
-            src++;
-        } else {
-            *dst++ = *src++;
+#define HOTP_PREFIX "otpauth://hotp/"
+#define TOTP_PREFIX "otpauth://totp/"
+#define PREFIX_LEN  (sizeof(TOTP_PREFIX) - 1)
+
+// Hex digit value, or -1 if not a hex digit
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode one URL-encoded character from [*p, end) and advance *p
+static char next_decoded(const char **p, const char *end) {
+    const char *s = *p;
+    if (*s == '%' && end - s >= 3) {
+        int hi = hex_value(s[1]);
+        int lo = hex_value(s[2]);
+        if (hi >= 0 && lo >= 0) {
+            *p = s + 3;
+            return (char)((hi << 4) | lo);
         }
     }
-    *dst++ = '\0';
+    *p = s + 1;
+    return (*s == '+') ? ' ' : *s;
 }
 
-// Extract query parameter value
-static bool get_query_param(const char *query, const char *param, char *value, size_t value_size) {
-    char search[64];
-    snprintf(search, sizeof(search), "%s=", param);
-    
-    const char *start = strstr(query, search);
-    if (start == NULL) {
-        return false;
+// URL decode [src, end) straight into dst. Returns the decoded length, or -1 if
+// it does not fit in dst_size (dst is still NUL-terminated, truncated).
+static int decode_into(char *dst, size_t dst_size, const char *src, const char *end) {
+    size_t len = 0;
+    while (src < end) {
+        char c = next_decoded(&src, end);
+        if (len + 1 >= dst_size) {
+            dst[len] = '\0';
+            return -1;
+        }
+        dst[len++] = c;
     }
-    
-    start += strlen(search);
-    const char *end = strchr(start, '&');
-    
-    size_t len;
-    if (end != NULL) {
-        len = end - start;
-    } else {
-        len = strlen(start);
+    dst[len] = '\0';
+    return (int)len;
+}
+
+// Parse an unsigned decimal value from [src, end); false on empty, non-digit or overflow
+static bool parse_uint(const char *src, const char *end, uint64_t *out) {
+    if (src == end) {
+        return false;
     }
-    
-    if (len >= value_size) {
-        len = value_size - 1;
+    uint64_t value = 0;
+    for (; src < end; src++) {
+        if (*src < '0' || *src > '9') {
+            return false;
+        }
+        uint64_t digit = (uint64_t)(*src - '0');
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
     }
-    
-    strncpy(value, start, len);
-    value[len] = '\0';
-    
-    // URL decode the value
-    char decoded[256];
-    url_decode(decoded, value);
-    strncpy(value, decoded, value_size - 1);
-    value[value_size - 1] = '\0';
-    
+    *out = value;
     return true;
 }
 
+// Case-insensitive comparison of [src, end) with a NUL-terminated literal
+static bool span_equals(const char *src, const char *end, const char *literal) {
+    size_t len = strlen(literal);
+    return (size_t)(end - src) == len && strncasecmp(src, literal, len) == 0;
+}
+
+// Decode the label ("Issuer:account" or "account") in one pass. The first
+// decoded ':' (also when sent as %3A) switches the destination to account.
+static void parse_label(const char *src, const char *end, totp_service_t *service) {
+    char *dst = service->service_name;
+    size_t dst_size = MAX_SERVICE_NAME_LEN;
+    size_t len = 0;
+    bool has_issuer = false;
+
+    while (src < end) {
+        char c = next_decoded(&src, end);
+        if (c == ':' && !has_issuer) {
+            dst[len] = '\0';
+            has_issuer = true;
+            dst = service->account;
+            dst_size = MAX_ACCOUNT_NAME_LEN;
+            len = 0;
+            continue;
+        }
+        if (len + 1 < dst_size) {
+            dst[len++] = c;
+        }
+    }
+    dst[len] = '\0';
+
+    if (!has_issuer) {
+        // Just "account": use it for both fields
+        memcpy(service->account, service->service_name, MAX_ACCOUNT_NAME_LEN - 1);
+        service->account[MAX_ACCOUNT_NAME_LEN - 1] = '\0';
+    }
+}
+
 esp_err_t totp_parse_uri(const char *uri, totp_service_t *service) {
     if (uri == NULL || service == NULL) {
         ESP_LOGE(TAG, "Invalid parameters");
@@ -75,21 +114,22 @@ esp_err_t totp_parse_uri(const char *uri, totp_service_t *service) {
 
     // Clear service structure
     memset(service, 0, sizeof(totp_service_t));
-    
+
     // Set defaults
     service->digits = 6;
     service->period = 30;
 
-    // Check if URI starts with "otpauth://totp/"
-    const char *prefix = "otpauth://totp/";
-    if (strncmp(uri, prefix, strlen(prefix)) != 0) {
-        ESP_LOGE(TAG, "Invalid URI prefix, must start with 'otpauth://totp/'");
+    // Check if URI starts with "otpauth://totp/" or "otpauth://hotp/"
+    if (strncmp(uri, HOTP_PREFIX, PREFIX_LEN) == 0) {
+        service->type = TOTP_TYPE_HOTP;
+    } else if (strncmp(uri, TOTP_PREFIX, PREFIX_LEN) != 0) {
+        ESP_LOGE(TAG, "Invalid URI prefix, must start with '" TOTP_PREFIX "' or '" HOTP_PREFIX "'");
         return ESP_ERR_INVALID_ARG;
     }
 
     // Skip prefix
-    const char *path = uri + strlen(prefix);
-    
+    const char *path = uri + PREFIX_LEN;
+
     // Find the query string (starts with '?')
     const char *query = strchr(path, '?');
     if (query == NULL) {
@@ -97,74 +137,103 @@ esp_err_t totp_parse_uri(const char *uri, totp_service_t *service) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Extract label (path before '?')
-    size_t label_len = query - path;
-    char label[MAX_SERVICE_NAME_LEN + MAX_ACCOUNT_NAME_LEN];
-    if (label_len >= sizeof(label)) {
-        label_len = sizeof(label) - 1;
-    }
-    strncpy(label, path, label_len);
-    label[label_len] = '\0';
-    
-    // URL decode label
-    char decoded_label[MAX_SERVICE_NAME_LEN + MAX_ACCOUNT_NAME_LEN];
-    url_decode(decoded_label, label);
-
-    // Parse label: can be "Issuer:account" or just "account"
-    char *colon = strchr(decoded_label, ':');
-    if (colon != NULL) {
-        // Format: "Issuer:account"
-        *colon = '\0';
-        strncpy(service->service_name, decoded_label, MAX_SERVICE_NAME_LEN - 1);
-        strncpy(service->account, colon + 1, MAX_ACCOUNT_NAME_LEN - 1);
-    } else {
-        // Format: just "account"
-        strncpy(service->account, decoded_label, MAX_ACCOUNT_NAME_LEN - 1);
-        strncpy(service->service_name, decoded_label, MAX_SERVICE_NAME_LEN - 1);
-    }
+    parse_label(path, query, service);
 
-    // Skip '?' in query
-    query++;
+    // Walk the query once: each "key=value" pair is matched by exact key, so a
+    // key name inside another parameter's value is never mistaken for a key
+    bool has_secret = false;
+    bool has_issuer = false;
+    bool has_counter = false;
+    const char *p = query + 1;
 
-    // Extract secret (required)
-    if (!get_query_param(query, "secret", service->secret, MAX_SECRET_LEN)) {
-        ESP_LOGE(TAG, "Secret parameter is required");
-        return ESP_ERR_INVALID_ARG;
+    while (*p != '\0') {
+        const char *key = p;
+        const char *end = p;
+        while (*end != '\0' && *end != '&') {
+            end++;
+        }
+        p = (*end == '&') ? end + 1 : end;
+
+        const char *eq = memchr(key, '=', end - key);
+        if (eq == NULL) {
+            continue;
+        }
+        size_t key_len = eq - key;
+        const char *value = eq + 1;
+        uint64_t number;
+
+#define KEY_IS(name) (key_len == sizeof(name) - 1 && memcmp(key, name, key_len) == 0)
+        if (KEY_IS("secret")) {
+            if (decode_into(service->secret, MAX_SECRET_LEN, value, end) < 0) {
+                ESP_LOGE(TAG, "Secret too long (max %d chars)", MAX_SECRET_LEN - 1);
+                return ESP_ERR_INVALID_SIZE;
+            }
+            has_secret = service->secret[0] != '\0';
+        } else if (KEY_IS("issuer")) {
+            // Optional, overrides label issuer (truncated if too long)
+            decode_into(service->issuer, MAX_ISSUER_LEN, value, end);
+            has_issuer = true;
+        } else if (KEY_IS("digits")) {
+            if (parse_uint(value, end, &number) && number >= 6 && number <= 8) {
+                service->digits = (uint8_t)number;
+            } else {
+                ESP_LOGW(TAG, "Invalid digits value '%.*s', using default 6", (int)(end - value), value);
+            }
+        } else if (KEY_IS("period")) {
+            if (parse_uint(value, end, &number) && number > 0 && number <= 120) {
+                service->period = (uint32_t)number;
+            } else {
+                ESP_LOGW(TAG, "Invalid period value '%.*s', using default 30", (int)(end - value), value);
+            }
+        } else if (KEY_IS("algorithm")) {
+            if (span_equals(value, end, "SHA1")) {
+                service->algorithm = TOTP_ALGO_SHA1;
+            } else if (span_equals(value, end, "SHA256")) {
+                service->algorithm = TOTP_ALGO_SHA256;
+            } else if (span_equals(value, end, "SHA512")) {
+                service->algorithm = TOTP_ALGO_SHA512;
+            } else {
+                ESP_LOGE(TAG, "Unsupported algorithm '%.*s'", (int)(end - value), value);
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+        } else if (KEY_IS("counter")) {
+            // Only meaningful for HOTP, TOTP derives the counter from time
+            if (service->type != TOTP_TYPE_HOTP) {
+                continue;
+            }
+            if (parse_uint(value, end, &number)) {
+                service->counter = number;
+                has_counter = true;
+            } else {
+                ESP_LOGW(TAG, "Invalid counter value '%.*s'", (int)(end - value), value);
+            }
+        } else if (KEY_IS("image")) {
+            // Logo URL used by some apps; the device has nowhere to show it
+        } else {
+            ESP_LOGD(TAG, "Ignoring unknown parameter '%.*s'", (int)key_len, key);
+        }
+#undef KEY_IS
     }
 
-    // Extract issuer (optional, overrides label issuer)
-    char issuer[MAX_ISSUER_LEN];
-    if (get_query_param(query, "issuer", issuer, sizeof(issuer))) {
-        strncpy(service->issuer, issuer, MAX_ISSUER_LEN - 1);
-    } else {
-        // Use service_name as issuer if not provided
-        strncpy(service->issuer, service->service_name, MAX_ISSUER_LEN - 1);
+    if (!has_secret) {
+        ESP_LOGE(TAG, "Secret parameter is required");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Extract digits (optional)
-    char digits_str[4];
-    if (get_query_param(query, "digits", digits_str, sizeof(digits_str))) {
-        int digits = atoi(digits_str);
-        if (digits >= 6 && digits <= 8) {
-            service->digits = digits;
-        } else {
-            ESP_LOGW(TAG, "Invalid digits value %d, using default 6", digits);
-        }
+    if (service->type == TOTP_TYPE_HOTP && !has_counter) {
+        ESP_LOGE(TAG, "Counter parameter is required for HOTP");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Extract period (optional)
-    char period_str[8];
-    if (get_query_param(query, "period", period_str, sizeof(period_str))) {
-        int period = atoi(period_str);
-        if (period > 0 && period <= 120) {
-            service->period = period;
-        } else {
-            ESP_LOGW(TAG, "Invalid period value %d, using default 30", period);
-        }
+    if (!has_issuer) {
+        // Use service_name as issuer if not provided
+        memcpy(service->issuer, service->service_name, MAX_ISSUER_LEN - 1);
+        service->issuer[MAX_ISSUER_LEN - 1] = '\0';
     }
 
-    ESP_LOGI(TAG, "Parsed URI - Issuer: %s, Account: %s, Digits: %d, Period: %lu",
-             service->issuer, service->account, service->digits, service->period);
+    ESP_LOGI(TAG, "Parsed URI - Issuer: %s, Account: %s, Digits: %d, Period: %lu, Algorithm: %s",
+             service->issuer, service->account, service->digits, (unsigned long)service->period,
+             totp_algorithm_name(service->algorithm));
 
     return ESP_OK;
 }
@@ -6,9 +6,14 @@
 
 /**
  * @brief Parse otpauth:// URI and extract TOTP parameters
- * @param uri Full otpauth://totp/... string
+ * @param uri Full otpauth://totp/... or otpauth://hotp/... string
  * @param service Output service structure
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the secret does not fit,
+ *         ESP_ERR_NOT_SUPPORTED for an unknown algorithm
+ *
+ * The query is walked once and values are URL-decoded directly into the
+ * service fields. Recognized keys: secret, issuer, digits, period,
+ * algorithm, counter (HOTP) and image (accepted, not stored).
  * 
  * Example URI formats:
  * - otpauth://totp/GitHub:user@email.com?secret=JBSWY3DPEHPK3PXP&issuer=GitHub
@@ -1,87 +1,660 @@
 #include "totp_storage.h"
+#include "totp_cache.h"
+#include "totp_verify.h"
 #include "storage/nvs_helper.h"
+#include "utils/base32.h"
+#include "utils/json_stream.h"
 #include "esp_log.h"
+#include "sdkconfig.h"
 #include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 
 static const char *TAG = "totp_storage";
 static bool storage_ready = false;
 
 #define NVS_KEY_COUNT "svc_count"
+#define NVS_KEY_NEXT_ID "svc_next_id"
 #define NVS_KEY_SERVICE_PREFIX "svc_"
 
-// In-memory cache of services
-static totp_service_t services[MAX_SERVICES];
-static uint8_t service_count = 0;
+#define RECORD_MAGIC        0xC6
+#define RECORD_MAGIC_V1     0xC5    // Packed record without an ID
+#define RECORD_V1_HEADER    20
+#define RECORD_MAX_KEY      (((MAX_SECRET_LEN - 1) * 5) / 8)
+#define KEY_POOL_SIZE       CONFIG_GMAKER_TOTP_KEY_POOL_SIZE
+
+// Packed service record, kept in RAM and written to NVS as-is. The header is
+// followed by the binary key, then service name, account and issuer (lengths
+// in the header, not NUL-terminated).
+typedef struct totp_record {
+    uint8_t magic;          // RECORD_MAGIC
+    uint8_t algorithm;      // totp_algorithm_t
+    uint8_t type;           // totp_type_t
+    uint8_t digits;
+    uint32_t period;
+    uint64_t counter;       // HOTP: reserved counter ceiling
+    uint8_t key_len;
+    uint8_t name_len;
+    uint8_t account_len;
+    uint8_t issuer_len;
+    uint32_t id;            // Stable service ID (never reused)
+    uint8_t data[];
+} totp_record_t;
+
+#define RECORD_HEADER_SIZE  offsetof(totp_record_t, data)
+
+// Records written by earlier firmware are the fixed-size totp_service_t; they
+// are at least this long, while a packed record never is
+#define LEGACY_MIN_SIZE     offsetof(totp_service_t, digits)
+
+// Serialized list entry, shared with listings that stream it after unlocking
+typedef struct {
+    uint16_t refs;          // Held by the table entry and by each listing in flight
+    uint16_t len;
+    char text[];
+} entry_json_t;
+
+typedef struct {
+    totp_record_t *record;  // Packed record (heap, exact size)
+    uint64_t hotp_next;     // Next HOTP counter to hand out; record->counter is the ceiling
+    int16_t key_slot;       // Slot in key_pool, -1 if none
+    entry_json_t *json;     // Cached list entry (exact size), NULL until built
+} service_entry_t;
+
+// Precomputed HMAC key states, built on demand and reused least recently used first
+typedef struct {
+    totp_key_t key;
+    uint32_t last_used;
+    int32_t owner;          // Service index, -1 if free
+} key_pool_entry_t;
+
+// Service table, grown on demand up to MAX_SERVICES
+static service_entry_t *table = NULL;
+static uint16_t table_capacity = 0;
+static uint16_t service_count = 0;
+
+// Open-addressing (linear probing) index from service ID to table position,
+// sized to a power of two at least twice the table capacity
+#define ID_SLOT_EMPTY       UINT16_MAX
+static uint16_t *id_slots = NULL;
+static uint32_t id_mask = 0;
+
+// Next ID to hand out, persisted so IDs of deleted services are not reused
+static uint32_t next_id = 1;
+
+static key_pool_entry_t key_pool[KEY_POOL_SIZE];
+static uint32_t key_clock = 0;
+
+// New services written after the published ones, not yet visible to readers
+// (owned by the writer holding write_mutex)
+static uint16_t staged_count = 0;
+
+// Serializes access between the HTTP server and the look-ahead task
+static SemaphoreHandle_t storage_mutex = NULL;
+
+// Serializes mutations. A writer holds it across NVS writes and takes
+// storage_mutex only to apply the committed change in RAM, so reads are not
+// held up by flash. The table layout (count, order, ID index, records) only
+// changes under both locks, so a writer may read it holding this one alone.
+// Lock order: write_mutex, then storage_mutex.
+static SemaphoreHandle_t write_mutex = NULL;
+
+static inline void storage_lock(void) {
+    xSemaphoreTake(storage_mutex, portMAX_DELAY);
+}
+
+static inline void storage_unlock(void) {
+    xSemaphoreGive(storage_mutex);
+}
+
+static inline void write_lock(void) {
+    xSemaphoreTake(write_mutex, portMAX_DELAY);
+}
+
+static inline void write_unlock(void) {
+    xSemaphoreGive(write_mutex);
+}
 
 // Helper function to generate service key
-static void get_service_key(uint8_t index, char *key, size_t key_size) {
+static void get_service_key(uint16_t index, char *key, size_t key_size) {
     snprintf(key, key_size, "%s%d", NVS_KEY_SERVICE_PREFIX, index);
 }
 
+static inline size_t record_size(const totp_record_t *r) {
+    return RECORD_HEADER_SIZE + r->key_len + r->name_len + r->account_len + r->issuer_len;
+}
+
+static inline const char *record_name(const totp_record_t *r) {
+    return (const char *)r->data + r->key_len;
+}
+
+static inline const char *record_account(const totp_record_t *r) {
+    return record_name(r) + r->name_len;
+}
+
+static inline const char *record_issuer(const totp_record_t *r) {
+    return record_account(r) + r->account_len;
+}
+
+// Pack a service into a newly allocated record (validates the secret)
+static esp_err_t record_from_service(const totp_service_t *service, uint32_t id, totp_record_t **out) {
+    if (service->digits < 6 || service->digits > 8 || service->period == 0 ||
+        service->algorithm > TOTP_ALGO_SHA512) {
+        ESP_LOGE(TAG, "Invalid digits, period or algorithm for service %s", service->issuer);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t key[RECORD_MAX_KEY];
+    int key_len = base32_decode(service->secret, key, sizeof(key));
+    if (key_len <= 0) {
+        ESP_LOGE(TAG, "Invalid secret for service %s", service->issuer);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t name_len = strnlen(service->service_name, MAX_SERVICE_NAME_LEN - 1);
+    size_t account_len = strnlen(service->account, MAX_ACCOUNT_NAME_LEN - 1);
+    size_t issuer_len = strnlen(service->issuer, MAX_ISSUER_LEN - 1);
+
+    totp_record_t *r = malloc(RECORD_HEADER_SIZE + key_len + name_len + account_len + issuer_len);
+    if (r == NULL) {
+        memset(key, 0, sizeof(key));
+        return ESP_ERR_NO_MEM;
+    }
+
+    r->magic = RECORD_MAGIC;
+    r->algorithm = service->algorithm;
+    r->type = service->type;
+    r->digits = service->digits;
+    r->period = service->period;
+    r->counter = service->counter;
+    r->key_len = key_len;
+    r->name_len = name_len;
+    r->account_len = account_len;
+    r->issuer_len = issuer_len;
+    r->id = id;
+
+    uint8_t *p = r->data;
+    memcpy(p, key, key_len);
+    p += key_len;
+    memcpy(p, service->service_name, name_len);
+    p += name_len;
+    memcpy(p, service->account, account_len);
+    p += account_len;
+    memcpy(p, service->issuer, issuer_len);
+
+    memset(key, 0, sizeof(key));
+    *out = r;
+    return ESP_OK;
+}
+
+// Expand a record into the fixed-size API form
+static void record_to_service(const totp_record_t *r, totp_service_t *service) {
+    memset(service, 0, sizeof(totp_service_t));
+    memcpy(service->service_name, record_name(r), r->name_len);
+    memcpy(service->account, record_account(r), r->account_len);
+    memcpy(service->issuer, record_issuer(r), r->issuer_len);
+    base32_encode(r->data, r->key_len, service->secret, MAX_SECRET_LEN);
+    service->digits = r->digits;
+    service->period = r->period;
+    service->algorithm = r->algorithm;
+    service->type = r->type;
+    service->counter = r->counter;
+}
+
+// Check that a blob read from NVS is a well-formed packed record
+static bool record_is_valid(const totp_record_t *r, size_t size) {
+    return size >= RECORD_HEADER_SIZE && r->magic == RECORD_MAGIC &&
+           record_size(r) == size && r->key_len > 0 && r->key_len <= RECORD_MAX_KEY;
+}
+
+// Convert a packed record written before IDs existed; the caller assigns the ID
+static totp_record_t *record_upgrade_v1(const uint8_t *blob, size_t size) {
+    const totp_record_t *old = (const totp_record_t *)blob;
+    if (size < RECORD_V1_HEADER || old->magic != RECORD_MAGIC_V1 || old->key_len == 0 ||
+        old->key_len > RECORD_MAX_KEY ||
+        (size_t)RECORD_V1_HEADER + old->key_len + old->name_len + old->account_len + old->issuer_len != size) {
+        return NULL;
+    }
+
+    totp_record_t *r = malloc(size - RECORD_V1_HEADER + RECORD_HEADER_SIZE);
+    if (r == NULL) {
+        return NULL;
+    }
+    memcpy(r, blob, RECORD_V1_HEADER);
+    r->magic = RECORD_MAGIC;
+    r->id = 0;
+    memcpy(r->data, blob + RECORD_V1_HEADER, size - RECORD_V1_HEADER);
+    return r;
+}
+
+// Release a reference to a list entry, wiping it (it embeds the secret) with the last one
+static void release_json(entry_json_t *json) {
+    if (--json->refs == 0) {
+        memset(json->text, 0, json->len);
+        free(json);
+    }
+}
+
+// Drop the cached list entry of a service (caller holds the lock)
+static void drop_json(service_entry_t *entry) {
+    if (entry->json != NULL) {
+        release_json(entry->json);
+        entry->json = NULL;
+    }
+}
+
+// Get the precomputed key state of a service, building it on a pool miss
+static const totp_key_t *service_key(uint16_t index) {
+    service_entry_t *entry = &table[index];
+    key_clock++;
+
+    if (entry->key_slot >= 0 && key_pool[entry->key_slot].owner == index) {
+        key_pool[entry->key_slot].last_used = key_clock;
+        return &key_pool[entry->key_slot].key;
+    }
+
+    // Free slot first, else the least recently used one
+    int victim = 0;
+    for (int i = 0; i < KEY_POOL_SIZE; i++) {
+        if (key_pool[i].owner < 0) {
+            victim = i;
+            break;
+        }
+        if (key_pool[i].last_used < key_pool[victim].last_used) {
+            victim = i;
+        }
+    }
+
+    key_pool_entry_t *slot = &key_pool[victim];
+    if (slot->owner >= 0) {
+        table[slot->owner].key_slot = -1;
+        totp_key_free(&slot->key);
+        slot->owner = -1;
+    }
+
+    const totp_record_t *r = entry->record;
+    if (totp_key_init_raw(&slot->key, r->data, r->key_len, r->algorithm,
+                          r->digits, r->period) != ESP_OK) {
+        return NULL;
+    }
+
+    slot->owner = index;
+    slot->last_used = key_clock;
+    entry->key_slot = victim;
+    return &slot->key;
+}
+
+static void key_pool_reset(void) {
+    for (int i = 0; i < KEY_POOL_SIZE; i++) {
+        if (key_pool[i].owner >= 0) {
+            totp_key_free(&key_pool[i].key);
+        }
+        key_pool[i].owner = -1;
+        key_pool[i].last_used = 0;
+    }
+}
+
+static inline uint32_t id_hash(uint32_t id) {
+    return (id * 2654435761u) & id_mask;    // Fibonacci hashing
+}
+
+static void id_index_insert(uint16_t pos) {
+    uint32_t h = id_hash(table[pos].record->id);
+    while (id_slots[h] != ID_SLOT_EMPTY) {
+        h = (h + 1) & id_mask;
+    }
+    id_slots[h] = pos;
+}
+
+// Probe position of an ID in id_slots, or -1
+static int32_t id_index_probe(uint32_t id) {
+    if (id_slots == NULL) {
+        return -1;
+    }
+    for (uint32_t h = id_hash(id); id_slots[h] != ID_SLOT_EMPTY; h = (h + 1) & id_mask) {
+        if (table[id_slots[h]].record->id == id) {
+            return h;
+        }
+    }
+    return -1;
+}
+
+// Find the table position of a service ID (caller holds the lock)
+static bool find_service(uint32_t id, uint16_t *pos) {
+    int32_t h = id_index_probe(id);
+    if (h < 0) {
+        return false;
+    }
+    *pos = id_slots[h];
+    return true;
+}
+
+// Remove an ID, shifting later probe entries back so no tombstones are needed
+static void id_index_remove(uint32_t id) {
+    int32_t found = id_index_probe(id);
+    if (found < 0) {
+        return;
+    }
+
+    uint32_t hole = found;
+    uint32_t h = (hole + 1) & id_mask;
+    while (id_slots[h] != ID_SLOT_EMPTY) {
+        uint32_t home = id_hash(table[id_slots[h]].record->id);
+        // Move the entry into the hole unless its home lies cyclically in (hole, h]
+        if (((h - home) & id_mask) >= ((h - hole) & id_mask)) {
+            id_slots[hole] = id_slots[h];
+            hole = h;
+        }
+        h = (h + 1) & id_mask;
+    }
+    id_slots[hole] = ID_SLOT_EMPTY;
+}
+
+// Point an indexed ID at a new table position
+static void id_index_move(uint32_t id, uint16_t pos) {
+    int32_t h = id_index_probe(id);
+    if (h >= 0) {
+        id_slots[h] = pos;
+    }
+}
+
+// Size the index for the table capacity and insert every service
+static esp_err_t id_index_rebuild(void) {
+    uint32_t size = 16;
+    while (size < 2u * table_capacity) {
+        size <<= 1;
+    }
+
+    if (size - 1 != id_mask || id_slots == NULL) {
+        uint16_t *slots = malloc(size * sizeof(uint16_t));
+        if (slots == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        free(id_slots);
+        id_slots = slots;
+        id_mask = size - 1;
+    }
+
+    memset(id_slots, 0xFF, (id_mask + 1) * sizeof(uint16_t));
+    for (uint16_t i = 0; i < service_count; i++) {
+        id_index_insert(i);
+    }
+    return ESP_OK;
+}
+
+// Make room for 'needed' services in the table
+static esp_err_t table_reserve(uint16_t needed) {
+    if (needed <= table_capacity) {
+        return ESP_OK;
+    }
+    if (needed > MAX_SERVICES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint16_t capacity = (table_capacity > 0) ? table_capacity * 2 : 8;
+    if (capacity < needed) {
+        capacity = needed;
+    }
+    if (capacity > MAX_SERVICES) {
+        capacity = MAX_SERVICES;
+    }
+
+    // Per-slot code cache and verify rings first: on failure the table is untouched
+    service_entry_t *grown = NULL;
+    if (totp_cache_reserve(capacity) == ESP_OK && totp_verify_reserve(capacity) == ESP_OK) {
+        grown = realloc(table, capacity * sizeof(service_entry_t));
+    }
+    if (grown == NULL) {
+        ESP_LOGE(TAG, "Failed to grow service table to %d entries", capacity);
+        return ESP_ERR_NO_MEM;
+    }
+
+    table = grown;
+    table_capacity = capacity;
+    return id_index_rebuild();
+}
+
+static void init_entry(service_entry_t *entry, totp_record_t *record) {
+    entry->record = record;
+    // Resume HOTP at the reserved ceiling: unused values are skipped, never reused
+    entry->hotp_next = record->counter;
+    entry->key_slot = -1;
+    entry->json = NULL;
+}
+
+// Append a packed record to the table (caller holds the lock)
+static esp_err_t push_record(totp_record_t *record) {
+    esp_err_t err = table_reserve(service_count + 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Records without an ID (new or converted) get the next free one
+    uint16_t existing;
+    if (record->id == 0) {
+        record->id = next_id;
+    } else if (find_service(record->id, &existing)) {
+        ESP_LOGE(TAG, "Duplicate service ID %lu", (unsigned long)record->id);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint16_t index = service_count++;
+    init_entry(&table[index], record);
+    id_index_insert(index);
+    if (record->id >= next_id) {
+        next_id = record->id + 1;
+    }
+    totp_cache_invalidate(index);
+    totp_verify_invalidate(index);
+    return ESP_OK;
+}
+
+// Release every service and the table itself
+static void free_all_services(void) {
+    key_pool_reset();
+    for (uint16_t i = 0; i < service_count; i++) {
+        drop_json(&table[i]);
+        free(table[i].record);
+    }
+    free(table);
+    table = NULL;
+    table_capacity = 0;
+    totp_cache_release();
+    totp_verify_release();
+    service_count = 0;
+    free(id_slots);
+    id_slots = NULL;
+    id_mask = 0;
+}
+
+// Persist the records of table entries [src, src + count) to slots [slot, slot + count)
+// plus a service count of 'total', with one commit. 'erase' lists a record key to
+// remove in the same commit (NULL for none); 'save_next_id' is set when IDs were handed out.
+static esp_err_t save_records(uint16_t slot, uint16_t src, uint16_t count, uint16_t total,
+                              const char *erase, bool save_next_id) {
+    esp_err_t err = nvs_helper_begin();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (uint16_t i = 0; i < count && err == ESP_OK; i++) {
+        const totp_record_t *r = table[src + i].record;
+        char key[16];
+        get_service_key(slot + i, key, sizeof(key));
+        err = nvs_helper_save(key, r, record_size(r));
+    }
+    if (err == ESP_OK && save_next_id) {
+        err = nvs_helper_save(NVS_KEY_NEXT_ID, &next_id, sizeof(uint32_t));
+    }
+    // Records before the count and erases after it: if the sequence is cut short,
+    // the count never covers a missing record (at worst an orphan is left behind)
+    if (err == ESP_OK) {
+        err = nvs_helper_save(NVS_KEY_COUNT, &total, sizeof(uint16_t));
+    }
+    if (err == ESP_OK && erase != NULL) {
+        err = nvs_helper_delete(erase);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+
+    esp_err_t commit_err = nvs_helper_commit();
+    return (err != ESP_OK) ? err : commit_err;
+}
+
 // Load all services from NVS
 static esp_err_t load_services_from_nvs(void) {
-    // Load service count
-    size_t size = sizeof(uint8_t);
-    esp_err_t err = nvs_helper_load(NVS_KEY_COUNT, &service_count, &size);
+    // Older firmware stored the count as one byte; the zeroed high byte keeps
+    // it valid when read into a uint16_t (little-endian)
+    uint16_t stored_count = 0;
+    size_t count_size = sizeof(uint16_t);
+    esp_err_t err = nvs_helper_load(NVS_KEY_COUNT, &stored_count, &count_size);
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGI(TAG, "No services found in NVS, starting fresh");
-        service_count = 0;
         return ESP_OK;
     } else if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to load service count: %s", esp_err_to_name(err));
         return err;
     }
 
-    if (service_count > MAX_SERVICES) {
-        ESP_LOGW(TAG, "Service count %d exceeds max %d, truncating", service_count, MAX_SERVICES);
-        service_count = MAX_SERVICES;
+    size_t size;
+    if (stored_count > MAX_SERVICES) {
+        ESP_LOGW(TAG, "Service count %d exceeds max %d, truncating", stored_count, MAX_SERVICES);
+        stored_count = MAX_SERVICES;
     }
 
-    ESP_LOGI(TAG, "Loading %d services from NVS", service_count);
+    // Every stored ID is below the persisted next ID, so IDs handed to
+    // converted records below never collide with a record read later
+    size = sizeof(uint32_t);
+    if (nvs_helper_load(NVS_KEY_NEXT_ID, &next_id, &size) != ESP_OK || next_id == 0) {
+        next_id = 1;
+    }
 
-    // Load each service
-    for (uint8_t i = 0; i < service_count; i++) {
+    ESP_LOGI(TAG, "Loading %d services from NVS", stored_count);
+
+    // Records from index 'rewrite_from' on are written back in packed form
+    // (legacy records, or records moved down after an unreadable one)
+    uint16_t rewrite_from = (count_size == sizeof(uint8_t)) ? 0 : UINT16_MAX;
+    totp_service_t *blob = malloc(sizeof(totp_service_t));
+    if (blob == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint16_t i = 0; i < stored_count; i++) {
         char key[16];
         get_service_key(i, key, sizeof(key));
-        
+
+        // Legacy records saved before a field was appended are shorter; missing fields read as 0
+        memset(blob, 0, sizeof(totp_service_t));
         size = sizeof(totp_service_t);
-        err = nvs_helper_load(key, &services[i], &size);
+        err = nvs_helper_load(key, blob, &size);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to load service %d: %s", i, esp_err_to_name(err));
             // Continue loading other services
+            continue;
+        }
+
+        totp_record_t *record = NULL;
+        bool legacy = size >= LEGACY_MIN_SIZE || ((const totp_record_t *)blob)->magic == RECORD_MAGIC_V1;
+        if (size >= LEGACY_MIN_SIZE) {
+            blob->service_name[MAX_SERVICE_NAME_LEN - 1] = '\0';
+            blob->account[MAX_ACCOUNT_NAME_LEN - 1] = '\0';
+            blob->secret[MAX_SECRET_LEN - 1] = '\0';
+            blob->issuer[MAX_ISSUER_LEN - 1] = '\0';
+            err = record_from_service(blob, 0, &record);
+        } else if (legacy) {
+            record = record_upgrade_v1((const uint8_t *)blob, size);
+            err = (record != NULL) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+        } else if (record_is_valid((const totp_record_t *)blob, size)) {
+            record = malloc(size);
+            err = (record != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+            if (record != NULL) {
+                memcpy(record, blob, size);
+            }
         } else {
-            ESP_LOGI(TAG, "Loaded service %d: %s (%s)", i, services[i].issuer, services[i].account);
+            err = ESP_ERR_INVALID_SIZE;
+        }
+
+        if (err == ESP_OK) {
+            err = push_record(record);
+            if (err != ESP_OK) {
+                free(record);
+            }
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Service %d is unreadable, dropping it: %s", i, esp_err_to_name(err));
+            continue;
+        }
+
+        uint16_t index = service_count - 1;
+        if ((legacy || index != i) && rewrite_from == UINT16_MAX) {
+            rewrite_from = index;
+        }
+        ESP_LOGI(TAG, "Loaded service %lu: %.*s (%.*s)", (unsigned long)record->id,
+                 record->issuer_len, record_issuer(record), record->account_len, record_account(record));
+    }
+
+    memset(blob, 0, sizeof(totp_service_t));
+    free(blob);
+
+    if (rewrite_from != UINT16_MAX) {
+        if (rewrite_from > service_count) {
+            rewrite_from = service_count;
+        }
+        ESP_LOGI(TAG, "Converting %d services to the current record format", service_count - rewrite_from);
+        err = save_records(rewrite_from, rewrite_from, service_count - rewrite_from, service_count, NULL, true);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to rewrite converted records: %s", esp_err_to_name(err));
         }
     }
 
     return ESP_OK;
 }
 
-// Save all services to NVS
-static esp_err_t save_services_to_nvs(void) {
-    // Save service count
-    esp_err_t err = nvs_helper_save(NVS_KEY_COUNT, &service_count, sizeof(uint8_t));
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save service count: %s", esp_err_to_name(err));
-        return err;
+// Get a code from the per-window cache, computing and caching it on a miss
+static esp_err_t cached_code(uint16_t index, uint64_t counter, uint32_t *code) {
+    if (totp_cache_lookup(index, counter, code)) {
+        return ESP_OK;
     }
 
-    // Save each service
-    for (uint8_t i = 0; i < service_count; i++) {
-        char key[16];
-        get_service_key(i, key, sizeof(key));
-        
-        err = nvs_helper_save(key, &services[i], sizeof(totp_service_t));
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to save service %d: %s", i, esp_err_to_name(err));
-            return err;
-        }
+    const totp_key_t *key = service_key(index);
+    if (key == NULL) {
+        return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Saved %d services to NVS", service_count);
+    esp_err_t err = totp_key_generate(key, counter, code);
+    if (err == ESP_OK) {
+        totp_cache_store(index, counter, *code);
+    }
+    return err;
+}
+
+// Get the current and next codes of a service (caller holds the lock)
+static esp_err_t get_code_cached(uint16_t index, uint64_t timestamp, totp_code_result_t *result) {
+    const totp_record_t *r = table[index].record;
+    result->valid = false;
+    result->digits = r->digits;
+    result->period = r->period;
+
+    if (r->type == TOTP_TYPE_HOTP) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint64_t counter = timestamp / r->period;
+    esp_err_t err = cached_code(index, counter, &result->code);
+    if (err == ESP_OK) {
+        err = cached_code(index, counter + 1, &result->next_code);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    result->remaining = r->period - (timestamp % r->period);
+    result->valid = true;
     return ESP_OK;
 }
 
@@ -93,6 +666,21 @@ esp_err_t totp_storage_init(void) {
 
     ESP_LOGI(TAG, "Initializing TOTP storage");
 
+    if (storage_mutex == NULL) {
+        storage_mutex = xSemaphoreCreateMutex();
+        if (storage_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create storage mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (write_mutex == NULL) {
+        write_mutex = xSemaphoreCreateMutex();
+        if (write_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create storage write mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
     // Initialize NVS helper
     esp_err_t err = nvs_helper_init();
     if (err != ESP_OK) {
@@ -100,6 +688,8 @@ esp_err_t totp_storage_init(void) {
         return err;
     }
 
+    key_pool_reset();
+
     // Load services from NVS (this is OK to fail on first run)
     err = load_services_from_nvs();
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
@@ -118,9 +708,13 @@ esp_err_t totp_storage_deinit(void) {
     }
 
     ESP_LOGI(TAG, "Deinitializing TOTP storage");
+    write_lock();
+    storage_lock();
     storage_ready = false;
-    service_count = 0;
-    
+    free_all_services();
+    storage_unlock();
+    write_unlock();
+
     return ESP_OK;
 }
 
@@ -128,41 +722,211 @@ bool totp_storage_is_ready(void) {
     return storage_ready;
 }
 
-esp_err_t totp_storage_add(const totp_service_t *service) {
-    if (!storage_ready) {
-        ESP_LOGE(TAG, "TOTP storage not initialized");
-        return ESP_ERR_INVALID_STATE;
+// Stage a packed record after the published ones with the next ID; readers do
+// not see it until publish_staged() (caller holds the write lock, the table
+// owns the record on success)
+static esp_err_t stage_record(totp_record_t *record) {
+    if (service_count + staged_count >= MAX_SERVICES) {
+        ESP_LOGE(TAG, "Storage is full (max %d services)", MAX_SERVICES);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Growing the table may move it, so readers must be kept out
+    storage_lock();
+    esp_err_t err = table_reserve(service_count + staged_count + 1);
+    if (err == ESP_OK) {
+        record->id = next_id;
+        init_entry(&table[service_count + staged_count], record);
+    }
+    storage_unlock();
+    if (err != ESP_OK) {
+        return err;
     }
 
+    staged_count++;
+    next_id++;
+    return ESP_OK;
+}
+
+static esp_err_t stage_service(const totp_service_t *service, uint32_t *id) {
     if (service == NULL) {
         ESP_LOGE(TAG, "Service is NULL");
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (service_count >= MAX_SERVICES) {
-        ESP_LOGE(TAG, "Storage is full (max %d services)", MAX_SERVICES);
-        return ESP_ERR_NO_MEM;
+    totp_record_t *record;
+    esp_err_t err = record_from_service(service, 0, &record);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = stage_record(record);
+    if (err != ESP_OK) {
+        free(record);
+        return err;
     }
+    if (id != NULL) {
+        *id = record->id;
+    }
+    return ESP_OK;
+}
 
-    // Add to in-memory cache
-    memcpy(&services[service_count], service, sizeof(totp_service_t));
-    service_count++;
+// Make the staged services visible to readers (caller holds the write lock)
+static void publish_staged(void) {
+    storage_lock();
+    for (; staged_count > 0; staged_count--) {
+        uint16_t index = service_count++;
+        id_index_insert(index);
+        totp_cache_invalidate(index);
+        totp_verify_invalidate(index);
+    }
+    storage_unlock();
+}
+
+// Discard the staged services and the IDs they took (caller holds the write lock)
+static void drop_staged(uint32_t previous_next_id) {
+    for (uint16_t i = 0; i < staged_count; i++) {
+        free(table[service_count + i].record);
+    }
+    staged_count = 0;
+    next_id = previous_next_id;
+}
+
+static esp_err_t add_service(const totp_service_t *service, uint32_t *id) {
+    uint32_t previous_next_id = next_id;
+    esp_err_t err = stage_service(service, id);
+    if (err != ESP_OK) {
+        return err;
+    }
 
-    // Save to NVS
-    esp_err_t err = save_services_to_nvs();
+    // Only the new record, the next ID and the count are written
+    err = save_records(service_count, service_count, 1, service_count + 1, NULL, true);
     if (err != ESP_OK) {
-        // Rollback
-        service_count--;
+        drop_staged(previous_next_id);
         ESP_LOGE(TAG, "Failed to save services after add: %s", esp_err_to_name(err));
         return err;
     }
+    publish_staged();
 
-    ESP_LOGI(TAG, "Added service: %s (%s) - Total: %d", 
+    ESP_LOGI(TAG, "Added service: %s (%s) - Total: %d",
              service->issuer, service->account, service_count);
     return ESP_OK;
 }
 
-esp_err_t totp_storage_get(uint8_t index, totp_service_t *service) {
+esp_err_t totp_storage_add(const totp_service_t *service, uint32_t *id) {
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    write_lock();
+    esp_err_t err = add_service(service, id);
+    write_unlock();
+    return err;
+}
+
+void totp_storage_batch_init(totp_storage_batch_t *batch) {
+    batch->records = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
+
+esp_err_t totp_storage_batch_add(totp_storage_batch_t *batch, const totp_service_t *service) {
+    if (batch == NULL || service == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Never more than the store could hold: the batch stays bounded whatever the input
+    if (batch->count >= MAX_SERVICES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (batch->count == batch->capacity) {
+        uint16_t capacity = (batch->capacity == 0) ? 8 : batch->capacity * 2;
+        if (capacity > MAX_SERVICES) {
+            capacity = MAX_SERVICES;
+        }
+        struct totp_record **grown = realloc(batch->records, capacity * sizeof(*grown));
+        if (grown == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        batch->records = grown;
+        batch->capacity = capacity;
+    }
+
+    // Packed (and validated) now, IDs are assigned at commit
+    totp_record_t *record;
+    esp_err_t err = record_from_service(service, 0, &record);
+    if (err == ESP_OK) {
+        batch->records[batch->count++] = record;
+    }
+    return err;
+}
+
+void totp_storage_batch_free(totp_storage_batch_t *batch) {
+    for (uint16_t i = 0; i < batch->count; i++) {
+        free(batch->records[i]);
+    }
+    free(batch->records);
+    totp_storage_batch_init(batch);
+}
+
+esp_err_t totp_storage_batch_commit(totp_storage_batch_t *batch, uint16_t *added) {
+    if (added != NULL) {
+        *added = 0;
+    }
+
+    if (batch == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        totp_storage_batch_free(batch);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The write lock is only held for staging, the single commit and publishing
+    write_lock();
+    uint32_t previous_next_id = next_id;
+    uint16_t taken = 0;
+    for (; taken < batch->count; taken++) {
+        if (stage_record(batch->records[taken]) != ESP_OK) {
+            break;
+        }
+    }
+    if (taken < batch->count) {
+        ESP_LOGW(TAG, "Batch: %d services did not fit", batch->count - taken);
+    }
+
+    // The table owns the staged records; the ones that did not fit are freed below
+    memmove(batch->records, batch->records + taken, (batch->count - taken) * sizeof(*batch->records));
+    batch->count -= taken;
+    totp_storage_batch_free(batch);
+
+    if (taken == 0) {
+        write_unlock();
+        return ESP_OK;
+    }
+
+    // Only the new records plus the count, all under one commit
+    esp_err_t err = save_records(service_count, service_count, taken, service_count + taken, NULL, true);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save batch of %d services: %s", taken, esp_err_to_name(err));
+        drop_staged(previous_next_id);
+    } else {
+        publish_staged();
+        ESP_LOGI(TAG, "Added %d services in one batch - Total: %d", taken, service_count);
+        if (added != NULL) {
+            *added = taken;
+        }
+    }
+
+    write_unlock();
+    return err;
+}
+
+esp_err_t totp_storage_get(uint32_t id, totp_service_t *service) {
     if (!storage_ready) {
         ESP_LOGE(TAG, "TOTP storage not initialized");
         return ESP_ERR_INVALID_STATE;
@@ -173,55 +937,319 @@ esp_err_t totp_storage_get(uint8_t index, totp_service_t *service) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (index >= service_count) {
-        ESP_LOGE(TAG, "Index %d out of range (count: %d)", index, service_count);
+    storage_lock();
+    uint16_t index;
+    if (!find_service(id, &index)) {
+        storage_unlock();
+        ESP_LOGE(TAG, "Service %lu not found", (unsigned long)id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    record_to_service(table[index].record, service);
+    storage_unlock();
+    return ESP_OK;
+}
+
+esp_err_t totp_storage_get_digits(uint32_t id, uint8_t *digits) {
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (digits == NULL) {
+        ESP_LOGE(TAG, "Digits output is NULL");
         return ESP_ERR_INVALID_ARG;
     }
 
-    memcpy(service, &services[index], sizeof(totp_service_t));
+    storage_lock();
+    uint16_t index;
+    if (!find_service(id, &index)) {
+        storage_unlock();
+        return ESP_ERR_NOT_FOUND;
+    }
+    *digits = table[index].record->digits;
+    storage_unlock();
     return ESP_OK;
 }
 
-uint8_t totp_storage_count(void) {
-    return storage_ready ? service_count : 0;
+esp_err_t totp_storage_generate_codes(uint64_t timestamp, uint16_t first, totp_code_result_t *results,
+                                      uint32_t *ids, uint16_t max_results, uint16_t *count) {
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (results == NULL || ids == NULL || count == NULL) {
+        ESP_LOGE(TAG, "Results output is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    storage_lock();
+    uint16_t available = (first < service_count) ? service_count - first : 0;
+    uint16_t n = (available < max_results) ? available : max_results;
+    *count = n;
+
+    esp_err_t ret = ESP_OK;
+    for (uint16_t i = 0; i < n; i++) {
+        ids[i] = table[first + i].record->id;
+        if (get_code_cached(first + i, timestamp, &results[i]) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+    }
+    storage_unlock();
+
+    return ret;
+}
+
+esp_err_t totp_storage_get_code(uint32_t id, uint64_t timestamp, totp_code_result_t *result,
+                                char *issuer, size_t issuer_size) {
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (result == NULL) {
+        ESP_LOGE(TAG, "Result output is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    storage_lock();
+    uint16_t index;
+    if (!find_service(id, &index)) {
+        storage_unlock();
+        ESP_LOGE(TAG, "Service %lu not found", (unsigned long)id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Copied from the record under the same lock: no second lookup, no decoded secret
+    if (issuer != NULL && issuer_size > 0) {
+        const totp_record_t *r = table[index].record;
+        size_t len = (r->issuer_len < issuer_size) ? r->issuer_len : issuer_size - 1;
+        memcpy(issuer, record_issuer(r), len);
+        issuer[len] = '\0';
+    }
+
+    esp_err_t err = get_code_cached(index, timestamp, result);
+    storage_unlock();
+    return err;
+}
+
+esp_err_t totp_storage_next_hotp(uint32_t id, uint32_t *code, uint64_t *counter) {
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (code == NULL) {
+        ESP_LOGE(TAG, "Code output is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Counter reservations rewrite the record, which writers read unlocked
+    write_lock();
+    storage_lock();
+    uint16_t index;
+    if (!find_service(id, &index)) {
+        storage_unlock();
+        write_unlock();
+        ESP_LOGE(TAG, "Service %lu not found", (unsigned long)id);
+        return ESP_ERR_NOT_FOUND;
+    }
+    const totp_key_t *key = service_key(index);
+    if (key == NULL) {
+        storage_unlock();
+        write_unlock();
+        return ESP_FAIL;
+    }
+
+    service_entry_t *entry = &table[index];
+    totp_record_t *r = entry->record;
+    if (r->type != TOTP_TYPE_HOTP) {
+        storage_unlock();
+        write_unlock();
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Reserve a new block before handing out a value past the persisted ceiling
+    // (rare, so readers are simply held up for this write)
+    esp_err_t err = ESP_OK;
+    if (entry->hotp_next >= r->counter) {
+        uint64_t previous = r->counter;
+        r->counter = entry->hotp_next + CONFIG_GMAKER_HOTP_COUNTER_RESERVE;
+
+        char name[16];
+        get_service_key(index, name, sizeof(name));
+        err = nvs_helper_save(name, r, record_size(r));
+        if (err != ESP_OK) {
+            r->counter = previous;
+            ESP_LOGE(TAG, "Failed to reserve HOTP counters: %s", esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Reserved HOTP counters up to %llu for service %lu", (unsigned long long)r->counter, (unsigned long)id);
+        }
+    }
+
+    if (err == ESP_OK) {
+        uint64_t value = entry->hotp_next;
+        err = totp_key_generate(key, value, code);
+        if (err == ESP_OK) {
+            entry->hotp_next++;
+            drop_json(entry);   // The list shows the next counter
+            if (counter != NULL) {
+                *counter = value;
+            }
+        }
+    }
+
+    storage_unlock();
+    write_unlock();
+    return err;
 }
 
-esp_err_t totp_storage_delete(uint8_t index) {
+esp_err_t totp_storage_verify(uint32_t id, uint64_t timestamp, uint32_t code,
+                              uint8_t window, bool *valid) {
     if (!storage_ready) {
         ESP_LOGE(TAG, "TOTP storage not initialized");
         return ESP_ERR_INVALID_STATE;
     }
 
-    if (index >= service_count) {
-        ESP_LOGE(TAG, "Index %d out of range (count: %d)", index, service_count);
+    if (valid == NULL) {
+        ESP_LOGE(TAG, "Valid output is NULL");
         return ESP_ERR_INVALID_ARG;
     }
 
-    ESP_LOGI(TAG, "Deleting service %d: %s (%s)", 
-             index, services[index].issuer, services[index].account);
+    storage_lock();
+    uint16_t index;
+    if (!find_service(id, &index)) {
+        storage_unlock();
+        ESP_LOGE(TAG, "Service %lu not found", (unsigned long)id);
+        return ESP_ERR_NOT_FOUND;
+    }
+    const totp_key_t *key = service_key(index);
+    if (key == NULL) {
+        storage_unlock();
+        return ESP_FAIL;
+    }
+
+    if (table[index].record->type == TOTP_TYPE_HOTP) {
+        storage_unlock();
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t err = totp_verify_ring_check(index, key, timestamp / key->period, code, window, valid);
+    storage_unlock();
+    return err;
+}
 
-    // Shift services down
-    for (uint8_t i = index; i < service_count - 1; i++) {
-        memcpy(&services[i], &services[i + 1], sizeof(totp_service_t));
+esp_err_t totp_storage_precompute(uint64_t timestamp, uint32_t *next_rollover) {
+    if (!storage_ready) {
+        return ESP_ERR_INVALID_STATE;
     }
-    service_count--;
 
-    // Clear the last service key in NVS (now unused)
-    char key[16];
-    get_service_key(service_count, key, sizeof(key));
-    nvs_helper_delete(key);
+    uint32_t soonest = UINT32_MAX;
 
-    // Save updated list to NVS
-    esp_err_t err = save_services_to_nvs();
+    storage_lock();
+    for (uint16_t i = 0; i < service_count; i++) {
+        const totp_record_t *r = table[i].record;
+        if (r->type == TOTP_TYPE_HOTP) {
+            continue;
+        }
+
+        // Fill the look-ahead window without counting it as a cache miss
+        uint64_t next_counter = timestamp / r->period + 1;
+        if (!totp_cache_contains(i, next_counter)) {
+            const totp_key_t *key = service_key(i);
+            uint32_t code;
+            if (key != NULL && totp_key_generate(key, next_counter, &code) == ESP_OK) {
+                totp_cache_store(i, next_counter, code);
+            }
+        }
+
+        uint32_t remaining = r->period - (timestamp % r->period);
+        if (remaining < soonest) {
+            soonest = remaining;
+        }
+    }
+    storage_unlock();
+
+    if (next_rollover != NULL) {
+        *next_rollover = soonest;
+    }
+    return ESP_OK;
+}
+
+uint16_t totp_storage_count(void) {
+    return storage_ready ? service_count : 0;
+}
+
+// Caller holds the write lock
+static esp_err_t delete_service(uint32_t id) {
+    uint16_t index;
+    if (!find_service(id, &index)) {
+        ESP_LOGE(TAG, "Service %lu not found", (unsigned long)id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const totp_record_t *r = table[index].record;
+    ESP_LOGI(TAG, "Deleting service %lu: %.*s (%.*s)", (unsigned long)id,
+             r->issuer_len, record_issuer(r), r->account_len, record_account(r));
+
+    // Move the last service into the freed slot, so only that record is rewritten.
+    // NVS is updated first; readers keep seeing the old table until it is committed.
+    uint16_t last = service_count - 1;
+    char last_key[16];
+    get_service_key(last, last_key, sizeof(last_key));
+    esp_err_t err = save_records(index, last, (index != last) ? 1 : 0, last, last_key, false);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to save services after delete: %s", esp_err_to_name(err));
         return err;
     }
 
+    storage_lock();
+    // The index is updated while the table still matches it
+    uint32_t moved_id = table[last].record->id;
+    id_index_remove(id);
+    if (index != last) {
+        id_index_move(moved_id, index);
+    }
+    service_entry_t removed = table[index];
+    table[index] = table[last];
+    service_count = last;
+
+    // Hand the key state over to the moved service's new index
+    if (removed.key_slot >= 0 && key_pool[removed.key_slot].owner == index) {
+        totp_key_free(&key_pool[removed.key_slot].key);
+        key_pool[removed.key_slot].owner = -1;
+    }
+    if (index != last && table[index].key_slot >= 0 &&
+        key_pool[table[index].key_slot].owner == last) {
+        key_pool[table[index].key_slot].owner = index;
+    }
+    drop_json(&removed);
+
+    // Only the freed slot and the moved service have stale cached codes
+    totp_cache_invalidate(index);
+    totp_verify_invalidate(index);
+    totp_cache_invalidate(last);
+    totp_verify_invalidate(last);
+    storage_unlock();
+
+    free(removed.record);
     ESP_LOGI(TAG, "Service deleted - Remaining: %d", service_count);
     return ESP_OK;
 }
 
+esp_err_t totp_storage_delete(uint32_t id) {
+    if (!storage_ready) {
+        ESP_LOGE(TAG, "TOTP storage not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    write_lock();
+    esp_err_t err = delete_service(id);
+    write_unlock();
+    return err;
+}
+
 esp_err_t totp_storage_clear(void) {
     if (!storage_ready) {
         ESP_LOGE(TAG, "TOTP storage not initialized");
@@ -230,17 +1258,33 @@ esp_err_t totp_storage_clear(void) {
 
     ESP_LOGI(TAG, "Clearing all services");
 
-    // Delete all service keys
-    for (uint8_t i = 0; i < service_count; i++) {
-        char key[16];
-        get_service_key(i, key, sizeof(key));
-        nvs_helper_delete(key);
+    write_lock();
+
+    // Save count = 0 first, then erase every record, all in one commit
+    esp_err_t err = nvs_helper_begin();
+    if (err == ESP_OK) {
+        uint16_t zero = 0;
+        err = nvs_helper_save(NVS_KEY_COUNT, &zero, sizeof(uint16_t));
+        for (uint16_t i = 0; i < service_count && err == ESP_OK; i++) {
+            char key[16];
+            get_service_key(i, key, sizeof(key));
+            err = nvs_helper_delete(key);
+            if (err == ESP_ERR_NVS_NOT_FOUND) {
+                err = ESP_OK;
+            }
+        }
+        esp_err_t commit_err = nvs_helper_commit();
+        if (err == ESP_OK) {
+            err = commit_err;
+        }
     }
 
-    service_count = 0;
-    
-    // Save count = 0
-    esp_err_t err = nvs_helper_save(NVS_KEY_COUNT, &service_count, sizeof(uint8_t));
+    if (err == ESP_OK) {
+        storage_lock();
+        free_all_services();
+        storage_unlock();
+    }
+    write_unlock();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to save cleared count: %s", esp_err_to_name(err));
         return err;
@@ -250,44 +1294,118 @@ esp_err_t totp_storage_clear(void) {
     return ESP_OK;
 }
 
-char* totp_storage_list_json(void) {
+// Serialize one entry of the service list; a NULL buffer only measures it
+static size_t write_entry_json(const service_entry_t *entry, const char *secret, char *buf, size_t size) {
+    const totp_record_t *r = entry->record;
+    json_writer_t w;
+    json_writer_init(&w, buf, size, NULL, NULL);
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "id");
+    json_writer_uint(&w, r->id);
+    json_writer_key(&w, "service_name");
+    json_writer_string_n(&w, record_name(r), r->name_len);
+    json_writer_key(&w, "account");
+    json_writer_string_n(&w, record_account(r), r->account_len);
+    json_writer_key(&w, "issuer");
+    json_writer_string_n(&w, record_issuer(r), r->issuer_len);
+    json_writer_key(&w, "secret");
+    json_writer_string(&w, secret);
+    json_writer_key(&w, "digits");
+    json_writer_uint(&w, r->digits);
+    json_writer_key(&w, "period");
+    json_writer_uint(&w, r->period);
+    json_writer_key(&w, "algorithm");
+    json_writer_string(&w, totp_algorithm_name(r->algorithm));
+    json_writer_key(&w, "type");
+    json_writer_string(&w, (r->type == TOTP_TYPE_HOTP) ? "hotp" : "totp");
+    json_writer_key(&w, "counter");
+    json_writer_uint(&w, entry->hotp_next);
+    json_writer_end_object(&w);
+    json_writer_finish(&w);
+    return json_writer_length(&w);
+}
+
+// Get the list entry of a service, serializing it on first use (caller holds the lock)
+static entry_json_t *entry_json(uint16_t index) {
+    service_entry_t *entry = &table[index];
+    if (entry->json != NULL) {
+        return entry->json;
+    }
+
+    char secret[MAX_SECRET_LEN];
+    base32_encode(entry->record->data, entry->record->key_len, secret, sizeof(secret));
+
+    // Measure first so the entry is allocated at its exact size
+    size_t needed = write_entry_json(entry, secret, NULL, 0);
+    entry_json_t *json = (needed < UINT16_MAX) ? malloc(sizeof(entry_json_t) + needed + 1) : NULL;
+    if (json != NULL) {
+        write_entry_json(entry, secret, json->text, needed + 1);
+        json->refs = 1;
+        json->len = needed;
+        entry->json = json;
+    }
+
+    memset(secret, 0, sizeof(secret));
+    return json;
+}
+
+esp_err_t totp_storage_write_list_json(totp_storage_json_writer_t write, void *ctx) {
     if (!storage_ready) {
         ESP_LOGE(TAG, "TOTP storage not initialized");
-        return NULL;
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // Calculate required size
-    size_t json_size = 2; // "[]"
-    for (uint8_t i = 0; i < service_count; i++) {
-        // Rough estimate: each service ~300 bytes
-        json_size += 350;
+    if (write == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    char *json = malloc(json_size);
-    if (json == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for JSON");
-        return NULL;
+    // Snapshot the entries under the lock (cached between calls, only rebuilt
+    // after their service changes) and take a reference to each
+    storage_lock();
+    uint16_t count = service_count;
+    entry_json_t **snapshot = NULL;
+    if (count > 0) {
+        snapshot = malloc(count * sizeof(entry_json_t *));
+        if (snapshot == NULL) {
+            storage_unlock();
+            ESP_LOGE(TAG, "Failed to allocate memory for JSON");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        snapshot[i] = entry_json(i);
+        if (snapshot[i] == NULL) {
+            while (i > 0) {
+                release_json(snapshot[--i]);
+            }
+            storage_unlock();
+            free(snapshot);
+            ESP_LOGE(TAG, "Failed to allocate memory for JSON");
+            return ESP_ERR_NO_MEM;
+        }
+        snapshot[i]->refs++;
     }
+    storage_unlock();
 
-    // Build JSON array
-    strcpy(json, "[");
-    
-    for (uint8_t i = 0; i < service_count; i++) {
-        char entry[400];
-        snprintf(entry, sizeof(entry),
-            "%s{\"service_name\":\"%s\",\"account\":\"%s\",\"issuer\":\"%s\",\"secret\":\"%s\",\"digits\":%d,\"period\":%lu}",
-            (i > 0) ? "," : "",
-            services[i].service_name,
-            services[i].account,
-            services[i].issuer,
-            services[i].secret,
-            services[i].digits,
-            services[i].period
-        );
-        strcat(json, entry);
-    }
-    
-    strcat(json, "]");
+    // Stream without the lock: a slow client does not hold up readers or writers
+    esp_err_t err = write("[", 1, ctx);
+    for (uint16_t i = 0; i < count && err == ESP_OK; i++) {
+        if (i > 0) {
+            err = write(",", 1, ctx);
+        }
+        if (err == ESP_OK) {
+            err = write(snapshot[i]->text, snapshot[i]->len, ctx);
+        }
+    }
+    if (err == ESP_OK) {
+        err = write("]", 1, ctx);
+    }
 
-    return json;
+    storage_lock();
+    for (uint16_t i = 0; i < count; i++) {
+        release_json(snapshot[i]);
+    }
+    storage_unlock();
+    free(snapshot);
+    return err;
 }
@@ -2,15 +2,32 @@
 #define TOTP_STORAGE_H
 
 #include "esp_err.h"
+#include "totp_engine.h"
+#include "sdkconfig.h"
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 #define MAX_SERVICE_NAME_LEN    64
 #define MAX_ACCOUNT_NAME_LEN    64
 #define MAX_SECRET_LEN          128
 #define MAX_ISSUER_LEN          64
-#define MAX_SERVICES            20
+#define MAX_SERVICES            CONFIG_GMAKER_TOTP_MAX_SERVICES
 
+/**
+ * @brief One-time password type (otpauth://totp or otpauth://hotp)
+ */
+typedef enum {
+    TOTP_TYPE_TOTP = 0,     // Time-based (RFC 6238), default for older records
+    TOTP_TYPE_HOTP = 1,     // Counter-based (RFC 4226)
+} totp_type_t;
+
+/**
+ * @brief Service description exchanged with the parser and the API
+ *
+ * Storage keeps services as packed, variable-length records (binary key and
+ * unpadded strings); this fixed-size form is only built on demand.
+ */
 typedef struct {
     char service_name[MAX_SERVICE_NAME_LEN];
     char account[MAX_ACCOUNT_NAME_LEN];
@@ -18,6 +35,9 @@ typedef struct {
     char issuer[MAX_ISSUER_LEN];
     uint8_t digits;         // Usually 6 or 8
     uint32_t period;        // Usually 30 seconds
+    uint8_t algorithm;      // totp_algorithm_t, kept last so older records load as SHA1
+    uint8_t type;           // totp_type_t, older records load as TOTP
+    uint64_t counter;       // HOTP: reserved counter ceiling persisted in NVS
 } totp_service_t;
 
 /**
@@ -41,30 +61,148 @@ bool totp_storage_is_ready(void);
 /**
  * @brief Add a new TOTP service
  * @param service Service to add
+ * @param id Output stable ID assigned to the service (can be NULL)
  * @return ESP_OK on success, ESP_ERR_NO_MEM if storage is full
+ *
+ * IDs are never reused and do not change when other services are deleted.
+ */
+esp_err_t totp_storage_add(const totp_service_t *service, uint32_t *id);
+
+/**
+ * @brief Services collected for one commit, owned by the caller
+ *
+ * Filled without any storage lock (e.g. while a request body is still
+ * arriving); only totp_storage_batch_commit() takes the write lock.
+ * count is the number of services staged so far; the other fields are
+ * private to totp_storage.c.
+ */
+typedef struct {
+    struct totp_record **records;   // Packed records, IDs assigned at commit
+    uint16_t count;
+    uint16_t capacity;
+} totp_storage_batch_t;
+
+/**
+ * @brief Start an empty batch
+ * @param batch Batch to initialize
  */
-esp_err_t totp_storage_add(const totp_service_t *service);
+void totp_storage_batch_init(totp_storage_batch_t *batch);
 
 /**
- * @brief Get service by index
- * @param index Service index (0 to count-1)
+ * @brief Validate and pack a service into the batch (RAM only, no lock)
+ * @param batch Batch
+ * @param service Service to add
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an invalid service,
+ *         ESP_ERR_NO_MEM if the batch holds MAX_SERVICES or memory is short
+ */
+esp_err_t totp_storage_batch_add(totp_storage_batch_t *batch, const totp_service_t *service);
+
+/**
+ * @brief Persist the batch with a single NVS commit and publish it
+ * @param batch Batch (emptied in every case)
+ * @param added Output number of services added; those that do not fit in the store are dropped (can be NULL)
+ * @return ESP_OK on success; on failure nothing is added
+ *
+ * Holds the storage write lock only for the commit itself; reads keep being
+ * served and see the whole batch at once.
+ */
+esp_err_t totp_storage_batch_commit(totp_storage_batch_t *batch, uint16_t *added);
+
+/**
+ * @brief Discard a batch that will not be committed
+ * @param batch Batch (emptied)
+ */
+void totp_storage_batch_free(totp_storage_batch_t *batch);
+
+/**
+ * @brief Get service by ID
+ * @param id Service ID
  * @param service Output service structure
- * @return ESP_OK on success, ESP_ERR_INVALID_ARG if index out of range
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID
  */
-esp_err_t totp_storage_get(uint8_t index, totp_service_t *service);
+esp_err_t totp_storage_get(uint32_t id, totp_service_t *service);
+
+/**
+ * @brief Get the number of digits of a service's codes, without copying its secret
+ * @param id Service ID
+ * @param digits Output number of digits
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID
+ */
+esp_err_t totp_storage_get_digits(uint32_t id, uint8_t *digits);
+
+/**
+ * @brief Get the current and next codes of a service, served from the code cache when possible
+ * @param id Service ID
+ * @param timestamp Unix timestamp
+ * @param result Output codes, remaining seconds and period
+ * @param issuer Output issuer, NUL-terminated and truncated to issuer_size (can be NULL)
+ * @param issuer_size Size of the issuer buffer
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID,
+ *         ESP_ERR_NOT_SUPPORTED for HOTP services
+ */
+esp_err_t totp_storage_get_code(uint32_t id, uint64_t timestamp, totp_code_result_t *result,
+                                char *issuer, size_t issuer_size);
+
+/**
+ * @brief Generate the next HOTP code of a service and advance its counter
+ * @param id Service ID
+ * @param code Output HOTP code
+ * @param counter Output counter value used for the code (optional)
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID,
+ *         ESP_ERR_NOT_SUPPORTED if the service is not HOTP
+ *
+ * Counters are reserved in blocks of CONFIG_GMAKER_HOTP_COUNTER_RESERVE, so
+ * NVS is only written when a block is used up.
+ */
+esp_err_t totp_storage_next_hotp(uint32_t id, uint32_t *code, uint64_t *counter);
+
+/**
+ * @brief Verify a code for a service at a given timestamp
+ * @param id Service ID
+ * @param timestamp Unix timestamp
+ * @param code Code to verify
+ * @param window Accepted skew in time steps (+/-)
+ * @param valid Output true if the code matches
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID,
+ *         ESP_ERR_INVALID_ARG if window is out of range
+ */
+esp_err_t totp_storage_verify(uint32_t id, uint64_t timestamp, uint32_t code,
+                              uint8_t window, bool *valid);
+
+/**
+ * @brief Precompute the next-window code of every service into the code cache
+ * @param timestamp Unix timestamp
+ * @param next_rollover Output seconds until the nearest window boundary
+ *                      (UINT32_MAX when there are no services, optional)
+ * @return ESP_OK on success
+ */
+esp_err_t totp_storage_precompute(uint64_t timestamp, uint32_t *next_rollover);
+
+/**
+ * @brief Generate the codes of a range of stored services at one timestamp
+ * @param timestamp Unix timestamp shared by all codes
+ * @param first Position of the first service (0 to count-1, not an ID)
+ * @param results Output array, one entry per service in storage order
+ * @param ids Output array of the matching service IDs
+ * @param max_results Size of the results and ids arrays
+ * @param count Output number of entries written (0 once first is past the end)
+ * @return ESP_OK on success, ESP_FAIL if any service could not produce a code
+ */
+esp_err_t totp_storage_generate_codes(uint64_t timestamp, uint16_t first, totp_code_result_t *results,
+                                      uint32_t *ids, uint16_t max_results, uint16_t *count);
 
 /**
  * @brief Get total number of services
  * @return Number of services stored
  */
-uint8_t totp_storage_count(void);
+uint16_t totp_storage_count(void);
 
 /**
- * @brief Delete service by index
- * @param index Service index to delete
- * @return ESP_OK on success
+ * @brief Delete service by ID
+ * @param id Service ID
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID
  */
-esp_err_t totp_storage_delete(uint8_t index);
+esp_err_t totp_storage_delete(uint32_t id);
 
 /**
  * @brief Clear all services
@@ -73,9 +211,26 @@ esp_err_t totp_storage_delete(uint8_t index);
 esp_err_t totp_storage_clear(void);
 
 /**
- * @brief Get all services as JSON string
- * @return Allocated JSON string (caller must free), or NULL on error
+ * @brief Receives consecutive pieces of the service list JSON
+ * @param data Piece of JSON (not NUL-terminated)
+ * @param len Length of the piece
+ * @param ctx User context given to totp_storage_write_list_json()
+ * @return ESP_OK to continue, any other value stops the listing with that error
+ */
+typedef esp_err_t (*totp_storage_json_writer_t)(const char *data, size_t len, void *ctx);
+
+/**
+ * @brief Write all services as a JSON array, piece by piece
+ * @param write Called for each piece, in order (without the storage lock held)
+ * @param ctx User context passed to the writer
+ * @return ESP_OK on success, ESP_ERR_NO_MEM or the writer's error otherwise
+ *
+ * Each entry is serialized once at its exact size and cached until that
+ * service changes, so repeated listings only copy cached text. The listing
+ * is a consistent snapshot: entries are referenced under the lock and
+ * streamed after it is released, so a slow writer never blocks other
+ * readers or storage writers.
  */
-char* totp_storage_list_json(void);
+esp_err_t totp_storage_write_list_json(totp_storage_json_writer_t write, void *ctx);
 
 #endif // TOTP_STORAGE_H
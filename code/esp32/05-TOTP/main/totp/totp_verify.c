@@ -0,0 +1,111 @@
+#include "totp_verify.h"
+#include "totp_storage.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define RING_SIZE       (2 * TOTP_VERIFY_MAX_WINDOW + 1)
+#define RING_EMPTY      UINT64_MAX
+
+typedef struct {
+    uint64_t counters[RING_SIZE];   // Counter held by each slot (slot = counter % RING_SIZE)
+    uint32_t codes[RING_SIZE];
+} verify_ring_t;
+
+// One ring per service slot (same indices as totp_storage), allocated on first use
+// since most services are never verified; the pointer array grows with the table
+static verify_ring_t **rings = NULL;
+static uint16_t ring_capacity = 0;
+
+static void ring_reset(verify_ring_t *ring) {
+    for (int i = 0; i < RING_SIZE; i++) {
+        ring->counters[i] = RING_EMPTY;
+        ring->codes[i] = 0;
+    }
+}
+
+esp_err_t totp_verify_reserve(uint16_t capacity) {
+    if (capacity <= ring_capacity) {
+        return ESP_OK;
+    }
+
+    verify_ring_t **grown = realloc(rings, capacity * sizeof(rings[0]));
+    if (grown == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint16_t i = ring_capacity; i < capacity; i++) {
+        grown[i] = NULL;
+    }
+    rings = grown;
+    ring_capacity = capacity;
+    return ESP_OK;
+}
+
+esp_err_t totp_verify(uint32_t id, uint32_t code, uint8_t window, bool *valid) {
+    return totp_storage_verify(id, totp_get_timestamp(), code, window, valid);
+}
+
+esp_err_t totp_verify_ring_check(uint16_t index, const totp_key_t *key, uint64_t counter,
+                                 uint32_t code, uint8_t window, bool *valid) {
+    if (index >= ring_capacity || key == NULL || valid == NULL || window > TOTP_VERIFY_MAX_WINDOW) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *valid = false;
+    verify_ring_t *ring = rings[index];
+    if (ring == NULL) {
+        ring = malloc(sizeof(verify_ring_t));
+        if (ring == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        ring_reset(ring);
+        rings[index] = ring;
+    }
+
+    uint64_t first = (counter > window) ? counter - window : 0;
+    uint64_t last = counter + window;
+
+    // Slide the ring: only counters that entered the window need an HMAC
+    for (uint64_t c = first; c <= last; c++) {
+        int slot = c % RING_SIZE;
+        if (ring->counters[slot] != c) {
+            uint32_t value;
+            esp_err_t err = totp_key_generate(key, c, &value);
+            if (err != ESP_OK) {
+                ring->counters[slot] = RING_EMPTY;
+                return err;
+            }
+            ring->counters[slot] = c;
+            ring->codes[slot] = value;
+        }
+    }
+
+    // Constant-time scan: every slot is compared, no early exit on a match
+    uint32_t match = 0;
+    for (int i = 0; i < RING_SIZE; i++) {
+        uint32_t in_window = (ring->counters[i] >= first) & (ring->counters[i] <= last);
+        uint32_t diff = ring->codes[i] ^ code;
+        uint32_t equal = ((diff | (0U - diff)) >> 31) ^ 1U;
+        match |= in_window & equal;
+    }
+
+    *valid = (match != 0);
+    return ESP_OK;
+}
+
+void totp_verify_invalidate(uint16_t index) {
+    if (index >= ring_capacity) {
+        return;
+    }
+
+    free(rings[index]);
+    rings[index] = NULL;
+}
+
+void totp_verify_release(void) {
+    for (uint16_t i = 0; i < ring_capacity; i++) {
+        free(rings[i]);
+    }
+    free(rings);
+    rings = NULL;
+    ring_capacity = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef TOTP_VERIFY_H
+#define TOTP_VERIFY_H
+
+#include "esp_err.h"
+#include "totp_engine.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TOTP_VERIFY_MAX_WINDOW  3   // Largest accepted skew in time steps (+/-)
+
+/**
+ * @brief Verify a code for a stored service, accepting +/- window time steps of skew
+ * @param id Service ID
+ * @param code Code to verify
+ * @param window Accepted skew in time steps (0 to TOTP_VERIFY_MAX_WINDOW)
+ * @param valid Output true if the code matches any counter in the window
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no service has that ID,
+ *         ESP_ERR_INVALID_ARG if window is out of range
+ *
+ * Codes for the surrounding counters are kept in a per-service ring, so a
+ * verification only computes the counters that entered the window since the
+ * previous call and then scans the whole ring in constant time.
+ */
+esp_err_t totp_verify(uint32_t id, uint32_t code, uint8_t window, bool *valid);
+
+/**
+ * @brief Check a code against the ring of a service (caller holds the storage lock)
+ * @param index Service index
+ * @param key Key state of the service
+ * @param counter Current time counter
+ * @param code Code to verify
+ * @param window Accepted skew in time steps (0 to TOTP_VERIFY_MAX_WINDOW)
+ * @param valid Output true if the code matches
+ * @return ESP_OK on success
+ */
+esp_err_t totp_verify_ring_check(uint16_t index, const totp_key_t *key, uint64_t counter,
+                                 uint32_t code, uint8_t window, bool *valid);
+
+/**
+ * @brief Drop the ring of one service (caller holds the storage lock)
+ * @param index Service index
+ */
+void totp_verify_invalidate(uint16_t index);
+
+/**
+ * @brief Make room for service indices below capacity (caller holds the storage lock)
+ * @param capacity Number of service slots
+ * @return ESP_OK, or ESP_ERR_NO_MEM (the rings keep their previous size)
+ */
+esp_err_t totp_verify_reserve(uint16_t capacity);
+
+/**
+ * @brief Drop every ring and free the ring table (caller holds the storage lock)
+ */
+void totp_verify_release(void);
+
+#endif // TOTP_VERIFY_H
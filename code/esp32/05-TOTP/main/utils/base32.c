@@ -1,51 +1,112 @@
 #include "base32.h"
 #include <string.h>
-#include <ctype.h>
 
-static int base32_char_to_value(char c) {
-    if (c >= 'A' && c <= 'Z') {
-        return c - 'A';
-    }
-    if (c >= '2' && c <= '7') {
-        return c - '2' + 26;
-    }
-    return -1;
-}
+// Table entries hold value + 1, so characters outside the alphabet read as 0
+#define B32_INVALID 0x00    // Not part of the alphabet
+#define B32_SKIP    0xFF    // Padding and whitespace, ignored
+
+static const char base32_alphabet[32] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+// Character -> 5-bit value + 1 lookup (upper and lower case accepted)
+static const uint8_t base32_table[256] = {
+    ['A'] = 1,   ['B'] = 2,   ['C'] = 3,   ['D'] = 4,   ['E'] = 5,   ['F'] = 6,
+    ['G'] = 7,   ['H'] = 8,   ['I'] = 9,   ['J'] = 10,  ['K'] = 11,  ['L'] = 12,
+    ['M'] = 13,  ['N'] = 14,  ['O'] = 15,  ['P'] = 16,  ['Q'] = 17,  ['R'] = 18,
+    ['S'] = 19,  ['T'] = 20,  ['U'] = 21,  ['V'] = 22,  ['W'] = 23,  ['X'] = 24,
+    ['Y'] = 25,  ['Z'] = 26,
+    ['a'] = 1,   ['b'] = 2,   ['c'] = 3,   ['d'] = 4,   ['e'] = 5,   ['f'] = 6,
+    ['g'] = 7,   ['h'] = 8,   ['i'] = 9,   ['j'] = 10,  ['k'] = 11,  ['l'] = 12,
+    ['m'] = 13,  ['n'] = 14,  ['o'] = 15,  ['p'] = 16,  ['q'] = 17,  ['r'] = 18,
+    ['s'] = 19,  ['t'] = 20,  ['u'] = 21,  ['v'] = 22,  ['w'] = 23,  ['x'] = 24,
+    ['y'] = 25,  ['z'] = 26,
+    ['2'] = 27,  ['3'] = 28,  ['4'] = 29,  ['5'] = 30,  ['6'] = 31,  ['7'] = 32,
+    ['='] = B32_SKIP, [' '] = B32_SKIP, ['\n'] = B32_SKIP, ['\r'] = B32_SKIP,
+};
 
 int base32_decode(const char *encoded, uint8_t *decoded, size_t decoded_len) {
     if (encoded == NULL || decoded == NULL) {
         return -1;
     }
 
-    size_t encoded_len = strlen(encoded);
+    const uint8_t *src = (const uint8_t *)encoded;
     size_t decoded_idx = 0;
-    uint32_t buffer = 0;
-    int bits_in_buffer = 0;
 
-    for (size_t i = 0; i < encoded_len; i++) {
-        char c = toupper(encoded[i]);
-        
-        // Skip padding and whitespace
-        if (c == '=' || c == ' ' || c == '\n' || c == '\r') {
-            continue;
+    for (;;) {
+        // Gather up to 8 symbols (40 bits) into one block
+        uint64_t block = 0;
+        int symbols = 0;
+
+        while (symbols < 8 && *src != '\0') {
+            uint8_t value = base32_table[*src++];
+            if (value == B32_SKIP) {
+                continue;
+            }
+            if (value == B32_INVALID) {
+                return -1; // Invalid character
+            }
+            block = (block << 5) | (value - 1);
+            symbols++;
         }
 
-        int value = base32_char_to_value(c);
-        if (value < 0) {
-            return -1; // Invalid character
+        // Each symbol carries 5 bits; trailing bits short of a byte are dropped
+        int bytes = (symbols * 5) / 8;
+        if (bytes == 0) {
+            break;
+        }
+        if (decoded_idx + bytes > decoded_len) {
+            return -1; // Output buffer too small
         }
 
-        buffer = (buffer << 5) | value;
-        bits_in_buffer += 5;
+        int bits = symbols * 5;
+        for (int i = 0; i < bytes; i++) {
+            bits -= 8;
+            decoded[decoded_idx++] = (block >> bits) & 0xFF;
+        }
 
-        if (bits_in_buffer >= 8) {
-            if (decoded_idx >= decoded_len) {
-                return -1; // Output buffer too small
-            }
-            decoded[decoded_idx++] = (buffer >> (bits_in_buffer - 8)) & 0xFF;
-            bits_in_buffer -= 8;
+        if (symbols < 8) {
+            break;
         }
     }
 
     return decoded_idx;
 }
+
+int base32_encode(const uint8_t *data, size_t data_len, char *encoded, size_t encoded_size) {
+    if (data == NULL || encoded == NULL) {
+        return -1;
+    }
+
+    size_t out_len = (data_len * 8 + 4) / 5;
+    if (out_len + 1 > encoded_size) {
+        return -1; // Output buffer too small
+    }
+
+    char *dst = encoded;
+    size_t i = 0;
+
+    // Full 5-byte blocks -> 8 symbols
+    for (; i + 5 <= data_len; i += 5) {
+        uint64_t block = ((uint64_t)data[i] << 32) | ((uint64_t)data[i + 1] << 24) |
+                         ((uint64_t)data[i + 2] << 16) | ((uint64_t)data[i + 3] << 8) |
+                         (uint64_t)data[i + 4];
+        for (int shift = 35; shift >= 0; shift -= 5) {
+            *dst++ = base32_alphabet[(block >> shift) & 0x1F];
+        }
+    }
+
+    // Tail block, zero-padded on the right, without '=' padding
+    size_t rest = data_len - i;
+    if (rest > 0) {
+        uint64_t block = 0;
+        for (size_t j = 0; j < rest; j++) {
+            block |= (uint64_t)data[i + j] << (32 - 8 * j);
+        }
+        size_t symbols = (rest * 8 + 4) / 5;
+        for (size_t j = 0; j < symbols; j++) {
+            *dst++ = base32_alphabet[(block >> (35 - 5 * j)) & 0x1F];
+        }
+    }
+
+    *dst = '\0';
+    return (int)(dst - encoded);
+}
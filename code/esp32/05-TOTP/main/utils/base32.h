@@ -6,11 +6,21 @@
 
 /**
  * @brief Decode Base32 encoded string
- * @param encoded Base32 encoded string (uppercase, no padding)
+ * @param encoded Base32 encoded string (either case, padding and whitespace ignored)
  * @param decoded Output buffer for decoded data
  * @param decoded_len Size of output buffer
  * @return Length of decoded data, or -1 on error
  */
 int base32_decode(const char *encoded, uint8_t *decoded, size_t decoded_len);
 
+/**
+ * @brief Encode data as Base32 (RFC 4648 alphabet, no padding)
+ * @param data Data to encode
+ * @param data_len Length of data
+ * @param encoded Output buffer for the NUL-terminated string
+ * @param encoded_size Size of output buffer
+ * @return Length of encoded string, or -1 on error
+ */
+int base32_encode(const uint8_t *data, size_t data_len, char *encoded, size_t encoded_size);
+
 #endif // BASE32_H
@@ -0,0 +1,219 @@
+#include "gzip_stream.h"
+#include "esp_rom_crc.h"
+#include <string.h>
+#include <stdbool.h>
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define END_OF_BLOCK 256
+
+// Deflate length codes 257..285 and distance codes 0..29 (RFC 1951, 3.2.5)
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void flush_out(gzip_stream_t *z) {
+    if (z->out_len > 0 && z->error == ESP_OK) {
+        z->error = z->output((const char *)z->out, z->out_len, z->ctx);
+    }
+    z->out_len = 0;
+}
+
+static void put_byte(gzip_stream_t *z, uint8_t byte) {
+    if (z->out_len == sizeof(z->out)) {
+        flush_out(z);
+    }
+    z->out[z->out_len++] = byte;
+}
+
+// Deflate packs fields starting at the least significant bit
+static void put_bits(gzip_stream_t *z, uint32_t value, uint8_t count) {
+    z->bit_buf |= value << z->bit_count;
+    z->bit_count += count;
+    while (z->bit_count >= 8) {
+        put_byte(z, z->bit_buf & 0xFF);
+        z->bit_buf >>= 8;
+        z->bit_count -= 8;
+    }
+}
+
+// Huffman codes are stored most significant bit first
+static void put_code(gzip_stream_t *z, uint32_t code, uint8_t len) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(z, reversed, len);
+}
+
+// Literal/length symbol with the fixed Huffman code (RFC 1951, 3.2.6)
+static void put_symbol(gzip_stream_t *z, uint16_t symbol) {
+    if (symbol < 144) {
+        put_code(z, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        put_code(z, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        put_code(z, symbol - 256, 7);
+    } else {
+        put_code(z, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static void put_match(gzip_stream_t *z, uint16_t len, uint16_t dist) {
+    int code = 28;
+    while (length_base[code] > len) {
+        code--;
+    }
+    put_symbol(z, 257 + code);
+    put_bits(z, len - length_base[code], length_extra[code]);
+
+    code = 29;
+    while (dist_base[code] > dist) {
+        code--;
+    }
+    put_code(z, code, 5);
+    put_bits(z, dist - dist_base[code], dist_extra[code]);
+}
+
+static void put_le32(gzip_stream_t *z, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        put_byte(z, (value >> (8 * i)) & 0xFF);
+    }
+}
+
+static inline uint16_t hash3(const uint8_t *p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (GZIP_STREAM_HASH_SIZE - 1);
+}
+
+// Encode the window up to MAX_MATCH bytes from its end (all of it when finishing)
+static void compress(gzip_stream_t *z, bool finishing) {
+    uint16_t limit = z->window_len;
+    if (!finishing) {
+        limit = (z->window_len > MAX_MATCH) ? z->window_len - MAX_MATCH : 0;
+    }
+
+    while (z->pos < limit) {
+        const uint8_t *p = &z->window[z->pos];
+        uint16_t avail = z->window_len - z->pos;
+        uint16_t match_len = 0;
+        uint16_t match_dist = 0;
+
+        if (avail >= MIN_MATCH) {
+            uint16_t h = hash3(p);
+            uint16_t candidate = z->head[h];
+            z->head[h] = z->pos + 1;
+            if (candidate != 0) {
+                const uint8_t *c = &z->window[candidate - 1];
+                uint16_t max = (avail < MAX_MATCH) ? avail : MAX_MATCH;
+                uint16_t n = 0;
+                while (n < max && c[n] == p[n]) {
+                    n++;
+                }
+                if (n >= MIN_MATCH) {
+                    match_len = n;
+                    match_dist = p - c;
+                }
+            }
+        }
+
+        if (match_len == 0) {
+            put_symbol(z, p[0]);
+            z->pos++;
+            continue;
+        }
+
+        put_match(z, match_len, match_dist);
+        // Index the covered bytes too, so later data can refer to them
+        for (uint16_t i = 1; i < match_len && avail - i >= MIN_MATCH; i++) {
+            z->head[hash3(p + i)] = z->pos + i + 1;
+        }
+        z->pos += match_len;
+    }
+}
+
+// Drop the oldest half of the window; at least GZIP_STREAM_WINDOW bytes of history remain
+static void slide(gzip_stream_t *z) {
+    memmove(z->window, z->window + GZIP_STREAM_WINDOW, z->window_len - GZIP_STREAM_WINDOW);
+    z->window_len -= GZIP_STREAM_WINDOW;
+    z->pos -= GZIP_STREAM_WINDOW;
+    for (size_t i = 0; i < GZIP_STREAM_HASH_SIZE; i++) {
+        z->head[i] = (z->head[i] > GZIP_STREAM_WINDOW) ? z->head[i] - GZIP_STREAM_WINDOW : 0;
+    }
+}
+
+void gzip_stream_init(gzip_stream_t *z, gzip_output_cb_t output, void *ctx) {
+    memset(z->head, 0, sizeof(z->head));
+    z->output = output;
+    z->ctx = ctx;
+    z->error = ESP_OK;
+    z->crc = 0;
+    z->total_in = 0;
+    z->bit_buf = 0;
+    z->bit_count = 0;
+    z->window_len = 0;
+    z->pos = 0;
+    z->out_len = 0;
+
+    // Member header: deflate, no name or mtime, unknown OS (RFC 1952)
+    static const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+    for (size_t i = 0; i < sizeof(header); i++) {
+        put_byte(z, header[i]);
+    }
+
+    // Everything goes in one fixed Huffman block, closed by gzip_stream_finish()
+    put_bits(z, 0, 1);          // BFINAL
+    put_bits(z, 1, 2);          // BTYPE = fixed Huffman
+}
+
+esp_err_t gzip_stream_write(gzip_stream_t *z, const char *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+    z->crc = esp_rom_crc32_le(z->crc, src, len);
+    z->total_in += len;
+
+    while (len > 0 && z->error == ESP_OK) {
+        if (z->window_len == sizeof(z->window)) {
+            compress(z, false);
+            slide(z);
+        }
+        size_t n = sizeof(z->window) - z->window_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&z->window[z->window_len], src, n);
+        z->window_len += n;
+        src += n;
+        len -= n;
+    }
+    return z->error;
+}
+
+esp_err_t gzip_stream_finish(gzip_stream_t *z) {
+    compress(z, true);
+    put_symbol(z, END_OF_BLOCK);
+
+    // The open block was not final: end the stream with an empty final block
+    put_bits(z, 1, 1);          // BFINAL
+    put_bits(z, 1, 2);          // BTYPE = fixed Huffman
+    put_symbol(z, END_OF_BLOCK);
+    if (z->bit_count > 0) {
+        put_bits(z, 0, 8 - z->bit_count);
+    }
+
+    put_le32(z, z->crc);
+    put_le32(z, z->total_in);
+    flush_out(z);
+    return z->error;
+}
@@ -0,0 +1,69 @@
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define GZIP_STREAM_WINDOW 2048     // LZ77 history always available to matches (bytes)
+#define GZIP_STREAM_HASH_SIZE 1024  // Match finder buckets, one candidate each
+#define GZIP_STREAM_OUT_SIZE 512    // Compressed bytes handed to the callback at once
+
+/**
+ * @brief Called with compressed output when the buffer is full and on gzip_stream_finish()
+ * @param data Compressed bytes
+ * @param len Number of bytes
+ * @param ctx User context given to gzip_stream_init()
+ * @return ESP_OK to continue, any other value is latched as the stream error
+ */
+typedef esp_err_t (*gzip_output_cb_t)(const char *data, size_t len, void *ctx);
+
+/**
+ * @brief Streaming gzip compressor with fixed memory (sizeof(gzip_stream_t))
+ *
+ * Trades ratio for size: greedy LZ77 over a small window with a single
+ * candidate per hash bucket, encoded with the fixed Huffman codes of
+ * deflate. Works well on repetitive text such as JSON lists.
+ * Fields are private to gzip_stream.c; use the functions below.
+ */
+typedef struct {
+    gzip_output_cb_t output;
+    void *ctx;
+    esp_err_t error;
+    uint32_t crc;
+    uint32_t total_in;
+    uint32_t bit_buf;
+    uint8_t bit_count;
+    uint16_t window_len;
+    uint16_t pos;               // Next window byte to encode
+    uint16_t out_len;
+    uint16_t head[GZIP_STREAM_HASH_SIZE];   // Window position + 1 of the latest match candidate
+    uint8_t window[2 * GZIP_STREAM_WINDOW];
+    uint8_t out[GZIP_STREAM_OUT_SIZE];
+} gzip_stream_t;
+
+/**
+ * @brief Start a gzip member (header is buffered, nothing is output yet)
+ * @param z Stream state
+ * @param output Output callback
+ * @param ctx User context passed to the callback
+ */
+void gzip_stream_init(gzip_stream_t *z, gzip_output_cb_t output, void *ctx);
+
+/**
+ * @brief Compress data
+ * @param z Stream state
+ * @param data Uncompressed input
+ * @param len Input length
+ * @return ESP_OK, or the first error returned by the output callback
+ */
+esp_err_t gzip_stream_write(gzip_stream_t *z, const char *data, size_t len);
+
+/**
+ * @brief Compress the remaining input and output the gzip trailer
+ * @param z Stream state
+ * @return ESP_OK, or the first error returned by the output callback
+ */
+esp_err_t gzip_stream_finish(gzip_stream_t *z);
+
+#endif // GZIP_STREAM_H
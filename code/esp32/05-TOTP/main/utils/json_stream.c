@@ -0,0 +1,564 @@
+#include "json_stream.h"
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+enum {
+    ST_VALUE = 0,       // A value is expected
+    ST_VALUE_OR_END,    // Right after '['
+    ST_KEY,             // After ',' in an object
+    ST_KEY_OR_END,      // Right after '{'
+    ST_AFTER,           // After a value: ',' or the closing bracket
+    ST_DONE,            // Top-level value complete
+    ST_ERROR,
+};
+
+static inline bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void skip_ws(json_reader_t *r) {
+    while (r->p < r->end && is_ws(*r->p)) {
+        r->p++;
+    }
+}
+
+static json_token_type_t fail(json_reader_t *r, json_token_t *tok) {
+    r->state = ST_ERROR;
+    tok->type = JSON_TOK_ERROR;
+    tok->start = r->p;
+    tok->len = 0;
+    return JSON_TOK_ERROR;
+}
+
+static json_token_type_t emit(json_token_t *tok, json_token_type_t type, const char *start, size_t len) {
+    tok->type = type;
+    tok->start = start;
+    tok->len = len;
+    return type;
+}
+
+static inline bool in_object(const json_reader_t *r) {
+    return r->depth > 0 && (r->in_object & (1u << (r->depth - 1)));
+}
+
+static bool push(json_reader_t *r, bool object) {
+    if (r->depth >= JSON_MAX_DEPTH) {
+        return false;
+    }
+    if (object) {
+        r->in_object |= 1u << r->depth;
+    } else {
+        r->in_object &= ~(1u << r->depth);
+    }
+    r->depth++;
+    return true;
+}
+
+static void pop(json_reader_t *r) {
+    r->depth--;
+    r->state = ST_AFTER;
+}
+
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Scan a string starting after its opening quote; *len gets the raw span length
+static bool scan_string(json_reader_t *r, const char **start, size_t *len) {
+    const char *s = r->p;
+    while (r->p < r->end) {
+        char c = *r->p;
+        if (c == '"') {
+            *start = s;
+            *len = r->p - s;
+            r->p++;
+            return true;
+        }
+        if ((unsigned char)c < 0x20) {
+            return false;
+        }
+        if (c == '\\') {
+            if (r->end - r->p < 2) {
+                return false;
+            }
+            if (r->p[1] == 'u') {
+                if (r->end - r->p < 6) {
+                    return false;
+                }
+                for (int i = 2; i < 6; i++) {
+                    if (hex_value(r->p[i]) < 0) {
+                        return false;
+                    }
+                }
+                r->p += 6;
+                continue;
+            }
+            if (strchr("\"\\/bfnrt", r->p[1]) == NULL || r->p[1] == '\0') {
+                return false;
+            }
+            r->p += 2;
+            continue;
+        }
+        r->p++;
+    }
+    return false;
+}
+
+static bool match_literal(json_reader_t *r, const char *literal) {
+    size_t len = strlen(literal);
+    if ((size_t)(r->end - r->p) < len || memcmp(r->p, literal, len) != 0) {
+        return false;
+    }
+    r->p += len;
+    return true;
+}
+
+void json_reader_init(json_reader_t *r, const char *data, size_t len) {
+    memset(r, 0, sizeof(*r));
+    r->p = data;
+    r->end = data + len;
+    r->state = ST_VALUE;
+}
+
+json_token_type_t json_reader_next(json_reader_t *r, json_token_t *tok) {
+    skip_ws(r);
+
+    if (r->state == ST_ERROR) {
+        return fail(r, tok);
+    }
+
+    if (r->state == ST_AFTER) {
+        if (r->depth == 0) {
+            r->state = ST_DONE;
+        } else if (r->p >= r->end) {
+            return fail(r, tok);
+        } else if (*r->p == ',') {
+            r->p++;
+            r->state = in_object(r) ? ST_KEY : ST_VALUE;
+            skip_ws(r);
+        } else if (*r->p == '}' && in_object(r)) {
+            pop(r);
+            return emit(tok, JSON_TOK_OBJECT_END, r->p++, 1);
+        } else if (*r->p == ']' && !in_object(r)) {
+            pop(r);
+            return emit(tok, JSON_TOK_ARRAY_END, r->p++, 1);
+        } else {
+            return fail(r, tok);
+        }
+    }
+
+    if (r->state == ST_DONE) {
+        return (r->p < r->end) ? fail(r, tok) : emit(tok, JSON_TOK_END, r->p, 0);
+    }
+
+    if (r->p >= r->end) {
+        return fail(r, tok);
+    }
+
+    char c = *r->p;
+    if (r->state == ST_KEY_OR_END && c == '}') {
+        pop(r);
+        return emit(tok, JSON_TOK_OBJECT_END, r->p++, 1);
+    }
+    if (r->state == ST_VALUE_OR_END && c == ']') {
+        pop(r);
+        return emit(tok, JSON_TOK_ARRAY_END, r->p++, 1);
+    }
+
+    const char *start;
+    size_t len;
+
+    if (r->state == ST_KEY || r->state == ST_KEY_OR_END) {
+        if (c != '"') {
+            return fail(r, tok);
+        }
+        r->p++;
+        if (!scan_string(r, &start, &len)) {
+            return fail(r, tok);
+        }
+        skip_ws(r);
+        if (r->p >= r->end || *r->p != ':') {
+            return fail(r, tok);
+        }
+        r->p++;
+        r->state = ST_VALUE;
+        return emit(tok, JSON_TOK_KEY, start, len);
+    }
+
+    // A value
+    start = r->p;
+    if (c == '{' || c == '[') {
+        if (!push(r, c == '{')) {
+            return fail(r, tok);
+        }
+        r->p++;
+        r->state = (c == '{') ? ST_KEY_OR_END : ST_VALUE_OR_END;
+        return emit(tok, (c == '{') ? JSON_TOK_OBJECT_START : JSON_TOK_ARRAY_START, start, 1);
+    }
+
+    r->state = ST_AFTER;
+    if (c == '"') {
+        r->p++;
+        if (!scan_string(r, &start, &len)) {
+            return fail(r, tok);
+        }
+        return emit(tok, JSON_TOK_STRING, start, len);
+    }
+    if (match_literal(r, "true")) {
+        return emit(tok, JSON_TOK_TRUE, start, 4);
+    }
+    if (match_literal(r, "false")) {
+        return emit(tok, JSON_TOK_FALSE, start, 5);
+    }
+    if (match_literal(r, "null")) {
+        return emit(tok, JSON_TOK_NULL, start, 4);
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        r->p++;
+        while (r->p < r->end && strchr("0123456789+-.eE", *r->p) != NULL && *r->p != '\0') {
+            r->p++;
+        }
+        return emit(tok, JSON_TOK_NUMBER, start, r->p - start);
+    }
+    return fail(r, tok);
+}
+
+esp_err_t json_reader_skip(json_reader_t *r, const json_token_t *tok) {
+    if (tok->type != JSON_TOK_OBJECT_START && tok->type != JSON_TOK_ARRAY_START) {
+        return (tok->type == JSON_TOK_ERROR) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+
+    uint8_t target = r->depth - 1;
+    json_token_t t;
+    while (r->depth > target) {
+        json_token_type_t type = json_reader_next(r, &t);
+        if (type == JSON_TOK_ERROR || type == JSON_TOK_END) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+// Append a code point as UTF-8; false if it does not fit
+static bool put_utf8(char *out, size_t out_size, size_t *len, uint32_t cp) {
+    char tmp[4];
+    size_t n;
+    if (cp < 0x80) {
+        tmp[0] = cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        tmp[0] = 0xC0 | (cp >> 6);
+        tmp[1] = 0x80 | (cp & 0x3F);
+        n = 2;
+    } else if (cp < 0x10000) {
+        tmp[0] = 0xE0 | (cp >> 12);
+        tmp[1] = 0x80 | ((cp >> 6) & 0x3F);
+        tmp[2] = 0x80 | (cp & 0x3F);
+        n = 3;
+    } else {
+        tmp[0] = 0xF0 | (cp >> 18);
+        tmp[1] = 0x80 | ((cp >> 12) & 0x3F);
+        tmp[2] = 0x80 | ((cp >> 6) & 0x3F);
+        tmp[3] = 0x80 | (cp & 0x3F);
+        n = 4;
+    }
+    if (*len + n >= out_size) {
+        return false;
+    }
+    memcpy(out + *len, tmp, n);
+    *len += n;
+    return true;
+}
+
+static uint32_t read_hex4(const char *s) {
+    return (hex_value(s[0]) << 12) | (hex_value(s[1]) << 8) | (hex_value(s[2]) << 4) | hex_value(s[3]);
+}
+
+int json_token_string(const json_token_t *tok, char *out, size_t out_size) {
+    if ((tok->type != JSON_TOK_STRING && tok->type != JSON_TOK_KEY) || out_size == 0) {
+        return -1;
+    }
+
+    // Escapes were validated by the reader. Output never outgrows the input
+    // (an escape is at least as long as its UTF-8), so out may alias the token.
+    const char *s = tok->start;
+    const char *end = s + tok->len;
+    size_t len = 0;
+
+    while (s < end) {
+        if (*s != '\\') {
+            if (len + 1 >= out_size) {
+                goto overflow;
+            }
+            out[len++] = *s++;
+            continue;
+        }
+
+        char e = s[1];
+        s += 2;
+        if (e == 'u') {
+            uint32_t cp = read_hex4(s);
+            s += 4;
+            // Combine a UTF-16 surrogate pair
+            if (cp >= 0xD800 && cp < 0xDC00 && end - s >= 6 && s[0] == '\\' && s[1] == 'u') {
+                uint32_t low = read_hex4(s + 2);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    s += 6;
+                }
+            }
+            if (!put_utf8(out, out_size, &len, cp)) {
+                goto overflow;
+            }
+            continue;
+        }
+
+        char c;
+        switch (e) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            default:  c = e; break;     // '"', '\\' and '/'
+        }
+        if (len + 1 >= out_size) {
+            goto overflow;
+        }
+        out[len++] = c;
+    }
+
+    out[len] = '\0';
+    return (int)len;
+
+overflow:
+    out[len] = '\0';
+    return -1;
+}
+
+bool json_token_equals(const json_token_t *tok, const char *literal) {
+    size_t len = strlen(literal);
+    return tok->len == len && memcmp(tok->start, literal, len) == 0;
+}
+
+esp_err_t json_find_string(const char *data, size_t len, const char *key, char *out, size_t out_size) {
+    json_reader_t r;
+    json_token_t tok;
+    json_reader_init(&r, data, len);
+
+    if (json_reader_next(&r, &tok) != JSON_TOK_OBJECT_START) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (true) {
+        json_token_type_t type = json_reader_next(&r, &tok);
+        if (type == JSON_TOK_OBJECT_END) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        if (type != JSON_TOK_KEY) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        bool match = json_token_equals(&tok, key);
+        type = json_reader_next(&r, &tok);
+        if (type == JSON_TOK_ERROR) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (match && type == JSON_TOK_STRING) {
+            return (json_token_string(&tok, out, out_size) < 0) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+        }
+        if (json_reader_skip(&r, &tok) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+}
+
+// Writer
+
+static void put(json_writer_t *w, const char *data, size_t len) {
+    w->total += len;
+    if (w->buf == NULL || w->error != ESP_OK) {
+        return;
+    }
+
+    // Without a flush callback one byte stays free for the terminating NUL
+    size_t capacity = (w->flush != NULL) ? w->size : w->size - 1;
+    while (len > 0) {
+        if (w->len == capacity) {
+            if (w->flush == NULL) {
+                w->error = ESP_ERR_INVALID_SIZE;
+                return;
+            }
+            w->error = w->flush(w->buf, w->len, w->ctx);
+            w->len = 0;
+            if (w->error != ESP_OK) {
+                return;
+            }
+        }
+        size_t n = capacity - w->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Emit the separator due before a value or key
+static void separate(json_writer_t *w) {
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth == 0) {
+        return;
+    }
+    uint32_t bit = 1u << (w->depth - 1);
+    if (w->has_items & bit) {
+        put(w, ",", 1);
+    }
+    w->has_items |= bit;
+}
+
+static void put_escaped(json_writer_t *w, const char *s, size_t len) {
+    put(w, "\"", 1);
+    const char *run = s;
+    for (const char *p = s; p < s + len; p++) {
+        unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        put(w, run, p - run);
+        run = p + 1;
+
+        char esc[7];
+        switch (c) {
+            case '"':  put(w, "\\\"", 2); break;
+            case '\\': put(w, "\\\\", 2); break;
+            case '\n': put(w, "\\n", 2); break;
+            case '\r': put(w, "\\r", 2); break;
+            case '\t': put(w, "\\t", 2); break;
+            case '\b': put(w, "\\b", 2); break;
+            case '\f': put(w, "\\f", 2); break;
+            default:
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                put(w, esc, 6);
+                break;
+        }
+    }
+    put(w, run, s + len - run);
+    put(w, "\"", 1);
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_flush_cb_t flush, void *ctx) {
+    memset(w, 0, sizeof(*w));
+    w->buf = (size > 0) ? buf : NULL;
+    w->size = size;
+    w->flush = flush;
+    w->ctx = ctx;
+    w->error = ESP_OK;
+}
+
+static void begin_container(json_writer_t *w, const char *open) {
+    separate(w);
+    put(w, open, 1);
+    if (w->depth >= JSON_MAX_DEPTH) {
+        w->error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->has_items &= ~(1u << w->depth);
+    w->depth++;
+}
+
+static void end_container(json_writer_t *w, const char *close) {
+    if (w->depth == 0) {
+        w->error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    put(w, close, 1);
+}
+
+void json_writer_begin_object(json_writer_t *w) {
+    begin_container(w, "{");
+}
+
+void json_writer_end_object(json_writer_t *w) {
+    end_container(w, "}");
+}
+
+void json_writer_begin_array(json_writer_t *w) {
+    begin_container(w, "[");
+}
+
+void json_writer_end_array(json_writer_t *w) {
+    end_container(w, "]");
+}
+
+void json_writer_key(json_writer_t *w, const char *key) {
+    separate(w);
+    put_escaped(w, key, strlen(key));
+    put(w, ":", 1);
+    w->after_key = true;
+}
+
+void json_writer_string(json_writer_t *w, const char *s) {
+    json_writer_string_n(w, s, strlen(s));
+}
+
+void json_writer_string_n(json_writer_t *w, const char *s, size_t len) {
+    separate(w);
+    put_escaped(w, s, len);
+}
+
+void json_writer_uint(json_writer_t *w, uint64_t value) {
+    char digits[21];
+    int n = snprintf(digits, sizeof(digits), "%" PRIu64, value);
+    separate(w);
+    put(w, digits, n);
+}
+
+void json_writer_bool(json_writer_t *w, bool value) {
+    separate(w);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_writer_raw(json_writer_t *w, const char *data, size_t len) {
+    put(w, data, len);
+}
+
+esp_err_t json_writer_finish(json_writer_t *w) {
+    if (w->buf == NULL) {
+        return w->error;
+    }
+
+    if (w->flush == NULL) {
+        w->buf[w->len] = '\0';
+        return w->error;
+    }
+
+    if (w->error == ESP_OK && w->len > 0) {
+        w->error = w->flush(w->buf, w->len, w->ctx);
+        w->len = 0;
+    }
+    return w->error;
+}
+
+size_t json_writer_length(const json_writer_t *w) {
+    return w->total;
+}
+
+esp_err_t json_writer_error(const json_writer_t *w) {
+    return w->error;
+}
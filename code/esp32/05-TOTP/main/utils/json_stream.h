@@ -0,0 +1,189 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_MAX_DEPTH  32      // Deepest nesting accepted by the reader and writer
+
+/**
+ * @brief Token types returned by json_reader_next()
+ */
+typedef enum {
+    JSON_TOK_ERROR = 0,     // Malformed input (or nesting deeper than JSON_MAX_DEPTH)
+    JSON_TOK_END,           // End of the document
+    JSON_TOK_OBJECT_START,
+    JSON_TOK_OBJECT_END,
+    JSON_TOK_ARRAY_START,
+    JSON_TOK_ARRAY_END,
+    JSON_TOK_KEY,           // Object member name (span without quotes, still escaped)
+    JSON_TOK_STRING,        // String value (span without quotes, still escaped)
+    JSON_TOK_NUMBER,
+    JSON_TOK_TRUE,
+    JSON_TOK_FALSE,
+    JSON_TOK_NULL,
+} json_token_type_t;
+
+/**
+ * @brief Token pointing into the reader input (nothing is copied)
+ */
+typedef struct {
+    json_token_type_t type;
+    const char *start;
+    size_t len;
+} json_token_t;
+
+/**
+ * @brief Pull parser state, fixed size whatever the document size
+ *
+ * Fields are private to json_stream.c; use the functions below.
+ */
+typedef struct {
+    const char *p;
+    const char *end;
+    uint32_t in_object;     // Bit per depth: container is an object
+    uint8_t depth;
+    uint8_t state;
+} json_reader_t;
+
+/**
+ * @brief Start reading a JSON document
+ * @param r Reader state
+ * @param data Document (not necessarily NUL-terminated)
+ * @param len Document length
+ */
+void json_reader_init(json_reader_t *r, const char *data, size_t len);
+
+/**
+ * @brief Read the next token
+ * @param r Reader state
+ * @param tok Output token
+ * @return Token type (also stored in tok->type)
+ */
+json_token_type_t json_reader_next(json_reader_t *r, json_token_t *tok);
+
+/**
+ * @brief Skip the value that starts with tok (a whole object or array if needed)
+ * @param r Reader state
+ * @param tok Token just returned for the value
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG on malformed input
+ */
+esp_err_t json_reader_skip(json_reader_t *r, const json_token_t *tok);
+
+/**
+ * @brief Find a string member of the top-level object
+ * @param data Document
+ * @param len Document length
+ * @param key Member name
+ * @param out Output buffer for the unescaped, NUL-terminated value
+ * @param out_size Size of the output buffer
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no such string member,
+ *         ESP_ERR_INVALID_SIZE if it does not fit, ESP_ERR_INVALID_ARG on malformed input
+ *
+ * out may point into data: unescaping never makes a string longer.
+ */
+esp_err_t json_find_string(const char *data, size_t len, const char *key, char *out, size_t out_size);
+
+/**
+ * @brief Unescape a KEY or STRING token
+ * @param tok Token
+ * @param out Output buffer (may alias tok->start)
+ * @param out_size Size of the output buffer
+ * @return Length of the NUL-terminated result, or -1 if invalid or too long
+ */
+int json_token_string(const json_token_t *tok, char *out, size_t out_size);
+
+/**
+ * @brief Compare a KEY or STRING token with a literal (no escapes in the token)
+ * @param tok Token
+ * @param literal NUL-terminated literal
+ * @return true if equal
+ */
+bool json_token_equals(const json_token_t *tok, const char *literal);
+
+/**
+ * @brief Called by the writer when its buffer is full and on json_writer_finish()
+ * @param data Buffered output
+ * @param len Length of the output
+ * @param ctx User context given to json_writer_init()
+ * @return ESP_OK to continue, any other value is latched as the writer error
+ */
+typedef esp_err_t (*json_flush_cb_t)(const char *data, size_t len, void *ctx);
+
+/**
+ * @brief Streaming writer over a caller-provided buffer
+ *
+ * Fields are private to json_stream.c; use the functions below.
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    size_t total;           // Bytes produced so far, also in counting mode
+    json_flush_cb_t flush;
+    void *ctx;
+    esp_err_t error;
+    uint32_t has_items;     // Bit per depth: a separator is due before the next value
+    uint8_t depth;
+    bool after_key;
+} json_writer_t;
+
+/**
+ * @brief Prepare a writer
+ * @param w Writer state
+ * @param buf Output buffer, or NULL to only count the output length
+ * @param size Size of the buffer
+ * @param flush Called when the buffer fills up, or NULL for a single fixed
+ *              buffer (output is then NUL-terminated, overflow is an error)
+ * @param ctx User context passed to flush
+ */
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_flush_cb_t flush, void *ctx);
+
+void json_writer_begin_object(json_writer_t *w);
+void json_writer_end_object(json_writer_t *w);
+void json_writer_begin_array(json_writer_t *w);
+void json_writer_end_array(json_writer_t *w);
+
+/**
+ * @brief Write an object member name; the next call writes its value
+ */
+void json_writer_key(json_writer_t *w, const char *key);
+
+/**
+ * @brief Write a string value, escaping quotes, backslashes and control characters
+ */
+void json_writer_string(json_writer_t *w, const char *s);
+
+/**
+ * @brief Write a string value of known length (need not be NUL-terminated)
+ */
+void json_writer_string_n(json_writer_t *w, const char *s, size_t len);
+
+void json_writer_uint(json_writer_t *w, uint64_t value);
+void json_writer_bool(json_writer_t *w, bool value);
+
+/**
+ * @brief Append already serialized JSON verbatim (no separator is added)
+ */
+void json_writer_raw(json_writer_t *w, const char *data, size_t len);
+
+/**
+ * @brief Flush the remaining output
+ * @param w Writer state
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if a fixed buffer overflowed, or the flush error
+ */
+esp_err_t json_writer_finish(json_writer_t *w);
+
+/**
+ * @brief Total bytes produced, including what was flushed or did not fit
+ */
+size_t json_writer_length(const json_writer_t *w);
+
+/**
+ * @brief First error latched by the writer (overflow or flush failure)
+ */
+esp_err_t json_writer_error(const json_writer_t *w);
+
+#endif // JSON_STREAM_H